@@ -17,6 +17,7 @@ struct ac_session {
 	jsval can_val;
 #endif
 	/* Can stuff */
+        char can_transport[SOLARD_TRANSPORT_LEN];
         char can_target[SOLARD_TARGET_LEN];
         char can_topts[SOLARD_TOPTS_LEN];
         solard_driver_t *can;
@@ -29,6 +29,8 @@ LICENSE file in the root directory of this source tree.
 #include "transports.h"
 #include <math.h>
 
+static solard_driver_t *ac_transports[] = { &can_driver, &canlog_driver, 0 };
+
 #define SDATA(f,b) ((int16_t *) &s->frames[f].data[b]);
 #define BDATA(f,b) ((int8_t *) &s->frames[f].data[b]);
 #define UBDATA(f,b) ((uint8_t *) &s->frames[f].data[b]);
@@ -233,23 +235,14 @@ int ac_can_init(ac_session_t *s) {
 	int retries;
 //	can_frame_t *fp;
 
-#if 0
-	/* Find the driver */
+	/* Find the driver (can, or canlog to record/replay) */
 	dprintf(dlevel,"getting driver for transport: %s\n", s->can_transport);
-	s->can = find_driver(ac_transports,s->can_transport);
+	s->can = find_driver(ac_transports,strlen(s->can_transport) ? s->can_transport : "can");
 	dprintf(dlevel,"s->can: %p\n", s->can);
 	if (!s->can) {
-		 if (strlen(s->can_transport)) {
-			sprintf(s->errmsg,"unable to find CAN driver for transport: %s",s->can_transport);
-			return 1;
-		} else {
-			sprintf(s->errmsg,"can_transport is empty!\n");
-			return 1;
-		}
+		log_error("unable to find CAN driver for transport: %s\n",s->can_transport);
+		return 1;
 	}
-#endif
-
-	s->can = &can_driver;
 
 	/* Create new instance */
 	s->can_handle = s->can->new(s->can_target, s->can_topts);
@@ -325,7 +318,7 @@ void ac_can_destroy(ac_session_t *s) {
 		dprintf(dlevel,"closing handle...\n");
 		if (check_state(s,AC_CAN_OPEN)) s->can->close(s->can_handle);
 		dprintf(dlevel,"stopping read thread...\n");
-		if (strcmp(s->can->name,"can") == 0) ac_can_stop_thread(s);
+		ac_can_stop_thread(s);
 		dprintf(dlevel,"clearing agent callback...\n");
 		if (s->ap) agent_clear_callback(s->ap);
 		dprintf(dlevel,"destroying handle...\n");
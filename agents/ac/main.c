@@ -22,9 +22,10 @@ bool ignore_wpi_flag;
 static int ac_agent_init(int argc, char **argv, opt_proctab_t *opts, ac_session_t *s) {
 	config_property_t ac_props[] = {
 		/* name, type, dest, dsize, def, flags, scope, values, labels, units, scale, precision, trigger, ctx */
+		{ "can_transport", DATA_TYPE_STRING, s->can_transport, sizeof(s->can_transport)-1, "can", 0, },
 		{ "can_target", DATA_TYPE_STRING, s->can_target, sizeof(s->can_target)-1, "can0", 0, },
 		{ "can_topts", DATA_TYPE_STRING, s->can_topts, sizeof(s->can_topts)-1, "500000", 0, },
-		{ "interval", DATA_TYPE_INT, 0, 0, "10", CONFIG_FLAG_NOWARN },
+		{ "interval", DATA_TYPE_DOUBLE, 0, 0, "10", CONFIG_FLAG_NOWARN },
 		{ 0 }
 	};
 	int r;
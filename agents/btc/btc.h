@@ -15,11 +15,18 @@ struct btc_session {
 };
 typedef struct btc_session btc_session_t;
 
+#define LOCAL_RETRY 60			/* Seconds between looks for an agent's local data */
+
 struct _btc_agentinfo {
 	char name[SOLARD_NAME_LEN];
 	char role[SOLARD_ROLE_LEN];
 	bool have_data;
 	solard_battery_t data;
+	shmdata_t *shm;			/* Local data plane, if the agent is on this host */
+	uint32_t shm_seq;
+	time_t shm_retry;		/* Next time to look for it */
+	bool local;			/* Data is coming from shm, ignore mqtt Data */
+	json_value_t *state;		/* Last full Data, for deltas (see datafilter.h) */
 };
 typedef struct _btc_agentinfo btc_agentinfo_t;
 
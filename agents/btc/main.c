@@ -58,13 +58,17 @@ static void process_message(btc_session_t *s, solard_message_t *msg) {
 		json_destroy_value(v);
 	} else if (strcmp(msg->func,"Data") == 0 && have_info && strcmp(info->role,SOLARD_ROLE_BATTERY) == 0) {
 		json_value_t *v;
+		char *j;
+
+		/* Read directly from the local data plane instead (while it's live) */
+		if (info->local) return;
 
 		dprintf(ldlevel,"getting data for %s\n", msg->name);
 		v = json_parse(msg->data);
 		dprintf(ldlevel,"v: %p\n", v);
-		if (v) {
-			char *j = json_dumps(v,4);
-			json_destroy_value(v);
+		/* Deltas are folded into the last full Data */
+		if (v && datafilter_merge(&info->state,v) == 0) {
+			j = json_dumps(info->state,4);
 			dprintf(ldlevel,"j: %p\n", j);
 			if (j) {
 				battery_from_json(&info->data,j);
@@ -77,10 +81,12 @@ static void process_message(btc_session_t *s, solard_message_t *msg) {
 }
 
 static void btc_getmsg(void *ctx, char *topic, char *message, int msglen, char *replyto) {
-	solard_message_t newmsg;
+	solard_message_t *msg;
 
-	if (solard_getmsg(&newmsg,topic,message,msglen,replyto)) return;
-	process_message((btc_session_t *)ctx,&newmsg);
+	msg = solard_message_new(topic,message,msglen,replyto);
+	if (!msg) return;
+	process_message((btc_session_t *)ctx,msg);
+	solard_message_unref(msg);
 }
 
 static int btc_data_source_trigger(void *ctx, config_property_t *p, void *old_value) {
@@ -127,7 +133,7 @@ static int btc_agent_init(int argc, char **argv, opt_proctab_t *opts, btc_sessio
 		/* name, type, dest, dsize, def, flags, scope, values, labels, units, scale, precision, trigger, ctx */
 		{ "log_power", DATA_TYPE_BOOL, &s->log_power, 0, "0", 0, "select", "0, 1", "log output_power from each read", 0, 1, 0 },
 		{ "data_source", DATA_TYPE_STRING, &s->data_source, sizeof(s->data_source), 0, 0, 0, 0, 0, 0, 0, 0, btc_data_source_trigger, s },
-		{ "interval", DATA_TYPE_INT, 0, 0, "10" },
+		{ "interval", DATA_TYPE_DOUBLE, 0, 0, "10" },
 		{ 0 }
 	};
 
@@ -622,7 +622,7 @@ int jbd_free(void *handle) {
 	jbd_session_t *s = handle;
 
 	if (check_state(s,JBD_STATE_OPEN)) jbd_close(s);
-	if (s->tp->destroy) s->tp->destroy(s->tp_handle);
+	if (s->tp && s->tp_handle && s->tp->destroy) s->tp->destroy(s->tp_handle);
 	free(s);
 	return 0;
 }
@@ -710,6 +710,8 @@ int jbd_read(void *handle, uint32_t *what, void *buf, int buflen) {
 
 	dprintf(2,"bp->state: %x\n", bp->state);
 
+	agent_pubshm(s->ap, SHMDATA_TYPE_BATTERY, bp, sizeof(*bp));
+
 #ifdef JS
 	/* If JS and read script exists, we'll use that */
 	if (agent_script_exists(s->ap, s->ap->js.read_script)) return 0;
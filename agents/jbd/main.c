@@ -16,6 +16,19 @@ LICENSE file in the root directory of this source tree.
 
 char *jbd_version_string = "1.0-" STRINGIFY(__SD_BUILD);
 
+/* One instance per config file (-H) */
+static solard_agent_t *jbd_host_new(int argc, char **argv) {
+	jbd_session_t *s;
+
+	s = jbd_driver.new(0,0);
+	if (!s) return 0;
+	if (jbd_agent_init(s,argc,argv)) {
+		jbd_free(s);
+		return 0;
+	}
+	return s->ap;
+}
+
 int main(int argc, char **argv) {
 	jbd_session_t *s;
 #if TESTING
@@ -24,6 +37,9 @@ int main(int argc, char **argv) {
 	argv = args;
 #endif
 
+	/* -H conf1,conf2,... runs several packs in this process */
+	if (agent_host_check(argc,argv)) return agent_host_main(argc,argv,jbd_host_new);
+
 	/* Init the driver */
 	s = jbd_driver.new(0,0);
 	if (!s) return 1;
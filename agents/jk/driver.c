@@ -563,6 +563,8 @@ static int jk_read(void *handle, uint32_t *control, void *buf, int buflen) {
         if (s->balancing) set_state(bp,JK_STATE_BALANCING);
         else clear_state(bp,JK_STATE_BALANCING);
 
+	agent_pubshm(s->ap, SHMDATA_TYPE_BATTERY, bp, sizeof(*bp));
+
 #ifdef JS
 	/* If JS and read script exists, we'll use that */
 	if (agent_script_exists(s->ap, s->ap->js.read_script)) return 0;
@@ -19,6 +19,23 @@ LICENSE file in the root directory of this source tree.
 char *jk_version_string = "1.0";
 extern solard_driver_t jk_driver;
 
+/* One instance per config file (-H) */
+static solard_agent_t *jk_host_new(int argc, char **argv) {
+	jk_session_t *s;
+
+	s = jk_driver.new(0,0);
+	if (!s) return 0;
+	if (jk_agent_init(s,argc,argv)) {
+		if (s->tp && s->tp_handle) {
+			s->tp->close(s->tp_handle);
+			if (s->tp->destroy) s->tp->destroy(s->tp_handle);
+		}
+		free(s);
+		return 0;
+	}
+	return s->ap;
+}
+
 int main(int argc, char **argv) {
 	jk_session_t *s;
 #if TESTING
@@ -27,6 +44,9 @@ int main(int argc, char **argv) {
 	argv = args;
 #endif
 
+	/* -H conf1,conf2,... runs several packs in this process */
+	if (agent_host_check(argc,argv)) return agent_host_main(argc,argv,jk_host_new);
+
 	/* Init the driver */
 	s = jk_driver.new(0,0);
 	if (!s) return 1;
@@ -45,6 +45,8 @@ function pa_get_battery_data(data) {
 	pa_get_number(data,"battery_level",false);
 }
 
+var pa_routes = {};
+
 function pa_process_messages(n,m,t,f) {
 
 	let dlevel = 1;
@@ -52,13 +54,16 @@ function pa_process_messages(n,m,t,f) {
     dprintf(dlevel,"n: %s,m : %s\n", n, m);
 	dprintf(dlevel,"m.connected: %s\n", m.connected);
 	if (!m.connected) m.reconnect();
-	let mq = m.mq;
-	dprintf(dlevel,"mq.len: %d\n", mq.length);
-	for(let i=mq.length-1; i >= 0; i--) {
-		let msg = mq[i];
-		let data = JSON.parse(msg.data);
-		if (msg.topic == t) f(data);
+	// Route the topic once (again if the topic or the connection changed)
+	let r = pa_routes[n];
+	if (typeof(r) == 'undefined' || r.m !== m || r.t != t) {
+		if (typeof(r) != 'undefined' && r.m === m) m.unroute(r.t);
+		dprintf(dlevel,"routing: %s\n", t);
+		m.route(t,function(msg) { f(JSON.parse(msg.data)); });
+		pa_routes[n] = { m: m, t: t };
 	}
+	let count = m.dispatch();
+	dprintf(dlevel,"dispatched: %d\n", count);
 	m.purgemq();
 }
 
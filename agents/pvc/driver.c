@@ -27,9 +27,18 @@ static void *pvc_new(void *transport, void *transport_handle) {
 
 static int pvc_free(void *handle) {
 	pvc_session_t *s = handle;
+	pvc_agentinfo_t *info;
 
         if (!s) return 1;
 
+	if (s->agents) {
+		list_reset(s->agents);
+		while((info = list_get_next(s->agents)) != 0) {
+			shmdata_close(info->shm);
+			if (info->state) json_destroy_value(info->state);
+		}
+	}
+
         /* must be last */
         dprintf(dlevel,"destroying agent...\n");
         if (s->ap) agent_destroy_agent(s->ap);
@@ -38,6 +47,50 @@ static int pvc_free(void *handle) {
 	return 0;
 }
 
+/* Open the local segment of an agent we know about (from its Info), if it's on this host */
+static void local_open(pvc_agentinfo_t *info) {
+	time_t now;
+
+	time(&now);
+	if (now < info->shm_retry) return;
+	info->shm_retry = now + LOCAL_RETRY;
+	info->shm = shmdata_open(info->name);
+	if (!info->shm) return;
+	if (shmdata_type(info->shm) != SHMDATA_TYPE_PVINVERTER || shmdata_size(info->shm) != sizeof(info->data)) {
+		log_error("%s: local data type/size mismatch (%d/%d != %d/%d), using mqtt\n", info->name,
+			shmdata_type(info->shm), shmdata_size(info->shm), SHMDATA_TYPE_PVINVERTER, (int)sizeof(info->data));
+		shmdata_close(info->shm);
+		info->shm = 0;
+		return;
+	}
+	dprintf(dlevel,"%s: using local data\n", info->name);
+}
+
+static void local_refresh(pvc_session_t *s) {
+	pvc_agentinfo_t *info;
+	list_iter_t it;
+
+	list_iter_init(&it,s->agents);
+	while((info = list_iter_next(&it)) != 0) {
+		if (strcmp(info->role,SOLARD_ROLE_PVINVERTER) != 0) continue;
+		if (!info->shm) local_open(info);
+		if (!info->shm) continue;
+		/* Writer went away or stopped updating - fall back to mqtt until it's back */
+		if (!shmdata_alive(info->shm)) {
+			dprintf(dlevel,"%s: local writer gone\n", info->name);
+			info->local = false;
+			shmdata_close(info->shm);
+			info->shm = 0;
+			continue;
+		}
+		if (shmdata_seq(info->shm) == info->shm_seq) continue;
+		if (shmdata_read(info->shm,&info->data,sizeof(info->data),&info->shm_seq)) continue;
+		info->data.last_update = shmdata_updated(info->shm) / 1000000;
+		info->have_data = true;
+		info->local = true;
+	}
+}
+
 static int combine_data(pvc_session_t *s, solard_pvinverter_t *pv) {
 	solard_pvinverter_t *pvp;
 	pvc_agentinfo_t *info;
@@ -46,6 +99,8 @@ static int combine_data(pvc_session_t *s, solard_pvinverter_t *pv) {
 
 	int ldlevel = dlevel;
 
+	local_refresh(s);
+
 	/* We only report 1 metric:  power (watts) */
 	memset(pv,0,sizeof(*pv));
 	strcpy(pv->name,"pvcombiner");
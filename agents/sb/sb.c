@@ -362,6 +362,8 @@ static int sb_read(void *handle, uint32_t *control, void *buf, int buflen) {
 	sb_destroy_results(results);
 	if (r) return 1;
 
+	agent_pubshm(s->ap, SHMDATA_TYPE_PVINVERTER, &inv, sizeof(inv));
+
 #ifdef JS
 	/* If read script exists, we'll use that */
 	if (agent_script_exists(s->ap, s->ap->js.read_script)) return 0;
@@ -27,75 +27,106 @@ LICENSE file in the root directory of this source tree.
 #include "transports.h"
 #include <math.h>
 
-solard_driver_t *si_transports[] = { &can_driver, &rdev_driver, 0 };
-
-#define SDATA(f,b) ((int16_t *) &s->frames[f].data[b]);
-#define BDATA(f,b) ((int8_t *) &s->frames[f].data[b]);
-#define UBDATA(f,b) ((uint8_t *) &s->frames[f].data[b]);
-#define USDATA(f,b) ((uint16_t *) &s->frames[f].data[b]);
-#define LDATA(f,b) ((int32_t *) &s->frames[f].data[b]);
-
-static void _setraw(si_session_t *s) {
-	struct si_raw_data *rdp = &s->raw_data;
-
-	/* x300 Active power grid/gen */
-	rdp->active_grid_l1 = SDATA(0,0);
-	rdp->active_grid_l2 = SDATA(0,2);
-	rdp->active_grid_l3 = SDATA(0,4);
-
-	/* x301 Active power Sunny Island */
-	rdp->active_si_l1 = SDATA(1,0);
-	rdp->active_si_l2 = SDATA(1,2);
-	rdp->active_si_l3 = SDATA(1,4);
-
-	/* x302 Reactive power grid/gen */
-	rdp->reactive_grid_l1 = SDATA(2,0);
-	rdp->reactive_grid_l2 = SDATA(2,2);
-	rdp->reactive_grid_l3 = SDATA(2,4);
-
-	/* x303 Reactive power Sunny Island */
-	rdp->reactive_si_l1 = SDATA(3,0);
-	rdp->reactive_si_l2 = SDATA(3,2);
-	rdp->reactive_si_l3 = SDATA(3,4);
-
-	/* 0x304 AC1 Voltage L1 / AC1 Voltage L2 / AC1 Voltage L3 / AC1 Frequency */
-	rdp->ac1_voltage_l1 = SDATA(4,0);
-	rdp->ac1_voltage_l2 = SDATA(4,2);
-	rdp->ac1_voltage_l3 = SDATA(4,4);
-	rdp->ac1_frequency = SDATA(4,6);
-
-	/* 0x305 Battery voltage Battery current Battery temperature SOC battery */
-	rdp->battery_voltage = SDATA(5,0);
-	rdp->battery_current = SDATA(5,2);
-	rdp->battery_temp = SDATA(5,4);
-	rdp->battery_soc = SDATA(5,6);
-
-	/* 0x306 SOH battery / Charging procedure / Operating state / active Error Message / Battery Charge Voltage Set-point */
-	rdp->battery_soh = SDATA(6,0);
-	rdp->charging_proc = BDATA(6,2);
-	rdp->state = BDATA(6,3);
-	rdp->errmsg = SDATA(6,4);
-	rdp->battery_cvsp = SDATA(6,6);
-
-	/* 0x307 Relay state / Relay function bit 1 / Relay function bit 2 / Synch-Bits */
-	rdp->relay_state = USDATA(7,0);
-	rdp->relay_bits1 = USDATA(7,2);
-	rdp->relay_bits2 = USDATA(7,4);
-	rdp->synch_bits = UBDATA(7,6);
-
-	/* 0x308 TotLodPwr */
-	rdp->TotLodPwr = SDATA(8,0);
-
-	/* 0x309 AC2 Voltage L1 / AC2 Voltage L2 / AC2 Voltage L3 / AC2 Frequency */
-	rdp->ac2_voltage_l1 = SDATA(9,0);
-	rdp->ac2_voltage_l2 = SDATA(9,2);
-	rdp->ac2_voltage_l3 = SDATA(9,4);
-	rdp->ac2_frequency = SDATA(9,6);
-
-	/* 0x30A PVPwrAt / GdCsmpPwrAt / GdFeedPwr */
-	rdp->PVPwrAt = SDATA(10,0);
-	rdp->GdCsmpPwrAt = SDATA(10,2);
-	rdp->GdFeedPwr = SDATA(10,4);
+solard_driver_t *si_transports[] = { &can_driver, &canlog_driver, &rdev_driver, 0 };
+
+/* What's in the frames the SI broadcasts (0x300 - 0x30A) */
+static int si_can_add_signals(si_session_t *s) {
+	cansig_def_t si_signals[] = {
+		/* name, id, start, size, flags, scale, offset, unit, type, dest */
+		/* 0x300 Active power grid/gen */
+		{ "active_grid_l1", 0x300, 0, 16, CANSIG_SIGNED, 100, 0, "W", DATA_TYPE_DOUBLE, &s->data.active_grid_l1 },
+		{ "active_grid_l2", 0x300, 16, 16, CANSIG_SIGNED, 100, 0, "W", DATA_TYPE_DOUBLE, &s->data.active_grid_l2 },
+		{ "active_grid_l3", 0x300, 32, 16, CANSIG_SIGNED, 100, 0, "W", DATA_TYPE_DOUBLE, &s->data.active_grid_l3 },
+		/* 0x301 Active power Sunny Island */
+		{ "active_si_l1", 0x301, 0, 16, CANSIG_SIGNED, 100, 0, "W", DATA_TYPE_DOUBLE, &s->data.active_si_l1 },
+		{ "active_si_l2", 0x301, 16, 16, CANSIG_SIGNED, 100, 0, "W", DATA_TYPE_DOUBLE, &s->data.active_si_l2 },
+		{ "active_si_l3", 0x301, 32, 16, CANSIG_SIGNED, 100, 0, "W", DATA_TYPE_DOUBLE, &s->data.active_si_l3 },
+		/* 0x302 Reactive power grid/gen */
+		{ "reactive_grid_l1", 0x302, 0, 16, CANSIG_SIGNED, 100, 0, "VAr", DATA_TYPE_DOUBLE, &s->data.reactive_grid_l1 },
+		{ "reactive_grid_l2", 0x302, 16, 16, CANSIG_SIGNED, 100, 0, "VAr", DATA_TYPE_DOUBLE, &s->data.reactive_grid_l2 },
+		{ "reactive_grid_l3", 0x302, 32, 16, CANSIG_SIGNED, 100, 0, "VAr", DATA_TYPE_DOUBLE, &s->data.reactive_grid_l3 },
+		/* 0x303 Reactive power Sunny Island */
+		{ "reactive_si_l1", 0x303, 0, 16, CANSIG_SIGNED, 100, 0, "VAr", DATA_TYPE_DOUBLE, &s->data.reactive_si_l1 },
+		{ "reactive_si_l2", 0x303, 16, 16, CANSIG_SIGNED, 100, 0, "VAr", DATA_TYPE_DOUBLE, &s->data.reactive_si_l2 },
+		{ "reactive_si_l3", 0x303, 32, 16, CANSIG_SIGNED, 100, 0, "VAr", DATA_TYPE_DOUBLE, &s->data.reactive_si_l3 },
+		/* 0x304 AC1 Voltage L1 / AC1 Voltage L2 / AC1 Voltage L3 / AC1 Frequency */
+		{ "ac1_voltage_l1", 0x304, 0, 16, CANSIG_SIGNED, .1, 0, "V", DATA_TYPE_DOUBLE, &s->data.ac1_voltage_l1 },
+		{ "ac1_voltage_l2", 0x304, 16, 16, CANSIG_SIGNED, .1, 0, "V", DATA_TYPE_DOUBLE, &s->data.ac1_voltage_l2 },
+		{ "ac1_voltage_l3", 0x304, 32, 16, CANSIG_SIGNED, .1, 0, "V", DATA_TYPE_DOUBLE, &s->data.ac1_voltage_l3 },
+		{ "ac1_frequency", 0x304, 48, 16, CANSIG_SIGNED, .01, 0, "Hz", DATA_TYPE_DOUBLE, &s->data.ac1_frequency },
+		/* 0x305 Battery voltage Battery current Battery temperature SOC battery */
+		{ "battery_voltage", 0x305, 0, 16, CANSIG_SIGNED, .1, 0, "V", DATA_TYPE_DOUBLE, &s->data.battery_voltage },
+		{ "battery_current", 0x305, 16, 16, CANSIG_SIGNED, .1, 0, "A", DATA_TYPE_DOUBLE, &s->data.battery_current },
+		{ "battery_temp", 0x305, 32, 16, CANSIG_SIGNED, .1, 0, "C", DATA_TYPE_DOUBLE, &s->data.battery_temp },
+		{ "battery_soc", 0x305, 48, 16, CANSIG_SIGNED, .1, 0, "%", DATA_TYPE_DOUBLE, &s->data.battery_soc },
+		/* 0x306 SOH battery / Charging procedure / Operating state / active Error Message / Battery Charge Voltage Set-point */
+		{ "battery_soh", 0x306, 0, 16, CANSIG_SIGNED, 1, 0, "%", DATA_TYPE_DOUBLE, &s->data.battery_soh },
+		{ "charging_proc", 0x306, 16, 8, 0, 1, 0, "", DATA_TYPE_U8, &s->data.charging_proc },
+		{ "state", 0x306, 24, 8, 0, 1, 0, "", DATA_TYPE_U8, &s->data.state },
+		{ "errmsg", 0x306, 32, 16, 0, 1, 0, "", DATA_TYPE_U16, &s->data.errmsg },
+		{ "battery_cvsp", 0x306, 48, 16, CANSIG_SIGNED, .1, 0, "V", DATA_TYPE_DOUBLE, &s->data.battery_cvsp },
+		/* 0x307 0-1 Relay state */
+		{ "relay1", 0x307, 0, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.relay1 },
+		{ "relay2", 0x307, 1, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.relay2 },
+		{ "s1_relay1", 0x307, 2, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.s1_relay1 },
+		{ "s1_relay2", 0x307, 3, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.s1_relay2 },
+		{ "s2_relay1", 0x307, 4, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.s2_relay1 },
+		{ "s2_relay2", 0x307, 5, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.s2_relay2 },
+		{ "s3_relay1", 0x307, 6, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.s3_relay1 },
+		{ "s3_relay2", 0x307, 7, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.s3_relay2 },
+		{ "GnRn", 0x307, 8, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.GnRn },
+		{ "s1_GnRn", 0x307, 9, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.s1_GnRn },
+		{ "s2_GnRn", 0x307, 10, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.s2_GnRn },
+		{ "s3_GnRn", 0x307, 11, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.s3_GnRn },
+		/* 0x307 2-3 Relay function bit 1 */
+		{ "AutoGn", 0x307, 16, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.AutoGn },
+		{ "AutoLodExt", 0x307, 17, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.AutoLodExt },
+		{ "AutoLodSoc", 0x307, 18, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.AutoLodSoc },
+		{ "Tm1", 0x307, 19, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.Tm1 },
+		{ "Tm2", 0x307, 20, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.Tm2 },
+		{ "ExtPwrDer", 0x307, 21, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.ExtPwrDer },
+		{ "ExtVfOk", 0x307, 22, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.ExtVfOk },
+		{ "GdOn", 0x307, 23, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.GdOn },
+		{ "Error", 0x307, 24, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.Error },
+		{ "Run", 0x307, 25, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.Run },
+		{ "BatFan", 0x307, 26, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.BatFan },
+		{ "AcdCir", 0x307, 27, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.AcdCir },
+		{ "MccBatFan", 0x307, 28, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.MccBatFan },
+		{ "MccAutoLod", 0x307, 29, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.MccAutoLod },
+		{ "Chp", 0x307, 30, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.Chp },
+		{ "ChpAdd", 0x307, 31, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.ChpAdd },
+		/* 0x307 4-5 Relay function bit 2 */
+		{ "SiComRemote", 0x307, 32, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.SiComRemote },
+		{ "OverLoad", 0x307, 33, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.OverLoad },
+		{ "ExtSrcConn", 0x307, 40, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.ExtSrcConn },
+		{ "Silent", 0x307, 41, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.Silent },
+		{ "Current", 0x307, 42, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.Current },
+		{ "FeedSelfC", 0x307, 43, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.FeedSelfC },
+		{ "Esave", 0x307, 44, 1, 0, 1, 0, "", DATA_TYPE_BOOL, &s->data.Esave },
+		/* 0x307 6 Synch-Bits */
+		{ "synch_bits", 0x307, 48, 8, 0, 1, 0, "" },
+		/* 0x308 TotLodPwr */
+		{ "TotLodPwr", 0x308, 0, 16, CANSIG_SIGNED, 100, 0, "W", DATA_TYPE_DOUBLE, &s->data.TotLodPwr },
+		/* 0x309 AC2 Voltage L1 / AC2 Voltage L2 / AC2 Voltage L3 / AC2 Frequency */
+		{ "ac2_voltage_l1", 0x309, 0, 16, CANSIG_SIGNED, .1, 0, "V", DATA_TYPE_DOUBLE, &s->data.ac2_voltage_l1 },
+		{ "ac2_voltage_l2", 0x309, 16, 16, CANSIG_SIGNED, .1, 0, "V", DATA_TYPE_DOUBLE, &s->data.ac2_voltage_l2 },
+		{ "ac2_voltage_l3", 0x309, 32, 16, CANSIG_SIGNED, .1, 0, "V", DATA_TYPE_DOUBLE, &s->data.ac2_voltage_l3 },
+		{ "ac2_frequency", 0x309, 48, 16, CANSIG_SIGNED, .01, 0, "Hz", DATA_TYPE_DOUBLE, &s->data.ac2_frequency },
+		/* 0x30A PVPwrAt / GdCsmpPwrAt / GdFeedPwr */
+		{ "PVPwrAt", 0x30A, 0, 16, CANSIG_SIGNED, .1, 0, "kW", DATA_TYPE_DOUBLE, &s->data.PVPwrAt },
+		{ "GdCsmpPwrAt", 0x30A, 16, 16, CANSIG_SIGNED, .1, 0, "kW", DATA_TYPE_DOUBLE, &s->data.GdCsmpPwrAt },
+		{ "GdFeedPwr", 0x30A, 32, 16, CANSIG_SIGNED, .1, 0, "kW", DATA_TYPE_DOUBLE, &s->data.GdFeedPwr },
+		{ 0 }
+	};
+
+	if (!s->can_signals) s->can_signals = cansig_create(0x300,0x310);
+	if (!s->can_signals) return 1;
+	if (cansig_add_table(s->can_signals,si_signals)) return 1;
+
+	/* Site specific additions/corrections */
+	if (strlen(s->can_signals_path) && cansig_load(s->can_signals,s->can_signals_path))
+		log_warning("unable to load CAN signals from %s\n", s->can_signals_path);
+	return 0;
 }
 
 static int _getcur(si_session_t *s, char *what, si_current_source_t *spec, double *dest) {
@@ -130,101 +161,44 @@ static int _getcur(si_session_t *s, char *what, si_current_source_t *spec, doubl
 	return 0;
 }
 
-void si_can_get_relays(si_session_t *s) {
-	si_raw_data_t *rdp = &s->raw_data;
-
-#define RS(m,b) { s->data.m = ((_gets16(rdp->relay_state) & b) != 0); }
-	RS(relay1,	0x0001);
-	RS(relay2,	0x0002);
-	RS(s1_relay1,	0x0004);
-	RS(s1_relay2,	0x0008);
-	RS(s2_relay1,	0x0010);
-	RS(s2_relay2,	0x0020);
-	RS(s3_relay1,	0x0040);
-	RS(s3_relay2,	0x0080);
-	RS(GnRn,	0x0100);
-	RS(s1_GnRn,	0x0200);
-	RS(s2_GnRn,	0x0400);
-	RS(s3_GnRn,	0x0800);
-
-	s->data.GnOn = (s->data.GnRn && s->data.AutoGn && s->data.ac2_frequency > 45.0) ? 1 : 0;
+/* Take a consistent copy of every frame the recv thread has and note the new ones */
+static void si_can_snapshot(si_session_t *s) {
+	canframe_info_t info;
+	int i;
 
-	/* 2-3 Relay function bit 1 */
-#define RB1(m,b) { s->data.m = ((_gets16(rdp->relay_bits1) & b) != 0); }
-	RB1(AutoGn,	0x0001);
-	RB1(AutoLodExt,	0x0002);
-	RB1(AutoLodSoc,	0x0004);
-	RB1(Tm1,	0x0008);
-	RB1(Tm2,	0x0010);
-	RB1(ExtPwrDer,	0x0020);
-	RB1(ExtVfOk,	0x0040);
-	RB1(GdOn,	0x0080);
-	RB1(Error,	0x0100);
-	RB1(Run,	0x0200);
-	RB1(BatFan,	0x0400);
-	RB1(AcdCir,	0x0800);
-	RB1(MccBatFan,	0x1000);
-	RB1(MccAutoLod,	0x2000);
-	RB1(Chp,	0x4000);
-	RB1(ChpAdd,	0x8000);
-
-	/* 4 & 5 Relay function bit 2 */
-#define RB2(m,b) { s->data.m = ((_gets16(rdp->relay_bits2) & b) != 0); }
-	RB2(SiComRemote,0x0001);
-	RB2(OverLoad,	0x0002);
-	RB2(ExtSrcConn,	0x0100);
-	RB2(Silent,	0x0200);
-	RB2(Current,	0x0400);
-	RB2(FeedSelfC,	0x0800);
-	RB2(Esave,	0x1000);
+	for(i=0; i < 16; i++) {
+		if (canframe_get(s->can_cache,0x300+i,&s->frames[i],&info)) continue;
+		if (info.gen == s->can_gens[i]) continue;
+		s->can_gens[i] = info.gen;
+		s->stamps[i] = info.stamp;
+		s->can_new |= (1 << i);
+	}
 }
 
-#define GETFVAL(val) (double)_gets16(val)
-#define GETFS100(val) (((double)_gets16(val))*100)
-#define GETF100(val) (((double)_gets16(val))*100)
-#define GETD10(val) (((double)_gets16(val))/10)
-#define GETD100(val) (((double)_gets16(val))/100)
-
 int si_can_get_data(si_session_t *s) {
-	si_raw_data_t *rdp = &s->raw_data;
+	uint64_t oldest;
+	int i;
 
 //	printf("\n\n***** GETTING DATA *****\n\n\n");
 
-	s->data.active_grid_l1 = GETF100(rdp->active_grid_l1);
-	s->data.active_grid_l2 = GETF100(rdp->active_grid_l2);
-	s->data.active_grid_l3 = GETF100(rdp->active_grid_l3);
-
-	s->data.active_si_l1 = GETF100(rdp->active_si_l1);
-	s->data.active_si_l2 = GETF100(rdp->active_si_l2);
-	s->data.active_si_l3 = GETF100(rdp->active_si_l3);
-
-	s->data.reactive_grid_l1 = GETF100(rdp->reactive_grid_l1);
-	s->data.reactive_grid_l2 = GETF100(rdp->reactive_grid_l2);
-	s->data.reactive_grid_l3 = GETF100(rdp->reactive_grid_l3);
+	if (s->can_cache) si_can_snapshot(s);
+	oldest = 0;
+	for(i=0; i <= 0xa; i++) {
+		if (s->stamps[i] && (!oldest || s->stamps[i] < oldest)) oldest = s->stamps[i];
+	}
+	s->data.can_time = oldest / 1000000000.0;
 
-	s->data.reactive_si_l1 = GETF100(rdp->reactive_si_l1);
-	s->data.reactive_si_l2 = GETF100(rdp->reactive_si_l2);
-	s->data.reactive_si_l3 = GETF100(rdp->reactive_si_l3);
+	/* Only frames that changed since last time */
+	for(i=0; i < 16; i++) {
+		if (s->can_new & (1 << i)) cansig_decode(s->can_signals,&s->frames[i]);
+	}
+	s->can_new = 0;
 
-	s->data.ac1_voltage_l1 =  GETD10(rdp->ac1_voltage_l1);
-	s->data.ac1_voltage_l2 =  GETD10(rdp->ac1_voltage_l2);
-	s->data.ac1_voltage_l3 =  GETD10(rdp->ac1_voltage_l3);
 	s->data.ac1_voltage = s->data.ac1_voltage_l1 + (double_equals(s->data.ac1_voltage_l2,0.0) ? s->data.ac1_voltage_l3 : s->data.ac1_voltage_l2);
-	s->data.ac1_frequency = GETD100(rdp->ac1_frequency);
-
-	s->data.battery_voltage =  GETD10(rdp->battery_voltage);
-	s->data.battery_current = GETD10(rdp->battery_current);
 	s->data.battery_power = s->data.battery_voltage * s->data.battery_current;
-	s->data.battery_temp = GETD10(rdp->battery_temp);
-	s->data.battery_soc = GETD10(rdp->battery_soc);
-
-	s->data.battery_soh = GETFVAL(rdp->battery_soh);
-	s->data.charging_proc = _gets8(rdp->charging_proc);
-	s->data.state = _gets8(rdp->state);
-	s->data.errmsg = GETFVAL(rdp->errmsg);
-	s->data.battery_cvsp = GETD10(rdp->battery_cvsp);
+	s->data.ac2_voltage = s->data.ac2_voltage_l1 + (double_equals(s->data.ac2_voltage_l2,0.0) ? s->data.ac2_voltage_l3 : s->data.ac2_voltage_l2);
+	s->data.GnOn = (s->data.GnRn && s->data.AutoGn && s->data.ac2_frequency > 45.0) ? 1 : 0;
 
-	si_can_get_relays(s);
 	dprintf(dlevel,"running: %d\n", s->running);
 	if (s->running == -1) {
 		s->running = s->data.Run;
@@ -238,18 +212,6 @@ int si_can_get_data(si_session_t *s) {
 		if (s->ap) agent_event(s->ap, "State", s->running ? "Run" : "Stop"); 
 	}
 
-	s->data.TotLodPwr = GETFS100(rdp->TotLodPwr);
-
-	s->data.ac2_voltage_l1 = GETD10(rdp->ac2_voltage_l1);
-	s->data.ac2_voltage_l2 = GETD10(rdp->ac2_voltage_l2);
-	s->data.ac2_voltage_l3 = GETD10(rdp->ac2_voltage_l3);
-	s->data.ac2_voltage = s->data.ac2_voltage_l1 + (double_equals(s->data.ac2_voltage_l2,0.0) ? s->data.ac2_voltage_l3 : s->data.ac2_voltage_l2);
-	s->data.ac2_frequency = GETD100(rdp->ac2_frequency);
-
-	s->data.PVPwrAt =  GETD10(rdp->PVPwrAt);
-	s->data.GdCsmpPwrAt = GETD10(rdp->GdCsmpPwrAt);
-	s->data.GdFeedPwr = GETD10(rdp->GdFeedPwr);
-
 	dprintf(dlevel,"input.source: %d\n", s->input.source);
 	if (s->input.source == CURRENT_SOURCE_CAN) {
 		if (s->input.type == CURRENT_TYPE_WATTS) {
@@ -404,8 +366,9 @@ int si_can_get_data(si_session_t *s) {
 static void *si_can_recv_thread(void *handle) {
 	si_session_t *s = handle;
 	struct can_frame frame;
-	int bytes,fidx;
+	int bytes;
 	uint32_t can_id;
+	uint64_t stamp;
 //	uint32_t mask;
 #if !defined(__WIN32) && !defined(__APPLE__)
 	sigset_t set;
@@ -425,7 +388,7 @@ static void *si_can_recv_thread(void *handle) {
 	while(check_state(s,SI_STATE_RUNNING)) {
 		dprintf(8,"%d: open: %d\n", getpid(), check_state(s,SI_STATE_OPEN));
 		if (!check_state(s,SI_STATE_OPEN)) {
-//			memset(&s->bitmap,0,sizeof(s->bitmap));
+			canframe_clear(s->can_cache);
 			sleep(1);
 			continue;
 		}
@@ -438,15 +401,10 @@ static void *si_can_recv_thread(void *handle) {
 			continue;
 		}
 		dprintf(8,"frame.can_id: %03x\n",frame.can_id);
-		if (frame.can_id < 0x300 || frame.can_id > 0x30f) continue;
 //		bindump("frame",&frame,sizeof(frame));
-		fidx = frame.can_id - 0x300;
-//		mask = 1 << frame.can_id;
-//		dprintf(8,"id: %03x, fidx: %x, mask: %08x, bitmap: %08x\n", frame.can_id, fidx, mask, s->bitmap);
-		dprintf(8,"id: %03x, fidx: %x\n", frame.can_id, fidx);
-		memcpy(&s->frames[fidx],&frame,sizeof(frame));
-		time(&s->times[fidx]);
-//		s->bitmap |= mask;
+		/* Kernel receive time if the transport has it */
+		if (s->can->config(s->can_handle,CAN_CONFIG_GET_TIMESTAMP,&stamp)) stamp = 0;
+		canframe_put(s->can_cache,&frame,stamp);
 	}
 	dprintf(dlevel,"thread exiting\n");
 	clear_state(s,SI_STATE_STARTED);
@@ -454,32 +412,23 @@ static void *si_can_recv_thread(void *handle) {
 }
 
 static int si_can_get_local(si_session_t *s, uint32_t id, uint8_t *data, int datasz) {
-//	uint32_t mask;
-	int fidx,retries,len;
-	int r;
-	time_t t;
+	struct can_frame frame;
+	canframe_info_t info;
+	int len;
 
 	dprintf(dlevel,"id: %03x, data: %p, len: %d\n", id, data, datasz);
 	if (id < 0x300 || id > 0x30f) return 1;
 
-	fidx = id - 0x300;
-	dprintf(dlevel,"id: %03x, fidx: %x\n", id, fidx);
-	retries=5;
-	r = 1;
-	time(&t);
-	while(retries--) {
-		dprintf(dlevel,"times[%d], time: %d, diff: %d\n", s->times[fidx], t, t - s->times[fidx]);
-		if (t - s->times[fidx] > 5) {
-			sleep(1);
-			continue;
-		}
-		len = (datasz > 8 ? 8 : datasz);
-		memcpy(data,s->frames[fidx].data,len);
-		r = 0;
-		break;
+	/* Use what we have unless it's stale, then wait for the next one */
+	if (canframe_get_fresh(s->can_cache,id,SI_CAN_MAX_AGE,SI_CAN_WAIT,&frame,&info)) {
+		dprintf(dlevel,"no fresh frame for %03x\n", id);
+		return 1;
 	}
-	dprintf(dlevel,"returning: %d\n", r);
-	return r;
+	dprintf(dlevel,"id: %03x, gen: %u, age: %llu\n", id, info.gen, (unsigned long long)info.age);
+	len = (datasz > 8 ? 8 : datasz);
+	memcpy(data,frame.data,len);
+	s->stamps[id - 0x300] = info.stamp;
+	return 0;
 }
 
 /* Func for can data that is remote (dont use thread/messages) */
@@ -497,6 +446,12 @@ static int si_can_get_remote(si_session_t *s, uint32_t id, uint8_t *data, int da
 		if (bytes == sizeof(frame)) {
 			len = (frame.can_dlc > datasz ? datasz : frame.can_dlc);
 			memcpy(data,&frame.data,len);
+			if (id >= 0x300 && id <= 0x30f) {
+				uint64_t stamp;
+
+				if (s->can->config(s->can_handle,CAN_CONFIG_GET_TIMESTAMP,&stamp)) stamp = canframe_now();
+				s->stamps[id - 0x300] = stamp;
+			}
 //			if (debug >= 7) bindump("FROM DRIVER",data,len);
 			break;
 		}
@@ -509,27 +464,21 @@ static int si_can_get_remote(si_session_t *s, uint32_t id, uint8_t *data, int da
 int si_can_set_reader(si_session_t *s) {
 	/* Start background recv thread */
 	dprintf(dlevel,"driver name: %s\n", s->can->name);
-	if (strcmp(s->can->name,"can") == 0 && s->th == 0) {
-		pthread_attr_t attr;
-
+	if (SI_CAN_LOCAL(s) && s->th == 0) {
 		/* Set the filter to our range */
 		s->can->config(s->can_handle,CAN_CONFIG_SET_RANGE,0x300,0x30F);
 
-		/* Create a detached thread */
-		if (pthread_attr_init(&attr)) {
-			sprintf(s->errmsg,"pthread_attr_init: %s",strerror(errno));
-			goto si_can_set_reader_error;
-		}
-		if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
-			sprintf(s->errmsg,"pthread_attr_setdetachstate: %s",strerror(errno));
-			goto si_can_set_reader_error;
-		}
+		if (!s->can_cache) s->can_cache = canframe_create(0x300,0x310);
+		if (!s->can_cache) goto si_can_set_reader_error;
+
+		/* Joinable, si_can_stop_thread waits for it */
 		set_state(s,SI_STATE_RUNNING);
-		if (pthread_create(&s->th,&attr,&si_can_recv_thread,s)) {
+		if (pthread_create(&s->th,0,&si_can_recv_thread,s)) {
 			sprintf(s->errmsg,"pthread_create: %s",strerror(errno));
+			clear_state(s,SI_STATE_RUNNING);
+			s->th = 0;
 			goto si_can_set_reader_error;
 		}
-		pthread_attr_destroy(&attr);
 
 		dprintf(dlevel,"setting func to local data\n");
 		s->can_read = si_can_get_local;
@@ -564,6 +513,8 @@ static void si_can_stop_thread(si_session_t *s) {
 		}
 #endif
 		pthread_cancel(s->th);
+		/* Don't let the cache/handle go while it's still in a read */
+		pthread_join(s->th,0);
 		s->th = 0;
 	}
 }
@@ -606,7 +557,7 @@ int si_can_connect(si_session_t *s) {
 
 	/* If local, "prime" the frames by reading a few IDs */
 	dprintf(dlevel,"name: %s\n", s->can->name);
-	if (strcmp(s->can->name,"can") == 0) {
+	if (SI_CAN_LOCAL(s)) {
 		uint8_t data[8];
 
 		if (s->can_read(s,0x304,data,8)) return 1;
@@ -674,11 +625,12 @@ int si_can_init(si_session_t *s) {
 			s->can->name,strerror(errno));
 		return 1;
 	}
+	if (si_can_add_signals(s)) {
+		sprintf(s->errmsg,"unable to create CAN signal table");
+		return 1;
+	}
 	if (si_can_set_reader(s)) return 1;
 
-	/* Set the pointers into the raw data */
-	_setraw(s);
-
 	if (!strlen(s->input.text)) s->input.source = CURRENT_SOURCE_NONE;
 	if (!strlen(s->input.text)) s->output.source = CURRENT_SOURCE_NONE;
 	/* Set inteval to 10s */
@@ -714,42 +666,52 @@ void si_can_destroy(si_session_t *s) {
 		dprintf(dlevel,"closing handle...\n");
 		if (check_state(s,SI_STATE_OPEN)) s->can->close(s->can_handle);
 		dprintf(dlevel,"stopping read thread...\n");
-		if (strcmp(s->can->name,"can") == 0) si_can_stop_thread(s);
+		if (SI_CAN_LOCAL(s)) si_can_stop_thread(s);
 		s->can_init = false;
 		dprintf(dlevel,"clearing agent callback...\n");
 		if (s->ap) agent_clear_callback(s->ap);
 		dprintf(dlevel,"destroying handle...\n");
 		s->can->destroy(s->can_handle);
 		s->can = 0;
+		cansig_destroy(s->can_signals);
+		s->can_signals = 0;
 		dprintf(dlevel,"done!\n");
 	}
 }
 
+/* Read a frame into frames[] to be decoded */
+static int si_can_read_frame(si_session_t *s, uint32_t id) {
+	struct can_frame *frame = &s->frames[id - 0x300];
+
+	if (s->can_read(s,id,frame->data,8)) return 1;
+	frame->can_id = id;
+	frame->can_dlc = 8;
+	s->can_new |= (1 << (id - 0x300));
+	return 0;
+}
+
 int si_can_read_data(si_session_t *s, int all) {
+	uint32_t id;
 
 	dprintf(dlevel,"all: %d\n",all);
 
 	/* If local can driver running, just refresh data */
 	dprintf(dlevel,"s->can->name: %s\n", s->can->name);
-	if (strcmp(s->can->name,"can") == 0) return si_can_get_data(s);
+	if (SI_CAN_LOCAL(s)) return si_can_get_data(s);
 
 	if (all || s->input.source == CURRENT_SOURCE_CALCULATED) {
-		if (s->can_read(s,0x300,s->frames[0].data,8)) return 1;
-		if (s->can_read(s,0x302,s->frames[2].data,8)) return 1;
+		if (si_can_read_frame(s,0x300)) return 1;
+		if (si_can_read_frame(s,0x302)) return 1;
 	}
 
 	if (all || s->output.source == CURRENT_SOURCE_CALCULATED) {
-		if (s->can_read(s,0x301,s->frames[1].data,8)) return 1;
-		if (s->can_read(s,0x303,s->frames[3].data,8)) return 1;
+		if (si_can_read_frame(s,0x301)) return 1;
+		if (si_can_read_frame(s,0x303)) return 1;
 	}
 
-	if (s->can_read(s,0x304,s->frames[4].data,8)) return 1;
-	if (s->can_read(s,0x305,s->frames[5].data,8)) return 1;
-	if (s->can_read(s,0x306,s->frames[6].data,8)) return 1;
-	if (s->can_read(s,0x307,s->frames[7].data,8)) return 1;
-	if (s->can_read(s,0x308,s->frames[8].data,8)) return 1;
-	if (s->can_read(s,0x309,s->frames[9].data,8)) return 1;
-	if (s->can_read(s,0x30a,s->frames[10].data,8)) return 1;
+	for(id = 0x304; id <= 0x30a; id++) {
+		if (si_can_read_frame(s,id)) return 1;
+	}
 
 //	dprintf(dlevel,"*** IN READ ***\n");
 	si_can_get_data(s);
@@ -54,8 +54,10 @@ static int si_destroy(void *h) {
 	/* Close and destroy transport */
 	dprintf(dlevel,"s->can: %p, s->can_handle: %p\n", s->can, s->can_handle);
 	if (s->can && s->can_handle) si_can_destroy(s);
+	/* After the recv thread is gone */
+	canframe_destroy(s->can_cache);
 	dprintf(dlevel,"s->smanet: %p\n", s->smanet);
-        if (s->smanet) smanet_destroy(s->smanet);
+        if (s->smanet) si_smanet_destroy(s);
 
 	dprintf(dlevel,"input.source: %d, output.source: %d\n", s->input.source, s->output.source);
         if (s->input.source == CURRENT_SOURCE_INFLUX) free(s->input.query);
@@ -134,6 +136,39 @@ static double _get_influx_value(influx_session_t *s, char *query) {
 #endif
 #endif
 
+/* CAN derived values (currents for SoC) sampled faster than the read interval */
+static void si_can_sample(void *ctx) {
+	si_session_t *s = ctx;
+
+	if (s->disable_si_read || !s->can || !s->can_connected) return;
+	if (si_can_read_data(s,0)) si_can_disconnect(s);
+}
+
+#ifdef SMANET
+/* SMANET parameters change slowly and are expensive to read */
+static void si_smanet_sample(void *ctx) {
+	si_session_t *s = ctx;
+
+	if (s->disable_si_read || !s->smanet || !smanet_connected(s->smanet)) return;
+	if (si_smanet_read_data(s)) si_smanet_disconnect(s);
+}
+#endif
+
+int si_update_tasks(si_session_t *s) {
+	dprintf(dlevel,"can_sample_interval: %d, smanet_interval: %d\n", s->can_sample_interval, s->smanet_interval);
+	if (s->can_sample_interval > 0)
+		agent_add_task(s->ap, "can_sample", s->can_sample_interval, 10, s->can_sample_interval / 2, 0, si_can_sample, s);
+	else
+		agent_del_task(s->ap, "can_sample");
+#ifdef SMANET
+	if (s->smanet_interval > 0)
+		agent_add_task(s->ap, "smanet", s->smanet_interval * 1000, 0, 1000, 0, si_smanet_sample, s);
+	else
+		agent_del_task(s->ap, "smanet");
+#endif
+	return 0;
+}
+
 static int si_read(void *handle, uint32_t *control, void *buf, int buflen) {
 	si_session_t *s = handle;
 //	long start = mem_used();
@@ -151,7 +186,8 @@ static int si_read(void *handle, uint32_t *control, void *buf, int buflen) {
 		dprintf(dlevel,"can_connected: %d\n", s->can_connected);
 		if (!s->can_connected) si_can_connect(s);
 		dprintf(dlevel,"can_connected: %d\n", s->can_connected);
-		if (s->can_connected) {
+		/* Otherwise the can_sample task reads it */
+		if (s->can_connected && s->can_sample_interval < 1) {
 			if (si_can_read_data(s,0)) si_can_disconnect(s);
 		}
 	}
@@ -166,7 +202,8 @@ static int si_read(void *handle, uint32_t *control, void *buf, int buflen) {
 		else if (!smanet_connected(s->smanet)) si_smanet_connect(s);
 	}
 	dprintf(dlevel,"smanet_connected: %d\n", smanet_connected(s->smanet));
-	if (s->smanet && smanet_connected(s->smanet)) {
+	/* Otherwise the smanet task reads it */
+	if (s->smanet && smanet_connected(s->smanet) && s->smanet_interval < 1) {
 		if (si_smanet_read_data(s)) si_smanet_disconnect(s);
 	}
 #endif
@@ -181,8 +218,10 @@ static int si_read(void *handle, uint32_t *control, void *buf, int buflen) {
 		influx_response_t *r;
 		double value;
 
- 		r = influx_query(s->ap->i,s->input.query);
-		if (r) influx_get_first_value(r, &value, 0, 0);
+		/* From memory - the cache keeps it fresh in the background */
+ 		r = influx_cache_get(s->ap->i,s->input.query,SI_INFLUX_TTL(s));
+		if (influx_get_first_value(r, &value, 0, 0)) value = 0;
+		influx_release_response(r);
 		if (s->input.type == CURRENT_TYPE_WATTS) {
 			s->data.ac2_power = value;
 			s->data.ac2_current = s->data.ac2_power / s->data.ac2_voltage_l1;
@@ -198,8 +237,10 @@ static int si_read(void *handle, uint32_t *control, void *buf, int buflen) {
 		influx_response_t *r;
 		double value;
 
- 		r = influx_query(s->ap->i,s->output.query);
-		if (r) influx_get_first_value(r, &value, 0, 0);
+		/* From memory - the cache keeps it fresh in the background */
+ 		r = influx_cache_get(s->ap->i,s->output.query,SI_INFLUX_TTL(s));
+		if (influx_get_first_value(r, &value, 0, 0)) value = 0;
+		influx_release_response(r);
 		if (s->output.type == CURRENT_TYPE_WATTS) {
 			s->data.ac1_power = value;
 			s->data.ac1_current = s->data.ac1_power / s->data.ac1_voltage_l1;
@@ -239,6 +280,8 @@ static int si_read(void *handle, uint32_t *control, void *buf, int buflen) {
 	s->soh = 100.0;
 //	log_info("mem used: %ld\n", mem_used() - start);
 
+	agent_pubshm(s->ap, SHMDATA_TYPE_AGENT, &s->data, sizeof(s->data));
+
 	// Must set before every write
 	s->force_charge_amps = 0;
 	return 0;
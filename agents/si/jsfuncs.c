@@ -55,6 +55,49 @@ static JSBool refresh_si_data(JSContext *cx, uintN argc, jsval *vp) {
 	return JS_TRUE;
 }
 
+/* Decoded CAN signal by name (undefined if there's no such signal) */
+static JSBool si_data_signal(JSContext *cx, uintN argc, jsval *vp) {
+	si_session_t *s = JS_GetPrivate(cx,JS_THIS_OBJECT(cx, vp));
+	jsval *argv = vp + 2;
+	char name[CANSIG_NAME_LEN];
+	cansig_t *sig;
+
+	if (argc != 1) {
+		JS_ReportError(cx,"signal requires 1 argument (name: string)\n");
+		return JS_FALSE;
+	}
+	if (!jsval_to_type(DATA_TYPE_STRING,name,sizeof(name)-1,cx,argv[0])) return JS_FALSE;
+	if (s->can_connected) si_can_get_data(s);
+	sig = cansig_find(s->can_signals,name);
+	if (!sig) {
+		*vp = JSVAL_VOID;
+		return JS_TRUE;
+	}
+	return JS_NewDoubleValue(cx, sig->value, vp);
+}
+
+/* All decoded CAN signals as { name: value, ... } */
+static JSBool si_data_signals(JSContext *cx, uintN argc, jsval *vp) {
+	si_session_t *s = JS_GetPrivate(cx,JS_THIS_OBJECT(cx, vp));
+	JSObject *obj;
+	cansig_t *sig;
+	list l;
+	jsval val;
+
+	obj = JS_NewObject(cx,0,0,0);
+	if (!obj) return JS_FALSE;
+	*vp = OBJECT_TO_JSVAL(obj);
+	if (s->can_connected) si_can_get_data(s);
+	l = cansig_signals(s->can_signals);
+	if (!l) return JS_TRUE;
+	list_reset(l);
+	while((sig = list_get_next(l)) != 0) {
+		if (!JS_NewDoubleValue(cx, sig->value, &val)) return JS_FALSE;
+		JS_DefineProperty(cx, obj, sig->name, val, 0, 0, JSPROP_ENUMERATE);
+	}
+	return JS_TRUE;
+}
+
 JSObject *jssi_data_new(JSContext *cx, JSObject *parent, si_session_t *s) {
 	JSAliasSpec si_data_aliases[] = {
 		{ "ac1_voltage", "output_voltage" },
@@ -70,6 +113,8 @@ JSObject *jssi_data_new(JSContext *cx, JSObject *parent, si_session_t *s) {
 	};
 	JSFunctionSpec si_data_funcs[] = {
 		JS_FN("refresh",refresh_si_data,0,0,0),
+		JS_FN("signal",si_data_signal,1,1,0),
+		JS_FN("signals",si_data_signals,0,0,0),
 		{ 0 }
 	};
 	JSObject *obj;
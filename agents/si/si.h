@@ -16,57 +16,8 @@ LICENSE file in the root directory of this source tree.
 #endif
 #include <pthread.h>
 #include "can.h"
-
-struct si_raw_data {
-	int16_t *active_grid_l1;
-	int16_t *active_grid_l2;
-	int16_t *active_grid_l3;
-
-	int16_t *active_si_l1;
-	int16_t *active_si_l2;
-	int16_t *active_si_l3;
-
-	int16_t *reactive_grid_l1;
-	int16_t *reactive_grid_l2;
-	int16_t *reactive_grid_l3;
-
-	int16_t *reactive_si_l1;
-	int16_t *reactive_si_l2;
-	int16_t *reactive_si_l3;
-
-	int16_t *ac1_voltage_l1;
-	int16_t *ac1_voltage_l2;
-	int16_t *ac1_voltage_l3;
-	int16_t *ac1_frequency;
-
-	int16_t *battery_voltage;
-	int16_t *battery_current;
-	int16_t *battery_temp;
-	int16_t *battery_soc;
-
-	int16_t *battery_soh;
-	int8_t *charging_proc;
-	int8_t *state;
-	int16_t *errmsg;
-	int16_t *battery_cvsp;
-
-	uint16_t *relay_state;
-	uint16_t *relay_bits1;
-	uint16_t *relay_bits2;
-	uint8_t *synch_bits;
-
-	int16_t *TotLodPwr;
-
-	int16_t *ac2_voltage_l1;
-	int16_t *ac2_voltage_l2;
-	int16_t *ac2_voltage_l3;
-	int16_t *ac2_frequency;
-
-	int16_t *PVPwrAt;
-	int16_t *GdCsmpPwrAt;
-	int16_t *GdFeedPwr;
-};
-typedef struct si_raw_data si_raw_data_t;
+#include "canframe.h"
+#include "cansig.h"
 
 struct si_data {
 	double active_grid_l1;
@@ -145,6 +96,7 @@ struct si_data {
 	double PVPwrAt;
 	double GdCsmpPwrAt;
 	double GdFeedPwr;
+	double can_time;		/* Receive time of the oldest frame these came from (s since the epoch) */
 };
 typedef struct si_data si_data_t;
 
@@ -214,11 +166,15 @@ struct si_session {
 	void *can_handle;
 	int can_init;
 	int can_connected;
-	struct can_frame frames[16];
-	time_t times[16];
+	struct can_frame frames[16];	/* What the values are decoded from */
+	uint64_t stamps[16];		/* Receive time of each frame (ns since the epoch) */
+	canframe_cache_t *can_cache;	/* Filled by the recv thread (local can) */
+	uint32_t can_gens[16];		/* Generation of each frame last decoded */
+	uint16_t can_new;		/* Frames not decoded yet (bit per id) */
+	cansig_table_t *can_signals;	/* What's in the frames and where it goes */
+	char can_signals_path[256];	/* .dbc with more/redefined signals */
 	pthread_t th;
 	int (*can_read)(struct si_session *, uint32_t id, uint8_t *data, int len);
-	si_raw_data_t raw_data;
 	si_data_t data;
 
 #ifdef SMANET
@@ -229,6 +185,11 @@ struct si_session {
 	char smanet_topts[SOLARD_TOPTS_LEN];
 	char smanet_channels_path[1024];
 	smanet_session_t *smanet;
+	smanet_plan_t *smanet_plan;	/* Values to read each cycle */
+	struct si_smanet_map *smanet_map;
+	int smanet_plan_count;
+	bool smanet_plan_can;		/* can_connected when the plan was made */
+	bool smanet_plan_dirty;
 	int smanet_auto_close;
 	int smanet_auto_close_timeout;
 	char battery_type[32];
@@ -280,6 +241,8 @@ struct si_session {
 	int disable_si_read;
 	int disable_si_write;
 	int sync_interval;
+	int can_sample_interval;	/* ms, 0 = with each read */
+	int smanet_interval;		/* seconds, 0 = with each read */
 	struct {
 		int enabled;
 		char name[256];
@@ -311,6 +274,15 @@ typedef struct si_session si_session_t;
 #define SI_VOLTAGE_MIN	41.0
 #define SI_VOLTAGE_MAX	63.0
 
+/* Frames arrive on their own (live bus or a replayed log) vs asked for through rdev */
+#define SI_CAN_LOCAL(s)	(strcmp((s)->can->name,"can") == 0 || strcmp((s)->can->name,"canlog") == 0)
+
+#define SI_CAN_MAX_AGE	5000		/* ms before a cached frame is too old to use */
+#define SI_CAN_WAIT	5000		/* ms to wait for a new one (returns as soon as it arrives) */
+
+/* Influx current sources are refreshed in the background once per read */
+#define SI_INFLUX_TTL(s)	((int)((s)->ap->interval * 1000))
+
 #define SI_CONFIG_FLAG_SMANET	0x1000
 
 #define SI_STATUS_CAN		0x01
@@ -320,6 +292,7 @@ typedef struct si_session si_session_t;
 
 /* driver */
 extern solard_driver_t si_driver;
+int si_update_tasks(si_session_t *s);
 
 /* can */
 int si_can_init(si_session_t *s);
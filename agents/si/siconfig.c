@@ -363,6 +363,15 @@ static int smanet_chanpath_set(void *ctx, config_property_t *p, void *old_value)
 	return si_smanet_load_channels(s);
 }
 
+/* can_signals trigger */
+static int can_signals_set(void *ctx, config_property_t *p, void *old_value) {
+	si_session_t *s = ctx;
+
+	/* Otherwise loaded by si_can_init */
+	if (!s->can_signals || !strlen(s->can_signals_path)) return 0;
+	return cansig_load(s->can_signals,s->can_signals_path);
+}
+
 static int set_input_current_source(void *ctx, config_property_t *p, void *old_value) {
 	si_session_t *s = ctx;
 
@@ -370,6 +379,9 @@ static int set_input_current_source(void *ctx, config_property_t *p, void *old_v
 
 	memset(&s->input.name,0,sizeof(s->input.name));
 	if (strlen(s->input.text)) _getsource(s,&s->input);
+#ifdef SMANET
+	s->smanet_plan_dirty = true;
+#endif
 	return 0;
 }
 
@@ -380,6 +392,9 @@ static int set_output_current_source(void *ctx, config_property_t *p, void *old_
 
 	memset(&s->output.name,0,sizeof(s->output.name));
 	if (strlen(s->output.text)) _getsource(s,&s->output);
+#ifdef SMANET
+	s->smanet_plan_dirty = true;
+#endif
 	return 0;
 }
 
@@ -403,6 +418,14 @@ static int set_solar_output_source(void *ctx, config_property_t *p, void *old_va
 	return 0;
 }
 
+static int set_task_interval(void *ctx, config_property_t *p, void *old_value) {
+	si_session_t *s = ctx;
+
+	/* Tasks are registered after agent_init */
+	if (s->ap && s->ap->sched) si_update_tasks(s);
+	return 0;
+}
+
 int si_agent_init(int argc, char **argv, opt_proctab_t *si_opts, si_session_t *s) {
 	config_property_t si_props[] = {
 		/* name, type, dest, dsize, def, flags, scope, values, labels, units, scale, precision, trigger, ctx */
@@ -434,6 +457,8 @@ int si_agent_init(int argc, char **argv, opt_proctab_t *si_opts, si_session_t *s
 		{ "can_transport", DATA_TYPE_STRING, s->can_transport, sizeof(s->can_transport)-1, 0, CONFIG_FLAG_READONLY },
 		{ "can_target", DATA_TYPE_STRING, s->can_target, sizeof(s->can_target)-1, 0, CONFIG_FLAG_READONLY, },
 		{ "can_topts", DATA_TYPE_STRING, s->can_topts, sizeof(s->can_topts)-1, 0, CONFIG_FLAG_READONLY, },
+		{ "can_signals", DATA_TYPE_STRING, s->can_signals_path, sizeof(s->can_signals_path)-1, 0, 0,
+			0, 0, 0, 0, 0, 1, can_signals_set, s },
 		{ "can_connected", DATA_TYPE_BOOL, &s->can_connected, 0, "N", CONFIG_FLAG_PRIVATE },
 #ifdef SMANET
 		{ "smanet_transport", DATA_TYPE_STRING, &s->smanet_transport, sizeof(s->smanet_transport)-1, 0, CONFIG_FLAG_READONLY, },
@@ -459,6 +484,10 @@ int si_agent_init(int argc, char **argv, opt_proctab_t *si_opts, si_session_t *s
 		{ "notify", DATA_TYPE_STRING, &s->notify_path, sizeof(s->notify_path)-1, 0, 0, },
 		{ "disable_si_read", DATA_TYPE_BOOL, &s->disable_si_read, 0, 0, 0 },
 		{ "disable_si_write", DATA_TYPE_BOOL, &s->disable_si_write, 0, 0, 0 },
+		{ "can_sample_interval", DATA_TYPE_INT, &s->can_sample_interval, 0, "0", 0,
+			"range", "0, 10000, 1", "CAN sample period (0 = each read)", "ms", 1, 0, set_task_interval, s },
+		{ "smanet_interval", DATA_TYPE_INT, &s->smanet_interval, 0, "0", 0,
+			"range", "0, 86400, 1", "SMANET read period (0 = each read)", "S", 1, 0, set_task_interval, s },
 		{ "force_charge_amps", DATA_TYPE_BOOL, &s->force_charge_amps, 0, "N", CONFIG_FLAG_PRIVATE },
 		{ "discharge_amps", DATA_TYPE_DOUBLE, &s->discharge_amps, 0, "1120", 0, },
 		{ "user_soc", DATA_TYPE_DOUBLE, &s->user_soc, 0, "-1", CONFIG_FLAG_NOSAVE, },
@@ -491,6 +520,7 @@ int si_agent_init(int argc, char **argv, opt_proctab_t *si_opts, si_session_t *s
 	if (!s->spread) s->spread = s->max_voltage - s->min_voltage;
 
 	si_smanet_config(s);
+	si_update_tasks(s);
 
 	if (!strlen(s->notify_path)) sprintf(s->notify_path,"%s/notify",SOLARD_BINDIR);
 	return 0;
@@ -564,6 +594,7 @@ void si_config_add_si_data(si_session_t *s) {
 		{ "PVPwrAt", DATA_TYPE_DOUBLE, &s->data.PVPwrAt, 0, 0, flags },
 		{ "GdCsmpPwrAt", DATA_TYPE_DOUBLE, &s->data.GdCsmpPwrAt, 0, 0, flags },
 		{ "GdFeedPwr", DATA_TYPE_DOUBLE, &s->data.GdFeedPwr, 0, 0, flags },
+		{ "can_time", DATA_TYPE_DOUBLE, &s->data.can_time, 0, 0, flags },
 		{0}
 	};
 
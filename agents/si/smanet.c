@@ -25,48 +25,71 @@ void get_genstate(si_session_t *s, smanet_multreq_t *mr) {
 	return;
 }
 
-int si_smanet_read_data(si_session_t *s) {
-	config_section_t *sec;
+struct si_smanet_parm {
+	char *smanet_name;
+	char *data_name;
+	double mult;
+	int can;
+	void (*cb)(si_session_t *, smanet_multreq_t *);
+};
+
+static struct si_smanet_parm si_smanet_parms[] = {
+	{ "ExtVtg", "ac2_voltage_l1", 1, 1 },
+	{ "ExtVtgSlv1", "ac2_voltage_l2", 1, 1 },
+	{ "ExtVtgSlv2", "ac2_voltage_l3", 1, 1 },
+	{ "ExtFrq", "ac2_frequency", 1, 1 },
+	{ "TotExtCur", "ac2_current", 1, 1 },
+	{ "InvVtg", "ac1_voltage_l1", 1, 1 },
+	{ "InvVtgSlv1", "ac1_voltage_l2", 1, 1 },
+	{ "InvVtgSlv2", "ac1_voltage_l3", 1, 1 },
+	{ "InvFrq", "ac1_frequency", 1, 1 },
+	{ "TotInvCur", "ac1_current", 1, 1 },
+	{ "BatSoc", "battery_soc", 1, 1 },
+	{ "BatVtg", "battery_voltage", 1, 1 },
+	{ "TotBatCur", "battery_current", 1, 1 },
+	{ "BatTmp", "battery_temp", 1, 1 },
+	{ "TotLodPwr", "TotLodPwr", 1, 1 },
+	{ "Msg", "errmsg", 1, 1 },
+	{ "GnStt", "GnOn", 1, 1, get_genstate },
+	{ "InvOpStt", "GnOn", 1, 1, get_runstate },
+	{ 0, 0, 0 }
+};
+
+#define SI_SMANET_PARM 0
+#define SI_SMANET_INPUT 1
+#define SI_SMANET_OUTPUT 2
+
+/* What to do with each value in the plan */
+struct si_smanet_map {
+	int type;
+	struct si_smanet_parm *pp;
 	config_property_t *p;
-	struct {
-		char *smanet_name;
-		char *data_name;
-		double mult;
-		int can;
-		void (*cb)(si_session_t *, smanet_multreq_t *);
-	} *pp, parminfo[] = {
-		{ "ExtVtg", "ac2_voltage_l1", 1, 1 },
-		{ "ExtVtgSlv1", "ac2_voltage_l2", 1, 1 },
-		{ "ExtVtgSlv2", "ac2_voltage_l3", 1, 1 },
-		{ "ExtFrq", "ac2_frequency", 1, 1 },
-		{ "TotExtCur", "ac2_current", 1, 1 },
-		{ "InvVtg", "ac1_voltage_l1", 1, 1 },
-		{ "InvVtgSlv1", "ac1_voltage_l2", 1, 1 },
-		{ "InvVtgSlv2", "ac1_voltage_l3", 1, 1 },
-		{ "InvFrq", "ac1_frequency", 1, 1 },
-		{ "TotInvCur", "ac1_current", 1, 1 },
-		{ "BatSoc", "battery_soc", 1, 1 },
-		{ "BatVtg", "battery_voltage", 1, 1 },
-		{ "TotBatCur", "battery_current", 1, 1 },
-		{ "BatTmp", "battery_temp", 1, 1 },
-		{ "TotLodPwr", "TotLodPwr", 1, 1 },
-		{ "Msg", "errmsg", 1, 1 },
-		{ "GnStt", "GnOn", 1, 1, get_genstate },
-		{ "InvOpStt", "GnOn", 1, 1, get_runstate },
-		{ 0, 0, 0 }
-	};
-	smanet_multreq_t *mr;
-	int count,mr_size,i;
+};
+
+static void si_smanet_free_plan(si_session_t *s) {
+	smanet_plan_destroy(s->smanet_plan);
+	s->smanet_plan = 0;
+	free(s->smanet_map);
+	s->smanet_map = 0;
+	s->smanet_plan_count = 0;
+}
 
-	if (!s->smanet) return 1;
-	if (!smanet_connected(s->smanet)) return 0;
+/* Resolve the names and properties once; redone when the sources or CAN state change */
+static int si_smanet_make_plan(si_session_t *s) {
+	struct si_smanet_parm *pp;
+	struct si_smanet_map *map;
+	config_section_t *sec;
+	char **names;
+	int count,i;
+
+	si_smanet_free_plan(s);
 
 	sec = config_get_section(s->ap->cp,"si_data");
 	dprintf(dlevel,"sec: %p\n",sec);
 	if (!sec) return 1;
 
 	count = 0;
-	for(pp = parminfo; pp->smanet_name; pp++) {
+	for(pp = si_smanet_parms; pp->smanet_name; pp++) {
 		dprintf(dlevel,"name: %s, can: %d, can_connected: %d\n", pp->smanet_name, pp->can, s->can_connected);
 		if (pp->can && s->can_connected) continue;
 		count++;
@@ -75,29 +98,70 @@ int si_smanet_read_data(si_session_t *s) {
 	if (s->input.source == CURRENT_SOURCE_SMANET) count++;
 	if (s->output.source == CURRENT_SOURCE_SMANET) count++;
 	dprintf(dlevel,"count: %d\n", count);
-	if (!count) return 0;
-	mr_size = count * sizeof(smanet_multreq_t);
-	dprintf(dlevel,"mr_size: %d\n", mr_size);
-	mr = malloc(mr_size);
-	if (!mr) return 1;
 
+	names = malloc((count ? count : 1) * sizeof(char *));
+	map = calloc(count ? count : 1, sizeof(*map));
+	if (!names || !map) {
+		log_syserror("si_smanet_make_plan: malloc");
+		free(names);
+		free(map);
+		return 1;
+	}
 	i = 0;
-	for(pp = parminfo; pp->smanet_name; pp++) {
+	for(pp = si_smanet_parms; pp->smanet_name; pp++) {
 		if (pp->can && s->can_connected) continue;
-		mr[i++].name = pp->smanet_name;
+		map[i].type = SI_SMANET_PARM;
+		map[i].pp = pp;
+		if (!pp->cb) map[i].p = config_section_get_property(sec, pp->data_name);
+		names[i++] = pp->smanet_name;
+	}
+	if (s->input.source == CURRENT_SOURCE_SMANET) {
+		map[i].type = SI_SMANET_INPUT;
+		names[i++] = s->input.name;
+	}
+	if (s->output.source == CURRENT_SOURCE_SMANET) {
+		map[i].type = SI_SMANET_OUTPUT;
+		names[i++] = s->output.name;
+	}
+	s->smanet_plan = smanet_plan_create(s->smanet,names,count);
+	free(names);
+	if (!s->smanet_plan) {
+		log_error("si_smanet_make_plan: %s\n", smanet_get_errmsg(s->smanet));
+		free(map);
+		return 1;
+	}
+	s->smanet_map = map;
+	s->smanet_plan_count = count;
+	s->smanet_plan_can = s->can_connected;
+	s->smanet_plan_dirty = false;
+	return 0;
+}
+
+int si_smanet_read_data(si_session_t *s) {
+	struct si_smanet_map *map;
+	config_property_t *p;
+	smanet_multreq_t *mr;
+	int i;
+
+	if (!s->smanet) return 1;
+	if (!smanet_connected(s->smanet)) return 0;
+
+	if (!s->smanet_plan || s->smanet_plan_dirty || s->smanet_plan_can != s->can_connected) {
+		if (si_smanet_make_plan(s)) return 1;
 	}
-	if (s->input.source == CURRENT_SOURCE_SMANET) mr[i++].name = s->input.name;
-	if (s->output.source == CURRENT_SOURCE_SMANET) mr[i++].name = s->output.name;
-//	for(i=0; i < count; i++) dprintf(dlevel,"mr[%d]: %s\n", i, mr[i].name);
-	if (smanet_get_multvalues(s->smanet,mr,count)) {
-		dprintf(dlevel,"smanet_get_multvalues error");
+	if (!s->smanet_plan_count) return 0;
+
+	mr = smanet_plan_read(s->smanet,s->smanet_plan);
+	if (!mr) {
+		dprintf(dlevel,"smanet_plan_read error: %s\n", smanet_get_errmsg(s->smanet));
 		smanet_disconnect(s->smanet);
-		free(mr);
 		return 1;
 	}
-	for(i=0; i < count; i++) {
+	for(i=0; i < s->smanet_plan_count; i++) {
+		map = &s->smanet_map[i];
 		dprintf(dlevel,"mr[%d]: %s\n", i, mr[i].name);
-		if (s->input.source == CURRENT_SOURCE_SMANET && strcmp(mr[i].name,s->input.name) == 0) {
+		switch(map->type) {
+		case SI_SMANET_INPUT:
 			if (s->input.type == CURRENT_TYPE_WATTS) {
 				s->data.ac2_power = mr[i].value;
 				s->data.ac2_current = s->data.ac2_power / s->data.ac2_voltage_l1;
@@ -106,9 +170,8 @@ int si_smanet_read_data(si_session_t *s) {
 				s->data.ac2_power = s->data.ac2_current * s->data.ac2_voltage_l1;
 			}
 			dprintf(dlevel,"ac2_current: %.1f, ac2_power: %.1f\n", s->data.ac2_current, s->data.ac2_power);
-			continue;
-		}
-		if (s->output.source == CURRENT_SOURCE_SMANET && strcmp(mr[i].name,s->output.name) == 0) {
+			break;
+		case SI_SMANET_OUTPUT:
 			if (s->output.type == CURRENT_TYPE_WATTS) {
 				s->data.ac1_power = mr[i].value;
 				s->data.ac1_current = s->data.ac1_power / s->data.ac1_voltage_l1;
@@ -117,27 +180,24 @@ int si_smanet_read_data(si_session_t *s) {
 				s->data.ac1_power = s->data.ac1_current * s->data.ac1_voltage_l1;
 			}
 			dprintf(dlevel,"ac1_current: %.1f, ac1_power: %.1f\n", s->data.ac1_current, s->data.ac1_power);
-			continue;
-		}
-		for(pp = parminfo; pp->smanet_name; pp++) {
-			if (strcmp(pp->smanet_name, mr[i].name) == 0) {
-				if (pp->cb) {
-					pp->cb(s, &mr[i]);
-				} else {
-					p = config_section_get_property(sec, pp->data_name);
-					if (!p) break;
-					dprintf(dlevel,"mr[%d]: value: %f, text: %s\n", i, mr[i].value, mr[i].text);
-					if (mr[i].text) 
-						p->len = conv_type(p->type, p->dest, p->dsize, DATA_TYPE_STRING,
-							mr[i].text, strlen(mr[i].text) );
-					else  {
-						double d = mr[i].value * pp->mult;
-						p->len = conv_type(p->type, p->dest, p->dsize, DATA_TYPE_DOUBLE, &d, 0 );
-					}
-					dprintf(dlevel,"%s: %.1f\n", p->name, *((double *)p->dest));
-				}
+			break;
+		default:
+			if (map->pp->cb) {
+				map->pp->cb(s, &mr[i]);
 				break;
 			}
+			p = map->p;
+			if (!p) break;
+			dprintf(dlevel,"mr[%d]: value: %f, text: %s\n", i, mr[i].value, mr[i].text);
+			if (mr[i].text) 
+				p->len = conv_type(p->type, p->dest, p->dsize, DATA_TYPE_STRING,
+					mr[i].text, strlen(mr[i].text) );
+			else  {
+				double d = mr[i].value * map->pp->mult;
+				p->len = conv_type(p->type, p->dest, p->dsize, DATA_TYPE_DOUBLE, &d, 0 );
+			}
+			dprintf(dlevel,"%s: %.1f\n", p->name, *((double *)p->dest));
+			break;
 		}
 	}
 	if (!s->can_connected) {
@@ -161,7 +221,6 @@ int si_smanet_read_data(si_session_t *s) {
 		if ((s->data.ac2_voltage > 10 && s->data.ac2_frequency > 10) && s->data.ac2_power > 100) s->data.GdOn = true;
 		else s->data.GdOn = false;
 	}
-	free(mr);
 	dprintf(dlevel,"done\n");
 	return 0;
 }
@@ -390,6 +449,15 @@ int si_smanet_connect(si_session_t *s) {
 	return 0;
 }
 
+int si_smanet_destroy(si_session_t *s) {
+
+	dprintf(dlevel,"smanet: %p\n", s->smanet);
+	si_smanet_free_plan(s);
+	if (s->smanet) smanet_destroy(s->smanet);
+	s->smanet = 0;
+	return 0;
+}
+
 int si_smanet_disconnect(si_session_t *s) {
 
 	dprintf(dlevel,"smanet: %p\n", s->smanet);
@@ -0,0 +1,13 @@
+#define JSDOCUMENT_PROPIDS \
+	JSDOCUMENT_PROPERTY_ID_COMPATMODE=1
+
+#define JSDOCUMENT_GETPROP \
+		case JSDOCUMENT_PROPERTY_ID_COMPATMODE:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->compatMode));\
+			break;
+
+#define JSDOCUMENT_SETPROP /* noop */
+
+#define JSDOCUMENT_PROPSPEC \
+		{ "compatMode",JSDOCUMENT_PROPERTY_ID_COMPATMODE,JSPROP_ENUMERATE| JSPROP_READONLY }
+
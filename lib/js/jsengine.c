@@ -119,6 +119,7 @@ struct _scriptinfo {
 	JSScript *script;
 	JSTempValueRooter tvr;
 	int exitcode;
+	int shared;			/* script belongs to the parent's pool */
 };
 typedef struct _scriptinfo scriptinfo_t;
 
@@ -180,6 +181,38 @@ static scriptinfo_t *_getsinfo(JSEngine *e, char *filename, int add) {
 	return sp;
 }
 
+static int _chkscript(JSContext *cx, scriptinfo_t *sp);
+
+/* Engines sharing a runtime compile each file once (into the owner's pool) and
+   just execute the compiled script in their own global */
+static int _chkshared(JSContext *cx, scriptinfo_t *sp, time_t mt) {
+	JSEngine *pe = sp->e->parent;
+	scriptinfo_t *pp;
+	int r;
+
+	list_reset(pe->pool);
+	while((pp = list_get_next(pe->pool)) != 0) {
+		if (strcmp(pp->filename,sp->filename) == 0) break;
+	}
+	if (!pp) {
+		scriptinfo_t newsinfo;
+
+		memset(&newsinfo,0,sizeof(newsinfo));
+		newsinfo.e = pe;
+		strcpy(newsinfo.filename,sp->filename);
+		pp = list_add(pe->pool,&newsinfo,sizeof(newsinfo));
+		if (!pp) return 1;
+	}
+	r = _chkscript(cx, pp);
+	dprintf(dlevel,"pool: %s: %d\n", pp->filename, r);
+	if (r == 1) return 1;
+	if (sp->script == pp->script && sp->modtime == mt) return 2;
+	sp->script = pp->script;
+	sp->modtime = mt;
+	sp->shared = 1;
+	return 0;
+}
+
 static int _chkscript(JSContext *cx, scriptinfo_t *sp) {
 	time_t mt;
 	int r;
@@ -191,6 +224,7 @@ static int _chkscript(JSContext *cx, scriptinfo_t *sp) {
 
 	mt = _getmodtime(sp->filename);
 	dprintf(ldlevel,"mt: %ld, modtime: %ld\n", mt, sp->modtime);
+	if (sp->e->parent) return _chkshared(cx, sp, mt);
 	if (sp->script && sp->modtime == mt) {
 		r = 2;
 	} else {
@@ -381,6 +415,15 @@ JS_EngineNewContext_error:
 }
 
 
+static JSEngine *_share_parent = 0;
+
+/* Engines created after this use the parent's runtime (and compiled scripts)
+   instead of creating their own; 0 turns it off.  Everything sharing a runtime
+   must run on the same thread and the parent must be destroyed last. */
+void JS_EngineShareRuntime(JSEngine *parent) {
+	_share_parent = parent;
+}
+
 JSEngine *JS_EngineInit(int rtsize, int stacksize, js_outputfunc_t *output) {
 	JSEngine *e;
 
@@ -389,6 +432,23 @@ JSEngine *JS_EngineInit(int rtsize, int stacksize, js_outputfunc_t *output) {
 	e = calloc(sizeof(*e),1);
 	if (!e) return 0;
 
+	if (_share_parent) {
+		e->parent = _share_parent;
+		e->parent->refs++;
+		e->rt = e->parent->rt;
+		e->rtsize = e->parent->rtsize;
+		e->stacksize = stacksize;
+		e->output = output;
+		e->scripts = list_create();
+		e->initfuncs = list_create();
+		pthread_mutex_init(&e->lockcx, 0);
+		e->roots = list_create();
+		e->loaded = list_create();
+		e->pool = list_create();
+		dprintf(dlevel,"e: %p, parent: %p, refs: %d\n", e, e->parent, e->parent->refs);
+		return e;
+	}
+
 	/* XXX must be called before runtime creation */
 	if (!_cstrings_set) {
 		JS_SetCStringsAreUTF8();
@@ -409,7 +469,7 @@ JSEngine *JS_EngineInit(int rtsize, int stacksize, js_outputfunc_t *output) {
 	pthread_mutex_init(&e->lockcx, 0);
 	e->roots = list_create();
 	e->loaded = list_create();
-	
+	e->pool = list_create();
 
 	dprintf(dlevel,"e: %p\n", e);
 	return e;
@@ -445,8 +505,13 @@ int JS_EngineDestroy(JSEngine *e) {
 	
 
 #if SCRIPT_CACHE
+	if (e->refs) log_error("JS_EngineDestroy: %d engines still sharing this runtime\n", e->refs);
 	list_reset(e->scripts);
 	while((sp = list_get_next(e->scripts)) != 0) {
+		if (sp->script && !sp->shared) JS_RemoveRoot(e->cx, &sp->script->object);
+	}
+	list_reset(e->pool);
+	while((sp = list_get_next(e->pool)) != 0) {
 		if (sp->script) JS_RemoveRoot(e->cx, &sp->script->object);
 	}
 #endif
@@ -462,6 +527,11 @@ int JS_EngineDestroy(JSEngine *e) {
 		JS_GlobalShutdown(e->cx);
 		JS_DestroyContext(e->cx);
 	}
+	if (e->parent) {
+		/* The runtime belongs to the parent */
+		e->parent->refs--;
+		goto destroy_lists;
+	}
 	JS_ShutDown();
 #ifdef JS_THREADSAFE
 	{
@@ -471,8 +541,10 @@ int JS_EngineDestroy(JSEngine *e) {
 	}
 #endif
 	JS_DestroyRuntime(e->rt);
+destroy_lists:
 	list_destroy(e->scripts);
 	list_destroy(e->initfuncs);
+	list_destroy(e->pool);
 	free(e);
 	return 1;
 }
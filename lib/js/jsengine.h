@@ -36,11 +36,15 @@ struct JSEngine {
 	list roots;
     list loaded;
 	void *private;
+	struct JSEngine *parent;		/* Runtime owner when sharing */
+	int refs;				/* Engines sharing this runtime */
+	list pool;				/* Compiled scripts shared with children */
 };
 typedef struct JSEngine JSEngine;
 
 JSEngine *JS_EngineInit(int rtsize, int stksize, js_outputfunc_t *);
 JSEngine *JS_DupEngine(JSEngine *e);
+void JS_EngineShareRuntime(JSEngine *parent);
 int JS_EngineDestroy(JSEngine *);
 int JS_EngineAddInitFunc(JSEngine *, char *name, js_initfunc_t *func, void *priv);
 int JS_EngineAddInitClass(JSEngine *, char *name, js_initclass_t *func);
@@ -57,6 +61,7 @@ void JS_EngineCleanup(JSEngine *e);
 JSContext *JS_EngineGetCX(JSEngine *e);
 void JS_GlobalShutdown(JSContext *cx);
 int JS_EngineAddRoot(JSContext *cx, char *name, void *rp);
+int JS_EngineRemoveRoot(JSContext *cx, void *rp);
 int JS_EngineLoadScript(JSEngine *e, char *path);
 int JS_EngineCheckLoaded(JSEngine *e);
 
@@ -0,0 +1,48 @@
+#define JSLOCATION_PROPIDS \
+	JSLOCATION_PROPERTY_ID_HASH=1,\
+	JSLOCATION_PROPERTY_ID_HOST=2,\
+	JSLOCATION_PROPERTY_ID_HOSTNAME=3,\
+	JSLOCATION_PROPERTY_ID_HREF=4,\
+	JSLOCATION_PROPERTY_ID_ORIGIN=5,\
+	JSLOCATION_PROPERTY_ID_PATHNAME=6,\
+	JSLOCATION_PROPERTY_ID_PROTOCOL=7,\
+	JSLOCATION_PROPERTY_ID_SEARCH=8
+
+#define JSLOCATION_GETPROP \
+		case JSLOCATION_PROPERTY_ID_HASH:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->hash));\
+			break;\
+		case JSLOCATION_PROPERTY_ID_HOST:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->host));\
+			break;\
+		case JSLOCATION_PROPERTY_ID_HOSTNAME:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->hostname));\
+			break;\
+		case JSLOCATION_PROPERTY_ID_HREF:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->href));\
+			break;\
+		case JSLOCATION_PROPERTY_ID_ORIGIN:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->origin));\
+			break;\
+		case JSLOCATION_PROPERTY_ID_PATHNAME:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->pathname));\
+			break;\
+		case JSLOCATION_PROPERTY_ID_PROTOCOL:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->protocol));\
+			break;\
+		case JSLOCATION_PROPERTY_ID_SEARCH:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->search));\
+			break;
+
+#define JSLOCATION_SETPROP /* noop */
+
+#define JSLOCATION_PROPSPEC \
+		{ "hash",JSLOCATION_PROPERTY_ID_HASH,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "host",JSLOCATION_PROPERTY_ID_HOST,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "hostname",JSLOCATION_PROPERTY_ID_HOSTNAME,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "href",JSLOCATION_PROPERTY_ID_HREF,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "origin",JSLOCATION_PROPERTY_ID_ORIGIN,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "pathname",JSLOCATION_PROPERTY_ID_PATHNAME,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "protocol",JSLOCATION_PROPERTY_ID_PROTOCOL,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "search",JSLOCATION_PROPERTY_ID_SEARCH,JSPROP_ENUMERATE| JSPROP_READONLY }
+
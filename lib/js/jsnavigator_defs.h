@@ -0,0 +1,49 @@
+#define JSNAVIGATOR_PROPIDS \
+	JSNAVIGATOR_PROPERTY_ID_APPCODENAME=1,\
+	JSNAVIGATOR_PROPERTY_ID_APPNAME=2,\
+	JSNAVIGATOR_PROPERTY_ID_APPVERSION=3,\
+	JSNAVIGATOR_PROPERTY_ID_COOKIEENABLED=4,\
+	JSNAVIGATOR_PROPERTY_ID_GEOLOCATION=5,\
+	JSNAVIGATOR_PROPERTY_ID_ONLINE=6,\
+	JSNAVIGATOR_PROPERTY_ID_PLATFORM=7,\
+	JSNAVIGATOR_PROPERTY_ID_PRODUCT=8,\
+	JSNAVIGATOR_PROPERTY_ID_USERAGENT=9
+
+#define JSNAVIGATOR_GETPROP \
+		case JSNAVIGATOR_PROPERTY_ID_APPCODENAME:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->appCodeName));\
+			break;\
+		case JSNAVIGATOR_PROPERTY_ID_APPNAME:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->appName));\
+			break;\
+		case JSNAVIGATOR_PROPERTY_ID_APPVERSION:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->appVersion));\
+			break;\
+		case JSNAVIGATOR_PROPERTY_ID_COOKIEENABLED:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->cookieEnabled));\
+			break;\
+		case JSNAVIGATOR_PROPERTY_ID_ONLINE:\
+			*rval = BOOLEAN_TO_JSVAL(s->onLine);\
+			break;\
+		case JSNAVIGATOR_PROPERTY_ID_PLATFORM:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->platform));\
+			break;\
+		case JSNAVIGATOR_PROPERTY_ID_PRODUCT:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->product));\
+			break;\
+		case JSNAVIGATOR_PROPERTY_ID_USERAGENT:\
+			*rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx,s->userAgent));\
+			break;
+
+#define JSNAVIGATOR_SETPROP /* noop */
+
+#define JSNAVIGATOR_PROPSPEC \
+		{ "appCodeName",JSNAVIGATOR_PROPERTY_ID_APPCODENAME,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "appName",JSNAVIGATOR_PROPERTY_ID_APPNAME,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "appVersion",JSNAVIGATOR_PROPERTY_ID_APPVERSION,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "cookieEnabled",JSNAVIGATOR_PROPERTY_ID_COOKIEENABLED,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "onLine",JSNAVIGATOR_PROPERTY_ID_ONLINE,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "platform",JSNAVIGATOR_PROPERTY_ID_PLATFORM,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "product",JSNAVIGATOR_PROPERTY_ID_PRODUCT,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "userAgent",JSNAVIGATOR_PROPERTY_ID_USERAGENT,JSPROP_ENUMERATE| JSPROP_READONLY }
+
@@ -0,0 +1,92 @@
+#define JSWINDOW_PROPIDS \
+	JSWINDOW_PROPERTY_ID_CLOSED=1024,\
+	JSWINDOW_PROPERTY_ID_CONSOLE=1025,\
+	JSWINDOW_PROPERTY_ID_SEE=1026,\
+	JSWINDOW_PROPERTY_ID_DEFAULTSTATUS=1027,\
+	JSWINDOW_PROPERTY_ID_FRAMEELEMENT=1028,\
+	JSWINDOW_PROPERTY_ID_FRAMES=1029,\
+	JSWINDOW_PROPERTY_ID_HISTORY=1030,\
+	JSWINDOW_PROPERTY_ID_INNERHEIGHT=1031,\
+	JSWINDOW_PROPERTY_ID_INNERWIDTH=1032,\
+	JSWINDOW_PROPERTY_ID_LENGTH=1033,\
+	JSWINDOW_PROPERTY_ID_LOCALSTORAGE=1034,\
+	JSWINDOW_PROPERTY_ID_NAME=1035,\
+	JSWINDOW_PROPERTY_ID_OPENER=1036,\
+	JSWINDOW_PROPERTY_ID_OUTERHEIGHT=1037,\
+	JSWINDOW_PROPERTY_ID_OUTERWIDTH=1038,\
+	JSWINDOW_PROPERTY_ID_PAGEXOFFSET=1039,\
+	JSWINDOW_PROPERTY_ID_PAGEYOFFSET=1040,\
+	JSWINDOW_PROPERTY_ID_PARENT=1041,\
+	JSWINDOW_PROPERTY_ID_SCREENLEFT=1042,\
+	JSWINDOW_PROPERTY_ID_SCREENTOP=1043,\
+	JSWINDOW_PROPERTY_ID_SCREENX=1044,\
+	JSWINDOW_PROPERTY_ID_SCREENY=1045,\
+	JSWINDOW_PROPERTY_ID_SESSIONSTORAGE=1046,\
+	JSWINDOW_PROPERTY_ID_SCROLLX=1047,\
+	JSWINDOW_PROPERTY_ID_SCROLLY=1048,\
+	JSWINDOW_PROPERTY_ID_SELF=1049,\
+	JSWINDOW_PROPERTY_ID_STATUS=1050,\
+	JSWINDOW_PROPERTY_ID_TOP=1051
+
+#define JSWINDOW_GETPROP \
+		case JSWINDOW_PROPERTY_ID_CLOSED:\
+			*rval = BOOLEAN_TO_JSVAL(((jswindow_t *)s->private)->closed);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_INNERHEIGHT:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->innerHeight);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_INNERWIDTH:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->innerWidth);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_LENGTH:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->length);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_OUTERHEIGHT:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->outerHeight);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_OUTERWIDTH:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->outerWidth);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_PAGEXOFFSET:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->pageXOffset);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_PAGEYOFFSET:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->pageYOffset);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_SCREENLEFT:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->screenLeft);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_SCREENTOP:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->screenTop);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_SCREENX:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->screenX);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_SCREENY:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->screenY);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_SCROLLX:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->scrollX);\
+			break;\
+		case JSWINDOW_PROPERTY_ID_SCROLLY:\
+			*rval = INT_TO_JSVAL(((jswindow_t *)s->private)->scrollY);\
+			break;
+
+#define JSWINDOW_SETPROP /* noop */
+
+#define JSWINDOW_PROPSPEC \
+		{ "closed",JSWINDOW_PROPERTY_ID_CLOSED,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "innerHeight",JSWINDOW_PROPERTY_ID_INNERHEIGHT,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "innerWidth",JSWINDOW_PROPERTY_ID_INNERWIDTH,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "length",JSWINDOW_PROPERTY_ID_LENGTH,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "outerHeight",JSWINDOW_PROPERTY_ID_OUTERHEIGHT,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "outerWidth",JSWINDOW_PROPERTY_ID_OUTERWIDTH,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "pageXOffset",JSWINDOW_PROPERTY_ID_PAGEXOFFSET,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "pageYOffset",JSWINDOW_PROPERTY_ID_PAGEYOFFSET,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "screenLeft",JSWINDOW_PROPERTY_ID_SCREENLEFT,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "screenTop",JSWINDOW_PROPERTY_ID_SCREENTOP,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "screenX",JSWINDOW_PROPERTY_ID_SCREENX,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "screenY",JSWINDOW_PROPERTY_ID_SCREENY,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "scrollX",JSWINDOW_PROPERTY_ID_SCROLLX,JSPROP_ENUMERATE| JSPROP_READONLY },\
+		{ "scrollY",JSWINDOW_PROPERTY_ID_SCROLLY,JSPROP_ENUMERATE| JSPROP_READONLY }
+
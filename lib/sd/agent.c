@@ -12,6 +12,7 @@ LICENSE file in the root directory of this source tree.
 #include "debug.h"
 
 #include "agent.h"
+#include <pthread.h>
 
 #ifdef JS
 #include "jsobj.h"
@@ -33,6 +34,37 @@ LICENSE file in the root directory of this source tree.
 
 static list agents = 0;
 
+/* Several instances in one process (see agent_host_main) */
+static struct {
+	bool active;
+	pthread_mutex_t lock;		/* agents is also walked on the MQTT thread */
+	list agents;			/* In init order */
+	solard_agent_t *owner;		/* First instance - owns the shared reactor/session/runtime */
+} host = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int agent_host_add(solard_agent_t *ap) {
+	int r;
+
+	r = 1;
+	pthread_mutex_lock(&host.lock);
+	if (!host.agents) host.agents = list_create();
+	if (!host.agents) goto done;
+	if (host.owner) ap->hosted = true;
+	else host.owner = ap;
+	if (list_add(host.agents,ap,0)) r = 0;
+done:
+	pthread_mutex_unlock(&host.lock);
+	return r;
+}
+
+static void agent_host_remove(solard_agent_t *ap) {
+	if (!host.agents) return;
+	pthread_mutex_lock(&host.lock);
+	list_delete(host.agents,ap);
+	if (host.owner == ap) host.owner = 0;
+	pthread_mutex_unlock(&host.lock);
+}
+
 int agent_set_callback(solard_agent_t *ap, solard_agent_callback_t cb, void *ctx) {
 	ap->callback.func = cb;
 	ap->callback.ctx = ctx;
@@ -85,7 +117,7 @@ int agent_pub(solard_agent_t *ap, char *func, char *message, int retain) {
 	*topic = 0;
 	agent_mktopic(topic,sizeof(topic)-1,ap->instance_name,func);
         dprintf(dlevel,"topic: %s\n", topic);
-	if (mqtt_pub(ap->m,topic,message,1,retain)) {
+	if (mqtt_pub(ap->m,topic,message,0,retain)) {
 		log_error("agent_pub: mqtt_pub: %s\n", ap->m->errmsg);
 		return 1;
 	}
@@ -151,25 +183,31 @@ int agent_pubdata(solard_agent_t *ap, json_value_t *v) {
 
 	if (!ap->m->enabled) return 0;
 
-	dprintf(dlevel,"publishing data...\n");
+	if (ap->data_filter && ap->df) {
+		data = datafilter_apply(ap->df, json_value_object(v), monotime_ms());
+		if (!data) {
+			dprintf(dlevel,"nothing changed\n");
+			return 0;
+		}
+	} else {
+		data = json_dumps(v, ap->pretty);
+	}
+	if (!data) return 1;
 
-	data = json_dumps(v, 1);
+	dprintf(dlevel,"publishing data...\n");
 	r = agent_pub(ap, SOLARD_FUNC_DATA, data, 0);
 	free(data);
 	return r;
 }
 
-static int agent_process_message(solard_agent_t *ap, solard_message_t *msg) {
+/* Config requests sent to our top level topic (routed) */
+static int agent_process_message(void *ctx, solard_message_t *msg) {
+	solard_agent_t *ap = ctx;
 	char topic[SOLARD_TOPIC_LEN],*data,*name;
 	json_object_t *status;
 	int mdata;
 
-	/* XXX only process messages sent to our top level topic */
-	*topic = 0;
-	agent_mktopic(topic,sizeof(topic)-1,ap->instance_name,0);
-	dprintf(dlevel,"my topic: %s, msg topic: %s\n", topic, msg->topic);
-	if (strcmp(msg->topic,topic) != 0) return 1;
-
+	dprintf(dlevel,"msg topic: %s\n", msg->topic);
 	status = json_create_object();
 
 	config_process_request(ap->cp, msg->data, status);
@@ -190,19 +228,101 @@ static int agent_process_message(solard_agent_t *ap, solard_message_t *msg) {
 		if (!strlen(name)) name = "agent";
 		snprintf(topic,sizeof(topic)-1,"%s/%s/%s/%s",SOLARD_TOPIC_ROOT,SOLARD_TOPIC_CLIENTS,msg->replyto,name);
 		dprintf(dlevel,"topic: %s\n", topic);
-		mqtt_pub(ap->m,topic,data,1,0);
+		mqtt_pubcorr(ap->m,topic,data,msg->corrid);
 		if (mdata) free(data);
 	}
 	json_destroy_object(status);
 	return 0;
 }
 
+/* (Re)register our config route when the instance name changes */
+static void agent_update_route(solard_agent_t *ap) {
+	char topic[SOLARD_TOPIC_LEN];
+
+	if (strcmp(ap->route_name,ap->instance_name) == 0 && router_count(ap->router)) return;
+	if (router_count(ap->router)) {
+		*topic = 0;
+		agent_mktopic(topic,sizeof(topic)-1,ap->route_name,0);
+		router_remove(ap->router,topic,agent_process_message,ap);
+	}
+	*topic = 0;
+	agent_mktopic(topic,sizeof(topic)-1,ap->instance_name,0);
+	dprintf(dlevel,"route: %s\n", topic);
+	router_add(ap->router,topic,agent_process_message,ap,0);
+	strcpy(ap->route_name,ap->instance_name);
+}
+
 static void agent_getmsg(void *ctx, char *topic, char *message, int msglen, char *replyto) {
 	solard_agent_t *ap = ctx;
-	solard_message_t newmsg;
+	solard_message_t *msg;
+
+	msg = solard_message_new(topic,message,msglen,replyto);
+	if (!msg) return;
+	if (rpc_intercept(ap->m,msg) == 0) {
+		solard_message_unref(msg);
+		return;
+	}
+	/* Runs on the MQTT thread - hand off to the agent thread */
+	if (inbox_put(ap->inbox,msg) == 0) agent_wakeup(ap);
+}
+
+/* Is topic at or under the instance's own topic */
+static int agent_host_topic(solard_agent_t *ap, char *topic) {
+	char base[SOLARD_TOPIC_LEN];
+	int len;
+
+	*base = 0;
+	agent_mktopic(base,sizeof(base)-1,ap->instance_name,0);
+	len = strlen(base);
+	return (strncmp(topic,base,len) == 0 && (topic[len] == 0 || topic[len] == '/'));
+}
+
+/* Shared session callback (ctx is the owner).  Messages under an instance's
+   own topic only go to that instance, anything else goes to all of them */
+static void agent_host_getmsg(void *ctx, char *topic, char *message, int msglen, char *replyto) {
+	solard_agent_t *owner = ctx;
+	solard_agent_t *ap,*target;
+	solard_message_t *msg;
+	list_iter_t it;
+	int wake;
+
+	msg = solard_message_new(topic,message,msglen,replyto);
+	if (!msg) return;
+	if (rpc_intercept(owner->m,msg) == 0) {
+		solard_message_unref(msg);
+		return;
+	}
+	wake = 0;
+	pthread_mutex_lock(&host.lock);
+	target = 0;
+	list_iter_init(&it,host.agents);
+	while((ap = list_iter_next(&it)) != 0) {
+		if (agent_host_topic(ap,topic)) {
+			target = ap;
+			break;
+		}
+	}
+	list_iter_init(&it,host.agents);
+	while((ap = list_iter_next(&it)) != 0) {
+		if ((target && ap != target) || !ap->inbox) continue;
+		if (inbox_put(ap->inbox,solard_message_ref(msg)) == 0) wake = 1;
+	}
+	pthread_mutex_unlock(&host.lock);
+	solard_message_unref(msg);
+	if (wake) reactor_wakeup(owner->r);
+}
 
-	if (solard_getmsg(&newmsg,topic,message,msglen,replyto)) return;
-	list_add(ap->mq,&newmsg,sizeof(newmsg));
+/* Move anything the MQTT thread received into mq (agent thread only) */
+static list agent_get_mq(solard_agent_t *ap) {
+	inbox_stats_t stats;
+
+	inbox_drain(ap->inbox,ap->mq);
+	inbox_get_stats(ap->inbox,&stats);
+	if (stats.dropped != ap->dropped) {
+		log_warning("agent: inbox full, %lu messages dropped\n", stats.dropped - ap->dropped);
+		ap->dropped = stats.dropped;
+	}
+	return ap->mq;
 }
 #else
 int agent_pubconfig(solard_agent_t *ap) { return 0; }
@@ -233,7 +353,7 @@ void agent_event(solard_agent_t *ap, char *module, char *action) {
 			char topic[SOLARD_TOPIC_SIZE];
 			*topic = 0;
 			agent_mktopic(topic,sizeof(topic)-1,ap->instance_name,"Event");
-			mqtt_pub(ap->m,topic,event,1,0);
+			mqtt_pub(ap->m,topic,event,0,0);
 			free(event);
 		}
 	}
@@ -272,6 +392,8 @@ int agent_get_info(solard_agent_t *ap, int info_flag, int pub) {
 int agent_repub(solard_agent_t *ap) {
 	agent_get_info(ap, false, true);
 	agent_pubconfig(ap);
+	/* Next Data is a full keyframe */
+	datafilter_reset(ap->df);
 //	agent_event(ap,"Agent","repub");
 	return 0;
 }
@@ -383,6 +505,61 @@ static int cf_agent_repub(void *ctx, list args, char *errmsg, json_object_t *res
 	return agent_repub(ctx);
 }
 
+/* Per task timing */
+static int cf_agent_tasks(void *ctx, list args, char *errmsg, json_object_t *results) {
+	solard_agent_t *ap = ctx;
+	scheduler_stats_t *stats;
+	json_array_t *a;
+	json_object_t *o;
+	int count,i;
+
+	count = scheduler_count(ap->sched);
+	a = json_create_array();
+	if (!a) return 1;
+	if (count) {
+		stats = malloc(count * sizeof(*stats));
+		if (!stats) {
+			json_destroy_array(a);
+			sprintf(errmsg,"malloc: %s",strerror(errno));
+			return 1;
+		}
+		count = scheduler_get_stats(ap->sched, stats, count);
+		for(i=0; i < count; i++) {
+			o = json_create_object();
+			if (!o) break;
+			json_object_set_string(o,"name",stats[i].name);
+			json_object_set_number(o,"period",stats[i].period);
+			json_object_set_number(o,"priority",stats[i].priority);
+			json_object_set_number(o,"jitter",stats[i].jitter);
+			json_object_set_number(o,"runs",stats[i].runs);
+			json_object_set_number(o,"late",stats[i].late);
+			json_object_set_number(o,"late_max",stats[i].late_max);
+			json_object_set_number(o,"overruns",stats[i].overruns);
+			json_object_set_number(o,"skipped",stats[i].skipped);
+			json_object_set_number(o,"run_avg",(stats[i].runs ? stats[i].run_total / stats[i].runs : 0));
+			json_object_set_number(o,"run_max",stats[i].run_max);
+			json_array_add_object(a,o);
+		}
+		free(stats);
+	}
+	json_object_set_array(results,"tasks",a);
+	return 0;
+}
+
+static int cf_agent_stats(void *ctx, list args, char *errmsg, json_object_t *results) {
+	solard_agent_t *ap = ctx;
+	json_object_t *o;
+
+	if (!ap->stats || ap->stats_interval <= 0) {
+		strcpy(errmsg,"stats are not enabled (set stats_interval)");
+		return 1;
+	}
+	o = stats_to_json(ap->stats,0);
+	if (!o) return 1;
+	json_object_set_object(results,"stats",o);
+	return 0;
+}
+
 
 int cf_agent_log_open(void *ctx, list args, char *errmsg, json_object_t *results) {
 	solard_agent_t *ap = ctx;
@@ -528,13 +705,136 @@ static int set_script_dir(void *ctx, config_property_t *p, void *old_value) {
 }
 #endif
 
+/* Publish the latest typed data to the local data plane (if enabled) */
+int agent_pubshm(solard_agent_t *ap, int type, void *data, int size) {
+	char *name;
+
+	if (!ap->local_data) {
+		if (ap->shm) {
+			shmdata_close(ap->shm);
+			ap->shm = 0;
+		}
+		return 0;
+	}
+	name = strlen(ap->instance_name) ? ap->instance_name : ap->name;
+	/* Re-create if the name or layout changed */
+	if (ap->shm && (shmdata_type(ap->shm) != type || shmdata_size(ap->shm) != size || strcmp(shmdata_name(ap->shm),name) != 0)) {
+		shmdata_close(ap->shm);
+		ap->shm = 0;
+	}
+	if (!ap->shm) {
+		ap->shm = shmdata_create(name, ap->driver->name, type, size);
+		if (!ap->shm) return 1;
+	}
+	dprintf(dlevel,"publishing local data...\n");
+	shmdata_set_interval(ap->shm, ap->interval * 1000);
+	return shmdata_write(ap->shm, data);
+}
+
+/* Publish the last interval's histograms and start over */
+static void agent_stats_task(void *ctx) {
+	solard_agent_t *ap = ctx;
+	json_object_t *o,*so;
+#ifdef MQTT
+	char *data;
+#endif
+
+	so = stats_to_json(ap->stats,1);
+	if (!so) return;
+	o = json_create_object();
+	if (!o) {
+		json_destroy_object(so);
+		return;
+	}
+	json_object_set_number(o,"interval",ap->stats_interval);
+	json_object_set_object(o,"stats",so);
+#ifdef MQTT
+	data = json_dumps(json_object_value(o), 1);
+	if (data) {
+		agent_pub(ap, SOLARD_FUNC_STATS, data, 0);
+		free(data);
+	}
+#endif
+	json_destroy_object(o);
+}
+
+/* Hook up (or unhook) the histograms.  They're only freed on destroy as other
+   threads (MQTT, influx writer) may be recording into them. */
+static int agent_stats_update(solard_agent_t *ap) {
+	dprintf(dlevel,"stats_interval: %d\n", ap->stats_interval);
+	if (ap->stats_interval > 0) {
+		if (!ap->stats) {
+			ap->stats = stats_create();
+			if (!ap->stats) return 1;
+		}
+		ap->hist.read = stats_get(ap->stats,"read","us");
+		ap->hist.read_script = stats_get(ap->stats,"read_script","us");
+		ap->hist.write = stats_get(ap->stats,"write","us");
+		ap->hist.write_script = stats_get(ap->stats,"write_script","us");
+		ap->hist.run_script = stats_get(ap->stats,"run_script","us");
+		ap->hist.messages = stats_get(ap->stats,"messages","us");
+		ap->hist.tasks = stats_get(ap->stats,"tasks","us");
+		ap->hist.loop = stats_get(ap->stats,"loop","us");
+		ap->hist.js_gc = stats_get(ap->stats,"js_gc","us");
+		ap->hist.mqtt_pub = stats_get(ap->stats,"mqtt_pub","us");
+		ap->hist.mqtt_ack = stats_get(ap->stats,"mqtt_ack","us");
+		ap->hist.influx_write = stats_get(ap->stats,"influx_write","us");
+		ap->hist.mq_depth = stats_get(ap->stats,"mq_depth",0);
+		ap->hist.mqtt_buffer = stats_get(ap->stats,"mqtt_buffer",0);
+		if (agent_add_task(ap,"stats",ap->stats_interval * 1000,-10,1000,0,agent_stats_task,ap)) return 1;
+	} else {
+		memset(&ap->hist,0,sizeof(ap->hist));
+		agent_del_task(ap,"stats");
+	}
+#ifdef MQTT
+	/* Hosted instances share the owner's session (and its histograms) */
+	if (ap->m && !ap->hosted) {
+		ap->m->pub_hist = ap->hist.mqtt_pub;
+		ap->m->ack_hist = ap->hist.mqtt_ack;
+	}
+#endif
+#ifdef INFLUX
+	if (ap->i) influx_set_stats(ap->i,ap->hist.influx_write);
+#endif
+	return 0;
+}
+
+static int agent_stats_set(void *ctx, config_property_t *p, void *old_value) {
+	return agent_stats_update(ctx);
+}
+
+static int agent_datafilter_set(void *ctx, config_property_t *p, void *old_value) {
+	solard_agent_t *ap = ctx;
+
+	dprintf(dlevel,"data_filter: %d, data_delta: %d, data_rules: %s, data_keyframe: %d\n",
+		ap->data_filter, ap->data_delta, ap->data_rules, ap->data_keyframe);
+	if (!ap->data_filter) return 0;
+	if (!ap->df) {
+		ap->df = datafilter_create();
+		if (!ap->df) return 1;
+	}
+	datafilter_set_rules(ap->df, ap->data_rules);
+	datafilter_set_keyframe(ap->df, ap->data_keyframe);
+	datafilter_set_delta(ap->df, ap->data_delta);
+	datafilter_reset(ap->df);
+	return 0;
+}
+
+#ifdef MQTT
+static int agent_inbox_set(void *ctx, config_property_t *p, void *old_value) {
+	solard_agent_t *ap = ctx;
+
+	return inbox_set_latest(ap->inbox, ap->inbox_latest);
+}
+#endif
+
 config_property_t *agent_get_props(solard_agent_t *ap) {
 	config_property_t agent_props[] = {
 		/* name, type, dest, dsize, def, flags, scope, values, labels, units, scale, precision */
 		{ "driver_name", DATA_TYPE_STRING, ap->name, sizeof(ap->name)-1, 0, CONFIG_FLAG_PRIVATE },
 		{ "name", DATA_TYPE_STRING, ap->instance_name, sizeof(ap->instance_name)-1, 0 },
 		{ "configfile", DATA_TYPE_STRING, ap->configfile, sizeof(ap->configfile)-1, 0, CONFIG_FLAG_NOSAVE, 0, 0, 0, 0, 0, 0, agent_configfile_set, ap },
-		{ "interval", DATA_TYPE_INT, &ap->interval, 0, "30", 0, "range", "0, 99999, 1", 0, "S", 1, 0 },
+		{ "interval", DATA_TYPE_DOUBLE, &ap->interval, 0, "30", 0, "range", "0, 99999, 0.1", 0, "S", 1, 0 },
 #ifdef DEBUG_MEM
 		{ "debug_mem", DATA_TYPE_BOOL, &ap->debug_mem, 0, "no", 0 },
 		{ "debug_mem_always", DATA_TYPE_BOOL, &ap->debug_mem_always, 0, "no", 0 },
@@ -543,8 +843,15 @@ config_property_t *agent_get_props(solard_agent_t *ap) {
 		{ "run_count", DATA_TYPE_INT, &ap->run_count, 0, 0, CONFIG_FLAG_READONLY },
 		{ "read_count", DATA_TYPE_INT, &ap->read_count, 0, 0, CONFIG_FLAG_READONLY },
 		{ "write_count", DATA_TYPE_INT, &ap->write_count, 0, 0, CONFIG_FLAG_READONLY },
+		{ "local_data", DATA_TYPE_BOOL, &ap->local_data, 0, "no", 0, "select", "0, 1", "publish data to local shared memory" },
+		{ "data_filter", DATA_TYPE_BOOL, &ap->data_filter, 0, "no", 0, "select", "0, 1", "only publish data that changed", 0, 0, 0, agent_datafilter_set, ap },
+		{ "data_delta", DATA_TYPE_BOOL, &ap->data_delta, 0, "no", 0, "select", "0, 1", "publish only changed fields between keyframes", 0, 0, 0, agent_datafilter_set, ap },
+		{ "data_rules", DATA_TYPE_STRING, ap->data_rules, sizeof(ap->data_rules)-1, "*=0", 0, 0, 0, "name=deadband[:min[:max]],...", 0, 0, 0, agent_datafilter_set, ap },
+		{ "data_keyframe", DATA_TYPE_INT, &ap->data_keyframe, 0, "60", 0, "range", "1, 86400, 1", "full data at least every N seconds", "S", 1, 0, agent_datafilter_set, ap },
+		{ "stats_interval", DATA_TYPE_INT, &ap->stats_interval, 0, "0", 0, "range", "0, 86400, 1", "publish Stats every N seconds (0 = off)", "S", 1, 0, agent_stats_set, ap },
 #ifdef MQTT
 		{ "purge", DATA_TYPE_BOOL, &ap->purge, 0, "true", 0 },
+		{ "inbox_latest", DATA_TYPE_STRING, ap->inbox_latest, sizeof(ap->inbox_latest)-1, 0, 0, 0, 0, "topic[#],... only the newest queued message is kept", 0, 0, 0, agent_inbox_set, ap },
 #endif
 #ifdef JS
 		{ "rtsize", DATA_TYPE_INT, &ap->js.rtsize, 0, 0, CONFIG_FLAG_READONLY },
@@ -571,6 +878,8 @@ static int agent_startup(solard_agent_t *ap, char *mqtt_info, char *influx_info,
 		{ "ping", cf_agent_ping, ap, 0 },
 		{ "exit", cf_agent_exit, ap, 0 },
 		{ "repub", cf_agent_repub, ap, 0 },
+		{ "tasks", cf_agent_tasks, ap, 0 },
+		{ "stats", cf_agent_stats, ap, 0 },
 		{ "get", agent_config_get_value, ap, 1 },
 		{ "set", agent_service_set, ap, 2 },
 		{ "clear", agent_service_clear, ap, 1 },
@@ -609,6 +918,8 @@ static int agent_startup(solard_agent_t *ap, char *mqtt_info, char *influx_info,
 #ifdef MQTT
 	/* Create LWT topic */
 	mptr = (ap->flags & AGENT_FLAG_NOMQTT ? 0 : &ap->m);
+	/* Hosted instances use the owner's session */
+	if (ap->hosted) mptr = 0;
 	*lwt = *old_name = 0;
 	agent_mktopic(lwt,sizeof(lwt)-1,ap->instance_name,"Status");
 	strcpy(old_name,ap->instance_name);
@@ -620,10 +931,15 @@ static int agent_startup(solard_agent_t *ap, char *mqtt_info, char *influx_info,
 	jptr = (ap->flags & AGENT_FLAG_NOJS ? 0 : &ap->js.e);
 #endif
 
+#ifdef JS
+	/* Hosted instances get their own context/global in the owner's runtime */
+	if (ap->hosted) JS_EngineShareRuntime(host.owner->js.e);
+#endif
+
         /* Call common startup */
 	if (solard_common_startup(&ap->cp, ap->section_name, ap->configfile, ap->props, ap->funcs, eptr
 #ifdef MQTT
-		,mptr, lwt, agent_getmsg, ap, mqtt_info, ap->config_from_mqtt
+		,mptr, lwt, (host.active ? agent_host_getmsg : agent_getmsg), ap, mqtt_info, ap->config_from_mqtt
 #endif
 #ifdef INFLUX
 		,iptr, influx_info
@@ -631,7 +947,18 @@ static int agent_startup(solard_agent_t *ap, char *mqtt_info, char *influx_info,
 #ifdef JS
 		,jptr, ap->js.rtsize, ap->js.stksize, (js_outputfunc_t *)log_info
 #endif
-	)) return 1;
+	)) {
+#ifdef JS
+		JS_EngineShareRuntime(0);
+#endif
+		return 1;
+	}
+#ifdef JS
+	JS_EngineShareRuntime(0);
+#endif
+#ifdef MQTT
+	if (ap->hosted && !(ap->flags & AGENT_FLAG_NOMQTT)) ap->m = host.owner->m;
+#endif
 
 #ifdef JS
 	/* See if the driver has an engine ptr */
@@ -642,7 +969,7 @@ static int agent_startup(solard_agent_t *ap, char *mqtt_info, char *influx_info,
 #ifdef MQTT
 	/* If name changed (from config), re-register new LWT */
 	dprintf(dlevel,"name: %s, instance_name: %s\n", old_name, ap->instance_name);
-	if (strcmp(ap->instance_name,old_name) != 0 && ap->m->enabled) {
+	if (strcmp(ap->instance_name,old_name) != 0 && !ap->hosted && ap->m->enabled) {
 		char new_topic[SOLARD_TOPIC_SIZE];
 
 		*new_topic = 0;
@@ -651,6 +978,10 @@ static int agent_startup(solard_agent_t *ap, char *mqtt_info, char *influx_info,
 	}
 #endif
 
+#ifdef INFLUX
+	if (ap->i) influx_set_spool_name(ap->i, ap->instance_name);
+#endif
+
 	/* Agent libdir */
 	sprintf(ap->agent_libdir,"%s/agents/%s",SOLARD_LIBDIR,ap->name);
 
@@ -672,7 +1003,11 @@ void agent_destroy_agent(solard_agent_t *ap) {
 	dprintf(ldlevel,"ap: %p\n", ap);
 	if (!ap) return;
 
+	/* Before the inbox goes - the shared session delivers to everything in the host */
+	agent_host_remove(ap);
 	if (ap->info) json_destroy_value(ap->info);
+	/* Before JS - tasks may hold JS roots */
+	scheduler_destroy(ap->sched);
 	/* XXX JS must come first because finialize is called on CTOR sessions */
 #ifdef JS
 	dprintf(ldlevel,"roots: %p\n", ap->js.roots);
@@ -693,9 +1028,13 @@ void agent_destroy_agent(solard_agent_t *ap) {
 	if (ap->cp) config_destroy_config(ap->cp);
 #ifdef MQTT
 	dprintf(ldlevel,"m: %p\n", ap->m);
-	if (ap->m) mqtt_destroy_session(ap->m);
+	if (ap->m && !ap->hosted) mqtt_destroy_session(ap->m);
+	inbox_destroy(ap->inbox);
 	list_destroy(ap->mq);
+	router_destroy(ap->router);
 #endif
+	if (!ap->hosted) reactor_destroy(ap->r);
+	shmdata_close(ap->shm);
 #ifdef INFLUX
 	dprintf(ldlevel,"i: %p\n", ap->i);
 	if (ap->i) influx_destroy_session(ap->i);
@@ -703,6 +1042,9 @@ void agent_destroy_agent(solard_agent_t *ap) {
 	dprintf(ldlevel,"e: %p\n", ap->e);
 	if (ap->e) event_destroy(ap->e);
 	if (ap->aliases) list_destroy(ap->aliases);
+	/* After MQTT/influx - they record into it */
+	stats_destroy(ap->stats);
+	datafilter_destroy(ap->df);
 
 #ifdef JS
 	if (ap->js.e) {
@@ -838,8 +1180,18 @@ solard_agent_t *agent_init(int argc, char **argv, char *agent_version, opt_proct
 	ap->driver = Cdriver;
 	ap->handle = handle;
 	ap->flags = flags;
+	if (host.active && agent_host_add(ap)) goto agent_init_error;
+	/* Hosted instances share the owner's reactor */
+	ap->r = (ap->hosted ? host.owner->r : reactor_create());
+	if (!ap->r) goto agent_init_error;
+	ap->sched = scheduler_create();
+	if (!ap->sched) goto agent_init_error;
 #ifdef MQTT
-	ap->mq = list_create();
+	ap->inbox = inbox_create(INBOX_DEFAULT_SIZE);
+	if (!ap->inbox) goto agent_init_error;
+	ap->mq = solard_message_list_create();
+	ap->router = router_create();
+	if (!ap->router) goto agent_init_error;
 	ap->config_from_mqtt = config_from_mqtt;
 	strcpy(ap->mqtt_topic,mqtt_topic);
 #endif
@@ -894,6 +1246,8 @@ solard_agent_t *agent_init(int argc, char **argv, char *agent_version, opt_proct
 
 	/* Call common startup */
 	if (agent_startup(ap, mqtt_info, influx_info, driver_props, driver_funcs)) goto agent_init_error;
+	/* stats_interval may have been set before the sessions existed */
+	if (agent_stats_update(ap)) goto agent_init_error;
 
 	/* If name was specified in config file, make sure it's "dirty" in config */
 	if (strlen(name) && ap->cp) config_set_property(ap->cp,ap->section_name,"name",DATA_TYPE_STRING,name,strlen(name));
@@ -966,178 +1320,293 @@ agent_init_error:
 	return 0;
 }
 
-int agent_run(solard_agent_t *ap) {
-#ifdef MQTT
-	solard_message_t *msg;
+void agent_wakeup(solard_agent_t *ap) {
+	if (ap) reactor_wakeup(ap->r);
+}
+
+int agent_add_fd(solard_agent_t *ap, int fd, reactor_func_t *func, void *ctx) {
+	return reactor_add_fd(ap->r, fd, func, ctx);
+}
+
+int agent_del_fd(solard_agent_t *ap, int fd) {
+	return reactor_del_fd(ap->r, fd);
+}
+
+/* Run func every period ms (or once after period ms with SCHEDULER_FLAG_ONESHOT) from the agent thread */
+int agent_add_task(solard_agent_t *ap, char *name, int period, int priority, int jitter, int flags, scheduler_func_t *func, void *ctx) {
+	if (!scheduler_add(ap->sched, name, period, priority, jitter, flags, func, ctx, 0)) return 1;
+	/* Recompute the sleep deadline */
+	reactor_wakeup(ap->r);
+	return 0;
+}
+
+int agent_del_task(solard_agent_t *ap, char *name) {
+	return scheduler_remove(ap->sched, name);
+}
+
+static int agent_read(solard_agent_t *ap) {
+	uint64_t start;
+	int read_status;
+
+	read_status = 0;
+	if (ap->driver) {
+		dprintf(dlevel,"open_before_read: %d, open: %p\n", AGENT_HASFLAG(OBREAD), ap->driver->open);
+		if (AGENT_HASFLAG(OBREAD) && ap->driver->open) {
+			if (ap->driver->open(ap->handle)) {
+				log_error("agent_run: open for read failed\n");
+				return -1;
+			}
+		}
+		dprintf(dlevel,"read: %p\n", ap->driver->read);
+		if (ap->driver->read) {
+			start = (ap->hist.read ? monotime_us() : 0);
+			read_status = ap->driver->read(ap->handle,0,0,0);
+			stats_hist_since(ap->hist.read,start);
+		}
+		dprintf(dlevel,"driver read_status: %d\n", read_status);
+	}
+#ifdef JS
+	/* Only call script if driver didnt error */
+	if (read_status == 0) {
+		dprintf(dlevel,"read_script: %s\n", ap->js.read_script);
+		if (agent_script_exists(ap,ap->js.read_script)) {
+			start = (ap->hist.read_script ? monotime_us() : 0);
+			read_status = agent_start_script(ap,ap->js.read_script);
+			stats_hist_since(ap->hist.read_script,start);
+			dprintf(dlevel,"script read_status: %d\n", read_status);
+			if (ap->js.ignore_js_errors) read_status = 0;
+		}
+	}
 #endif
-	int read_status,write_status;
-	time_t last_read,cur,diff;
-#ifdef DEBUG_MEM
-	int used,last_used,peak,last_peak;
+	if (ap->driver) {
+		dprintf(dlevel,"close_after_read: %d, close: %p\n", AGENT_HASFLAG(CAREAD), ap->driver->close);
+		if (AGENT_HASFLAG(CAREAD) && ap->driver->close) ap->driver->close(ap->handle);
+	}
+	ap->read_count++;
+	return read_status;
+}
+
+static int agent_write(solard_agent_t *ap) {
+	uint64_t start;
+	int write_status;
+
+	write_status = 0;
+	if (ap->driver) {
+		dprintf(dlevel,"flags: 0x%04x\n", ap->flags);
+		dprintf(dlevel,"open_before_write: %d, open: %p\n", AGENT_HASFLAG(OBWRITE), ap->driver->open);
+		if (AGENT_HASFLAG(OBWRITE) && ap->driver->open) {
+			if (ap->driver->open(ap->handle)) {
+				log_error("agent_run: open for write failed\n");
+				return -1;
+			}
+		}
+		dprintf(dlevel,"write: %p\n", ap->driver->write);
+		if (ap->driver->write) {
+			start = (ap->hist.write ? monotime_us() : 0);
+			write_status = ap->driver->write(ap->handle,0,0,0);
+			stats_hist_since(ap->hist.write,start);
+		}
+		dprintf(dlevel,"driver write_status: %d\n", write_status);
+	}
+#ifdef JS
+	/* Only call script if driver didnt error */
+	if (write_status == 0) {
+		dprintf(dlevel,"write_script: %s\n", ap->js.write_script);
+		if (agent_script_exists(ap,ap->js.write_script)) {
+			start = (ap->hist.write_script ? monotime_us() : 0);
+			write_status = agent_start_script(ap,ap->js.write_script);
+			stats_hist_since(ap->hist.write_script,start);
+			dprintf(dlevel,"script write_status: %d\n", write_status);
+			if (ap->js.ignore_js_errors) write_status = 0;
+		}
+	}
 #endif
+	if (ap->driver) {
+		dprintf(dlevel,"close_after_write: %d, close: %p\n", AGENT_HASFLAG(CAWRITE), ap->driver->close);
+		if (AGENT_HASFLAG(CAWRITE) && ap->driver->close) ap->driver->close(ap->handle);
+	}
+	dprintf(dlevel,"write_status: %d\n", write_status);
+	if (write_status) dprintf(dlevel,"write failed!\n");
+	ap->write_count++;
+	return write_status;
+}
+
+#define AGENT_TICK_MS 1000
+
+/* Get ready to run: start script, initial GC and deadlines */
+int agent_start(solard_agent_t *ap) {
+	uint64_t now;
 
 	dprintf(dlevel,"ap: %p\n", ap);
 #ifdef JS
 	if (agent_script_exists(ap,ap->js.start_script)) agent_start_script(ap,ap->js.start_script);
 #endif
 
-	last_read = 0;
 #ifdef JS
 	/* Do a GC before we start */
 	dprintf(dlevel,"Cleaning up...\n");
 	JS_EngineCleanup(ap->js.e);
 	dprintf(dlevel,"back...\n");
 #endif
-#ifdef DEBUG_MEM
-	peak = last_peak = last_used = 0;
-#endif
+	ap->loop.peak = ap->loop.last_peak = ap->loop.last_used = 0;
 	set_state(ap,SOLARD_AGENT_STATE_RUNNING);
 	ap->run_count = ap->read_count = ap->write_count = 0;
 	dprintf(dlevel,"Starting...\n");
 	agent_event(ap,"Agent","Start");
 	dprintf(dlevel,"state: %d\n", ap->state);
-	while(check_state(ap,SOLARD_AGENT_STATE_RUNNING)) {
+
+	/* All deadlines are on the monotonic clock (ms) */
+	now = monotime_ms();
+	ap->loop.read = ap->loop.tick = now;
 #ifdef JS
-		/* Check every 10s if any of the JS loaded scripts have been updated and if so reload them */
-		if (ap->js.e && (ap->run_count % 10) == 0) {
-			dprintf(dlevel,"Checking if loaded JS scripts have been updated....\n");
-			JS_EngineCheckLoaded(ap->js.e);
-		}
+	ap->loop.check = now + 10000;
+	ap->loop.gc = now + (ap->js.gc_interval > 0 ? ap->js.gc_interval * 1000 : 0);
 #endif
+	ap->loop.started = true;
+	return 0;
+}
+
+/* One pass of the run loop.  Returns the deadline (monotime_ms) to wait for, 0 to go again now */
+uint64_t agent_step(solard_agent_t *ap) {
+#ifdef MQTT
+	solard_message_t *msg;
+	list_iter_t mit;
+#endif
+	int read_status;
+	uint64_t now,next_task,deadline,start,busy,period;
+	bool need_tick;
+#ifdef DEBUG_MEM
+	int used;
+#endif
+
+	now = monotime_ms();
+	busy = (ap->hist.loop ? monotime_us() : 0);
 
-		/* Call read func */
-		time(&cur);
-		diff = cur - last_read;
-		/* only write if read is successful */
-		dprintf(dlevel,"diff: %d, interval: %d\n", (int)diff, ap->interval);
-		read_status = 0;
-		if (diff >= ap->interval) {
-			if (ap->driver) {
-				dprintf(dlevel,"open_before_read: %d, open: %p\n", AGENT_HASFLAG(OBREAD), ap->driver->open);
-				if (AGENT_HASFLAG(OBREAD) && ap->driver->open) {
-					if (ap->driver->open(ap->handle)) {
-						log_error("agent_run: open for read failed\n");
-						/* make sure we wait the correct amount */
-						time(&last_read);
-						continue;
-					}
-				}
-				dprintf(dlevel,"read: %p\n", ap->driver->read);
-				if (ap->driver->read) read_status = ap->driver->read(ap->handle,0,0,0);
-				dprintf(dlevel,"driver read_status: %d\n", read_status);
-			}
 #ifdef JS
-			/* Only call script if driver didnt error */
-			if (read_status == 0) {
-				dprintf(dlevel,"read_script: %s\n", ap->js.read_script);
-				if (agent_script_exists(ap,ap->js.read_script)) {
-					read_status = agent_start_script(ap,ap->js.read_script);
-					dprintf(dlevel,"script read_status: %d\n", read_status);
-					if (ap->js.ignore_js_errors) read_status = 0;
-				}
-			}
+	/* Check every 10s if any of the JS loaded scripts have been updated and if so reload them */
+	if (ap->js.e && now >= ap->loop.check) {
+		dprintf(dlevel,"Checking if loaded JS scripts have been updated....\n");
+		JS_EngineCheckLoaded(ap->js.e);
+		ap->loop.check = now + 10000;
+	}
 #endif
-			if (ap->driver) {
-				dprintf(dlevel,"close_after_read: %d, close: %p\n", AGENT_HASFLAG(CAREAD), ap->driver->close);
-				if (AGENT_HASFLAG(CAREAD) && ap->driver->close) ap->driver->close(ap->handle);
-			}
-			time(&last_read);
-			ap->read_count++;
-		}
 
+	if (ap->refresh) {
+		ap->loop.read = now;
+		ap->refresh = false;
+	}
+
+	/* Tasks with their own period */
+	start = (ap->hist.tasks ? monotime_us() : 0);
+	if (scheduler_run(ap->sched, now)) stats_hist_since(ap->hist.tasks,start);
+
+	/* Call read func */
+	dprintf(dlevel,"now: %llu, next_read: %llu, interval: %.3f\n", (unsigned long long)now, (unsigned long long)ap->loop.read, ap->interval);
+	read_status = 1;
+	if (now >= ap->loop.read) {
+		/* Schedule from the deadline (not now) so the cadence doesnt drift */
+		period = (uint64_t)(ap->interval * 1000.0);
+		if (period < 1) period = AGENT_TICK_MS;
+		ap->loop.read += period;
+		if (ap->loop.read <= now) ap->loop.read = now + period;
+		read_status = agent_read(ap);
+	}
+
+	/* Callback and run script keep their 1s cadence */
+	need_tick = (ap->callback.func != 0);
+#ifdef JS
+	if (!need_tick) need_tick = agent_script_exists(ap,ap->js.run_script);
+#endif
+	if (now >= ap->loop.tick) {
 		/* Call cb */
 		dprintf(dlevel+1,"func: %p\n", ap->callback.func);
 		if (ap->callback.func) ap->callback.func(ap->callback.ctx);
 
 #ifdef JS
 		/* Call run script */
-		if (agent_script_exists(ap,ap->js.run_script)) agent_start_script(ap,ap->js.run_script);
+		if (agent_script_exists(ap,ap->js.run_script)) {
+			start = (ap->hist.run_script ? monotime_us() : 0);
+			agent_start_script(ap,ap->js.run_script);
+			stats_hist_since(ap->hist.run_script,start);
+		}
 #endif
+		ap->loop.tick = now + AGENT_TICK_MS;
+	}
 
 #ifdef MQTT
-		/* Process messages */
-		dprintf(dlevel+1,"mq count: %d\n", list_count(ap->mq));
-		list_reset(ap->mq);
-		while((msg = list_get_next(ap->mq)) != 0) {
-//			solard_message_dump(msg,0);
-			if (agent_process_message(ap,msg) == 0 || ap->purge) {
-				dprintf(dlevel,"deleting message...\n");
-				list_delete(ap->mq,msg);
-			}
+	/* Process messages */
+	agent_get_mq(ap);
+	dprintf(dlevel+1,"mq count: %d\n", list_count(ap->mq));
+	if (ap->hist.mq_depth) {
+		stats_hist_record(ap->hist.mq_depth,list_count(ap->mq));
+		if (ap->m) stats_hist_record(ap->hist.mqtt_buffer,mqtt_buffer_count(ap->m->buffer));
+	}
+	agent_update_route(ap);
+	start = (ap->hist.messages && list_count(ap->mq) ? monotime_us() : 0);
+	list_iter_init(&mit,ap->mq);
+	while((msg = list_iter_next(&mit)) != 0) {
+//		solard_message_dump(msg,0);
+		if (router_dispatch(ap->router,msg) || ap->purge) {
+			dprintf(dlevel,"deleting message...\n");
+			list_delete(ap->mq,msg);
 		}
+	}
+	if (start) stats_hist_since(ap->hist.messages,start);
 #endif
 
-		/* Call write func */
-		if (read_status == 0 && diff >= ap->interval) {
-			if (ap->driver) {
-				dprintf(dlevel,"flags: 0x%04x\n", ap->flags);
-				dprintf(dlevel,"open_before_write: %d, open: %p\n",
-					AGENT_HASFLAG(OBWRITE), ap->driver->open);
-				if (AGENT_HASFLAG(OBWRITE) && ap->driver->open) {
-					if (ap->driver->open(ap->handle)) {
-						log_error("agent_run: open for write failed\n");
-						continue;
-					}
-				}
-				write_status = 0;
-				dprintf(dlevel,"write: %p\n", ap->driver->write);
-				if (ap->driver->write) write_status = ap->driver->write(ap->handle,0,0,0);
-				dprintf(dlevel,"driver write_status: %d\n", write_status);
-			}
-#ifdef JS
-			/* Only call script if driver didnt error */
-			if (write_status == 0) {
-				dprintf(dlevel,"write_script: %s\n", ap->js.write_script);
-				if (agent_script_exists(ap,ap->js.write_script)) {
-					write_status = agent_start_script(ap,ap->js.write_script);
-					dprintf(dlevel,"script write_status: %d\n", write_status);
-					if (ap->js.ignore_js_errors) write_status = 0;
-				}
-			}
-#endif
-			if (ap->driver) {
-				dprintf(dlevel,"close_after_write: %d, close: %p\n",
-					AGENT_HASFLAG(CAWRITE), ap->driver->close);
-				if (AGENT_HASFLAG(CAWRITE) && ap->driver->close) ap->driver->close(ap->handle);
-			}
-			dprintf(dlevel,"write_status: %d\n", write_status);
-			if (write_status) dprintf(dlevel,"write failed!\n");
-			ap->write_count++;
+	/* Call write func (only write if read is successful) */
+	if (read_status == 0) {
+		agent_write(ap);
 
 #ifdef DEBUG_MEM
             if (ap->debug_mem) {
                 used = mem_used();
-                if (used > peak) peak = used;
-                dprintf(dlevel,"debug_mem: %d, used: %d, last_used: %d\n", ap->debug_mem, used, last_used);
-                if ((ap->debug_mem_always == 1) || (ap->debug_mem && used != last_used)) {
+                if (used > ap->loop.peak) ap->loop.peak = used;
+                dprintf(dlevel,"debug_mem: %d, used: %d, last_used: %d\n", ap->debug_mem, used, ap->loop.last_used);
+                if ((ap->debug_mem_always == 1) || (ap->debug_mem && used != ap->loop.last_used)) {
                     int udiff,pdiff;
 
-                    udiff = used - last_used;
-                    pdiff = peak - last_peak;
-                    log_info("used: %d (%s%d), peak: %d (%s%d)\n", used, (udiff > 0 ? "+" : ""), udiff, peak, (pdiff > 0 ? "+" : ""), pdiff);
+                    udiff = used - ap->loop.last_used;
+                    pdiff = ap->loop.peak - ap->loop.last_peak;
+                    log_info("used: %d (%s%d), peak: %d (%s%d)\n", used, (udiff > 0 ? "+" : ""), udiff, ap->loop.peak, (pdiff > 0 ? "+" : ""), pdiff);
                 }
-                last_used = used;
-                last_peak = peak;
+                ap->loop.last_used = used;
+                ap->loop.last_peak = ap->loop.peak;
             }
 #endif
-		}
+	}
 #ifdef JS
-		/* At gc_interval, do a cleanup */
-		dprintf(dlevel,"e: %p, run_count: %d, gc_interval: %d\n", ap->js.e, ap->run_count, ap->js.gc_interval);
-		if (ap->js.e && ap->js.gc_interval > 0 && ((ap->run_count % ap->js.gc_interval) == 0)) {
-			if (ap->debug_mem) dprintf(dlevel,"running gc...\n");
-			JS_EngineCleanup(ap->js.e);
-		}
+	/* At gc_interval, do a cleanup */
+	dprintf(dlevel,"e: %p, now: %llu, gc_interval: %d\n", ap->js.e, (unsigned long long)now, ap->js.gc_interval);
+	if (ap->js.e && ap->js.gc_interval > 0 && now >= ap->loop.gc) {
+		if (ap->debug_mem) dprintf(dlevel,"running gc...\n");
+		start = (ap->hist.js_gc ? monotime_us() : 0);
+		JS_EngineCleanup(ap->js.e);
+		stats_hist_since(ap->hist.js_gc,start);
+		ap->loop.gc = now + (ap->js.gc_interval * 1000);
+	}
 #endif
-		ap->run_count++;
-		sleep(1);
+	ap->run_count++;
+	stats_hist_since(ap->hist.loop,busy);
 
-		if (ap->refresh) {
-			last_read -= ap->interval;
-			ap->refresh = false;
-		}
-//		break;
+	/* Sleep until the next deadline, a message arrives or a registered fd is ready */
+	deadline = ap->loop.read;
+	if (need_tick && ap->loop.tick < deadline) deadline = ap->loop.tick;
+#ifdef JS
+	if (ap->js.e) {
+		if (ap->loop.check < deadline) deadline = ap->loop.check;
+		if (ap->js.gc_interval > 0 && ap->loop.gc < deadline) deadline = ap->loop.gc;
 	}
+#endif
+	next_task = scheduler_next(ap->sched);
+	if (next_task && next_task < deadline) deadline = next_task;
+	if (ap->refresh) deadline = 0;
+	return deadline;
+}
+
+int agent_stop(solard_agent_t *ap) {
+	if (!ap->loop.started) return 0;
+	ap->loop.started = false;
 	agent_event(ap,"Agent","Stop");
 #ifdef JS
 	if (agent_script_exists(ap,ap->js.stop_script)) agent_start_script(ap,ap->js.stop_script);
@@ -1145,6 +1614,140 @@ int agent_run(solard_agent_t *ap) {
 	return 0;
 }
 
+int agent_run(solard_agent_t *ap) {
+	uint64_t deadline;
+
+	dprintf(dlevel,"ap: %p\n", ap);
+	agent_start(ap);
+	while(check_state(ap,SOLARD_AGENT_STATE_RUNNING)) {
+		deadline = agent_step(ap);
+		if (deadline && reactor_wait(ap->r, deadline) < 0) sleep(1);
+	}
+	return agent_stop(ap);
+}
+
+/* Is -H (host mode) on the command line */
+int agent_host_check(int argc, char **argv) {
+	int i;
+
+	for(i=1; i < argc; i++) {
+		if (strncmp(argv[i],"-H",2) == 0) return 1;
+	}
+	return 0;
+}
+
+/* Every hosted instance in one thread: each does a pass, then wait on the
+   shared reactor for the earliest deadline */
+static int agent_host_run(void) {
+	solard_agent_t *ap;
+	list_iter_t it;
+	uint64_t deadline,d;
+	int running;
+
+	list_iter_init(&it,host.agents);
+	while((ap = list_iter_next(&it)) != 0) agent_start(ap);
+	while(true) {
+		running = 0;
+		deadline = (uint64_t)-1;
+		list_iter_init(&it,host.agents);
+		while((ap = list_iter_next(&it)) != 0) {
+			if (!check_state(ap,SOLARD_AGENT_STATE_RUNNING)) {
+				agent_stop(ap);
+				continue;
+			}
+			running++;
+			d = agent_step(ap);
+			if (d < deadline) deadline = d;
+		}
+		dprintf(dlevel+1,"running: %d, deadline: %llu\n", running, (unsigned long long)deadline);
+		if (!running) break;
+		if (deadline && reactor_wait(host.owner->r, deadline) < 0) sleep(1);
+	}
+	return 0;
+}
+
+/* Run one instance per config file (-H conf1,conf2,...) in this process.
+   The instances share a reactor, the first instance's MQTT session and its
+   JS runtime (compiled scripts included); each still has its own config,
+   driver, router, inbox and JS global.  func creates an instance from the
+   command line it's given (the original one without -H, plus -c conf). */
+int agent_host_main(int argc, char **argv, agent_host_new_t *func) {
+	char confs[1024],*p,**args;
+	char conf[AGENT_HOST_MAX][SOLARD_PATH_MAX];
+	solard_agent_t *ap;
+	int i,j,count,nargs,r;
+
+	*confs = 0;
+	args = 0;
+	r = 1;
+	for(i=1; i < argc; i++) {
+		if (strncmp(argv[i],"-H",2) != 0) continue;
+		p = (argv[i][2] ? &argv[i][2] : (i+1 < argc ? argv[i+1] : ""));
+		strncpy(confs,p,sizeof(confs)-1);
+		confs[sizeof(confs)-1] = 0;
+		break;
+	}
+	for(count=0; count < AGENT_HOST_MAX; count++) {
+		p = strele(count,",",confs);
+		if (!strlen(p)) break;
+		strncpy(conf[count],trim(p),sizeof(conf[count])-1);
+		conf[count][sizeof(conf[count])-1] = 0;
+	}
+	if (!count) {
+		log_error("agent_host_main: -H requires a list of config files\n");
+		return 1;
+	}
+
+	/* Instances keep pointers into their args, so these live until the end */
+	args = calloc(count * (argc + 3),sizeof(char *));
+	if (!args) {
+		log_syserror("agent_host_main: calloc");
+		return 1;
+	}
+	host.active = true;
+	for(i=0; i < count; i++) {
+		char **iargv = &args[i * (argc + 3)];
+
+		nargs = 0;
+		for(j=0; j < argc; j++) {
+			if (strncmp(argv[j],"-H",2) == 0) {
+				if (!argv[j][2]) j++;
+				continue;
+			}
+			/* Only the first instance daemonizes */
+			if (i && strcmp(argv[j],"-b") == 0) continue;
+			iargv[nargs++] = argv[j];
+		}
+		iargv[nargs++] = "-c";
+		iargv[nargs++] = conf[i];
+		log_info("Starting instance %d: %s\n", i, conf[i]);
+		ap = func(nargs,iargv);
+		if (!ap) {
+			log_error("agent_host_main: %s: init failed\n", conf[i]);
+			goto done;
+		}
+	}
+	r = agent_host_run();
+
+done:
+	/* Newest first - the first instance owns what the others share */
+	while(host.agents && list_count(host.agents)) {
+		list_iter_t it;
+		solard_agent_t *last;
+
+		last = 0;
+		list_iter_init(&it,host.agents);
+		while((ap = list_iter_next(&it)) != 0) last = ap;
+		agent_destroy_agent(last);
+	}
+	if (host.agents) list_destroy(host.agents);
+	host.agents = 0;
+	host.active = false;
+	agent_shutdown();
+	free(args);
+	return r;
+}
+
 #ifdef JS
 enum AGENT_PROPERTY_ID {
 	AGENT_PROPERTY_ID_START=2048,
@@ -1189,7 +1792,7 @@ static JSBool js_agent_getprop(JSContext *cx, JSObject *obj, jsval id, jsval *rv
 		switch(prop_id) {
 #ifdef MQTT
 		case AGENT_PROPERTY_ID_MSG:
-			*rval = OBJECT_TO_JSVAL(js_create_messages_array(cx,obj,ap->mq));
+			*rval = OBJECT_TO_JSVAL(js_create_messages_array(cx,obj,agent_get_mq(ap)));
 			break;
 		case AGENT_PROPERTY_ID_ADDMQ:
 			*rval = type_to_jsval(cx,DATA_TYPE_BOOL,&ap->addmq,0);
@@ -1238,7 +1841,7 @@ static JSBool js_agent_getprop(JSContext *cx, JSObject *obj, jsval id, jsval *rv
 			*rval = ap->js.mqtt_val;
 			break;
 		case AGENT_PROPERTY_ID_MSG:
-			*rval = OBJECT_TO_JSVAL(js_create_messages_array(cx,obj,ap->mq));
+			*rval = OBJECT_TO_JSVAL(js_create_messages_array(cx,obj,agent_get_mq(ap)));
 			break;
 		case AGENT_PROPERTY_ID_ADDMQ:
 			*rval = type_to_jsval(cx,DATA_TYPE_BOOL,&ap->addmq,0);
@@ -1410,7 +2013,7 @@ static JSBool js_agent_purgemq(JSContext *cx, uintN argc, jsval *vp) {
 		JS_ReportError(cx,"agent private is null!\n");
 		return JS_FALSE;
 	}
-	list_purge(ap->mq);
+	list_purge(agent_get_mq(ap));
 	return JS_TRUE;
 }
 
@@ -1512,6 +2115,87 @@ static JSBool js_agent_event(JSContext *cx, JSObject *obj, uintN argc, jsval *ar
 	return JS_TRUE;
 }
 
+struct js_agent_task {
+	JSContext *cx;
+	jsval func;
+};
+
+static void _js_agent_task(void *ctx) {
+	struct js_agent_task *info = ctx;
+	jsval rval;
+	JSBool ok;
+
+	ok = JS_CallFunctionValue(info->cx, JS_GetGlobalObject(info->cx), info->func, 0, 0, &rval);
+	dprintf(dlevel+1,"call ok: %d\n", ok);
+}
+
+static void _js_agent_task_free(void *ctx) {
+	struct js_agent_task *info = ctx;
+
+	JS_EngineRemoveRoot(info->cx,&info->func);
+	free(info);
+}
+
+/* addTask(name, period ms, func[, priority, jitter ms, oneshot]) */
+static JSBool js_agent_addtask(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
+	solard_agent_t *ap;
+	struct js_agent_task *info;
+	char *name;
+	int period,priority,jitter;
+	JSBool oneshot;
+	jsval func;
+
+	ap = JS_GetPrivate(cx, obj);
+	if (!ap) {
+		JS_ReportError(cx,"agent private is null!\n");
+		return JS_FALSE;
+	}
+	name = 0;
+	func = 0;
+	priority = jitter = 0;
+	oneshot = JS_FALSE;
+	if (!JS_ConvertArguments(cx, argc, argv, "s i v / i i b", &name, &period, &func, &priority, &jitter, &oneshot)) return JS_FALSE;
+	if (!VALUE_IS_FUNCTION(cx, func)) {
+		JS_free(cx,name);
+		JS_ReportError(cx, "addTask: arguments: required: name(string), period(number), func(function), optional: priority(number), jitter(number), oneshot(boolean)");
+		return JS_FALSE;
+	}
+	info = malloc(sizeof(*info));
+	if (!info) {
+		JS_free(cx,name);
+		JS_ReportError(cx, "js_agent_addtask: internal error: malloc");
+		return JS_FALSE;
+	}
+	info->cx = cx;
+	info->func = func;
+	JS_EngineAddRoot(cx,name,&info->func);
+	if (scheduler_add(ap->sched, name, period, priority, jitter, (oneshot ? SCHEDULER_FLAG_ONESHOT : 0), _js_agent_task, info, _js_agent_task_free)) {
+		reactor_wakeup(ap->r);
+		*rval = JSVAL_TRUE;
+	} else {
+		_js_agent_task_free(info);
+		*rval = JSVAL_FALSE;
+	}
+	JS_free(cx,name);
+	return JS_TRUE;
+}
+
+static JSBool js_agent_deltask(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
+	solard_agent_t *ap;
+	char *name;
+
+	ap = JS_GetPrivate(cx, obj);
+	if (!ap) {
+		JS_ReportError(cx,"agent private is null!\n");
+		return JS_FALSE;
+	}
+	name = 0;
+	if (!JS_ConvertArguments(cx, argc, argv, "s", &name)) return JS_FALSE;
+	*rval = BOOLEAN_TO_JSVAL(scheduler_remove(ap->sched, name) == 0);
+	JS_free(cx,name);
+	return JS_TRUE;
+}
+
 static JSBool js_agent_ctor(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
 	solard_agent_t *ap;
 	char **args, *vers;
@@ -1672,7 +2356,7 @@ static JSBool js_agent_ctor(JSContext *cx, JSObject *obj, uintN argc, jsval *arg
 	}
 #if 0
 	config_dump(ap->cp);
-	dprintf(-1,"interval: %d\n", ap->interval);
+	dprintf(-1,"interval: %f\n", ap->interval);
 	{
 		config_property_t *p;
 printf("==> getting prop\n");
@@ -1729,6 +2413,8 @@ JSObject *js_InitAgentClass(JSContext *cx, JSObject *parent) {
 		JS_FS("delete_message",js_agent_deletemsg,1,1,0),
 #endif
 		JS_FS("signal",js_agent_event,2,2,0),
+		JS_FS("addTask",js_agent_addtask,3,3,0),
+		JS_FS("delTask",js_agent_deltask,1,1,0),
 		JS_FN("pubinfo",js_agent_pubinfo,0,0,0),
 		JS_FN("pubconfig",js_agent_pubconfig,0,0,0),
 		{ 0 }
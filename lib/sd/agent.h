@@ -12,6 +12,8 @@ LICENSE file in the root directory of this source tree.
 
 #include "common.h"
 #include "driver.h"
+#include "reactor.h"
+#include "scheduler.h"
 #ifdef JS
 #include "jsengine.h"
 #endif
@@ -40,15 +42,58 @@ struct solard_agent {
 	mqtt_session_t *m;
 	bool config_from_mqtt;
 	char mqtt_topic[SOLARD_TOPIC_SIZE];
-	list mq;			/* incoming message queue */
+	inbox_t *inbox;			/* MQTT thread -> agent thread handoff */
+	list mq;			/* incoming message queue (agent thread only) */
+	router_t *router;		/* topic -> handler (agent thread only) */
+	char route_name[SOLARD_NAME_LEN]; /* instance_name our config route is for */
+	unsigned long dropped;		/* inbox drops already reported */
 	bool purge;			/* automatically purge unprocessed messages */
+	char inbox_latest[256];		/* topic[#],... to keep only the newest of (see inbox.h) */
 	bool addmq;			/* for client: add to mq */
 #endif
 #ifdef INFLUX
 	influx_session_t *i;
 #endif
 	event_session_t *e;
-	int interval;
+	reactor_t *r;			/* Wakes the run loop on messages/fds/deadlines */
+	scheduler_t *sched;		/* Tasks with their own period (see scheduler.h) */
+	bool local_data;		/* Also publish data to the local data plane */
+	shmdata_t *shm;			/* Local data plane segment (see shmdata.h) */
+	bool data_filter;		/* Only publish Data that changed (see datafilter.h) */
+	bool data_delta;		/* Send only the changed fields between keyframes */
+	char data_rules[256];		/* name=deadband[:min[:max]],... */
+	int data_keyframe;		/* Full Data at least every N seconds */
+	datafilter_t *df;
+	int stats_interval;		/* Publish Stats every N seconds (0 = off) */
+	stats_t *stats;			/* Kept until destroy once created (see stats.h) */
+	struct {			/* All null when stats are off */
+		stats_hist_t *read;		/* Driver read (us) */
+		stats_hist_t *read_script;
+		stats_hist_t *write;
+		stats_hist_t *write_script;
+		stats_hist_t *run_script;
+		stats_hist_t *messages;		/* Message dispatch, per loop */
+		stats_hist_t *tasks;		/* scheduler_run, per loop */
+		stats_hist_t *loop;		/* Busy time per loop (not the wait) */
+		stats_hist_t *js_gc;
+		stats_hist_t *mqtt_pub;
+		stats_hist_t *mqtt_ack;
+		stats_hist_t *influx_write;
+		stats_hist_t *mq_depth;		/* Messages waiting, per loop */
+		stats_hist_t *mqtt_buffer;	/* Offline buffer depth, per loop */
+	} hist;
+	double interval;		/* Read/write interval in seconds (may be fractional) */
+	struct {			/* Run loop state (see agent_step) */
+		bool started;
+		uint64_t read;			/* Next deadlines (monotime_ms) */
+		uint64_t tick;
+		uint64_t check;
+		uint64_t gc;
+		int last_used;			/* DEBUG_MEM */
+		int peak;
+		int last_peak;
+	} loop;
+	bool hosted;			/* Reactor/MQTT/JS runtime belong to the host (see agent_host_main) */
 	int run_count;
 	int read_count;
 	int write_count;
@@ -132,6 +177,20 @@ void agent_shutdown(void);
 int agent_event_handler(solard_agent_t *ap, event_handler_t *func, void *ctx, char *name, char *module, char *action);
 config_property_t *agent_get_props(solard_agent_t *);
 int agent_run(solard_agent_t *ap);
+int agent_start(solard_agent_t *ap);
+uint64_t agent_step(solard_agent_t *ap);
+int agent_stop(solard_agent_t *ap);
+
+/* Several instances in one process (see agent.c) */
+#define AGENT_HOST_MAX			32
+typedef solard_agent_t *(agent_host_new_t)(int argc, char **argv);
+int agent_host_check(int argc, char **argv);
+int agent_host_main(int argc, char **argv, agent_host_new_t *func);
+void agent_wakeup(solard_agent_t *ap);
+int agent_add_fd(solard_agent_t *ap, int fd, reactor_func_t *func, void *ctx);
+int agent_del_fd(solard_agent_t *ap, int fd);
+int agent_add_task(solard_agent_t *ap, char *name, int period, int priority, int jitter, int flags, scheduler_func_t *func, void *ctx);
+int agent_del_task(solard_agent_t *ap, char *name);
 #ifdef MQTT
 void agent_mktopic(char *topic, int topicsz, char *name, char *func);
 int agent_sub(solard_agent_t *ap, char *name, char *func);
@@ -141,6 +200,7 @@ int agent_pubconfig(solard_agent_t *ap);
 int agent_pubdata(solard_agent_t *ap, json_value_t *v);
 int agent_reply(solard_agent_t *ap, char *topic, int status, char *message);
 #endif
+int agent_pubshm(solard_agent_t *ap, int type, void *data, int size);
 int agent_set_callback(solard_agent_t *, solard_agent_callback_t *, void *);
 int agent_clear_callback(solard_agent_t *);
 int cf_agent_getinfo(void *ctx, list args, char *errmsg, json_object_t *results);
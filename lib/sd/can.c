@@ -82,6 +82,8 @@ LICENSE file in the root directory of this source tree.
 #include "transports.h"
 #ifndef WINDOWS
 #include "can.h"
+#include "canframe.h"
+#include "canmux.h"
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <net/if.h>
@@ -93,12 +95,15 @@ LICENSE file in the root directory of this source tree.
 #include <sys/time.h>
 #include <sys/signal.h>
 #include <pthread.h>
+#include <limits.h>
 
 #define DEFAULT_BITRATE 250000
 #define CAN_INTERFACE_LEN 16
+#define CAN_BUFFER_WAIT 5000		/* ms to wait for a buffered id we haven't seen yet */
 
 struct can_session {
-	int fd;
+	int fd;				/* Shared bus socket while open */
+	canmux_sub_t *sub;		/* Our place on the bus (see canmux.h) */
 	char errmsg[128];
 	char interface[CAN_INTERFACE_LEN+1];
 	int bitrate;
@@ -106,12 +111,9 @@ struct can_session {
 	int filters_size;
 	canid_t min,max;
 	int (*read)(struct can_session *,uint32_t *control,void *,int);
-	pthread_t th;
-	struct can_frame *frames;
-	int frames_size;
+	canframe_cache_t *cache;	/* Buffered frames (see canframe.h) */
 	canid_t start,end;
-	uint32_t *bitmaps;
-	int bitmaps_size;
+	uint64_t stamp;			/* Receive time of the last frame read (ns since the epoch) */
 };
 typedef struct can_session can_session_t;
 
@@ -123,13 +125,10 @@ static int can_stop_buffer(can_session_t *s);
 static int can_config_clear_filter(can_session_t *s) {
 	dprintf(dlevel,"s->filters: %p\n", s->filters);
 	if (s->filters) {
-		int r;
-
-		r = setsockopt(s->fd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
-		dprintf(dlevel,"r: %d\n", r);
 		free(s->filters);
 		s->filters = 0;
-		if (r < 0) return 1;
+		s->filters_size = 0;
+		return canmux_filter(s->sub,0,0);
 	}
 	return 0;
 }
@@ -172,7 +171,7 @@ static int can_config_set_filter(can_session_t *s, struct can_config_filter *fs)
 		if (id > s->max) s->max = id;
 	}
 	if (s->min > s->max) s->min = s->max;
-	return 0;
+	return canmux_filter(s->sub,s->filters,fs->count);
 }
 
 static int can_config_set_range(can_session_t *s, canid_t start, canid_t end) {
@@ -290,6 +289,11 @@ static void *can_new(void *target, void *topts) {
 	}
 	s->fd = -1;
 	s->read = can_read_direct;
+	s->sub = canmux_create();
+	if (!s->sub) {
+		free(s);
+		return 0;
+	}
 
 	strncat(s->interface,strele(0,",",(char *)target),sizeof(s->interface)-1);
 	if (topts) {
@@ -1031,139 +1035,128 @@ static int up_down_up(int fd, char *interface) {
 	return 0;
 }
 
-static int can_open(void *handle) {
-	can_session_t *s = handle;
+/* Raw socket bound to interface (see canmux.h) */
+int can_socket(char *interface, int bitrate) {
 	struct can_bittiming bt;
 	struct sockaddr_can addr;
 	struct ifreq ifr;
-	int if_up;
-
-	/* If already open, dont try again */
-	dprintf(dlevel,"fd: %d\n", s->fd);
-	if (s->fd >= 0) return 0;
+	int fd,if_up;
 
 	/* Open socket */
 	dprintf(dlevel,"opening socket...\n");
-	s->fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
-	if (s->fd < 0) {
-		log_syserror("can_open: socket");
-		return 1;
+	fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+	if (fd < 0) {
+		log_syserror("can_socket: socket");
+		return -1;
 	}
-	dprintf(dlevel,"fd: %d\n", s->fd);
+	dprintf(dlevel,"fd: %d\n", fd);
 
 	/* Get the state */
 	memset(&ifr,0,sizeof(ifr));
-	strcpy(ifr.ifr_name,s->interface);
-	if (ioctl(s->fd, SIOCGIFFLAGS, &ifr) < 0) {
-		log_syserror("can_open: SIOCGIFFLAGS");
-		goto can_open_error;
+	strcpy(ifr.ifr_name,interface);
+	if (ioctl(fd, SIOCGIFFLAGS, &ifr) < 0) {
+		log_syserror("can_socket: SIOCGIFFLAGS");
+		goto can_socket_error;
 	}
 	if_up = ((ifr.ifr_flags & IFF_UP) != 0 ? 1 : 0);
 
 	dprintf(dlevel,"if_up: %d\n",if_up);
 	if (!if_up) {
 		/* Set the bitrate */
-		can_set_bitrate(s->interface, s->bitrate);
+		can_set_bitrate(interface, bitrate);
 #if 0
-		if (can_set_bitrate(s->interface, s->bitrate) < 0) {
-			printf("ERROR: unable to set bitrate on %s!\n", s->interface);
-			goto can_open_error;
+		if (can_set_bitrate(interface, bitrate) < 0) {
+			printf("ERROR: unable to set bitrate on %s!\n", interface);
+			goto can_socket_error;
 		}
 #endif
-		up_down_up(s->fd,s->interface);
+		up_down_up(fd,interface);
 	} else {
-		bt.bitrate = s->bitrate;
+		bt.bitrate = bitrate;
 #if 0
 		/* Get the current timing */
-		if (can_get_bittiming(s->interface,&bt) < 0) {
-//			log_error("can_open: unable to get bittiming");
-//			goto can_open_error;
-			bt.bitrate = s->bitrate;
+		if (can_get_bittiming(interface,&bt) < 0) {
+//			log_error("can_socket: unable to get bittiming");
+//			goto can_socket_error;
+			bt.bitrate = bitrate;
 		}
 #endif
 
 		/* Check the bitrate */
-		dprintf(dlevel,"current bitrate: %d, wanted bitrate: %d\n", bt.bitrate, s->bitrate);
-		if (bt.bitrate != s->bitrate) {
+		dprintf(dlevel,"current bitrate: %d, wanted bitrate: %d\n", bt.bitrate, bitrate);
+		if (bt.bitrate != bitrate) {
 			/* Bring down the IF */
 			ifr.ifr_flags = 0;
-			dprintf(dlevel,"can_open: SIOCSIFFLAGS clear\n");
-			if (ioctl(s->fd, SIOCSIFFLAGS, &ifr) < 0) {
-				log_syserror("can_open: SIOCSIFFLAGS IFF_DOWN");
-				goto can_open_error;
+			dprintf(dlevel,"can_socket: SIOCSIFFLAGS clear\n");
+			if (ioctl(fd, SIOCSIFFLAGS, &ifr) < 0) {
+				log_syserror("can_socket: SIOCSIFFLAGS IFF_DOWN");
+				goto can_socket_error;
 			}
 
 			/* Set the bitrate */
 			dprintf(dlevel,"setting bitrate...\n");
-			if (can_set_bitrate(s->interface, s->bitrate) < 0) {
-				printf("ERROR: unable to set bitrate on %s!\n", s->interface);
-				goto can_open_error;
+			if (can_set_bitrate(interface, bitrate) < 0) {
+				printf("ERROR: unable to set bitrate on %s!\n", interface);
+				goto can_socket_error;
 			}
-			up_down_up(s->fd,s->interface);
+			up_down_up(fd,interface);
 
 		}
 	}
 
 	/* Get IF index */
-	strcpy(ifr.ifr_name, s->interface);
-	if (ioctl(s->fd, SIOCGIFINDEX, &ifr) < 0) {
-		log_syserror("can_open: SIOCGIFINDEX");
-		goto can_open_error;
+	strcpy(ifr.ifr_name, interface);
+	if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+		log_syserror("can_socket: SIOCGIFINDEX");
+		goto can_socket_error;
 	}
 
 	/* Bind the socket */
 	memset(&addr,0,sizeof(addr));
 	addr.can_family = AF_CAN;
 	addr.can_ifindex = ifr.ifr_ifindex;
-	if (bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-		log_syserror("can_open: bind");
-		goto can_open_error;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		log_syserror("can_socket: bind");
+		goto can_socket_error;
 	}
 
-	/* If a filter specified, set it */
-	if (s->filters) {
-#if 0
-		int join_filter = 1;
+	/* Have the kernel stamp each frame as it's received */
+	{
+		int on = 1;
 
-		dprintf(dlevel,"setting join_filter = 1\n");
-		if (setsockopt(s->fd, SOL_CAN_RAW, CAN_RAW_JOIN_FILTERS, &join_filter, sizeof(join_filter)) < 0) {
-			log_error("setsockopt CAN_RAW_JOIN_FILTERS not supported by your Linux Kernel");
-		}
-#endif
-#if 0
-		{
-			int i,count;
-			count = s->filters_size / sizeof(struct can_filter);
-			dprintf(dlevel,"count: %d\n", count);
-			for(i=0; i < s->filters_size / sizeof(struct can_filter); i++) {
-				printf("filter[%d].can_id: %x, can_mask: %x\n", i, s->filters[i].can_id, s->filters[i].can_mask);
-			}
-		}
-#endif
-		dprintf(dlevel,"setting filters... size: %d\n", s->filters_size);
-		if (setsockopt(s->fd, SOL_CAN_RAW, CAN_RAW_FILTER, s->filters, s->filters_size) < 0) {
-			log_syserror("setsockopt CAN_RAW_FILTER");
-			goto can_open_error;
-		}
+		if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) dprintf(dlevel,"SO_TIMESTAMPNS: %s\n", strerror(errno));
 	}
 
-//	fcntl(s->fd, F_SETFL, O_NONBLOCK);
+//	fcntl(fd, F_SETFL, O_NONBLOCK);
 
 #if 0
 	{
 		struct timeval tv;
 		tv.tv_sec = 0;
 		tv.tv_usec = 10000;
-		setsockopt(s->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 	}
 #endif
 
 	dprintf(dlevel,"done!\n");
+	return fd;
+can_socket_error:
+	close(fd);
+	return -1;
+}
+
+static int can_open(void *handle) {
+	can_session_t *s = handle;
+
+	/* If already open, dont try again */
+	dprintf(dlevel,"fd: %d\n", s->fd);
+	if (s->fd >= 0) return 0;
+
+	/* Everyone on this interface shares one socket */
+	if (canmux_open(s->sub,s->interface,s->bitrate)) return 1;
+	s->fd = canmux_fd(s->sub);
+	dprintf(dlevel,"fd: %d\n", s->fd);
 	return 0;
-can_open_error:
-	close(s->fd);
-	s->fd = -1;
-	return 1;
 }
 
 static int can_read(void *handle, uint32_t *control, void *buf, int buflen) {
@@ -1209,7 +1202,7 @@ static int can_write(void *handle, uint32_t *control, void *buf, int buflen) {
 	if (debug >= 5) bindump("TO DEVICE",buf,buflen);
 #endif
 	dprintf(dlevel,"id: %03x\n", ((struct can_frame *)buf)->can_id);
-	bytes = write(s->fd, buf, buflen);
+	bytes = canmux_write(s->sub, buf);
 	dprintf(dlevel,"fd: %d, returning: %d\n", s->fd, bytes);
 	return bytes;
 }
@@ -1219,64 +1212,17 @@ static int can_close(void *handle) {
 
 	if (s->fd >= 0) {
 		dprintf(dlevel,"closing %d\n", s->fd);
-		close(s->fd);
+		canmux_close(s->sub);
 		s->fd = -1;
+		/* Nothing we have is current anymore */
+		canframe_clear(s->cache);
 	}
 	return 0;
 }
 
-static void *can_recv_thread(void *handle) {
-	can_session_t *s = handle;
-	struct can_frame frame;
-	int bytes,id,idx;
-	uint32_t mask;
-#ifndef __WIN32
-	sigset_t set;
-
-	/* Ignore SIGPIPE */
-	sigemptyset(&set);
-	sigaddset(&set, SIGPIPE);
-	sigprocmask(SIG_BLOCK, &set, NULL);
-#endif
-
-	/* Enable us to be cancelled immediately */
-	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS,0);
-
-	dprintf(dlevel,"thread started!\n");
-//	while(s->flags & CAN_FLAG_RUNNING)) {
-	while(1) {
-		/* If not open, clear the bitmaps and loop */
-		dprintf(8,"fd: %d\n", s->fd);
-		if (s->fd < 0) {
-			memset(s->bitmaps,0,s->bitmaps_size);
-			sleep(1);
-			continue;
-		}
-
-		/* Read a frame */
-		bytes = read(s->fd,&frame,sizeof(frame));
-		dprintf(8,"bytes: %d\n", bytes);
-		if (bytes < 1) continue;
-
-		/* In range? */
-		dprintf(8,"frame.can_id: %03x\n",frame.can_id);
-		if (frame.can_id < s->start || frame.can_id >= s->end) continue;
-//		bindump("frame",&frame,sizeof(frame));
-
-		/* Yes, store the frame and set the bitmap */
-		id = frame.can_id - s->start;
-		idx = id / 32;
-		mask = 1 << (id % 32);
-		dprintf(8,"id: %03x, idx: %d, mask: %08x\n", id, idx, mask);
-		memcpy(&s->frames[id],&frame,sizeof(frame));
-		s->bitmaps[idx] |= mask;
-	}
-	dprintf(dlevel,"returning!\n");
-	return 0;
-}
-
 static int can_read_direct(can_session_t *s, uint32_t *id, void *buf, int buflen) {
 	struct can_frame *frame = buf;
+	uint64_t stamp;
 	int bytes;
 
 	dprintf(dlevel,"fd: %d\n", s->fd);
@@ -1288,16 +1234,10 @@ static int can_read_direct(can_session_t *s, uint32_t *id, void *buf, int buflen
 	/* Keep reading until we get our ID */
 	do {
 		dprintf(8,"fd: %d\n", s->fd);
-		bytes = read(s->fd, frame, sizeof(*frame));
+		bytes = canmux_read(s->sub, frame, &stamp, -1);
 		dprintf(8,"bytes: %d\n", bytes);
-		if (bytes < 0) {
-			if (errno != EAGAIN) bytes = -1;
-			break;
-		}
-		if (bytes != sizeof(struct can_frame)) {
-			log_error("can_read_direct: incomplete CAN frame\n");
-			continue;
-		}
+		if (bytes < 1) break;
+		s->stamp = stamp;
 		dprintf(8,"id: %x, frame->can_id: %x\n", id, frame->can_id);
 	} while(*id != 0xFFFF && frame->can_id != *id);
 #ifdef DEBUG
@@ -1308,9 +1248,8 @@ static int can_read_direct(can_session_t *s, uint32_t *id, void *buf, int buflen
 }
 
 static int can_read_buffer(can_session_t *s, uint32_t *control, void *data, int datasz) {
-	uint32_t mask;
+	canframe_info_t info;
 	canid_t can_id;
-	int id,idx,retries;
 
 	if (!control) return 0;
 	can_id = *control;
@@ -1322,101 +1261,47 @@ static int can_read_buffer(can_session_t *s, uint32_t *control, void *data, int
 	dprintf(dlevel,"datasz: %d\n", datasz);
 	if (datasz != sizeof(struct can_frame)) return -1;
 
-	id = can_id - s->start;
-	idx = id / 32;
-	mask = 1 << (id % 32);
-	dprintf(dlevel,"id: %03x, mask: %08x, bitmaps[%d]: %08x\n", id, mask, idx, s->bitmaps[idx]);
-	retries=5;
-	while(retries--) {
-		if ((s->bitmaps[idx] & mask) == 0) {
-			dprintf(dlevel,"bit not set, sleeping...\n");
-			sleep(1);
-			continue;
-		}
-//		if (debug >= 5) bindump("FRAME",&s->frames[id],sizeof(struct can_frame));
-		dprintf(dlevel,"returning data!\n");
-		memcpy(data,&s->frames[id],datasz);
-		return sizeof(struct can_frame);
+	/* Whatever we have, or wait for the first one */
+	if (canframe_get_fresh(s->cache, can_id, INT_MAX, CAN_BUFFER_WAIT, data, &info)) {
+		dprintf(dlevel,"no frame for %03x\n", can_id);
+		return 0;
 	}
-	return 0;
+	dprintf(dlevel,"returning data! gen: %u, age: %llu\n", info.gen, (unsigned long long)info.age);
+	s->stamp = info.stamp;
+	return sizeof(struct can_frame);
 }
 
 static int can_start_buffer(can_session_t *s, canid_t start, canid_t end) {
-	pthread_attr_t attr;
-	int num;
-
 	dprintf(dlevel,"start: %03x, end: %03x\n", start, end);
 
 	/* if we already have buffer set, exit */
-	if (s->frames) {
+	if (s->cache) {
 		sprintf(s->errmsg,"unable to start buffer: buffer already defined");
 		return 1;
 	}
 
-	/* Create the frame buffer and bitmaps */
-	num = end-start;
-	dprintf(dlevel,"num: %d\n", num);
-
-	/* Alloc frames */
-	s->frames_size = num * sizeof(struct can_frame);
-	dprintf(dlevel,"frames_size: %d\n", s->frames_size);
-	s->frames = calloc(s->frames_size,1);
-	if (!s->frames) {
-		log_syserror("can_start_buffer: malloc frames(%d)",s->frames_size);
-		return 1;
-	}
-
-	/* Alloc bitmaps */
-	s->bitmaps_size = num / 32;
-	if (!s->bitmaps_size) s->bitmaps_size = 1;
-	dprintf(dlevel,"bitmaps_size: %d\n", s->bitmaps_size);
-	s->bitmaps = calloc(s->bitmaps_size,1);
-	if (!s->bitmaps) {
-		log_syserror("can_start_buffer: malloc bitmaps(%d)",s->bitmaps_size);
-		return 1;
-	}
+	/* Create the frame cache */
+	s->cache = canframe_create(start,end);
+	if (!s->cache) return 1;
 
 	s->start = start;
 	s->end = end;
 
-	/* Create a detached thread */
-	dprintf(dlevel,"creating thread...\n");
-	if (pthread_attr_init(&attr)) {
-		sprintf(s->errmsg,"pthread_attr_init: %s",strerror(errno));
-		goto can_set_reader_error;
-	}
-	if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
-		sprintf(s->errmsg,"pthread_attr_setdetachstate: %s",strerror(errno));
-		goto can_set_reader_error;
-	}
-	if (pthread_create(&s->th,&attr,&can_recv_thread,s)) {
-		sprintf(s->errmsg,"pthread_create: %s",strerror(errno));
-		goto can_set_reader_error;
-	}
-	pthread_attr_destroy(&attr);
+	/* The bus puts our frames straight into it */
+	canmux_set_cache(s->sub,s->cache);
 
 	dprintf(dlevel,"setting func to buffer\n");
 	s->read = can_read_buffer;
 	return 0;
-
-can_set_reader_error:
-	s->read = can_read_direct;
-	return 1;
 }
 
 static int can_stop_buffer(can_session_t *s) {
-	dprintf(dlevel,"frames: %p\n", s->frames);
-	if (!s->frames) return 1;
+	dprintf(dlevel,"cache: %p\n", s->cache);
+	if (!s->cache) return 1;
 	s->read = can_read_direct;
-	pthread_cancel(s->th);
-	if (s->frames) {
-		free(s->frames);
-		s->frames = 0;
-	}
-	if (s->bitmaps) {
-		free(s->bitmaps);
-		s->bitmaps = 0;
-	}
+	canmux_set_cache(s->sub,0);
+	canframe_destroy(s->cache);
+	s->cache = 0;
 	return 0;
 }
 
@@ -1467,6 +1352,14 @@ static int can_config(void *handle, int func, ...) {
 	case CAN_CONFIG_STOP_BUFFER:
 		r = can_stop_buffer(s);
 		break;
+	case CAN_CONFIG_GET_TIMESTAMP:
+	    {
+		uint64_t *stamp = va_arg(va,uint64_t *);
+
+		*stamp = s->stamp;
+		r = (s->stamp == 0);
+	    }
+	    break;
 	default:
 		dprintf(dlevel,"error: unhandled func: %d\n", func);
 		break;
@@ -1477,9 +1370,10 @@ static int can_config(void *handle, int func, ...) {
 static int can_destroy(void *handle) {
 	can_session_t *s = handle;
 
-	can_config_clear_filter(s);
 	can_stop_buffer(s);
         if (s->fd >= 0) can_close(s);
+	canmux_destroy(s->sub);
+	free(s->filters);
         free(s);
         return 0;
 }
@@ -56,6 +56,7 @@ enum CAN_CONFIG_FUNCS {
 	CAN_CONFIG_START_BUFFER,
 	CAN_CONFIG_STOP_BUFFER,
 	CAN_CONFIG_GET_FD,
+	CAN_CONFIG_GET_TIMESTAMP,	/* uint64_t *: receive time of the last frame read (ns since the epoch) */
 };
 
 #define CAN_ID_ANY 0xFFFF
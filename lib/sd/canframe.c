@@ -0,0 +1,201 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 7
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include "log.h"
+#include "reactor.h"
+#include "canframe.h"
+
+struct canframe_entry {
+	uint32_t seq;			/* Odd while the writer is in it */
+	uint32_t gen;
+	uint64_t stamp;			/* ns since the epoch */
+	uint64_t stored;		/* monotime_ms, 0 = nothing here */
+	struct can_frame frame;
+};
+
+struct canframe_cache {
+	canid_t start;
+	canid_t end;
+	struct canframe_entry *entries;
+	int waiters;			/* Only signal when someone is waiting */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+canframe_cache_t *canframe_create(canid_t start, canid_t end) {
+	canframe_cache_t *c;
+
+	dprintf(dlevel,"start: %03x, end: %03x\n", start, end);
+	if (end <= start) return 0;
+	c = calloc(1,sizeof(*c));
+	if (!c) {
+		log_syserror("canframe_create: calloc");
+		return 0;
+	}
+	c->entries = calloc(end - start,sizeof(*c->entries));
+	if (!c->entries) {
+		log_syserror("canframe_create: calloc entries(%d)", end - start);
+		free(c);
+		return 0;
+	}
+	c->start = start;
+	c->end = end;
+	pthread_mutex_init(&c->lock,0);
+	pthread_cond_init(&c->cond,0);
+	return c;
+}
+
+void canframe_destroy(canframe_cache_t *c) {
+	if (!c) return;
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+	free(c->entries);
+	free(c);
+}
+
+static struct canframe_entry *_entry(canframe_cache_t *c, canid_t id) {
+	if (!c || id < c->start || id >= c->end) return 0;
+	return &c->entries[id - c->start];
+}
+
+static void _wake(canframe_cache_t *c) {
+	if (!__atomic_load_n(&c->waiters,__ATOMIC_SEQ_CST)) return;
+	pthread_mutex_lock(&c->lock);
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+}
+
+/* Wall clock in the same units as the stamps */
+uint64_t canframe_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME,&ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+int canframe_put(canframe_cache_t *c, struct can_frame *frame, uint64_t stamp) {
+	struct canframe_entry *e;
+
+	e = _entry(c,frame->can_id);
+	if (!e) return 1;
+	if (!stamp) stamp = canframe_now();
+	__atomic_store_n(&e->seq,e->seq + 1,__ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&e->frame,frame,sizeof(e->frame));
+	e->stamp = stamp;
+	e->stored = monotime_ms();
+	/* SEQ_CST pairs with canframe_wait's load so a waiter can't miss it */
+	__atomic_store_n(&e->gen,e->gen + 1,__ATOMIC_SEQ_CST);
+	__atomic_store_n(&e->seq,e->seq + 1,__ATOMIC_RELEASE);
+	_wake(c);
+	return 0;
+}
+
+/* Transport went away - nothing we have is current anymore */
+void canframe_clear(canframe_cache_t *c) {
+	struct canframe_entry *e;
+	int i;
+
+	if (!c) return;
+	for(i=0; i < c->end - c->start; i++) {
+		e = &c->entries[i];
+		if (!e->stored) continue;
+		__atomic_store_n(&e->seq,e->seq + 1,__ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		e->stored = 0;
+		__atomic_store_n(&e->seq,e->seq + 1,__ATOMIC_RELEASE);
+	}
+}
+
+/* Consistent copy of an entry */
+static int _read(struct canframe_entry *e, struct can_frame *frame, canframe_info_t *info) {
+	struct can_frame f;
+	uint32_t seq,gen;
+	uint64_t stamp,stored;
+
+	do {
+		seq = __atomic_load_n(&e->seq,__ATOMIC_ACQUIRE);
+		if (seq & 1) continue;
+		memcpy(&f,&e->frame,sizeof(f));
+		gen = e->gen;
+		stamp = e->stamp;
+		stored = e->stored;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while((seq & 1) || seq != __atomic_load_n(&e->seq,__ATOMIC_RELAXED));
+	if (!stored) return 1;
+	if (frame) memcpy(frame,&f,sizeof(f));
+	if (info) {
+		info->gen = gen;
+		info->stamp = stamp;
+		info->age = monotime_ms() - stored;
+	}
+	return 0;
+}
+
+int canframe_get(canframe_cache_t *c, canid_t id, struct can_frame *frame, canframe_info_t *info) {
+	struct canframe_entry *e;
+
+	e = _entry(c,id);
+	if (!e) return 1;
+	return _read(e,frame,info);
+}
+
+int canframe_wait(canframe_cache_t *c, canid_t id, uint32_t gen, int timeout, struct can_frame *frame, canframe_info_t *info) {
+	struct canframe_entry *e;
+	struct timespec ts;
+	struct timeval tv;
+	int rc;
+
+	e = _entry(c,id);
+	if (!e) return 1;
+	dprintf(dlevel,"id: %03x, gen: %u, timeout: %d\n", id, gen, timeout);
+	gettimeofday(&tv,0);
+	ts.tv_sec = tv.tv_sec + timeout / 1000;
+	ts.tv_nsec = (tv.tv_usec * 1000) + ((timeout % 1000) * 1000000);
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	rc = 0;
+	pthread_mutex_lock(&c->lock);
+	__atomic_add_fetch(&c->waiters,1,__ATOMIC_SEQ_CST);
+	while(rc == 0 && __atomic_load_n(&e->gen,__ATOMIC_SEQ_CST) == gen) rc = pthread_cond_timedwait(&c->cond,&c->lock,&ts);
+	__atomic_sub_fetch(&c->waiters,1,__ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&c->lock);
+	dprintf(dlevel,"id: %03x, rc: %d\n", id, rc);
+	if (__atomic_load_n(&e->gen,__ATOMIC_ACQUIRE) == gen) return 1;
+	return _read(e,frame,info);
+}
+
+int canframe_get_fresh(canframe_cache_t *c, canid_t id, int max_age, int timeout, struct can_frame *frame, canframe_info_t *info) {
+	canframe_info_t i;
+	struct canframe_entry *e;
+	uint32_t gen;
+
+	e = _entry(c,id);
+	if (!e) return 1;
+	/* Anything after this counts as new */
+	gen = __atomic_load_n(&e->gen,__ATOMIC_ACQUIRE);
+	if (_read(e,frame,&i) == 0) {
+		if (i.age <= max_age) {
+			if (info) *info = i;
+			return 0;
+		}
+		gen = i.gen;
+	}
+	return canframe_wait(c,id,gen,timeout,frame,info);
+}
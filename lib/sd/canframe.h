@@ -0,0 +1,53 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_CANFRAME_H
+#define __SD_CANFRAME_H
+
+#include <stdint.h>
+#include "can.h"
+
+/* Latest frame for each CAN id in a range, written by one receive thread and
+   read from anywhere.  Each id has its own seqlock so a reader always gets a
+   whole frame (never half of an old one and half of a new one) without ever
+   blocking the writer, and a generation count so a reader can tell a new frame
+   from the one it already has.  Every frame carries the time it was received
+   (the kernel's SO_TIMESTAMPNS time when the transport has it).  Readers that
+   need a fresh value wait on a condvar for the next frame rather than polling,
+   with millisecond timeouts. */
+
+struct canframe_cache;
+typedef struct canframe_cache canframe_cache_t;
+
+struct canframe_info {
+	uint32_t gen;			/* Frames received for this id */
+	uint64_t stamp;			/* Receive time (ns since the epoch) */
+	uint64_t age;			/* ms since it was received */
+};
+typedef struct canframe_info canframe_info_t;
+
+/* ids start .. end-1 */
+canframe_cache_t *canframe_create(canid_t start, canid_t end);
+void canframe_destroy(canframe_cache_t *c);
+
+/* Writer side.  stamp is the receive time (ns since the epoch), or 0 for now */
+int canframe_put(canframe_cache_t *c, struct can_frame *frame, uint64_t stamp);
+uint64_t canframe_now(void);
+void canframe_clear(canframe_cache_t *c);
+
+/* Returns 0 and a copy of the latest frame, 1 if there isn't one (info may be 0) */
+int canframe_get(canframe_cache_t *c, canid_t id, struct can_frame *frame, canframe_info_t *info);
+
+/* Wait up to timeout ms for a frame newer than generation gen */
+int canframe_wait(canframe_cache_t *c, canid_t id, uint32_t gen, int timeout, struct can_frame *frame, canframe_info_t *info);
+
+/* The latest frame if it's no older than max_age ms, otherwise wait up to timeout ms for the next one */
+int canframe_get_fresh(canframe_cache_t *c, canid_t id, int max_age, int timeout, struct can_frame *frame, canframe_info_t *info);
+
+#endif /* __SD_CANFRAME_H */
@@ -0,0 +1,381 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include "transports.h"
+#ifndef WINDOWS
+#include "canlog.h"
+#include "canframe.h"
+#include "reactor.h"
+#include <pthread.h>
+#include <time.h>
+
+#define CANLOG_FLUSH 1000		/* Flush the log at least this often (ms) */
+
+struct canlog_session {
+	char path[SOLARD_TARGET_LEN];
+	FILE *fp;
+	int record;			/* Recording (else replaying) */
+	void *can;			/* can driver handle (record: the bus, replay: dev) */
+	char interface[32];
+	int bitrate;
+	double speed;			/* Replay speed, 0 = max */
+	int loop;
+	uint64_t first;			/* Replay: stamp of the first frame */
+	uint64_t base;			/* Replay: monotime_us it was replayed at */
+	uint64_t stamp;			/* Receive time of the last frame read */
+	uint64_t flushed;		/* Record: last flush (monotime_ms) */
+	pthread_mutex_t lock;		/* Protects fp (reads, writes and close come from different threads) */
+	unsigned long frames;
+	unsigned long dropped;
+};
+typedef struct canlog_session canlog_session_t;
+
+static void *canlog_new(void *target, void *topts) {
+	canlog_session_t *s;
+	char temp[SOLARD_TOPTS_LEN],*p,*v;
+	int i;
+
+	dprintf(dlevel,"target: %s, topts: %s\n", target, topts);
+	if (!target || !strlen(target)) return 0;
+
+	s = calloc(sizeof(*s),1);
+	if (!s) {
+		log_syserror("canlog_new: calloc");
+		return 0;
+	}
+	strncpy(s->path,strele(0,",",(char *)target),sizeof(s->path)-1);
+	s->speed = 1.0;
+	s->bitrate = 0;
+	if (topts) {
+		strncpy(temp,topts,sizeof(temp)-1);
+		temp[sizeof(temp)-1] = 0;
+		for(i=0; ; i++) {
+			p = strele(i,":",temp);
+			if (!strlen(p)) break;
+			v = strchr(p,'=');
+			if (v) *v++ = 0;
+			else v = "";
+			dprintf(dlevel,"option: %s, value: %s\n", p, v);
+			if (strcmp(p,"record") == 0) {
+				s->record = 1;
+				strncpy(s->interface,v,sizeof(s->interface)-1);
+			} else if (strcmp(p,"dev") == 0) {
+				strncpy(s->interface,v,sizeof(s->interface)-1);
+			} else if (strcmp(p,"bitrate") == 0) {
+				s->bitrate = strtol(v,0,0);
+			} else if (strcmp(p,"speed") == 0) {
+				s->speed = strcasecmp(v,"max") == 0 ? 0 : atof(v);
+				if (s->speed < 0) s->speed = 0;
+			} else if (strcmp(p,"loop") == 0) {
+				s->loop = 1;
+			} else {
+				log_warning("canlog: unknown option: %s\n", p);
+			}
+		}
+	}
+	if (s->record && !strlen(s->interface)) {
+		log_error("canlog: record needs an interface (record=<if>)\n");
+		free(s);
+		return 0;
+	}
+	/* The bus we record from, or the one we replay onto */
+	if (strlen(s->interface)) {
+		char bitrate[16];
+
+		sprintf(bitrate,"%d",s->bitrate);
+		s->can = can_driver.new(s->interface,s->bitrate ? bitrate : 0);
+		if (!s->can) {
+			free(s);
+			return 0;
+		}
+	}
+	pthread_mutex_init(&s->lock,0);
+	dprintf(dlevel,"path: %s, record: %d, interface: %s, speed: %f, loop: %d\n", s->path, s->record, s->interface, s->speed, s->loop);
+	return s;
+}
+
+/* Back to the first frame */
+static int canlog_rewind(canlog_session_t *s) {
+	struct canlog_header h;
+
+	rewind(s->fp);
+	if (fread(&h,sizeof(h),1,s->fp) != 1 || memcmp(h.magic,CANLOG_MAGIC,sizeof(h.magic)) != 0) {
+		log_error("canlog: %s: not a CAN log\n", s->path);
+		return 1;
+	}
+	if (h.version != CANLOG_VERSION) {
+		log_error("canlog: %s: unsupported version: %d\n", s->path, h.version);
+		return 1;
+	}
+	s->first = s->base = 0;
+	return 0;
+}
+
+static int canlog_open(void *handle) {
+	canlog_session_t *s = handle;
+	struct canlog_header h;
+	long pos;
+
+	dprintf(dlevel,"fp: %p\n", s->fp);
+	if (s->fp) return 0;
+
+	if (s->can && can_driver.open(s->can)) return 1;
+	if (s->record) {
+		s->fp = fopen(s->path,"a+");
+		if (!s->fp) {
+			log_syserror("canlog_open: fopen %s",s->path);
+			goto canlog_open_error;
+		}
+		/* New file gets a header, an existing one is appended to */
+		fseek(s->fp,0,SEEK_END);
+		pos = ftell(s->fp);
+		if (pos == 0) {
+			memset(&h,0,sizeof(h));
+			memcpy(h.magic,CANLOG_MAGIC,sizeof(h.magic));
+			h.version = CANLOG_VERSION;
+			fwrite(&h,sizeof(h),1,s->fp);
+		} else if (pos > 0 && canlog_rewind(s) == 0) {
+			fseek(s->fp,0,SEEK_END);
+		} else {
+			goto canlog_open_error;
+		}
+		s->flushed = monotime_ms();
+	} else {
+		s->fp = fopen(s->path,"r");
+		if (!s->fp) {
+			log_syserror("canlog_open: fopen %s",s->path);
+			goto canlog_open_error;
+		}
+		if (canlog_rewind(s)) goto canlog_open_error;
+	}
+	return 0;
+
+canlog_open_error:
+	if (s->fp) fclose(s->fp);
+	s->fp = 0;
+	if (s->can) can_driver.close(s->can);
+	return 1;
+}
+
+static int canlog_close(void *handle) {
+	canlog_session_t *s = handle;
+
+	dprintf(dlevel,"fp: %p, frames: %lu\n", s->fp, s->frames);
+	pthread_mutex_lock(&s->lock);
+	if (s->fp) {
+		fclose(s->fp);
+		s->fp = 0;
+	}
+	pthread_mutex_unlock(&s->lock);
+	if (s->can) can_driver.close(s->can);
+	return 0;
+}
+
+static void canlog_put(canlog_session_t *s, struct can_frame *frame, uint64_t stamp, int tx) {
+	struct canlog_record rec;
+	uint64_t now;
+	int len;
+
+	rec.stamp = stamp ? stamp : canframe_now();
+	rec.can_id = frame->can_id;
+	len = (frame->can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : frame->can_dlc);
+	rec.dlc = len | (tx ? CANLOG_TX : 0);
+	pthread_mutex_lock(&s->lock);
+	if (s->fp) {
+		if (fwrite(&rec,sizeof(rec),1,s->fp) != 1 || (len && fwrite(frame->data,len,1,s->fp) != 1)) {
+			s->dropped++;
+		} else {
+			s->frames++;
+		}
+		/* Don't lose much if we're killed */
+		now = monotime_ms();
+		if (now - s->flushed >= CANLOG_FLUSH) {
+			fflush(s->fp);
+			s->flushed = now;
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+/* Next received frame from the log, 0 at the end */
+static int canlog_next(canlog_session_t *s, struct can_frame *frame) {
+	struct canlog_record rec;
+
+	while(1) {
+		if (fread(&rec,sizeof(rec),1,s->fp) != 1) {
+			if (!s->loop || canlog_rewind(s)) return 0;
+			dprintf(dlevel,"looping\n");
+			continue;
+		}
+		memset(frame,0,sizeof(*frame));
+		frame->can_id = rec.can_id;
+		frame->can_dlc = rec.dlc & ~CANLOG_TX;
+		if (frame->can_dlc > CAN_MAX_DLEN) {
+			log_error("canlog: %s: bad record (dlc: %d)\n", s->path, frame->can_dlc);
+			return 0;
+		}
+		if (frame->can_dlc && fread(frame->data,frame->can_dlc,1,s->fp) != 1) return 0;
+		/* Replay what was received, not what the agent sent */
+		if (rec.dlc & CANLOG_TX) continue;
+		s->stamp = rec.stamp;
+		return sizeof(*frame);
+	}
+}
+
+/* Wait until it's time for a frame received at stamp */
+static void canlog_pace(canlog_session_t *s, uint64_t stamp) {
+	struct timespec ts;
+	uint64_t due,now;
+
+	if (s->speed <= 0) return;
+	now = monotime_us();
+	if (!s->base || stamp < s->first) {
+		s->first = stamp;
+		s->base = now;
+		return;
+	}
+	due = s->base + (uint64_t)((double)(stamp - s->first) / 1000.0 / s->speed);
+	if (due <= now) return;
+	ts.tv_sec = (due - now) / 1000000;
+	ts.tv_nsec = ((due - now) % 1000000) * 1000;
+	nanosleep(&ts,0);
+}
+
+static int canlog_read(void *handle, uint32_t *control, void *buf, int buflen) {
+	canlog_session_t *s = handle;
+	struct can_frame *frame = buf;
+	uint64_t stamp;
+	int bytes;
+
+	if (!s->fp) return -1;
+	if (buflen != sizeof(struct can_frame)) return -1;
+
+	if (s->record) {
+		bytes = can_driver.read(s->can,control,buf,buflen);
+		if (bytes == sizeof(struct can_frame)) {
+			if (can_driver.config(s->can,CAN_CONFIG_GET_TIMESTAMP,&stamp)) stamp = 0;
+			s->stamp = stamp;
+			canlog_put(s,frame,stamp,0);
+		}
+		return bytes;
+	}
+
+	/* Replay: until we get our ID (0xFFFF = any) */
+	do {
+		/* Closed under us? */
+		pthread_mutex_lock(&s->lock);
+		bytes = (s->fp ? canlog_next(s,frame) : -1);
+		pthread_mutex_unlock(&s->lock);
+		if (bytes < 1) return bytes;
+		canlog_pace(s,s->stamp);
+		if (s->can) can_driver.write(s->can,0,frame,sizeof(*frame));
+	} while(control && *control != 0xFFFF && frame->can_id != *control);
+#ifdef DEBUG
+	if (debug >= 8) bindump("FROM LOG",buf,sizeof(struct can_frame));
+#endif
+	return bytes;
+}
+
+static int canlog_write(void *handle, uint32_t *control, void *buf, int buflen) {
+	canlog_session_t *s = handle;
+	int bytes;
+
+	if (!s->fp) return -1;
+	if (buflen != sizeof(struct can_frame)) return -1;
+
+	/* Replaying without a bus - nowhere for it to go */
+	if (!s->can) return buflen;
+	bytes = can_driver.write(s->can,control,buf,buflen);
+	if (s->record && bytes == buflen) canlog_put(s,buf,0,1);
+	return bytes;
+}
+
+static int canlog_config(void *handle, int func, ...) {
+	canlog_session_t *s = handle;
+	va_list va;
+	int r;
+
+	r = 1;
+	va_start(va,func);
+	switch(func) {
+	case CAN_CONFIG_GET_TIMESTAMP:
+	    {
+		uint64_t *stamp = va_arg(va,uint64_t *);
+
+		*stamp = s->stamp;
+		r = (s->stamp == 0);
+	    }
+	    break;
+	case CAN_CONFIG_SET_RANGE:
+	    {
+		canid_t start, end;
+
+		/* Filters etc are the bus's business */
+		start = va_arg(va,canid_t);
+		end = va_arg(va,canid_t);
+		r = (s->record ? can_driver.config(s->can,func,start,end) : 0);
+	    }
+	    break;
+	case CAN_CONFIG_SET_FILTER:
+		r = (s->record ? can_driver.config(s->can,func,va_arg(va,struct can_config_filter *)) : 0);
+		break;
+	case CAN_CONFIG_PARSE_FILTER:
+		r = (s->record ? can_driver.config(s->can,func,va_arg(va,char *)) : 0);
+		break;
+	case CAN_CONFIG_CLEAR_FILTER:
+		r = (s->record ? can_driver.config(s->can,func) : 0);
+		break;
+	case CAN_CONFIG_GET_FD:
+	    {
+		int *fdptr = va_arg(va,int *);
+
+		if (s->record) {
+			r = can_driver.config(s->can,func,fdptr);
+		} else {
+			*fdptr = (s->fp ? fileno(s->fp) : -1);
+			r = 0;
+		}
+	    }
+	    break;
+	default:
+		/* Buffering would hide frames from the log */
+		dprintf(dlevel,"error: unhandled func: %d\n", func);
+		break;
+	}
+	va_end(va);
+	return r;
+}
+
+static int canlog_destroy(void *handle) {
+	canlog_session_t *s = handle;
+
+	canlog_close(s);
+	dprintf(dlevel,"frames: %lu, dropped: %lu\n", s->frames, s->dropped);
+	if (s->can) can_driver.destroy(s->can);
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+	return 0;
+}
+
+solard_driver_t canlog_driver = {
+	"canlog",
+	canlog_new,
+	canlog_destroy,
+	canlog_open,
+	canlog_close,
+	canlog_read,
+	canlog_write,
+	canlog_config
+};
+#else
+solard_driver_t canlog_driver = { "canlog" };
+#endif
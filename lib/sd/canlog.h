@@ -0,0 +1,58 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_CANLOG_H
+#define __SD_CANLOG_H
+
+#include <stdint.h>
+#include "can.h"
+
+/* CAN capture/replay transport.  The target is the log file and topts are
+   colon separated options:
+
+	record=<if>	record: run on live interface <if> (through the can
+			driver) and log every frame read from or written to it
+	bitrate=<n>	record: bitrate for <if>
+	speed=<n>	replay: 1 = real time (default), 10 = 10x, 0 = as fast as possible
+	loop		replay: start over at the end of the log
+	dev=<if>	replay: also send every frame out on <if> (e.g. vcan0)
+
+   e.g. "canlog,/var/log/si.canlog,record=can0" then "canlog,/var/log/si.canlog,speed=0:loop".
+   Without record= the log is replayed: reads return the logged frames (with
+   their original receive times) paced like they were received, and writes
+   are dropped (or sent to dev).
+
+   The log is a header followed by packed records in host byte order:
+
+	header	"SDCANLOG", uint32 version, uint32 flags
+	record	uint64 stamp (ns since the epoch), uint32 can_id, uint8 dlc
+		(CANLOG_TX set if the agent sent it), dlc bytes of data */
+
+#define CANLOG_MAGIC		"SDCANLOG"
+#define CANLOG_VERSION		1
+#define CANLOG_TX		0x80	/* In dlc: frame was written, not read */
+
+struct canlog_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+} __attribute__((packed));
+
+struct canlog_record {
+	uint64_t stamp;
+	uint32_t can_id;
+	uint8_t dlc;
+} __attribute__((packed));
+
+#if !defined(__WIN32) && !defined(__WIN64)
+#include "driver.h"
+extern solard_driver_t canlog_driver;
+#endif
+
+#endif /* __SD_CANLOG_H */
@@ -0,0 +1,480 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#if !defined(WINDOWS) && !defined(__APPLE__)
+#define _GNU_SOURCE
+#define dlevel 7
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/can/raw.h>
+#include "log.h"
+#include "canmux.h"
+
+#ifndef CAN_RAW_FILTER_MAX
+#define CAN_RAW_FILTER_MAX 512
+#endif
+
+#define CANMUX_INTERFACE_LEN 16
+
+struct canmux_entry {
+	uint64_t stamp;			/* Receive time (ns since the epoch) */
+	struct can_frame frame;
+};
+
+struct canmux_bus {
+	char interface[CANMUX_INTERFACE_LEN+1];
+	int bitrate;
+	int fd;
+	int refs;			/* Subscribers attached */
+	struct canmux_sub *subs;
+	pthread_mutex_t lock;		/* subs, their filters/caches and ring producers */
+	pthread_t th;
+	uint64_t batches;
+	uint64_t frames;
+	struct canmux_bus *next;
+};
+
+struct canmux_sub {
+	struct canmux_bus *bus;		/* 0 = closed */
+	struct can_filter *filters;
+	int count;
+	canframe_cache_t *cache;
+	struct canmux_entry ring[CANMUX_RING];
+	uint32_t head;			/* Only the producer writes this */
+	uint32_t tail;			/* Only the consumer writes this */
+	uint64_t dropped;
+	int pending;			/* Pushed something this batch */
+	int waiters;			/* Only signal when someone is waiting */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct canmux_sub *next;
+};
+
+/* Open buses */
+static struct canmux_bus *canmux_buses;
+static pthread_mutex_t canmux_lock = PTHREAD_MUTEX_INITIALIZER;
+
+canmux_sub_t *canmux_create(void) {
+	canmux_sub_t *sub;
+
+	sub = calloc(1,sizeof(*sub));
+	if (!sub) {
+		log_syserror("canmux_create: calloc");
+		return 0;
+	}
+	pthread_mutex_init(&sub->lock,0);
+	pthread_cond_init(&sub->cond,0);
+	return sub;
+}
+
+void canmux_destroy(canmux_sub_t *sub) {
+	if (!sub) return;
+	canmux_close(sub);
+	pthread_cond_destroy(&sub->cond);
+	pthread_mutex_destroy(&sub->lock);
+	free(sub->filters);
+	free(sub);
+}
+
+static int _match(canmux_sub_t *sub, canid_t id) {
+	int i;
+
+	if (!sub->count) return 1;
+	for(i=0; i < sub->count; i++) {
+		if ((id & sub->filters[i].can_mask) == (sub->filters[i].can_id & sub->filters[i].can_mask)) return 1;
+	}
+	return 0;
+}
+
+/* Bus lock held */
+static void _push(struct canmux_bus *bus, canmux_sub_t *sub, struct can_frame *frame, uint64_t stamp) {
+	struct canmux_entry *e;
+	uint32_t head;
+
+	if (sub->cache) {
+		canframe_put(sub->cache,frame,stamp);
+		return;
+	}
+	head = sub->head;
+	if (head - __atomic_load_n(&sub->tail,__ATOMIC_ACQUIRE) >= CANMUX_RING) {
+		if (!sub->dropped++) log_warning("canmux: %s: subscriber not keeping up, dropping frames\n", bus->interface);
+		return;
+	}
+	e = &sub->ring[head & (CANMUX_RING-1)];
+	e->stamp = stamp;
+	memcpy(&e->frame,frame,sizeof(e->frame));
+	__atomic_store_n(&sub->head,head + 1,__ATOMIC_SEQ_CST);
+	sub->pending = 1;
+}
+
+static void _wake(canmux_sub_t *sub) {
+	pthread_mutex_lock(&sub->lock);
+	pthread_cond_broadcast(&sub->cond);
+	pthread_mutex_unlock(&sub->lock);
+}
+
+/* Bus lock held */
+static void _dispatch(struct canmux_bus *bus, canmux_sub_t *from, struct can_frame *frame, uint64_t stamp) {
+	canmux_sub_t *sub;
+
+	for(sub = bus->subs; sub; sub = sub->next) {
+		if (sub != from && _match(sub,frame->can_id)) _push(bus,sub,frame,stamp);
+	}
+}
+
+/* Bus lock held */
+static void _wakeall(struct canmux_bus *bus) {
+	canmux_sub_t *sub;
+
+	for(sub = bus->subs; sub; sub = sub->next) {
+		if (!sub->pending) continue;
+		sub->pending = 0;
+		if (__atomic_load_n(&sub->waiters,__ATOMIC_SEQ_CST)) _wake(sub);
+	}
+}
+
+/* Kernel filter = union of everyone's (bus lock held) */
+static void _setfilter(struct canmux_bus *bus) {
+	struct can_filter all = { 0, 0 }, *filters;
+	canmux_sub_t *sub;
+	int i,j,n,count;
+
+	n = 0;
+	for(sub = bus->subs; sub; sub = sub->next) {
+		if (!sub->count) break;
+		n += sub->count;
+	}
+	filters = 0;
+	count = 0;
+	if (!sub && n && n <= CAN_RAW_FILTER_MAX) {
+		filters = malloc(n * sizeof(*filters));
+		if (filters) {
+			for(sub = bus->subs; sub; sub = sub->next) {
+				for(i=0; i < sub->count; i++) {
+					for(j=0; j < count; j++) {
+						if (filters[j].can_id == sub->filters[i].can_id && filters[j].can_mask == sub->filters[i].can_mask) break;
+					}
+					if (j == count) filters[count++] = sub->filters[i];
+				}
+			}
+		}
+	}
+	dprintf(dlevel,"%s: filters: %d\n", bus->interface, filters ? count : 0);
+	if (setsockopt(bus->fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters ? filters : &all, (filters ? count : 1) * sizeof(all)) < 0)
+		log_syserror("canmux: %s: setsockopt CAN_RAW_FILTER",bus->interface);
+	free(filters);
+}
+
+static uint64_t _stamp(struct msghdr *msg) {
+	struct cmsghdr *cmsg;
+	struct timespec ts;
+
+	for(cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg,cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			memcpy(&ts,CMSG_DATA(cmsg),sizeof(ts));
+			return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+		}
+	}
+	return canframe_now();
+}
+
+static void *canmux_thread(void *arg) {
+	struct canmux_bus *bus = arg;
+	struct mmsghdr msgs[CANMUX_BATCH];
+	struct iovec iovs[CANMUX_BATCH];
+	struct can_frame frames[CANMUX_BATCH];
+	char control[CANMUX_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+	int i,n,errors,state;
+	sigset_t set;
+
+	/* Ignore SIGPIPE */
+	sigemptyset(&set);
+	sigaddset(&set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	memset(msgs,0,sizeof(msgs));
+	for(i=0; i < CANMUX_BATCH; i++) {
+		iovs[i].iov_base = &frames[i];
+		iovs[i].iov_len = sizeof(frames[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = control[i];
+	}
+
+	dprintf(dlevel,"%s: thread started\n", bus->interface);
+	errors = 0;
+	while(1) {
+		for(i=0; i < CANMUX_BATCH; i++) {
+			msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+			msgs[i].msg_hdr.msg_flags = 0;
+		}
+
+		/* Wait for one, then take whatever else is there */
+		n = recvmmsg(bus->fd, msgs, CANMUX_BATCH, MSG_WAITFORONE, 0);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN) continue;
+			if (!errors++) log_syserror("canmux: %s: recvmmsg",bus->interface);
+			sleep(1);
+			continue;
+		}
+		errors = 0;
+		dprintf(8,"%s: n: %d\n", bus->interface, n);
+
+		/* Not cancelled with the bus locked */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,&state);
+		pthread_mutex_lock(&bus->lock);
+		bus->batches++;
+		for(i=0; i < n; i++) {
+			if (msgs[i].msg_len != sizeof(struct can_frame)) continue;
+			bus->frames++;
+			_dispatch(bus,0,&frames[i],_stamp(&msgs[i].msg_hdr));
+		}
+		_wakeall(bus);
+		pthread_mutex_unlock(&bus->lock);
+		pthread_setcancelstate(state,0);
+	}
+	return 0;
+}
+
+static struct canmux_bus *canmux_newbus(char *interface, int bitrate) {
+	struct canmux_bus *bus;
+
+	bus = calloc(1,sizeof(*bus));
+	if (!bus) {
+		log_syserror("canmux_newbus: calloc");
+		return 0;
+	}
+	strncpy(bus->interface,interface,sizeof(bus->interface)-1);
+	bus->bitrate = bitrate;
+	bus->fd = can_socket(interface,bitrate);
+	if (bus->fd < 0) {
+		free(bus);
+		return 0;
+	}
+	pthread_mutex_init(&bus->lock,0);
+	if (pthread_create(&bus->th,0,canmux_thread,bus)) {
+		log_syserror("canmux_newbus: pthread_create");
+		pthread_mutex_destroy(&bus->lock);
+		close(bus->fd);
+		free(bus);
+		return 0;
+	}
+	dprintf(dlevel,"%s: fd: %d\n", bus->interface, bus->fd);
+	return bus;
+}
+
+static void canmux_freebus(struct canmux_bus *bus) {
+	dprintf(dlevel,"%s: batches: %llu, frames: %llu\n", bus->interface,
+		(unsigned long long)bus->batches, (unsigned long long)bus->frames);
+	pthread_cancel(bus->th);
+	pthread_join(bus->th,0);
+	close(bus->fd);
+	pthread_mutex_destroy(&bus->lock);
+	free(bus);
+}
+
+int canmux_open(canmux_sub_t *sub, char *interface, int bitrate) {
+	struct canmux_bus *bus;
+
+	if (!sub || !interface) return 1;
+	dprintf(dlevel,"interface: %s, bitrate: %d, bus: %p\n", interface, bitrate, sub->bus);
+	if (sub->bus) return 0;
+
+	pthread_mutex_lock(&canmux_lock);
+	for(bus = canmux_buses; bus; bus = bus->next) {
+		if (strcmp(bus->interface,interface) == 0) break;
+	}
+	if (bus) {
+		if (bitrate && bitrate != bus->bitrate)
+			log_warning("canmux: %s already open at %d, not changing to %d\n", interface, bus->bitrate, bitrate);
+	} else {
+		bus = canmux_newbus(interface,bitrate);
+		if (!bus) {
+			pthread_mutex_unlock(&canmux_lock);
+			return 1;
+		}
+		bus->next = canmux_buses;
+		canmux_buses = bus;
+	}
+	bus->refs++;
+
+	pthread_mutex_lock(&bus->lock);
+	/* Start with an empty ring */
+	sub->tail = sub->head;
+	sub->dropped = 0;
+	sub->next = bus->subs;
+	bus->subs = sub;
+	__atomic_store_n(&sub->bus,bus,__ATOMIC_SEQ_CST);
+	_setfilter(bus);
+	pthread_mutex_unlock(&bus->lock);
+
+	pthread_mutex_unlock(&canmux_lock);
+	return 0;
+}
+
+int canmux_close(canmux_sub_t *sub) {
+	struct canmux_bus *bus,**bpp;
+	canmux_sub_t **pp;
+
+	if (!sub || !sub->bus) return 0;
+	bus = sub->bus;
+	dprintf(dlevel,"%s: refs: %d\n", bus->interface, bus->refs);
+
+	pthread_mutex_lock(&canmux_lock);
+	pthread_mutex_lock(&bus->lock);
+	for(pp = &bus->subs; *pp; pp = &(*pp)->next) {
+		if (*pp == sub) {
+			*pp = sub->next;
+			break;
+		}
+	}
+	sub->next = 0;
+	__atomic_store_n(&sub->bus,0,__ATOMIC_SEQ_CST);
+	if (bus->subs) _setfilter(bus);
+	pthread_mutex_unlock(&bus->lock);
+
+	/* Anyone waiting gets -1 */
+	_wake(sub);
+
+	if (--bus->refs == 0) {
+		for(bpp = &canmux_buses; *bpp; bpp = &(*bpp)->next) {
+			if (*bpp == bus) {
+				*bpp = bus->next;
+				break;
+			}
+		}
+		canmux_freebus(bus);
+	}
+	pthread_mutex_unlock(&canmux_lock);
+	return 0;
+}
+
+int canmux_filter(canmux_sub_t *sub, struct can_filter *filters, int count) {
+	struct can_filter *newf,*oldf;
+	struct canmux_bus *bus;
+
+	if (!sub) return 1;
+	newf = 0;
+	if (count > 0) {
+		newf = malloc(count * sizeof(*newf));
+		if (!newf) {
+			log_syserror("canmux_filter: malloc(%d)", count * sizeof(*newf));
+			return 1;
+		}
+		memcpy(newf,filters,count * sizeof(*newf));
+	} else {
+		count = 0;
+	}
+	bus = sub->bus;
+	if (bus) pthread_mutex_lock(&bus->lock);
+	oldf = sub->filters;
+	sub->filters = newf;
+	sub->count = count;
+	if (bus) {
+		_setfilter(bus);
+		pthread_mutex_unlock(&bus->lock);
+	}
+	free(oldf);
+	return 0;
+}
+
+int canmux_set_cache(canmux_sub_t *sub, canframe_cache_t *cache) {
+	struct canmux_bus *bus;
+
+	if (!sub) return 1;
+	bus = sub->bus;
+	if (bus) pthread_mutex_lock(&bus->lock);
+	sub->cache = cache;
+	if (bus) pthread_mutex_unlock(&bus->lock);
+	return 0;
+}
+
+static void _unwait(void *arg) {
+	canmux_sub_t *sub = arg;
+
+	__atomic_sub_fetch(&sub->waiters,1,__ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&sub->lock);
+}
+
+int canmux_read(canmux_sub_t *sub, struct can_frame *frame, uint64_t *stamp, int timeout) {
+	struct canmux_entry *e;
+	struct timespec ts;
+	uint32_t tail;
+	int rc;
+
+	if (!sub) return -1;
+	if (timeout >= 0) {
+		clock_gettime(CLOCK_REALTIME,&ts);
+		ts.tv_sec += timeout / 1000;
+		ts.tv_nsec += (timeout % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+	tail = sub->tail;
+	rc = 0;
+	while(1) {
+		if (tail != __atomic_load_n(&sub->head,__ATOMIC_ACQUIRE)) {
+			e = &sub->ring[tail & (CANMUX_RING-1)];
+			memcpy(frame,&e->frame,sizeof(*frame));
+			if (stamp) *stamp = e->stamp;
+			__atomic_store_n(&sub->tail,tail + 1,__ATOMIC_RELEASE);
+			return sizeof(*frame);
+		}
+		if (!__atomic_load_n(&sub->bus,__ATOMIC_SEQ_CST)) return -1;
+		if (rc == ETIMEDOUT) return 0;
+		if (rc) return -1;
+
+		/* Empty - wait for the bus thread (or close) */
+		pthread_mutex_lock(&sub->lock);
+		pthread_cleanup_push(_unwait,sub);
+		__atomic_add_fetch(&sub->waiters,1,__ATOMIC_SEQ_CST);
+		if (tail == __atomic_load_n(&sub->head,__ATOMIC_SEQ_CST) && __atomic_load_n(&sub->bus,__ATOMIC_SEQ_CST)) {
+			if (timeout < 0) pthread_cond_wait(&sub->cond,&sub->lock);
+			else rc = pthread_cond_timedwait(&sub->cond,&sub->lock,&ts);
+		}
+		pthread_cleanup_pop(1);
+	}
+}
+
+int canmux_write(canmux_sub_t *sub, struct can_frame *frame) {
+	struct canmux_bus *bus;
+	int bytes;
+
+	if (!sub || !sub->bus) return -1;
+	bus = sub->bus;
+	bytes = write(bus->fd, frame, sizeof(*frame));
+	dprintf(dlevel,"%s: id: %03x, bytes: %d\n", bus->interface, frame->can_id, bytes);
+	if (bytes == sizeof(*frame)) {
+		/* The others would have seen it on their own sockets */
+		pthread_mutex_lock(&bus->lock);
+		_dispatch(bus,sub,frame,canframe_now());
+		_wakeall(bus);
+		pthread_mutex_unlock(&bus->lock);
+	}
+	return bytes;
+}
+
+int canmux_fd(canmux_sub_t *sub) {
+	return (sub && sub->bus ? sub->bus->fd : -1);
+}
+
+uint64_t canmux_dropped(canmux_sub_t *sub) {
+	return (sub ? sub->dropped : 0);
+}
+#endif
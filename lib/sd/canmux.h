@@ -0,0 +1,59 @@
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_CANMUX_H
+#define __SD_CANMUX_H
+
+#include <stdint.h>
+#include "can.h"
+#include "canframe.h"
+
+/* One reader per CAN interface per process.  Every can driver session on an
+   interface is a subscriber of that interface's bus.  The bus has a single
+   raw socket and thread which receives frames in batches (recvmmsg, with the
+   kernel receive stamps), with the kernel filter set to the union of the
+   subscribers' filters.  Each frame is handed to every subscriber whose
+   filters match it: into the subscriber's frame cache if it has one (buffer
+   mode), otherwise onto its ring.  A ring has one producer at a time (under
+   the bus lock, taken once per batch) and one consumer which reads without
+   locking; it only blocks, on a condvar, when the ring is empty.
+
+   Frames written by a subscriber go out on the shared socket and are also
+   given to the other subscribers, as they would have seen them on their
+   own sockets.  The bitrate is set by whoever opens the interface first. */
+
+#define CANMUX_BATCH		32	/* Frames per recvmmsg */
+#define CANMUX_RING		512	/* Frames per subscriber (power of 2) */
+
+struct canmux_sub;
+typedef struct canmux_sub canmux_sub_t;
+
+canmux_sub_t *canmux_create(void);
+void canmux_destroy(canmux_sub_t *sub);
+
+/* Attach to / detach from the bus on interface (closing wakes any reader) */
+int canmux_open(canmux_sub_t *sub, char *interface, int bitrate);
+int canmux_close(canmux_sub_t *sub);
+
+/* Which frames we want (count 0 = all) */
+int canmux_filter(canmux_sub_t *sub, struct can_filter *filters, int count);
+
+/* Put frames in cache rather than on the ring (0 = back to the ring) */
+int canmux_set_cache(canmux_sub_t *sub, canframe_cache_t *cache);
+
+/* Next frame off the ring: returns frame size, 0 on timeout (ms, -1 = forever), -1 if closed */
+int canmux_read(canmux_sub_t *sub, struct can_frame *frame, uint64_t *stamp, int timeout);
+int canmux_write(canmux_sub_t *sub, struct can_frame *frame);
+
+int canmux_fd(canmux_sub_t *sub);
+uint64_t canmux_dropped(canmux_sub_t *sub);
+
+/* Raw socket bound to interface, brought up at bitrate if needed (can.c) */
+int can_socket(char *interface, int bitrate);
+
+#endif /* __SD_CANMUX_H */
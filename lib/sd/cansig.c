@@ -0,0 +1,296 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 7
+#include "debug.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "log.h"
+#include "types.h"
+#include "utils.h"
+#include "cansig.h"
+
+struct cansig_table {
+	canid_t start;
+	canid_t end;
+	cansig_t **frames;		/* 1st signal of each frame */
+	list signals;
+};
+
+cansig_table_t *cansig_create(canid_t start, canid_t end) {
+	cansig_table_t *t;
+
+	dprintf(dlevel,"start: %03x, end: %03x\n", start, end);
+	if (end <= start) return 0;
+	t = calloc(1,sizeof(*t));
+	if (!t) {
+		log_syserror("cansig_create: calloc");
+		return 0;
+	}
+	t->frames = calloc(end - start,sizeof(*t->frames));
+	t->signals = list_create();
+	if (!t->frames || !t->signals) {
+		log_syserror("cansig_create: calloc frames(%d)", end - start);
+		cansig_destroy(t);
+		return 0;
+	}
+	t->start = start;
+	t->end = end;
+	return t;
+}
+
+void cansig_destroy(cansig_table_t *t) {
+	if (!t) return;
+	if (t->signals) list_destroy(t->signals);
+	free(t->frames);
+	free(t);
+}
+
+static cansig_t **_head(cansig_table_t *t, canid_t id) {
+	if (!t || id < t->start || id >= t->end) return 0;
+	return &t->frames[id - t->start];
+}
+
+cansig_t *cansig_find(cansig_table_t *t, char *name) {
+	cansig_t *sig;
+
+	if (!t || !name) return 0;
+	list_reset(t->signals);
+	while((sig = list_get_next(t->signals)) != 0) {
+		if (strcmp(sig->name,name) == 0) return sig;
+	}
+	return 0;
+}
+
+list cansig_signals(cansig_table_t *t) {
+	return (t ? t->signals : 0);
+}
+
+/* Work out where the signal is in the frame read as one 64-bit value */
+static int _plan(cansig_t *sig) {
+	int msb;
+
+	if (sig->size < 1 || sig->size > 64) return 1;
+	if (sig->flags & CANSIG_MOTOROLA) {
+		/* DBC start is the MSB; data[0] is the top byte of the value */
+		if (sig->start < 0 || sig->start > 63) return 1;
+		msb = ((7 - (sig->start / 8)) * 8) + (sig->start % 8);
+		sig->shift = msb - (sig->size - 1);
+		if (sig->shift < 0) return 1;
+		sig->need = 8 - (sig->shift / 8);
+	} else {
+		if (sig->start < 0 || sig->start + sig->size > 64) return 1;
+		sig->shift = sig->start;
+		sig->need = ((sig->start + sig->size - 1) / 8) + 1;
+	}
+	sig->mask = (sig->size == 64 ? ~0ULL : (1ULL << sig->size) - 1);
+	return 0;
+}
+
+static void _unlink(cansig_table_t *t, cansig_t *sig) {
+	cansig_t **pp;
+
+	for(pp = _head(t,sig->id); pp && *pp; pp = &(*pp)->next) {
+		if (*pp == sig) {
+			*pp = sig->next;
+			break;
+		}
+	}
+	sig->next = 0;
+}
+
+cansig_t *cansig_add(cansig_table_t *t, cansig_def_t *def) {
+	cansig_t newsig,*sig,**pp;
+
+	if (!t || !def || !def->name) return 0;
+	dprintf(dlevel,"name: %s, id: %03x, start: %d, size: %d, flags: %02x, scale: %f, offset: %f\n",
+		def->name, def->id, def->start, def->size, def->flags, def->scale, def->offset);
+	if (!_head(t,def->id)) {
+		log_error("cansig_add: %s: id %03x not in range %03x-%03x\n", def->name, def->id, t->start, t->end - 1);
+		return 0;
+	}
+	memset(&newsig,0,sizeof(newsig));
+	strncpy(newsig.name,def->name,sizeof(newsig.name)-1);
+	newsig.id = def->id;
+	newsig.start = def->start;
+	newsig.size = def->size;
+	newsig.flags = def->flags;
+	newsig.scale = (def->scale == 0.0 ? 1.0 : def->scale);
+	newsig.offset = def->offset;
+	if (def->unit) strncpy(newsig.unit,def->unit,sizeof(newsig.unit)-1);
+	newsig.type = def->type;
+	newsig.dest = def->dest;
+	if (_plan(&newsig)) {
+		log_error("cansig_add: %s: invalid start/size: %d/%d\n", def->name, def->start, def->size);
+		return 0;
+	}
+
+	sig = cansig_find(t,newsig.name);
+	if (sig) {
+		/* Redefined - keep where it goes unless given a new place */
+		_unlink(t,sig);
+		if (!newsig.dest) {
+			newsig.type = sig->type;
+			newsig.dest = sig->dest;
+		}
+		*sig = newsig;
+	} else {
+		sig = list_add(t->signals,&newsig,sizeof(newsig));
+		if (!sig) {
+			log_syserror("cansig_add: list_add");
+			return 0;
+		}
+	}
+
+	/* Frame signals are decoded in the order they were defined */
+	for(pp = _head(t,sig->id); *pp; pp = &(*pp)->next);
+	*pp = sig;
+	return sig;
+}
+
+int cansig_add_table(cansig_table_t *t, cansig_def_t *defs) {
+	cansig_def_t *def;
+	int r;
+
+	r = 0;
+	for(def = defs; def->name; def++) {
+		if (!cansig_add(t,def)) r = 1;
+	}
+	return r;
+}
+
+int cansig_load(cansig_table_t *t, char *path) {
+	char line[1024],name[CANSIG_NAME_LEN],unit[CANSIG_UNIT_LEN],order,sign,*p,*e;
+	cansig_def_t def;
+	unsigned long id;
+	int have_id,count,lineno,len;
+	FILE *fp;
+
+	dprintf(dlevel,"path: %s\n", path);
+	fp = fopen(path,"r");
+	if (!fp) {
+		log_syserror("cansig_load: fopen %s",path);
+		return 1;
+	}
+	have_id = count = lineno = 0;
+	id = 0;
+	while(fgets(line,sizeof(line),fp)) {
+		lineno++;
+		for(p = line; *p == ' ' || *p == '\t'; p++);
+		if (strncmp(p,"BO_ ",4) == 0) {
+			have_id = (sscanf(p+4,"%lu",&id) == 1);
+			/* Extended ids have bit 31 set - same as CAN_EFF_FLAG */
+			continue;
+		}
+		if (strncmp(p,"SG_ ",4) != 0) continue;
+		if (!have_id) {
+			log_warning("%s(%d): SG_ before BO_, ignored\n", path, lineno);
+			continue;
+		}
+		memset(&def,0,sizeof(def));
+		*name = 0;
+		sscanf(p+4,"%31s",name);
+		p = strchr(p,':');
+		if (!*name || !p || sscanf(p+1," %d|%d@%c%c (%lf,%lf)",&def.start,&def.size,&order,&sign,&def.scale,&def.offset) != 6) {
+			log_warning("%s(%d): unable to parse signal, ignored\n", path, lineno);
+			continue;
+		}
+		*unit = 0;
+		p = strchr(p,'"');
+		if (p && (e = strchr(p+1,'"')) != 0) {
+			len = e - (p+1);
+			if (len > sizeof(unit)-1) len = sizeof(unit)-1;
+			memcpy(unit,p+1,len);
+			unit[len] = 0;
+		}
+		def.name = name;
+		def.id = id;
+		if (order == '0') def.flags |= CANSIG_MOTOROLA;
+		if (sign == '-') def.flags |= CANSIG_SIGNED;
+		def.unit = unit;
+		if (cansig_add(t,&def)) count++;
+	}
+	fclose(fp);
+	log_info("%s: loaded %d signals\n", path, count);
+	return 0;
+}
+
+static void _store(cansig_t *sig, double val) {
+	switch(sig->type) {
+	case DATA_TYPE_F64:
+		*(double *)sig->dest = val;
+		break;
+	case DATA_TYPE_F32:
+		*(float *)sig->dest = val;
+		break;
+	case DATA_TYPE_BOOL:
+		*(int *)sig->dest = (val != 0.0);
+		break;
+	case DATA_TYPE_S32:
+		*(int32_t *)sig->dest = val;
+		break;
+	case DATA_TYPE_U32:
+		*(uint32_t *)sig->dest = val;
+		break;
+	case DATA_TYPE_S16:
+		*(int16_t *)sig->dest = val;
+		break;
+	case DATA_TYPE_U16:
+		*(uint16_t *)sig->dest = val;
+		break;
+	case DATA_TYPE_S8:
+		*(int8_t *)sig->dest = val;
+		break;
+	case DATA_TYPE_U8:
+		*(uint8_t *)sig->dest = val;
+		break;
+	default:
+		conv_type(sig->type,sig->dest,0,DATA_TYPE_F64,&val,0);
+		break;
+	}
+}
+
+int cansig_decode(cansig_table_t *t, struct can_frame *frame) {
+	cansig_t **pp,*sig;
+	uint64_t le,be,raw;
+	double val;
+	int i,n;
+
+	pp = _head(t,frame->can_id);
+	if (!pp || !*pp) return 0;
+
+	/* The frame as one value both ways round */
+	le = be = 0;
+	for(i=0; i < 8; i++) {
+		le |= ((uint64_t)frame->data[i]) << (i * 8);
+		be = (be << 8) | frame->data[i];
+	}
+
+	n = 0;
+	for(sig = *pp; sig; sig = sig->next) {
+		if (frame->can_dlc < sig->need) continue;
+		raw = (((sig->flags & CANSIG_MOTOROLA) ? be : le) >> sig->shift) & sig->mask;
+		if (sig->flags & CANSIG_SIGNED) {
+			if (sig->size < 64 && (raw >> (sig->size - 1)) & 1) raw |= ~sig->mask;
+			val = (double)(int64_t)raw;
+		} else {
+			val = (double)raw;
+		}
+		val = (val * sig->scale) + sig->offset;
+		sig->value = val;
+		sig->count++;
+		if (sig->dest) _store(sig,val);
+		n++;
+	}
+	dprintf(dlevel,"id: %03x, decoded: %d\n", frame->can_id, n);
+	return n;
+}
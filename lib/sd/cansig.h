@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_CANSIG_H
+#define __SD_CANSIG_H
+
+#include <stdint.h>
+#include "can.h"
+#include "list.h"
+
+/* Table driven CAN signal decoding.  Each signal is described like a DBC
+   signal (frame id, start bit, length, byte order, signedness, scale,
+   offset and unit) and optionally bound to a variable of some DATA_TYPE.
+   Signals are chained per frame id when they're added, so decoding a frame
+   is one walk of that frame's signals - each is extracted, scaled, kept in
+   the table (for lookup by name) and stored to its variable.
+
+   Definitions come from a table in the code and/or a .dbc file.  Only the
+   BO_ and SG_ lines of the file are used:
+
+	BO_ 772 SI_AC1: 8 SI
+	 SG_ ac1_voltage_l1 : 0|16@1- (0.1,0) [0|0] "V" Vector__XXX
+
+   A signal in the file with the same name as one already in the table
+   replaces its definition but keeps its variable; any others are value only. */
+
+#define CANSIG_NAME_LEN		32
+#define CANSIG_UNIT_LEN		16
+
+#define CANSIG_SIGNED		0x01	/* Two's complement (DBC -) */
+#define CANSIG_MOTOROLA		0x02	/* Big endian, start is the MSB (DBC @0) */
+
+struct cansig_def {
+	char *name;
+	canid_t id;
+	int start;			/* Start bit (DBC numbering) */
+	int size;			/* Length in bits (1 - 64) */
+	int flags;
+	double scale;			/* value = raw * scale + offset (scale 0 = 1) */
+	double offset;
+	char *unit;
+	int type;			/* DATA_TYPE_* of dest */
+	void *dest;			/* 0 = value only */
+};
+typedef struct cansig_def cansig_def_t;
+
+struct cansig {
+	char name[CANSIG_NAME_LEN];
+	canid_t id;
+	int start;
+	int size;
+	int flags;
+	double scale;
+	double offset;
+	char unit[CANSIG_UNIT_LEN];
+	int type;
+	void *dest;
+	/* Decode plan */
+	int shift;			/* Of the LSB in the 64-bit frame value */
+	int need;			/* Bytes the frame must have */
+	uint64_t mask;
+	double value;			/* Last decoded */
+	uint32_t count;			/* Times decoded */
+	struct cansig *next;		/* Next signal in the same frame */
+};
+typedef struct cansig cansig_t;
+
+struct cansig_table;
+typedef struct cansig_table cansig_table_t;
+
+/* ids start .. end-1 */
+cansig_table_t *cansig_create(canid_t start, canid_t end);
+void cansig_destroy(cansig_table_t *t);
+
+/* Add (or redefine) one signal / a table ending with { 0 } */
+cansig_t *cansig_add(cansig_table_t *t, cansig_def_t *def);
+int cansig_add_table(cansig_table_t *t, cansig_def_t *defs);
+int cansig_load(cansig_table_t *t, char *path);
+
+/* Decode every signal in the frame, returns the number decoded */
+int cansig_decode(cansig_table_t *t, struct can_frame *frame);
+
+cansig_t *cansig_find(cansig_table_t *t, char *name);
+list cansig_signals(cansig_table_t *t);
+
+#endif /* __SD_CANSIG_H */
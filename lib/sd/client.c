@@ -44,12 +44,24 @@ struct js_client_rootinfo {
 
 static void client_getmsg(void *ctx, char *topic, char *message, int msglen, char *replyto) {
 	solard_client_t *c = ctx;
-	solard_message_t newmsg;
+	solard_message_t *msg;
 
 	dprintf(dlevel,"addmq: %d\n", c->addmq);
-	if (!c->addmq) return;
-	if (solard_getmsg(&newmsg,topic,message,msglen,replyto)) return;
-	list_add(c->mq,&newmsg,sizeof(newmsg));
+	if (!c->addmq && (!c->m || !c->m->rpc)) return;
+	msg = solard_message_new(topic,message,msglen,replyto);
+	if (!msg) return;
+	if (rpc_intercept(c->m,msg) == 0 || !c->addmq) {
+		solard_message_unref(msg);
+		return;
+	}
+	/* Runs on the MQTT thread - messages are moved to mq by client_get_mq */
+	inbox_put(c->inbox,msg);
+}
+
+list client_get_mq(solard_client_t *c) {
+	if (!c) return 0;
+	inbox_drain(c->inbox,c->mq);
+	return c->mq;
 }
 
 void client_mktopic(char *topic, int topicsz, char *name, char *func) {
@@ -83,7 +95,7 @@ void client_event(solard_client_t *c, char *module, char *action) {
 		if (event) {
 			char topic[SOLARD_TOPIC_SIZE];
 			client_mktopic(topic,sizeof(topic)-1,c->name,"Event");
-			mqtt_pub(c->m,topic,event,1,0);
+			mqtt_pub(c->m,topic,event,0,0);
 			free(event);
 		}
 	}
@@ -152,6 +164,9 @@ static int client_startup(solard_client_t *c, char *configfile, char *mqtt_info,
 #endif
 	)) return 1;
         if (props) free(props);
+#ifdef INFLUX
+	if (c->i) influx_set_spool_name(c->i, c->name);
+#endif
 
 #ifdef MQTT
 	if (0) {
@@ -258,7 +273,9 @@ solard_client_t *client_init(int argc,char **argv,char *Cname, char *version,opt
 	dprintf(ldlevel,"c->section_name: %s\n", c->section_name);
 #ifdef MQTT
 	c->config_from_mqtt = config_from_mqtt;
-	c->mq = list_create();
+	c->inbox = inbox_create(INBOX_DEFAULT_SIZE);
+	if (!c->inbox) goto client_init_error;
+	c->mq = solard_message_list_create();
 	c->addmq = addmq_flag;
 #endif
 	c->flags = flags;
@@ -374,6 +391,7 @@ void client_destroy_client(solard_client_t *c) {
 	config_destroy_config(c->cp);
 #ifdef MQTT
 	if (c->m) mqtt_destroy_session(c->m);
+	inbox_destroy(c->inbox);
 	list_destroy(c->mq);
 #endif
 #ifdef INFLUX
@@ -420,7 +438,7 @@ static JSBool js_client_getprop(JSContext *cx, JSObject *obj, jsval id, jsval *r
 			break;
 #ifdef MQTT
 		case CLIENT_PROPERTY_ID_MQ:
-			*rval = OBJECT_TO_JSVAL(js_create_messages_array(cx,obj,c->mq));
+			*rval = OBJECT_TO_JSVAL(js_create_messages_array(cx,obj,client_get_mq(c)));
 			break;
 		case CLIENT_PROPERTY_ID_ADDMQ:
 			*rval = type_to_jsval(cx,DATA_TYPE_BOOL,&c->addmq,0);
@@ -662,7 +680,7 @@ static JSBool js_client_purgemq(JSContext *cx, uintN argc, jsval *vp) {
 		JS_ReportError(cx,"client private is null!\n");
 		return JS_FALSE;
 	}
-	list_purge(c->mq);
+	list_purge(client_get_mq(c));
 	return JS_TRUE;
 }
 
@@ -31,7 +31,8 @@ struct solard_client {
 	mqtt_session_t *m;			/* MQTT session */
 	bool config_from_mqtt;
 	int mqtt_init;
-	list mq;				/* Messages */
+	inbox_t *inbox;				/* MQTT thread -> client handoff */
+	list mq;				/* Messages (see client_get_mq) */
 	bool addmq;				/* add messages to q if true */
 #endif
 #ifdef INFLUX
@@ -71,6 +72,11 @@ typedef struct solard_client solard_client_t;
 solard_client_t *client_init(int argc,char **argv,char *Cname, char *version, opt_proctab_t *opts, int flags, config_property_t *props);
 void client_shutdown(void);
 
+#ifdef MQTT
+/* Messages received so far (moved off the inbox) */
+list client_get_mq(solard_client_t *c);
+#endif
+
 #if 0
 typedef int (client_callback_t)(void *ctx, solard_client_t *);
 void client_destroy_client(solard_client_t *c);
@@ -797,6 +797,7 @@ JSEngine *common_jsinit(int rtsize, int stksize, js_outputfunc_t *jsout) {
 	JS_EngineAddInitClass(e, "js_InitClientClass", js_InitClientClass);
 	JS_EngineAddInitClass(e, "js_InitMQTTClass", js_InitMQTTClass);
 	JS_EngineAddInitClass(e, "js_InitMessageClass", js_InitMessageClass);
+	JS_EngineAddInitClass(e, "js_InitRPCRequestClass", js_InitRPCRequestClass);
 #endif
 #ifdef INFLUX
 	if (influx_jsinit(e)) return 0;
@@ -59,6 +59,7 @@ enum SOLARD_MESSAGE_TYPE {
 #define SOLARD_FUNC_CONFIG	"Config"
 #define SOLARD_FUNC_DATA	"Data"
 #define SOLARD_FUNC_EVENT	"Event"
+#define SOLARD_FUNC_STATS	"Stats"
 #define SOLARD_FUNC_LEN		16
 
 struct solard_power {
@@ -94,13 +95,20 @@ extern char SOLARD_TZ[16], SOLARD_TZNAME[128];
 #include "cfg.h"
 #include "config.h"
 #include "message.h"
+#include "inbox.h"
+#include "router.h"
+#include "rpc.h"
+#include "shmdata.h"
 #include "json.h"
+#include "stats.h"
+#include "datafilter.h"
 #include "utils.h"
 #include "debug.h"
 #include "state.h"
 #include "mqtt.h"
 #include "influx.h"
 #include "event.h"
+#include "reactor.h"
 #include "agent.h"
 #include "client.h"
 
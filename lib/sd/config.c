@@ -27,6 +27,10 @@ static list configs = 0;
 static list js_ctxs = 0;
 #endif
 
+static int config_index_update(config_t *cp);
+static config_property_t *config_index_get(config_t *cp, config_section_t *s, char *name);
+static void config_index_free(config_t *cp);
+
 char *config_get_errmsg(config_t *cp) { return cp->errmsg; }
 
 void config_dump_property(config_property_t *p, int level) {
@@ -146,6 +150,7 @@ config_function_t *config_function_get(config_t *cp, char *name) {
 
 config_property_t *config_section_get_property(config_section_t *s, char *name) {
 	config_property_t *p;
+	list_iter_t it;
 
 	int ldlevel = dlevel;
 
@@ -153,18 +158,17 @@ config_property_t *config_section_get_property(config_section_t *s, char *name)
 
 	dprintf(ldlevel,"==> LOOKING FOR: section: %s, name: %s\n", s->name, name);
 
-	list_save_next(s->items);
-	list_reset(s->items);
-	while((p = list_get_next(s->items)) != 0) {
+	if (s->cp && s->cp->index && !s->cp->index_dirty) return config_index_get(s->cp, s, name);
+
+	list_iter_init(&it,s->items);
+	while((p = list_iter_next(&it)) != 0) {
 //		dprintf(dlevel+1,"p: %p\n", p);
 		dprintf(ldlevel+2,"CHECKING: p->name: %s, name: %s\n", p->name, name);
 		if (strcasecmp(p->name,name)==0) {
 			dprintf(ldlevel,"found: %p\n",p);
-			list_restore_next(s->items);
 			return p;
 		}
 	}
-	list_restore_next(s->items);
 	dprintf(ldlevel,"NOT found\n");
 	return 0;
 }
@@ -198,6 +202,7 @@ config_property_t *config_get_property(config_t *cp, char *sname, char *name) {
 	dprintf(dlevel,"s: %p\n", s);
 	if (!s) return 0;
 
+	config_index_update(cp);
 	return config_section_get_property(s,name);
 #if 0
 	dprintf(dlevel,"item count: %d\n", list_count(s->items));
@@ -229,6 +234,7 @@ int config_delete_property(config_t *cp, char *sname, char *name) {
 			dprintf(dlevel,"found\n");
 			if (cp->map && p->id >=0 && p->id < cp->map_maxid) cp->map[p->id] = 0;
 			list_delete(s->items,p);
+			cp->index_dirty = 1;
 			return 0;
 		}
 	}
@@ -477,8 +483,9 @@ config_property_t *config_combine_props(config_property_t *p1, config_property_t
 				if (strcmp(pp1->name,npp->name) == 0) {
 					dprintf(dlevel+2,"p1: name: %s, dest: %p(%d), allocdest: %d\n", pp1->name, pp1->dest, pp1->dsize, check_bit(pp1->flags,CONFIG_FLAG_ALLOCDEST));
 					dprintf(dlevel+2,"npp: name: %s, dest: %p(%d)\n", npp->name, npp->dest, npp->dsize);
-					/* if p1's dest is static && p2's dest is empty */
+					/* if p1's dest is static && p2's dest is empty (the dest's type goes with it) */
 					if (pp1->dest && !check_bit(pp1->flags,CONFIG_FLAG_ALLOCDEST) && !npp->dest) {
+						npp->type = pp1->type;
 						npp->dest = pp1->dest;
 						npp->dsize = pp1->dsize;
 						dprintf(dlevel+2,"NEW npp->dest: %p(%d)\n", npp->dest, npp->dsize);
@@ -629,6 +636,7 @@ int config_section_add_property(config_t *cp, config_section_t *s, config_proper
 //		if (pp->flags & CONFIG_FLAG_FILE) p->flags |= CONFIG_FLAG_FILE;
 		config_destroy_property(pp);
 		list_delete(s->items,pp);
+		cp->index_dirty = 1;
 	}
 	p->flags |= flags;
 	dprintf(dlevel,"%s: dest: %p, def: %s, flags: %x\n", p->name, p->dest, p->def, p->flags);
@@ -638,6 +646,7 @@ int config_section_add_property(config_t *cp, config_section_t *s, config_proper
 	}
 	if ((flags & CONFIG_FLAG_NOID) == 0) p->id = cp->id++;
 	list_add(s->items, p, p->flags & CONFIG_FLAG_ALLOC ? 0 : sizeof(*p));
+	cp->index_dirty = 1;
 //	config_dump_property(p,0);
 	return 0;
 }
@@ -652,6 +661,7 @@ void config_destroy_props(config_property_t *props) {
 void config_build_propmap(config_t *cp) {
 	config_section_t *s;
 	config_property_t *p;
+	list_iter_t sit,pit;
 	int size;
 
 	dprintf(dlevel,"cp->map: %p\n", cp->map);
@@ -665,12 +675,13 @@ void config_build_propmap(config_t *cp) {
 		return;
 	}
 	memset(cp->map,0,size);
-	list_reset(cp->sections);
-	while((s = list_get_next(cp->sections)) != 0) {
-		list_reset(s->items);
-		while((p = list_get_next(s->items)) != 0) {
+	/* Called from lookups, so don't move the lists' cursors */
+	list_iter_init(&sit,cp->sections);
+	while((s = list_iter_next(&sit)) != 0) {
+		list_iter_init(&pit,s->items);
+		while((p = list_iter_next(&pit)) != 0) {
 //			dprintf(dlevel,"p: id: %d, name: %s, flags: %x\n", p->id, p->name, p->flags)
-			if (p->id < 0 || p->id > cp->id) continue;
+			if (p->id < 0 || p->id >= cp->id) continue;
 			dprintf(dlevel+1,"adding: %s as ID %d\n", p->name, p->id);
 			cp->map[p->id] = p;
 		}
@@ -682,6 +693,115 @@ void config_build_propmap(config_t *cp) {
 	}
 }
 
+/* Name index: every property hashed by (case-insensitive) name with chains kept
+   in section/item order, so the first match is the same one a list walk finds.
+   Any change to the section/item lists just marks it dirty; it's rebuilt on the
+   next lookup (along with the ID map) */
+struct config_index_entry {
+	config_property_t *p;
+	config_section_t *s;
+	struct config_index_entry *next;
+};
+
+struct config_index {
+	unsigned int mask;
+	struct config_index_entry **buckets;
+	struct config_index_entry *entries;
+};
+
+static unsigned int config_index_hash(char *name) {
+	register unsigned int h;
+
+	/* FNV-1a */
+	h = 2166136261U;
+	while(*name) {
+		h ^= (unsigned char)tolower((unsigned char)*name++);
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void config_index_free(config_t *cp) {
+	if (!cp->index) return;
+	free(cp->index->buckets);
+	free(cp->index->entries);
+	free(cp->index);
+	cp->index = 0;
+}
+
+static int config_index_update(config_t *cp) {
+	struct config_index *ip;
+	struct config_index_entry *e,**tail;
+	config_section_t *s;
+	config_property_t *p;
+	list_iter_t sit,pit;
+	unsigned int size;
+	int count;
+
+	if (cp->index && !cp->index_dirty) return 0;
+
+	config_index_free(cp);
+	count = 0;
+	list_iter_init(&sit,cp->sections);
+	while((s = list_iter_next(&sit)) != 0) count += list_count(s->items);
+	size = 16;
+	while(size < (unsigned int)count * 2) size <<= 1;
+	dprintf(dlevel,"count: %d, size: %d\n", count, size);
+
+	ip = calloc(1,sizeof(*ip));
+	if (!ip) goto config_index_update_error;
+	ip->buckets = calloc(size,sizeof(*ip->buckets));
+	ip->entries = calloc(count ? count : 1,sizeof(*ip->entries));
+	if (!ip->buckets || !ip->entries) goto config_index_update_error;
+	ip->mask = size - 1;
+
+	e = ip->entries;
+	list_iter_init(&sit,cp->sections);
+	while((s = list_iter_next(&sit)) != 0) {
+		list_iter_init(&pit,s->items);
+		while((p = list_iter_next(&pit)) != 0) {
+			if (!p->name || e - ip->entries >= count) continue;
+			e->p = p;
+			e->s = s;
+			/* Append to keep list order */
+			for(tail = &ip->buckets[config_index_hash(p->name) & ip->mask]; *tail; tail = &(*tail)->next);
+			*tail = e++;
+		}
+	}
+	cp->index = ip;
+	cp->index_dirty = 0;
+	config_build_propmap(cp);
+	return 0;
+
+config_index_update_error:
+	log_syserror("config_index_update: calloc");
+	if (ip) {
+		free(ip->buckets);
+		free(ip->entries);
+		free(ip);
+	}
+	return 1;
+}
+
+/* First property named name (case-insensitive) in section s (or sname, or any section if both null) */
+static config_property_t *_config_index_find(config_t *cp, config_section_t *s, char *sname, char *name, int nocase) {
+	struct config_index_entry *e;
+
+	for(e = cp->index->buckets[config_index_hash(name) & cp->index->mask]; e; e = e->next) {
+		if ((nocase ? strcasecmp(e->p->name,name) : strcmp(e->p->name,name)) != 0) continue;
+		if (s && e->s != s) continue;
+		if (sname && strcasecmp(e->s->name,sname) != 0) continue;
+		dprintf(dlevel,"found: %s\n", e->p->name);
+		return e->p;
+	}
+	dprintf(dlevel,"NOT found: %s\n", name);
+	return 0;
+}
+
+static config_property_t *config_index_get(config_t *cp, config_section_t *s, char *name) {
+	return _config_index_find(cp,s,0,name,1);
+}
+
 config_section_t *config_get_section(config_t *cp,char *name) {
 	config_section_t *section;
 
@@ -751,6 +871,7 @@ int config_delete_section(config_t *cp, char *name) {
 		if (strcasecmp(section->name,name)==0) {
 			dprintf(dlevel,"found\n");
 			list_delete(cp->sections,section);
+			cp->index_dirty = 1;
 			*cp->errmsg = 0;
 			return 0;
 		}
@@ -915,6 +1036,7 @@ void config_destroy_config(config_t *cp) {
 #endif
 	list_destroy(cp->funcs);
 	if (cp->map) free(cp->map);
+	config_index_free(cp);
 
 	if (configs) list_delete(configs,cp);
 	free(cp);
@@ -1463,6 +1585,20 @@ config_property_t *config_find_property(config_t *cp, char *name) {
 	if (!cp) return 0;
 
 	dprintf(dlevel,"name: %s\n", name);
+	if (config_index_update(cp) == 0) {
+		if (strchr(name,'.')) {
+			char sname[CONFIG_SECTION_NAME_SIZE];
+			char pname[64];
+
+			strncpy(sname,strele(0,".",name),sizeof(sname)-1);
+			strncpy(pname,strele(1,".",name),sizeof(pname)-1);
+			p = _config_index_find(cp,0,sname,pname,1);
+			if (p) return p;
+		}
+		return _config_index_find(cp,0,0,name,0);
+	}
+
+	/* No index, walk the lists */
 	if (strchr(name,'.')) {
 		char sname[CONFIG_SECTION_NAME_SIZE];
 		char pname[64];
@@ -1486,6 +1622,7 @@ config_property_t *config_find_property(config_t *cp, char *name) {
 			dprintf(dlevel,"p->name: %s, name: %s\n", p->name, name);
 			if (!p->name) {
 				list_delete(s->items,p);
+				cp->index_dirty = 1;
 				continue;
 			}
 			if (strcmp(p->name,name)==0) {
@@ -1504,18 +1641,11 @@ config_property_t *config_get_propbyid(config_t *cp, int id) {
 
 	if (!cp) return 0;
 
-#if 0
-	dprintf(dlevel,"cp->map: %p, id: %d, map_maxid: %d, cp->id: %d\n", cp->map, id, cp->map_maxid, cp->id);
-	if (cp->map && (id >= 0 && id < cp->map_maxid)) {
-		dprintf(dlevel,"cp->map[%d]: %p\n", id, cp->map[id]);
-	}
-	dprintf(dlevel,"checking map...\n");
-	if (cp->map && id >= 0 && id < cp->map_maxid && cp->map[id]) {
-		dprintf(dlevel,"found: %s\n", cp->map[id]->name);
-		return cp->map[id];
+	/* Map is rebuilt along with the index */
+	if (config_index_update(cp) == 0 && cp->map) {
+		dprintf(dlevel,"cp->map: %p, id: %d, map_maxid: %d, cp->id: %d\n", cp->map, id, cp->map_maxid, cp->id);
+		return ((id >= 0 && id < cp->map_maxid) ? cp->map[id] : 0);
 	}
-	dprintf(dlevel,"NOT found, checking lists\n");
-#endif
 
 	dprintf(dlevel,"id: %d\n", id);
 	list_reset(cp->sections);
@@ -2874,6 +3004,7 @@ static JSBool js_config_section_setprop(JSContext *cx, JSObject *obj, jsval id,
 				dprintf(dlevel,"count: %d\n", count);
 				list_destroy(sec->items);
 				sec->items = list_create();
+				if (sec->cp) sec->cp->index_dirty = 1;
 				for(i=0; i < count; i++) {
 					JS_GetElement(cx, arr, i, &val);
 					dprintf(dlevel,"val[%d]: %x, isobj: %d\n", i, val, JSVAL_IS_OBJECT(val));
@@ -2900,6 +3031,7 @@ static JSBool js_config_section_setprop(JSContext *cx, JSObject *obj, jsval id,
 						continue;
 					}
 					list_add(sec->items,p,0);
+					if (sec->cp) sec->cp->index_dirty = 1;
 //					jsval_to_type(type, dest, size, cx, val);
 				}
 			}
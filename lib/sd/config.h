@@ -121,6 +121,8 @@ struct config {
 	char errmsg[128];
 	config_property_t **map;		/* ID map */
 	int map_maxid;
+	struct config_index *index;		/* Name index (rebuilt on lookup when dirty) */
+	int index_dirty;
 	union {
 		cfg_info_t *cfg;
 		json_value_t *v;
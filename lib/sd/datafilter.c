@@ -0,0 +1,375 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "log.h"
+#include "utils.h"
+#include "datafilter.h"
+
+struct datafilter_rule {
+	char name[DATAFILTER_NAME_LEN];
+	double deadband;
+	int min;			/* ms */
+	int max;			/* ms */
+};
+
+/* What was last published for a field */
+struct datafilter_field {
+	char name[DATAFILTER_NAME_LEN];
+	struct datafilter_rule *rule;
+	int type;
+	double *nums;			/* Number, or array of numbers */
+	int count;
+	char *text;			/* Anything else, serialized */
+	uint64_t last;			/* ms */
+};
+
+struct datafilter {
+	struct datafilter_rule rules[DATAFILTER_MAX_RULES];
+	int rule_count;
+	struct datafilter_rule *def;
+	struct datafilter_field *fields;
+	int count;
+	int size;
+	int keyframe;			/* ms */
+	uint64_t last_key;		/* ms, 0 = send one now */
+	int delta;
+	char *buf;			/* Output */
+	int len;
+	int bufsize;
+};
+
+static struct datafilter_rule _norule;
+
+#define DELTA_HEAD "{\"" DATAFILTER_DELTA "\":true"
+
+#define SEND_NO		-1
+#define SEND_UNTRACKED	-2
+
+datafilter_t *datafilter_create(void) {
+	datafilter_t *f;
+
+	f = calloc(1,sizeof(*f));
+	if (!f) {
+		log_syserror("datafilter_create: calloc");
+		return 0;
+	}
+	f->keyframe = DATAFILTER_KEYFRAME * 1000;
+	f->def = &_norule;
+	return f;
+}
+
+static void _free_fields(datafilter_t *f) {
+	int i;
+
+	for(i=0; i < f->count; i++) {
+		free(f->fields[i].nums);
+		free(f->fields[i].text);
+	}
+	free(f->fields);
+	f->fields = 0;
+	f->count = f->size = 0;
+}
+
+void datafilter_destroy(datafilter_t *f) {
+	if (!f) return;
+	_free_fields(f);
+	free(f->buf);
+	free(f);
+}
+
+static struct datafilter_rule *_find_rule(datafilter_t *f, char *name) {
+	int i;
+
+	for(i=0; i < f->rule_count; i++) {
+		if (strcmp(f->rules[i].name,name) == 0) return &f->rules[i];
+	}
+	return f->def;
+}
+
+int datafilter_set_rules(datafilter_t *f, char *rules) {
+	char temp[1024],*p,*e,*m;
+	struct datafilter_rule *r;
+	int i;
+
+	if (!f) return 1;
+	if (!rules) rules = "";
+	dprintf(dlevel,"rules: %s\n", rules);
+	strncpy(temp,rules,sizeof(temp)-1);
+	temp[sizeof(temp)-1] = 0;
+	f->rule_count = 0;
+	f->def = &_norule;
+	for(i=0; i < DATAFILTER_MAX_RULES; i++) {
+		p = strele(i,",",temp);
+		if (!strlen(p)) break;
+		e = strchr(p,'=');
+		if (!e) {
+			log_error("datafilter_set_rules: invalid entry: %s\n", p);
+			continue;
+		}
+		*e++ = 0;
+		p = trim(p);
+		if (strlen(p) >= DATAFILTER_NAME_LEN) {
+			log_error("datafilter_set_rules: %s: name too long (max %d)\n", p, DATAFILTER_NAME_LEN-1);
+			continue;
+		}
+		r = &f->rules[f->rule_count];
+		memset(r,0,sizeof(*r));
+		strcpy(r->name,p);
+		r->deadband = fabs(atof(e));
+		m = strchr(e,':');
+		if (m) {
+			r->min = atof(m+1) * 1000.0;
+			m = strchr(m+1,':');
+			if (m) r->max = atof(m+1) * 1000.0;
+		}
+		dprintf(dlevel,"name: %s, deadband: %f, min: %d, max: %d\n", r->name, r->deadband, r->min, r->max);
+		if (strcmp(r->name,"*") == 0) f->def = r;
+		f->rule_count++;
+	}
+	/* Rules may have moved */
+	for(i=0; i < f->count; i++) f->fields[i].rule = _find_rule(f,f->fields[i].name);
+	return 0;
+}
+
+void datafilter_set_keyframe(datafilter_t *f, int seconds) {
+	if (f) f->keyframe = (seconds > 0 ? seconds : DATAFILTER_KEYFRAME) * 1000;
+}
+
+void datafilter_set_delta(datafilter_t *f, int delta) {
+	if (!f || f->delta == delta) return;
+	f->delta = delta;
+	f->last_key = 0;
+}
+
+/* Send everything next time */
+void datafilter_reset(datafilter_t *f) {
+	if (f) f->last_key = 0;
+}
+
+/* Fields usually come in the same order every time, so try the same slot first.
+   Names too long to keep aren't tracked (0) and go out every time. */
+static struct datafilter_field *_get_field(datafilter_t *f, int hint, char *name) {
+	struct datafilter_field *fp;
+	int i;
+
+	if (strlen(name) >= sizeof(fp->name)) return 0;
+	if (hint < f->count && strcmp(f->fields[hint].name,name) == 0) return &f->fields[hint];
+	for(i=0; i < f->count; i++) {
+		if (strcmp(f->fields[i].name,name) == 0) return &f->fields[i];
+	}
+	if (f->count == f->size) {
+		fp = realloc(f->fields,(f->size + 16) * sizeof(*fp));
+		if (!fp) {
+			log_syserror("datafilter: realloc");
+			return 0;
+		}
+		f->fields = fp;
+		f->size += 16;
+	}
+	fp = &f->fields[f->count++];
+	memset(fp,0,sizeof(*fp));
+	strcpy(fp->name,name);
+	fp->rule = _find_rule(f,fp->name);
+	return fp;
+}
+
+/* Count of elements if v is a number or an array of only numbers, else -1 */
+static int _numcount(json_value_t *v) {
+	json_array_t *a;
+	int i;
+
+	if (json_value_get_type(v) == JSON_TYPE_NUMBER) return 1;
+	if (json_value_get_type(v) != JSON_TYPE_ARRAY) return -1;
+	a = json_value_array(v);
+	for(i=0; i < a->count; i++) {
+		if (json_value_get_type(a->items[i]) != JSON_TYPE_NUMBER) return -1;
+	}
+	return a->count;
+}
+
+static double _numget(json_value_t *v, int i) {
+	if (json_value_get_type(v) == JSON_TYPE_NUMBER) return json_value_get_number(v);
+	return json_value_get_number(json_value_array(v)->items[i]);
+}
+
+static int _changed(struct datafilter_field *fp, json_value_t *v) {
+	char *text;
+	int i,n,r;
+
+	if (json_value_get_type(v) != fp->type) return 1;
+	n = _numcount(v);
+	if (n >= 0) {
+		if (n != fp->count || !fp->nums) return 1;
+		for(i=0; i < n; i++) {
+			if (fabs(_numget(v,i) - fp->nums[i]) > fp->rule->deadband) return 1;
+			/* A deadband of 0 means any change */
+			if (fp->rule->deadband == 0 && _numget(v,i) != fp->nums[i]) return 1;
+		}
+		return 0;
+	}
+	if (!fp->text) return 1;
+	text = json_dumps(v,0);
+	if (!text) return 1;
+	r = (strcmp(text,fp->text) != 0);
+	free(text);
+	return r;
+}
+
+static void _save(struct datafilter_field *fp, json_value_t *v, uint64_t now) {
+	double *nums;
+	int i,n;
+
+	fp->type = json_value_get_type(v);
+	fp->last = now;
+	free(fp->text);
+	fp->text = 0;
+	n = _numcount(v);
+	if (n >= 0) {
+		if (n != fp->count || !fp->nums) {
+			nums = realloc(fp->nums,(n ? n : 1) * sizeof(double));
+			if (!nums) {
+				fp->count = 0;
+				return;
+			}
+			fp->nums = nums;
+			fp->count = n;
+		}
+		for(i=0; i < n; i++) fp->nums[i] = _numget(v,i);
+	} else {
+		free(fp->nums);
+		fp->nums = 0;
+		fp->count = 0;
+		fp->text = json_dumps(v,0);
+	}
+}
+
+static int _append(datafilter_t *f, char *str, int len) {
+	char *p;
+	int size;
+
+	if (f->len + len + 1 > f->bufsize) {
+		size = f->bufsize ? f->bufsize : 1024;
+		while(size < f->len + len + 1) size *= 2;
+		p = realloc(f->buf,size);
+		if (!p) {
+			log_syserror("datafilter: realloc");
+			return 1;
+		}
+		f->buf = p;
+		f->bufsize = size;
+	}
+	memcpy(f->buf + f->len,str,len);
+	f->len += len;
+	f->buf[f->len] = 0;
+	return 0;
+}
+
+char *datafilter_apply(datafilter_t *f, json_object_t *o, uint64_t now) {
+	struct datafilter_field *fp;
+	char *text;
+	int *send;			/* Field index, SEND_NO or SEND_UNTRACKED (fields may be realloc'd) */
+	int i,keyframe,count,age;
+
+	if (!f || !o) return 0;
+
+	keyframe = (!f->last_key || now - f->last_key >= f->keyframe);
+	send = malloc((o->count ? o->count : 1) * sizeof(*send));
+	if (!send) {
+		log_syserror("datafilter_apply: malloc");
+		return 0;
+	}
+	count = 0;
+	for(i=0; i < o->count; i++) {
+		send[i] = SEND_NO;
+		fp = _get_field(f,i,o->names[i]);
+		if (!fp) {
+			send[i] = SEND_UNTRACKED;
+			count++;
+			continue;
+		}
+		age = (int)(now - fp->last);
+		if (keyframe || (fp->rule->max && age >= fp->rule->max) ||
+				((!fp->rule->min || age >= fp->rule->min) && _changed(fp,o->values[i]))) {
+			send[i] = fp - f->fields;
+			count++;
+		}
+	}
+	dprintf(dlevel,"keyframe: %d, count: %d/%d\n", keyframe, count, (int)o->count);
+	text = 0;
+	if (!count) goto done;
+
+	if (keyframe || !f->delta) {
+		/* Everything goes out */
+		text = json_dumps(json_object_value(o),0);
+		if (!text) goto done;
+		for(i=0; i < o->count; i++) {
+			fp = (send[i] >= 0 ? &f->fields[send[i]] : _get_field(f,i,o->names[i]));
+			if (fp) _save(fp,o->values[i],now);
+		}
+		f->last_key = now;
+		goto done;
+	}
+
+	f->len = 0;
+	if (_append(f,DELTA_HEAD,strlen(DELTA_HEAD))) goto done;
+	for(i=0; i < o->count; i++) {
+		if (send[i] == SEND_NO) continue;
+		text = json_dumps(o->values[i],0);
+		if (!text) continue;
+		_append(f,",\"",2);
+		_append(f,o->names[i],strlen(o->names[i]));
+		_append(f,"\":",2);
+		_append(f,text,strlen(text));
+		free(text);
+		if (send[i] >= 0) _save(&f->fields[send[i]],o->values[i],now);
+	}
+	_append(f,"}",1);
+	text = strdup(f->buf);
+
+done:
+	free(send);
+	return text;
+}
+
+int datafilter_merge(json_value_t **state, json_value_t *v) {
+	json_object_t *o,*so;
+	json_value_t *copy;
+	char *text;
+	int i;
+
+	o = (json_value_get_type(v) == JSON_TYPE_OBJECT ? json_value_object(v) : 0);
+	if (!o || !json_object_get_value(o,DATAFILTER_DELTA)) {
+		/* Full data (or not an object) replaces what we had */
+		if (*state) json_destroy_value(*state);
+		*state = v;
+		return 0;
+	}
+	so = (*state ? json_value_object(*state) : 0);
+	if (!so) {
+		json_destroy_value(v);
+		return 1;
+	}
+	for(i=0; i < o->count; i++) {
+		if (strcmp(o->names[i],DATAFILTER_DELTA) == 0) continue;
+		/* Values belong to v, so take a copy */
+		text = json_dumps(o->values[i],0);
+		if (!text) continue;
+		copy = json_parse(text);
+		free(text);
+		if (copy) json_object_set_value(so,o->names[i],copy);
+	}
+	json_destroy_value(v);
+	return 0;
+}
@@ -0,0 +1,53 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_DATAFILTER_H
+#define __SD_DATAFILTER_H
+
+#include <stdint.h>
+#include "json.h"
+
+/* Change-only publishing for agent Data.  Each top level field of the data
+   object is compared against the value last published; numbers (and arrays of
+   numbers) only count as changed when they move more than the field's
+   deadband.  Rules are "name=deadband[:min[:max]],..." with min/max in seconds
+   ("*" sets the default):
+
+	deadband	smallest change worth publishing
+	min		don't republish the field more often than this
+	max		republish the field at least this often even if unchanged
+
+   Nothing is published while nothing has changed, except a full keyframe every
+   keyframe seconds.  In delta mode only the changed fields are sent between
+   keyframes, marked with DATAFILTER_DELTA; consumers fold them into the last
+   keyframe with datafilter_merge. */
+
+#define DATAFILTER_DELTA	"_delta"
+#define DATAFILTER_NAME_LEN	32
+#define DATAFILTER_MAX_RULES	32
+#define DATAFILTER_KEYFRAME	60		/* Default keyframe interval (s) */
+
+struct datafilter;
+typedef struct datafilter datafilter_t;
+
+datafilter_t *datafilter_create(void);
+void datafilter_destroy(datafilter_t *f);
+int datafilter_set_rules(datafilter_t *f, char *rules);
+void datafilter_set_keyframe(datafilter_t *f, int seconds);
+void datafilter_set_delta(datafilter_t *f, int delta);
+void datafilter_reset(datafilter_t *f);
+
+/* Returns the (compact) document to publish or 0 if there's nothing to send */
+char *datafilter_apply(datafilter_t *f, json_object_t *o, uint64_t now);
+
+/* Consumer side: takes ownership of v.  Returns 0 with *state holding the full
+   data, 1 if v was a delta and there is no keyframe yet */
+int datafilter_merge(json_value_t **state, json_value_t *v);
+
+#endif /* __SD_DATAFILTER_H */
@@ -0,0 +1,291 @@
+#ifdef MQTT
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 5
+#include "debug.h"
+
+#include <pthread.h>
+#include "common.h"
+
+/* Bounded ring (D. Vyukov): each slot carries a sequence number that tells
+   producers when it's free and the consumer when it's been filled.  The tail
+   is claimed with a CAS so a producer that finds the ring full can take the
+   oldest message off it to make room. */
+struct inbox_slot {
+	uint32_t seq;
+	solard_message_t *msg;
+	uint64_t stamp;
+};
+
+struct inbox_policy {
+	char topic[SOLARD_TOPIC_SIZE];
+	int len;				/* match len (prefix match if topic ends with #) */
+	int policy;
+};
+
+struct inbox {
+	uint32_t mask;
+	struct inbox_slot *slots;
+	uint32_t head;				/* Next slot to fill (producers) */
+	uint32_t tail;				/* Next slot to drain (consumer, or a producer evicting) */
+	list policies;
+	inbox_stats_t stats;
+	/* Only used while the consumer is blocked in inbox_wait */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int waiting;
+};
+
+/* Take the oldest message off the ring, returns 0 if empty */
+static solard_message_t *_take(inbox_t *ib, uint64_t *stamp) {
+	struct inbox_slot *slot;
+	solard_message_t *msg;
+	uint32_t pos,seq;
+	int32_t dif;
+
+	pos = __atomic_load_n(&ib->tail,__ATOMIC_RELAXED);
+	while(1) {
+		slot = &ib->slots[pos & ib->mask];
+		seq = __atomic_load_n(&slot->seq,__ATOMIC_ACQUIRE);
+		dif = (int32_t)(seq - (pos + 1));
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&ib->tail,&pos,pos+1,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED)) break;
+		} else if (dif < 0) {
+			return 0;
+		} else {
+			pos = __atomic_load_n(&ib->tail,__ATOMIC_RELAXED);
+		}
+	}
+	msg = slot->msg;
+	if (stamp) *stamp = slot->stamp;
+	__atomic_store_n(&slot->seq,pos + ib->mask + 1,__ATOMIC_RELEASE);
+	return msg;
+}
+
+inbox_t *inbox_create(int size) {
+	inbox_t *ib;
+	uint32_t i,n;
+
+	if (size <= 0) size = INBOX_DEFAULT_SIZE;
+	/* Round up to a power of 2 */
+	n = 2;
+	while(n < (uint32_t)size) n <<= 1;
+	dprintf(dlevel,"size: %d, n: %d\n", size, n);
+
+	ib = calloc(1,sizeof(*ib));
+	if (!ib) {
+		log_syserror("inbox_create: calloc");
+		return 0;
+	}
+	ib->slots = calloc(n,sizeof(struct inbox_slot));
+	if (!ib->slots) {
+		log_syserror("inbox_create: calloc slots");
+		free(ib);
+		return 0;
+	}
+	for(i=0; i < n; i++) ib->slots[i].seq = i;
+	ib->mask = n - 1;
+	ib->policies = list_create();
+	pthread_mutex_init(&ib->lock,0);
+	pthread_cond_init(&ib->cond,0);
+	return ib;
+}
+
+void inbox_destroy(inbox_t *ib) {
+	solard_message_t *msg;
+
+	if (!ib) return;
+	/* Release anything that was never drained */
+	while((msg = _take(ib,0)) != 0) solard_message_unref(msg);
+	list_destroy(ib->policies);
+	pthread_cond_destroy(&ib->cond);
+	pthread_mutex_destroy(&ib->lock);
+	free(ib->slots);
+	free(ib);
+}
+
+/* Takes ownership of msg; if the inbox is full the oldest message is dropped to make room */
+int inbox_put(inbox_t *ib, solard_message_t *msg) {
+	struct inbox_slot *slot;
+	solard_message_t *old;
+	uint32_t pos,seq;
+	int32_t dif;
+
+	if (!ib || !msg) return 1;
+
+	pos = __atomic_load_n(&ib->head,__ATOMIC_RELAXED);
+	while(1) {
+		slot = &ib->slots[pos & ib->mask];
+		seq = __atomic_load_n(&slot->seq,__ATOMIC_ACQUIRE);
+		dif = (int32_t)(seq - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&ib->head,&pos,pos+1,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED)) break;
+		} else if (dif < 0) {
+			/* Full - evict the oldest (0 if the consumer or another producer got there first) */
+			old = _take(ib,0);
+			if (old) {
+				__atomic_add_fetch(&ib->stats.dropped,1,__ATOMIC_RELAXED);
+				dprintf(dlevel,"full, dropping: %s\n", old->topic);
+				solard_message_unref(old);
+			}
+			pos = __atomic_load_n(&ib->head,__ATOMIC_RELAXED);
+		} else {
+			pos = __atomic_load_n(&ib->head,__ATOMIC_RELAXED);
+		}
+	}
+	slot->msg = msg;
+	slot->stamp = monotime_us();
+	/* SEQ_CST with inbox_wait: either it sees the slot filled or we see it waiting */
+	__atomic_store_n(&slot->seq,pos+1,__ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&ib->stats.enqueued,1,__ATOMIC_RELAXED);
+	if (__atomic_load_n(&ib->waiting,__ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&ib->lock);
+		pthread_cond_signal(&ib->cond);
+		pthread_mutex_unlock(&ib->lock);
+	}
+	return 0;
+}
+
+static int _empty(inbox_t *ib) {
+	uint32_t pos;
+
+	pos = __atomic_load_n(&ib->tail,__ATOMIC_RELAXED);
+	return (__atomic_load_n(&ib->slots[pos & ib->mask].seq,__ATOMIC_SEQ_CST) != pos + 1);
+}
+
+/* Consumer only: block until there's something to drain or timeout (ms, -1 = forever).
+   Returns 1 if there is, 0 on timeout. */
+int inbox_wait(inbox_t *ib, int timeout) {
+	struct timespec ts;
+	int rc;
+
+	if (!ib) return 0;
+	if (!_empty(ib)) return 1;
+	if (!timeout) return 0;
+	if (timeout > 0) {
+		clock_gettime(CLOCK_REALTIME,&ts);
+		ts.tv_sec += timeout / 1000;
+		ts.tv_nsec += (timeout % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+	rc = 0;
+	pthread_mutex_lock(&ib->lock);
+	__atomic_store_n(&ib->waiting,1,__ATOMIC_SEQ_CST);
+	while(_empty(ib) && rc == 0) {
+		if (timeout < 0) rc = pthread_cond_wait(&ib->cond,&ib->lock);
+		else rc = pthread_cond_timedwait(&ib->cond,&ib->lock,&ts);
+	}
+	__atomic_store_n(&ib->waiting,0,__ATOMIC_RELAXED);
+	pthread_mutex_unlock(&ib->lock);
+	return !_empty(ib);
+}
+
+static int inbox_get_policy(inbox_t *ib, char *topic) {
+	struct inbox_policy *p;
+
+	list_reset(ib->policies);
+	while((p = list_get_next(ib->policies)) != 0) {
+		if (strncmp(p->topic,topic,p->len) == 0 && (p->topic[p->len] == '#' || topic[p->len] == 0))
+			return p->policy;
+	}
+	return INBOX_POLICY_QUEUE;
+}
+
+/* Consumer only: move everything in the inbox to mq, returns number moved */
+int inbox_drain(inbox_t *ib, list mq) {
+	solard_message_t *msg,*old;
+	uint64_t now,stamp,lat;
+	int count;
+
+	if (!ib) return 0;
+
+	count = 0;
+	now = monotime_us();
+	while((msg = _take(ib,&stamp)) != 0) {
+		lat = (now > stamp ? now - stamp : 0);
+
+		ib->stats.lat_total += lat;
+		if (lat > ib->stats.lat_max) ib->stats.lat_max = lat;
+		ib->stats.dequeued++;
+
+		if (list_count(ib->policies) && inbox_get_policy(ib,msg->topic) == INBOX_POLICY_LATEST) {
+			list_reset(mq);
+			while((old = list_get_next(mq)) != 0) {
+				if (strcmp(old->topic,msg->topic) == 0) {
+					dprintf(dlevel,"replacing: %s\n", old->topic);
+					list_delete(mq,old);
+					ib->stats.coalesced++;
+					break;
+				}
+			}
+		}
+		list_add(mq,msg,0);
+		count++;
+	}
+	dprintf(dlevel+1,"count: %d\n", count);
+	return count;
+}
+
+/* Topic may end with # to match everything under it */
+int inbox_set_policy(inbox_t *ib, char *topic, int policy) {
+	struct inbox_policy newp,*p;
+
+	if (!ib || !topic) return 1;
+
+	list_reset(ib->policies);
+	while((p = list_get_next(ib->policies)) != 0) {
+		if (strcmp(p->topic,topic) == 0) {
+			p->policy = policy;
+			return 0;
+		}
+	}
+	memset(&newp,0,sizeof(newp));
+	strncpy(newp.topic,topic,sizeof(newp.topic)-1);
+	newp.len = strlen(newp.topic);
+	if (newp.len && newp.topic[newp.len-1] == '#') newp.len--;
+	newp.policy = policy;
+	list_add(ib->policies,&newp,sizeof(newp));
+	return 0;
+}
+
+/* Topics are a comma separated list (each may end with #), empty = queue everything */
+int inbox_set_latest(inbox_t *ib, char *topics) {
+	char temp[1024],*p;
+	int i;
+
+	if (!ib) return 1;
+	dprintf(dlevel,"topics: %s\n", topics);
+	list_purge(ib->policies);
+	if (!topics) return 0;
+	strncpy(temp,topics,sizeof(temp)-1);
+	temp[sizeof(temp)-1] = 0;
+	for(i=0; ; i++) {
+		p = strele(i,",",temp);
+		if (!strlen(p)) break;
+		if (inbox_set_policy(ib,trim(p),INBOX_POLICY_LATEST)) return 1;
+	}
+	return 0;
+}
+
+void inbox_get_stats(inbox_t *ib, inbox_stats_t *stats) {
+	if (!ib || !stats) return;
+	/* Producers update these while we read */
+	stats->enqueued = __atomic_load_n(&ib->stats.enqueued,__ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&ib->stats.dropped,__ATOMIC_RELAXED);
+	/* Consumer only */
+	stats->coalesced = ib->stats.coalesced;
+	stats->dequeued = ib->stats.dequeued;
+	stats->lat_total = ib->stats.lat_total;
+	stats->lat_max = ib->stats.lat_max;
+}
+#endif
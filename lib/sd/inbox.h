@@ -0,0 +1,50 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_INBOX_H
+#define __SD_INBOX_H
+
+#include <stdint.h>
+#include "message.h"
+
+/* Bounded lock-free inbox: any number of threads (the MQTT callbacks) put
+   messages, a single consumer drains them into its message queue.  When it's
+   full the oldest message is dropped.  The consumer can block until something
+   arrives; producers only take a lock to wake it when it's actually waiting. */
+
+#define INBOX_DEFAULT_SIZE 1024
+
+enum INBOX_POLICY {
+	INBOX_POLICY_QUEUE,			/* Keep every message */
+	INBOX_POLICY_LATEST,			/* Newest message replaces an older one with the same topic */
+};
+
+struct inbox_stats {
+	unsigned long enqueued;			/* Messages accepted */
+	unsigned long dropped;			/* Oldest messages dropped because the inbox was full */
+	unsigned long coalesced;		/* Older messages replaced under INBOX_POLICY_LATEST */
+	unsigned long dequeued;			/* Messages drained */
+	uint64_t lat_total;			/* Total put->drain latency (us) */
+	uint64_t lat_max;			/* Max put->drain latency (us) */
+};
+typedef struct inbox_stats inbox_stats_t;
+
+struct inbox;
+typedef struct inbox inbox_t;
+
+inbox_t *inbox_create(int size);
+void inbox_destroy(inbox_t *);
+int inbox_put(inbox_t *, solard_message_t *);
+int inbox_drain(inbox_t *, list mq);
+int inbox_wait(inbox_t *, int timeout);
+int inbox_set_policy(inbox_t *, char *topic, int policy);
+int inbox_set_latest(inbox_t *, char *topics);
+void inbox_get_stats(inbox_t *, inbox_stats_t *);
+
+#endif /* __SD_INBOX_H */
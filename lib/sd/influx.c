@@ -12,54 +12,21 @@ LICENSE file in the root directory of this source tree.
 #include "debug.h"
 
 #include <string.h>
+#include <sys/time.h>
 //#include "common.h"
 #include "influx.h"
-#include <curl/curl.h>
 #include "json.h"
+#include "stats.h"
+#include "reactor.h"
 #ifdef JS
 #include "jsnum.h" /* for JSDOUBLE_IS_NaN */
 #include "jsclass.h"
 #endif
 
-#define INFLUX_ENDPOINT_SIZE 128
-#define INFLUX_DATABASE_SIZE 64
-#define INFLUX_USERNAME_SIZE 32
-#define INFLUX_PASSWORD_SIZE 32
-#define INFLUX_TOKEN_SIZE 128
+#include "influx_internal.h"
 
-#define INFLUX_INIT_BUFSIZE 4096
-#define SESSION_ID_SIZE 128
 static list influx_sessions = 0;
 
-struct influx_session {
-	bool enabled;
-	char endpoint[INFLUX_ENDPOINT_SIZE];
-	char database[INFLUX_DATABASE_SIZE];
-	char username[INFLUX_USERNAME_SIZE];
-	char password[INFLUX_PASSWORD_SIZE];
-	char token[INFLUX_TOKEN_SIZE];
-	char epoch[16];
-	bool connected;
-	int errcode;
-	char errmsg[128];
-	CURL *curl;
-	struct curl_slist *hs;
-	char version[8];
-	char session_id[SESSION_ID_SIZE];
-	char *buffer;                   /* Read buffer */
-	int bufsize;                    /* Buffer size */
-	int bufidx;                     /* Current write pos */
-	list responses;
-	char *login_fields;
-	char *read_fields;
-	char *config_fields;
-	bool verbose;
-	bool convdt;
-	bool timeout;
-	bool ctor;
-};
-typedef struct influx_session influx_session_t;
-
 int influx_parse_config(influx_session_t *s, char *influx_info) {
 	dprintf(dlevel,"info: %s\n", influx_info);
 	strncpy(s->endpoint,strele(0,",",influx_info),sizeof(s->endpoint)-1);
@@ -68,6 +35,7 @@ int influx_parse_config(influx_session_t *s, char *influx_info) {
 	strncpy(s->password,strele(3,",",influx_info),sizeof(s->password)-1);
 	strncpy(s->token,strele(4,",",influx_info),sizeof(s->token)-1);
 	dprintf(dlevel,"endpoint: %s, database: %s, user: %s, pass: %s, token: %s\n", s->endpoint, s->database, s->username, s->password, s->token);
+	influx_writer_update(s);
 	return 0;
 }
 
@@ -91,37 +59,15 @@ static size_t influx_getheader(void *ptr, size_t size, size_t nmemb, void *ctx)
 
 static size_t getdata(void *ptr, size_t size, size_t nmemb, void *ctx) {
 	influx_session_t *s = ctx;
-	int bytes,newidx;
-
-	if (s->verbose) log_info("data: %s\n",(char *)ptr);
-
-	dprintf(dlevel,"bufsize: %d\n", s->bufsize);
+	int bytes;
 
 	bytes = size*nmemb;
-	dprintf(dlevel,"bytes: %d, bufidx: %d, bufsize: %d\n", bytes, s->bufidx, s->bufsize);
-	newidx = s->bufidx + bytes;
-	dprintf(dlevel+1,"newidx: %d\n", newidx);
-	if (newidx >= s->bufsize) {
-		char *newbuf;
-		int newsize;
-
-		newsize = (newidx / 4096) + 1;
-		dprintf(dlevel+1,"newsize: %d\n", newsize);
-		newsize *= 4096;
-		dprintf(dlevel+1,"newsize: %d\n", newsize);
-//		printf("*** influx_getdata: expanding buffer to: %d\n", newsize);
-		newbuf = realloc(s->buffer,newsize);
-		dprintf(dlevel,"newbuf: %p\n", newbuf);
-		if (!newbuf) {
-			log_syserror("influx_getdata: realloc(buffer,%d)",newsize);
-			return 0;
-		}
-		s->buffer = newbuf;
-		s->bufsize = newsize;
-	}
-	strcpy(s->buffer + s->bufidx,ptr);
-	s->bufidx = newidx;
+	if (s->verbose) log_info("data: %.*s\n",bytes,(char *)ptr);
+	dprintf(dlevel,"bytes: %d\n", bytes);
 
+	/* Parse as it arrives.  A parse error is picked up by influx_parser_finish -
+	   keep taking the data so the transfer itself doesn't fail */
+	if (s->parser) influx_parser_feed(s->parser,ptr,bytes);
 	return bytes;
 }
 
@@ -132,6 +78,15 @@ influx_session_t *influx_new(void) {
 	if (!s) return 0;
 	memset(s,0,sizeof(*s));
 	s->responses = list_create();
+	s->batch = true;
+	s->batch_size = INFLUX_BATCH_SIZE;
+	s->batch_age = INFLUX_BATCH_AGE;
+	s->batch_max = INFLUX_BATCH_MAX;
+	s->gzip = true;
+	s->spool = true;
+	s->spool_max = INFLUX_SPOOL_MAX;
+	s->rollup_raw = true;
+	strcpy(s->rollup_energy,INFLUX_ROLLUP_ENERGY);
 
 	s->curl = curl_easy_init();
 	if (!s->curl) {
@@ -141,18 +96,6 @@ influx_session_t *influx_new(void) {
 	}
  	s->hs = curl_slist_append(0, "Content-Type: application/x-www-form-urlencoded");
 
-#if 0
-	/* init data buffer */
-	s->buffer = malloc(INFLUX_INIT_BUFSIZE);
-	if (!s->buffer) {
-		log_syserror("influx_new: malloc(%d)",INFLUX_INIT_BUFSIZE);
-		curl_easy_cleanup(s->curl);
-		free(s);
-		return 0;
-	}
-	s->bufsize = INFLUX_INIT_BUFSIZE;
-#endif
-
 	curl_easy_setopt(s->curl, CURLOPT_HTTPHEADER, s->hs);
 	curl_easy_setopt(s->curl, CURLOPT_SSL_VERIFYPEER, 0L);
 	curl_easy_setopt(s->curl, CURLOPT_SSL_VERIFYHOST, 0L);
@@ -164,6 +107,34 @@ influx_session_t *influx_new(void) {
 	return s;
 }
 
+/* Same server/settings, for writing elsewhere (e.g. another retention policy).
+   The caller owns it - it isn't destroyed by influx_shutdown */
+influx_session_t *influx_clone(influx_session_t *s) {
+	influx_session_t *c;
+
+	c = influx_new();
+	if (!c) return 0;
+	list_delete(influx_sessions,c);
+	c->enabled = s->enabled;
+	c->connected = s->connected;
+	strcpy(c->endpoint,s->endpoint);
+	strcpy(c->database,s->database);
+	strcpy(c->username,s->username);
+	strcpy(c->password,s->password);
+	strcpy(c->token,s->token);
+	c->verbose = s->verbose;
+	c->timeout = s->timeout;
+	c->batch_size = s->batch_size;
+	c->batch_age = s->batch_age;
+	c->batch_max = s->batch_max;
+	c->gzip = s->gzip;
+	c->spool = s->spool;
+	strcpy(c->spool_dir,s->spool_dir);
+	c->spool_max = s->spool_max;
+	strcpy(c->spool_name,s->spool_name);
+	return c;
+}
+
 int influx_enable(influx_session_t *s, int enabled) {
 	int old_enabled = s->enabled;
 	s->enabled = enabled;
@@ -172,32 +143,26 @@ int influx_enable(influx_session_t *s, int enabled) {
 
 int influx_set_db(influx_session_t *s, char *name) {
 	strncpy(s->database,name,sizeof(s->database)-1);
+	influx_writer_update(s);
 	return 0;
 }
 
 #if 0
-static void display_value(influx_value_t *vp) {
-	char value[2048];
-
-	printf("vp: %p\n", vp);
-	printf("type: %s\n", typestr(vp->type));
-	conv_type(DATA_TYPE_STRING,value,sizeof(value),vp->type,vp->data,vp->len);
-	printf("value: %s\n", value);
-}
-
 static void display_series(influx_series_t *sp) {
+	char *str;
 	int i,j;
 
 	printf("sp: %p\n", sp);
 	printf("name: %s\n", sp->name);
 	printf("column_count: %d\n", sp->column_count);
-	for(i=0; i < sp->column_count; i++) printf("column[%d]: %s\n", i, sp->columns[i]);
-	printf("values: %p\n", sp->values);
+	for(i=0; i < sp->column_count; i++) printf("column[%d]: %s (type: %d)\n", i, sp->columns[i], sp->cols[i].type);
 	printf("value_count: %d\n", sp->value_count);
 	for(i=0; i < sp->value_count; i++) {
 		for(j=0; j < sp->column_count; j++) {
-			printf("value[%d][%d]: %p\n", i, j, sp->values[i][j]);
-			display_value(sp->values[i][j]);
+			str = influx_series_string(sp,i,j);
+			if (influx_series_isnull(sp,i,j)) printf("value[%d][%d]: null\n", i, j);
+			else if (str) printf("value[%d][%d]: %s\n", i, j, str);
+			else printf("value[%d][%d]: %f\n", i, j, influx_series_double(sp,i,j));
 		}
 	}
 }
@@ -232,8 +197,6 @@ static void display_response(influx_response_t *r) {
 #endif
 
 int influx_destroy_series(influx_series_t *sp) {
-	int i,j;
-	influx_value_t *vp;
 
 	dprintf(dlevel,"sp: %p\n", sp);
 	if (!sp) return 0;
@@ -241,35 +204,7 @@ int influx_destroy_series(influx_series_t *sp) {
 	dprintf(dlevel,"refs: %d\n", sp->refs);
 	if (sp->refs) return 1;
 
-	dprintf(dlevel,"sp->columns: %p\n", sp->columns);
-	if (sp->columns) {
-		dprintf(dlevel,"column_count: %d\n", sp->column_count);
-		for(i=0; i < sp->column_count; i++) {
-			dprintf(dlevel,"columns[%d]: %p\n", i, sp->columns[i]);
-			if (!sp->columns[i]) break;
-			free(sp->columns[i]);
-		}
-		free(sp->columns);
-		sp->columns = 0;
-	}
-	dprintf(dlevel,"sp->values: %p\n", sp->values);
-	if (sp->values) {
-		dprintf(dlevel,"value_count: %d\n", sp->value_count);
-		for(i=0; i < sp->value_count; i++) {
-			dprintf(dlevel,"values[%d]: %p\n", i, sp->values[i]);
-			if (!sp->values[i]) continue;
-			for(j=0; j < sp->column_count; j++) {
-				vp = sp->values[i][j];
-				if (vp && vp->data) {
-					dprintf(dlevel,"freeing value[%d][%d]\n",i,j);
-					free(vp->data);
-				}
-			}
-			free(sp->values[i]);
-		}
-		free(sp->values);
-		sp->values = 0;
-	}
+	influx_series_free(sp);
 
 	if (sp->parent) {
 		dprintf(dlevel,"sp->parent: %p\n", sp->parent);
@@ -325,28 +260,33 @@ int influx_destroy_response(influx_response_t *r) {
 			dprintf(dlevel,"r->parent->responses: %p\n", r->parent->responses);
 			list_delete(r->parent->responses,r);
 		}
+		free(r);
 	}
 	return c;
 }
 
 static void influx_cleanup(influx_session_t *s) {
 	influx_response_t *r;
-	if (s->buffer) {
-		free(s->buffer);
-		s->buffer = 0;
-		s->bufsize = 0;
-	}
+
 	list_reset(s->responses);
 	while((r = list_get_next(s->responses)) != 0) influx_destroy_response(r);
 }
 
 void influx_destroy_session(influx_session_t *s) {
+	influx_response_t *r;
 
 	dprintf(dlevel,"s: %s\n", s);
 	if (!s) return;
 
+	/* Partial windows go out with the last batch */
+	influx_rollup_destroy(s);
+	influx_writer_destroy(s);
+	influx_cache_destroy(s);
 	influx_cleanup(s);
-	if (s->buffer) free(s->buffer);
+	/* JS may still hold responses - they go when it lets go of them */
+	list_reset(s->responses);
+	while((r = list_get_next(s->responses)) != 0) r->parent = 0;
+	list_destroy(s->responses);
 	curl_slist_free_all(s->hs);
 	curl_easy_cleanup(s->curl);
 
@@ -393,6 +333,7 @@ char *influx_mkurl(influx_session_t *s, char *action, char *query) {
 		size += strlen(s->database) + 4;	/* + "?db=" */
 	}
 	if (strlen(s->epoch)) size += strlen(s->epoch) + 7; /* + "&epoch=" */
+	if (strlen(s->rp)) size += strlen(s->rp) + 4; /* + "&rp=" */
 	eq = (query ? curl_easy_escape(s->curl, query, strlen(query)) : 0);
 	if (eq) size += strlen(eq) + 3; /* + "&q=" */
 	dprintf(dlevel,"size: %d\n", size);
@@ -409,6 +350,7 @@ char *influx_mkurl(influx_session_t *s, char *action, char *query) {
 		if (db) p += sprintf(p,"?db=%s",s->database);
 	}
 	if (strlen(s->epoch)) p += sprintf(p,"&epoch=%s",s->epoch);
+	if (strlen(s->rp)) p += sprintf(p,"&rp=%s",s->rp);
 	if (eq) {
 		p += sprintf(p,"&q=%s",eq);
 		curl_free(eq);
@@ -417,240 +359,62 @@ char *influx_mkurl(influx_session_t *s, char *action, char *query) {
 	return url;
 }
 
-static influx_value_t *get_value(json_value_t *rv) {
-	influx_value_t *vp;
-	int type;
-	register char *p;
-
-	vp = malloc(sizeof(*vp));
-	dprintf(dlevel,"vp: %p\n", vp);
-	if (!vp) return 0;
-	memset(vp,0,sizeof(*vp));
-	vp->type = DATA_TYPE_NULL;
-
-	type = json_value_get_type(rv);
-	dprintf(dlevel,"type: %d (%s)\n", type, json_typestr(type));
-	switch(type) {
-	case JSON_TYPE_NUMBER:
-	    {
-		vp->type = DATA_TYPE_DOUBLE;
-		vp->data = malloc(sizeof(double));
-		if (!vp->data) {
-			free(vp);
-			return 0;
-		}
-		*((double *)vp->data) = json_value_get_number(rv);
-		dprintf(dlevel,"number: %f\n", *((double *)vp->data));
-	    }
-	    break;
-	case JSON_TYPE_STRING:
-		vp->type = DATA_TYPE_STRING;
-		p = json_value_get_string(rv);
-		vp->len = strlen(p);
-		vp->data = strdup(p);
-		if (!vp->data) {
-			free(vp);
-			return 0;
-		}
-		dprintf(dlevel,"string: %s\n", (char *)vp->data);
-		break;
-	}
-
-	dprintf(dlevel,"returning: %p\n", vp);
-	return vp;
-}
-
-static int _get_series(json_object_t *o, influx_series_t *sp) {
-	json_array_t *columns_array,*values_array,*aa;
-	int i,j,type;
-	char *p;
-
-	columns_array = values_array = 0;
-	dprintf(dlevel,"o->count: %d\n", o->count);
-	for(i=0; i < o->count; i++) {
-		type = json_value_get_type(o->values[i]);
-		dprintf(dlevel,"o->names[%d]: %s, type: %s\n", i, o->names[i], json_typestr(type));
-
-		/* measurement name */
-		if (strcmp(o->names[i],"name") == 0) {
-			strncpy(sp->name,o->names[i],sizeof(sp->name));
-
-		/* columns */
-		} else if (strcmp(o->names[i],"columns") == 0 && type == JSON_TYPE_ARRAY) {
-			columns_array = json_value_array(o->values[i]);
-
-		/* values */
-		} else if (strcmp(o->names[i],"values") == 0 && type == JSON_TYPE_ARRAY) {
-			values_array = json_value_array(o->values[i]);
-		}
-	}
-	/* need both or its invalid response */
-	if (!columns_array || !values_array) goto get_series_error;
-
-	/* Get the columns */
-	sp->column_count = columns_array->count;
-	sp->columns = calloc(sp->column_count*sizeof(char *),1);
-	dprintf(dlevel,"sp->columns: %p\n", sp->columns);
-	if (!sp->columns) goto get_series_error;
-	dprintf(dlevel,"column_count: %d\n", sp->column_count);
-	for(i=0; i < sp->column_count; i++) {
-		p = json_value_get_string(columns_array->items[i]);
-		dprintf(dlevel,"column[%d]: %s\n", i, p);
-		if (!p) goto get_series_error;
-		sp->columns[i] = strdup(p);
-		if (!sp->columns[i]) goto get_series_error;
-	}
-
-	/* Get the values */
-	/* Values are a multidemential array of [values][column_count] */
-	sp->value_count = values_array->count;
-	sp->values = calloc(sp->value_count * sizeof(influx_value_t **),1);
-	dprintf(dlevel,"values: %p\n", sp->values);
-	if (!sp->values) goto get_series_error;
-	dprintf(dlevel,"value_count: %d\n", sp->value_count);
-	for(i=0; i < sp->value_count; i++) {
-		/* MUST be array of arrays */
-		if (json_value_get_type(values_array->items[i]) != JSON_TYPE_ARRAY) goto get_series_error;
-		aa = json_value_array(values_array->items[i]);
-
-		/* number of values MUST equal column_count */
-		dprintf(dlevel,"aa->count: %d, column_count: %d\n", aa->count, sp->column_count);
-		if (aa->count != sp->column_count) goto get_series_error;
-
-		/* get the values */
-		sp->values[i] = calloc(sp->column_count * sizeof(influx_value_t *),1);
-		if (!sp->values[i]) goto get_series_error;
-		for(j=0; j < aa->count; j++) {
-			type = json_value_get_type(aa->items[j]);
-			dprintf(dlevel,"items[%d] type: %s (%d)\n", j, json_typestr(type), type);
-			sp->values[i][j] = get_value(aa->items[j]);
-		}
-	}
-
-	return 0;
-
-get_series_error:
-	influx_destroy_series(sp);
-	return 1;
-}
-
-static int _get_result(json_object_t *o, influx_result_t *rp) {
-	influx_series_t newseries,*sp;
-	int i,type;
-
-	dprintf(dlevel,"o->count: %d\n", o->count);
-	for(i=0; i < o->count; i++) {
-		type = json_value_get_type(o->values[i]);
-		dprintf(dlevel,"o->names[%d]: %s, type: %s\n", i, o->names[i], json_typestr(type));
-
-		/* Statement ID */
-		if (strcmp(o->names[i],"statement_id") == 0 && type == JSON_TYPE_NUMBER) {
-			rp->statement_id = json_value_get_number(o->values[i]);
-			dprintf(dlevel,"statement_id: %d\n", rp->statement_id);
-		}
-
-		if (strcmp(o->names[i],"error") == 0 && type == JSON_TYPE_STRING) {
-			strncpy(rp->errmsg,json_value_get_string(o->values[i]),sizeof(rp->errmsg)-1);
-			dprintf(dlevel,"errmsg: %s\n", rp->errmsg);
-		}
-
-		/* Series */
-		if (strcmp(o->names[i],"series") == 0 && type == JSON_TYPE_ARRAY) {
-			json_array_t *a = json_value_array(o->values[i]);
-
-			dprintf(dlevel,"a->count: %d\n", a->count);
-			/* XXX */
-			if (!rp->series) continue;
-			for(i=0; i < a->count; i++) {
-				type = json_value_get_type(a->items[i]);
-				dprintf(dlevel,"type[%d]: %s\n", i, json_typestr(type));
-				if (type != JSON_TYPE_OBJECT) continue;
-				memset(&newseries,0,sizeof(newseries));
-				/* XXX */
-				if (_get_series(json_value_object(a->items[i]),&newseries)) continue;
-				sp = list_add(rp->series,&newseries,sizeof(newseries));
-				dprintf(dlevel,"sp: %p\n", sp);
-			}
+/* Free results that never made it into a response */
+static void influx_free_results(list results) {
+	influx_result_t *rp;
+	influx_series_t *sp;
 
-		}
+	list_reset(results);
+	while((rp = list_get_next(results)) != 0) {
+		list_reset(rp->series);
+		while((sp = list_get_next(rp->series)) != 0) influx_series_free(sp);
+		list_destroy(rp->series);
 	}
-	return 0;
+	list_destroy(results);
 }
 
-static int _get_response(influx_session_t *s, influx_response_t *r) {
-	influx_result_t newresult,*rp;
-	json_object_t *o;
-	int type;
-	json_value_t *v;
-	int i;
+/* Responses are in the session's list until the last ref is released
+   (or the session goes, see influx_destroy_session) */
+static influx_response_t *influx_add_response(influx_session_t *s, influx_response_t *newresp) {
+	influx_response_t *r;
+	influx_result_t *rp;
+	influx_series_t *sp;
 
-	/* Parse the buffer */
-//	dprintf(dlevel,"buffer: %s\n", s->buffer);
-	dprintf(dlevel,"bufidx: %d\n", s->bufidx);
-	/* No body (e.g. 204 No Content) is OK for writes */
-	if (!s->bufidx || !s->buffer || !strlen(s->buffer)) {
-		dprintf(dlevel,"no response body, returning success\n");
+	r = malloc(sizeof(*r));
+	dprintf(dlevel,"r: %p\n", r);
+	if (!r || !list_add(s->responses,r,0)) {
+		if (r) free(r);
+		if (newresp->results) influx_free_results(newresp->results);
 		return 0;
 	}
-	v = json_parse(s->buffer);
-	dprintf(dlevel,"v: %p\n", v);
-	/* May not be valiid json data */
-	if (!v) {
-		r->error = true;
-		sprintf(r->errmsg,"invalid json output");
-		return 1;
-	}
+	*r = *newresp;
+	r->parent = s;
 
-	/* top level must be object */
-	type = json_value_get_type(v);
-	dprintf(dlevel,"type: %s\n", json_typestr(type));
-	if (type == JSON_TYPE_OBJECT) {
-		o = json_value_object(v);
-		dprintf(dlevel,"o->count: %d\n", o->count);
-		for(i=0; i < o->count; i++) {
-			type = json_value_get_type(o->values[0]);
-			dprintf(dlevel,"o->names[%d]: %s, type: %s\n", i, o->names[i], json_typestr(type));
-			if (strcmp(o->names[i],"results") == 0 && type == JSON_TYPE_ARRAY) {
-				json_array_t *a = json_value_array(o->values[i]);
-				if (!r->results) r->results = list_create();
-				dprintf(dlevel,"r->results: %p\n", r->results);
-				if (!r->results) {
-					r->error = true;
-					sprintf(r->errmsg,"memory allocation error");
-					return 1;
-				}
-				dprintf(dlevel,"a->count: %d\n", a->count);
-				for(i=0; i < a->count; i++) {
-					type = json_value_get_type(a->items[i]);
-					dprintf(dlevel,"type[%d]: %s\n", i, json_typestr(type));
-					if (type != JSON_TYPE_OBJECT) continue;
-					memset(&newresult,0,sizeof(newresult));
-					newresult.series = list_create();
-					dprintf(dlevel,"newresult.series: %p\n", newresult.series);
-					if (!newresult.series) continue;
-					if (_get_result(json_value_object(a->items[i]),&newresult)) continue;
-					rp = list_add(r->results,&newresult,sizeof(newresult));
-					dprintf(dlevel,"rp: %p\n", rp);
-				}
-			}
-		}
+	/* XXX must be done here */
+	dprintf(dlevel,"r->results: %p\n", r->results);
+	list_reset(r->results);
+	while ((rp = list_get_next(r->results)) != 0) {
+		dprintf(dlevel,"rp->series: %p\n", rp->series);
+		list_reset(rp->series);
+		while ((sp = list_get_next(rp->series)) != 0) sp->parent = rp;
+		rp->parent = r;
 	}
-	json_destroy_value(v);
-	return 0;
+
+	r->refs++;
+	return r;
 }
 
 static influx_response_t *influx_request(influx_session_t *s, char *url, int post, char *data) {
-	influx_response_t newresp,*r;
-	influx_result_t *rp;
-	influx_series_t *sp;
+	influx_response_t newresp;
+	influx_parser_t *parser;
 //	char cl[128];
 	CURLcode res;
-	int rc;
-//,err;
+	long rc;
+	int perr,server_error;
 	char *msg;
 
 	memset(&newresp,0,sizeof(newresp));
-	newresp.results = list_create();
+	newresp.results = list_create_arena(0);
 	if (!newresp.results) {
 		newresp.error = true;
 		strcpy(newresp.errmsg,"list_create results");
@@ -666,7 +430,12 @@ static influx_response_t *influx_request(influx_session_t *s, char *url, int pos
 	dprintf(dlevel,"url: %s, post: %d, data: %s\n", url, post, data);
 
 	influx_cleanup(s);
-	s->bufidx = 0;
+	parser = influx_parser_new(&newresp);
+	if (!parser) {
+		newresp.error = true;
+		strcpy(newresp.errmsg,"memory allocation error");
+		goto influx_request_done;
+	}
 
 	/* Make the request */
 #if 0
@@ -697,17 +466,26 @@ static influx_response_t *influx_request(influx_session_t *s, char *url, int pos
 	curl_easy_setopt(s->curl, CURLOPT_TIMEOUT, s->timeout);
 	if (post && data) curl_easy_setopt(s->curl, CURLOPT_POSTFIELDS, data);
 	dprintf(dlevel,"calling perform...\n");
+	s->parser = parser;
 	res = curl_easy_perform(s->curl);
+	s->parser = 0;
 	dprintf(dlevel,"res: %d\n", res);
+	perr = influx_parser_finish(parser);
+	influx_parser_free(parser);
+	if (perr) log_error("influx_request: error parsing response\n");
 	if (res != CURLE_OK) {
 		sprintf(s->errmsg,"influx_request failed: %s", curl_easy_strerror(res));
+		influx_free_results(newresp.results);
 		return 0;
 	}
+	/* Error reported in the body (sets newresp.error/errmsg) */
+	server_error = newresp.error;
 
 	/* Get the response code */
 	dprintf(dlevel,"getting rc...\n");
+	rc = 0;
 	curl_easy_getinfo(s->curl, CURLINFO_RESPONSE_CODE, &rc);
-	dprintf(dlevel,"rc: %d\n", rc);
+	dprintf(dlevel,"rc: %ld\n", rc);
 	msg = "";
 	newresp.error = true;
 	switch(rc) {
@@ -744,30 +522,47 @@ static influx_response_t *influx_request(influx_session_t *s, char *url, int pos
 		msg = "Service unavailable";
 		break;
 	default:
-		dprintf(dlevel,"influx_request: unhandled rc: %d\n", rc);
+		dprintf(dlevel,"influx_request: unhandled rc: %ld\n", rc);
 		msg = "unknown response code";
 		break;
 	}
-	strncpy(newresp.errmsg,msg,sizeof(newresp.errmsg)-1);
-	/* _get_response could/should? be part of this func */
-	if (!newresp.error) _get_response(s,&newresp);
+	if (server_error) {
+		newresp.error = true;
+	} else if (!newresp.error && perr) {
+		newresp.error = true;
+		msg = "invalid json output";
+	}
+	/* Keep the server's message if it gave one */
+	if (!server_error) strncpy(newresp.errmsg,msg,sizeof(newresp.errmsg)-1);
 influx_request_done:
-	r = list_add(s->responses,&newresp,sizeof(newresp));
-	dprintf(dlevel,"r: %p\n", r);
-	if (r) r->parent = s;
+	return influx_add_response(s,&newresp);
+}
 
-	/* XXX must be done here */
-	dprintf(dlevel,"r->results: %p\n", r->results);
-	list_reset(r->results);
-	while ((rp = list_get_next(r->results)) != 0) {
-		dprintf(dlevel,"rp->series: %p\n", rp->series);
-		list_reset(rp->series);
-		while ((sp = list_get_next(rp->series)) != 0) sp->parent = rp;
-		rp->parent = r;
-	}
+/* Parse a query result that was fetched elsewhere (see influx_cache.c) */
+influx_response_t *influx_parse_response(influx_session_t *s, char *data, int len) {
+	influx_response_t newresp;
+	influx_parser_t *parser;
+	int perr;
 
-	r->refs++;
-	return r;
+	memset(&newresp,0,sizeof(newresp));
+	newresp.results = list_create_arena(0);
+	if (!newresp.results) return 0;
+	influx_cleanup(s);
+	parser = influx_parser_new(&newresp);
+	if (!parser) {
+		list_destroy(newresp.results);
+		return 0;
+	}
+	perr = influx_parser_feed(parser,data,len);
+	if (influx_parser_finish(parser)) perr = 1;
+	influx_parser_free(parser);
+	if (perr && !newresp.error) {
+		newresp.error = true;
+		strcpy(newresp.errmsg,"invalid json output");
+	} else if (!newresp.error) {
+		strcpy(newresp.errmsg,"Success");
+	}
+	return influx_add_response(s,&newresp);
 }
 
 int influx_release_response(influx_response_t *r) {
@@ -791,9 +586,10 @@ int influx_health(influx_session_t *s) {
 	dprintf(dlevel,"url: %p\n", url);
 	if (!url) return 1;
 	r = influx_request(s,url,0,0);
-	error = r->error;
-	influx_destroy_response(r);
 	free(url);
+	if (!r) return 1;
+	error = r->error;
+	influx_release_response(r);
 	return error;
 
 #if 0
@@ -840,9 +636,10 @@ int influx_ping(influx_session_t *s) {
 	dprintf(dlevel,"url: %p\n", url);
 	if (!url) return 1;
 	r = influx_request(s,url,0,0);
-	error = r->error;
-	influx_destroy_response(r);
 	free(url);
+	if (!r) return 1;
+	error = r->error;
+	influx_release_response(r);
 	if (error) return error;
 
 	curl_easy_getinfo(s->curl, CURLINFO_RESPONSE_CODE, &rc);
@@ -871,6 +668,12 @@ influx_response_t *influx_query(influx_session_t *s, char *query) {
 	}
 	dprintf(dlevel,"post: %d\n", post);
 
+	/* Same query again within the TTL? */
+	if (!post && s->cache_ttl > 0) {
+		r = influx_cache_lookup(s,query);
+		if (r) return r;
+	}
+
 	url = influx_mkurl(s,"query",query);
 	dprintf(dlevel,"url: %p\n", url);
 	if (!url) return 0;
@@ -879,49 +682,93 @@ influx_response_t *influx_query(influx_session_t *s, char *query) {
 	dprintf(dlevel,"r: %p\n", r);
 	dprintf(dlevel,"freeing url...\n");
 	free(url);
+	if (r && !post && s->cache_ttl > 0) influx_cache_store(s,query,r);
 	return r;
 }
 
 int influx_get_first_value(influx_response_t *r, double *val, char *text, int text_size) {
-        influx_result_t *rp;
-        influx_series_t *sp;
-	influx_value_t *vp;
+	influx_result_t *rp;
+	influx_series_t *sp;
+	char *str;
 
-        dprintf(dlevel,"r: %p\n", r);
-        if (!r) return 1;
+	dprintf(dlevel,"r: %p\n", r);
+	if (!r) return 1;
 
-	dprintf(0,"r->results: %p\n", r->results);
-	dprintf(0,"results count: %d\n", list_count(r->results));
+	dprintf(dlevel,"results count: %d\n", list_count(r->results));
 	if (!list_count(r->results)) return 1;
 	rp = list_get_first(r->results);
-	dprintf(0,"rp: %p\n", rp);
-	dprintf(0,"rp->series: %p\n", rp->series);
-	dprintf(0,"series count: %d\n", list_count(rp->series));
+	dprintf(dlevel,"series count: %d\n", list_count(rp->series));
 	if (!list_count(rp->series)) return 1;
 	sp = list_get_first(rp->series);
-	dprintf(0,"sp: %p\n", sp);
-	dprintf(0,"value_count: %d\n", sp->value_count);
-	if (!sp->value_count) return 1;
+	dprintf(dlevel,"value_count: %d, column_count: %d\n", sp->value_count, sp->column_count);
+	if (!sp->value_count || sp->column_count < 2) return 1;
+
+	/* 1st column is time */
+	if (val) *val = influx_series_double(sp,0,1);
+	if (text) {
+		str = influx_series_string(sp,0,1);
+		if (str) {
+			*text = 0;
+			strncat(text,str,text_size-1);
+		} else if (influx_series_isnull(sp,0,1)) {
+			*text = 0;
+		} else {
+			snprintf(text,text_size,"%f",influx_series_double(sp,0,1));
+		}
+	}
+	return 0;
+}
 
-	vp = sp->values[0][1];
-	if (text) conv_type(DATA_TYPE_STRING,text,text_size,vp->type,vp->data,vp->len);
-	if (val) conv_type(DATA_TYPE_DOUBLE,val,sizeof(*val),vp->type,vp->data,vp->len);
-#if 0
-	dprintf(0,"result_count: %d\n", r->result_count);
-        if (r->result_count > 0) {
-                rp = r->results[0];
-		dprintf(0,"series_count: %d\n", rp->series_count);
-                if (rp->series_count > 0) {
-                        sp = rp->series[0];
-			dprintf(0,"value_count: %d\n", sp->value_count);
-                        if (sp->value_count > 0) {
-				*vp = *sp->values[0][1];
-				return 0;
-                        }
-                }
-        }
-#endif
-	return 1;
+int influx_series_column(influx_series_t *sp, char *name) {
+	int i;
+
+	if (!sp || !name) return -1;
+	for(i=0; i < sp->column_count; i++) {
+		if (strcmp(sp->columns[i],name) == 0) return i;
+	}
+	return -1;
+}
+
+int influx_series_isnull(influx_series_t *sp, int row, int col) {
+	if (!sp || row < 0 || row >= sp->value_count || col < 0 || col >= sp->column_count) return 1;
+	return sp->cols[col].nulls[row];
+}
+
+/* Numeric value (0 if null or a string) */
+double influx_series_double(influx_series_t *sp, int row, int col) {
+	influx_column_t *cp;
+
+	if (influx_series_isnull(sp,row,col)) return 0;
+	cp = &sp->cols[col];
+	switch(cp->type) {
+	case INFLUX_TYPE_DOUBLE:
+		return cp->data.d[row];
+	case INFLUX_TYPE_INT64:
+	case INFLUX_TYPE_TIME:
+	case INFLUX_TYPE_BOOL:
+		return (double)cp->data.i[row];
+	case INFLUX_TYPE_STRING:
+		return strtod(sp->strings + cp->data.i[row],0);
+	}
+	return 0;
+}
+
+/* Value of a series tag (0 if it doesn't have it) */
+char *influx_series_tag(influx_series_t *sp, char *name) {
+	int i;
+
+	if (!sp || !name) return 0;
+	for(i=0; i < sp->tag_count; i++) {
+		if (strcmp(sp->tag_names[i],name) == 0) return sp->tag_values[i];
+	}
+	return 0;
+}
+
+/* String value (0 if null or not a string column) */
+char *influx_series_string(influx_series_t *sp, int row, int col) {
+	if (influx_series_isnull(sp,row,col)) return 0;
+	if (sp->cols[col].type != INFLUX_TYPE_STRING) return 0;
+	return sp->strings + sp->cols[col].data.i[row];
 }
 
 int influx_connect(influx_session_t *s) {
@@ -940,13 +787,27 @@ int influx_connect(influx_session_t *s) {
 	r = influx_query(s,"show measurements");
 	if (!r) goto influx_connect_done;
 	error = r->error;
-	influx_destroy_response(r);
+	influx_release_response(r);
 influx_connect_done:
 	dprintf(dlevel,"error: %d\n", error);
 	s->connected = (error == 0);
 	return error;
 }
 
+/* Record write latency into write_hist (0 to stop); the caller owns it */
+void influx_set_stats(influx_session_t *s, struct stats_hist *write_hist) {
+	if (!s) return;
+	s->write_hist = write_hist;
+	influx_writer_update(s);
+}
+
+void influx_set_spool_name(influx_session_t *s, char *name) {
+	if (!s) return;
+	*s->spool_name = 0;
+	if (name) strncpy(s->spool_name,name,sizeof(s->spool_name)-1);
+	influx_writer_update(s);
+}
+
 int influx_connected(influx_session_t *s) {
 	if (!s) return 0;
 	else return s->connected;
@@ -955,6 +816,7 @@ int influx_connected(influx_session_t *s) {
 influx_response_t *influx_write(influx_session_t *s, char *mm, char *string) {
 	influx_response_t *r;
 	char *temp,*url;
+	uint64_t start;
 
 	dprintf(dlevel,"enabled: %d\n", s->enabled);
 	if (!s->enabled) return 0;
@@ -983,20 +845,62 @@ u=<username>	Optional if you haven.t enabled authentication. Required if you.ve
 	strcat(temp," ");
 	strcat(temp,string);
 	dprintf(dlevel,"temp: %s\n", temp);
+	start = (s->write_hist ? monotime_us() : 0);
 	r = influx_request(s,url,1,temp);
+	stats_hist_since(s->write_hist,start);
 	dprintf(dlevel,"r: %d\n", r);
 	free(url);
 	free(temp);
 	return r;
 }
 
+/* Write a point, queued for the flush thread if batching is enabled */
+int influx_write_line(influx_session_t *s, char *mm, char *fields) {
+	influx_response_t *r;
+	struct timeval tv;
+	char *line;
+	int len,error;
+
+	dprintf(dlevel,"enabled: %d, batch: %d\n", s->enabled, s->batch);
+	if (!s->enabled) return 0;
+
+	while(*fields == ' ' || *fields == '\n') fields++;
+	if (!*fields) return 1;
+
+	/* mm + <space> + fields + <space> + timestamp(19) + newline + 0 */
+	len = strlen(mm) + 1 + strlen(fields) + 1 + 20 + 2;
+	line = malloc(len);
+	if (!line) {
+		strcpy(s->errmsg,"memory allocation error");
+		return 1;
+	}
+	gettimeofday(&tv,0);
+	len = sprintf(line,"%s %s %lld\n", mm, fields, ((long long)tv.tv_sec * 1000000000LL) + ((long long)tv.tv_usec * 1000LL));
+	dprintf(dlevel+1,"line: %s", line);
+	/* Everything in it made it into the rollups and raw points aren't wanted */
+	if (influx_rollup_add(s,mm,fields,((uint64_t)tv.tv_sec * 1000) + (tv.tv_usec / 1000)) && !s->rollup_raw) {
+		free(line);
+		return 0;
+	}
+	if (s->batch) {
+		error = influx_writer_add(s,line,len);
+	} else {
+		r = influx_write(s,mm,line + strlen(mm) + 1);
+		/* Couldn't reach the server, let the writer spool it */
+		if (!r && s->spool) error = influx_writer_add(s,line,len);
+		else error = (r ? r->error : 1);
+		influx_release_response(r);
+	}
+	free(line);
+	return error;
+}
+
 #ifndef NO_CONFIG
 #include "config.h"
 int influx_write_props(influx_session_t *s, char *name, config_property_t *props) {
-	influx_response_t *r;
 	register config_property_t *pp;
 	char value[2048], *string;
-	int strsize,stridx,newidx,len,count;
+	int strsize,stridx,newidx,len,count,error;
 
 	if (!s->enabled) return 0;
 
@@ -1037,17 +941,23 @@ int influx_write_props(influx_session_t *s, char *name, config_property_t *props
 			strsize = newsize;
 		}
 		if (pp->type == DATA_TYPE_STRING)
-			sprintf(string + stridx, "%s%s=\"%s\"\n", (count ? "," : ""), pp->name, value);
+			sprintf(string + stridx, "%s%s=\"%s\"", (count ? "," : ""), pp->name, value);
 		else
-			sprintf(string + stridx, "%s%s=%s\n", (count ? "," : ""), pp->name, value);
+			sprintf(string + stridx, "%s%s=%s", (count ? "," : ""), pp->name, value);
 		stridx = newidx;
 		count++;
 	}
 	dprintf(dlevel,"string: %s\n", string);
-	r = influx_write(s,name,string);
+	error = influx_write_line(s,name,string);
 	free(string);
-	dprintf(dlevel,"returning: %d\n", r->error);
-	return r->error;
+	dprintf(dlevel,"returning: %d\n", error);
+	return error;
+}
+
+/* The flush thread has its own copy of these */
+static int writer_set(void *ctx, config_property_t *p, void *old_value) {
+	influx_writer_update(ctx);
+	return 0;
 }
 
 int enabled_set(void *ctx, config_property_t *p, void *old_value) {
@@ -1062,17 +972,29 @@ int enabled_set(void *ctx, config_property_t *p, void *old_value) {
 void influx_add_props(influx_session_t *s, config_t *cp, char *name) {
 	config_property_t influx_private_props[] = {
 		{ "influx_enabled", DATA_TYPE_BOOL, &s->enabled, 0, "yes", 0, 0, 0, 0, 0, 0, 1, enabled_set, s },
-		{ "influx_timeout", DATA_TYPE_INT, &s->timeout, 0, "10", 0, 0, 0, 0, 0, 0, 1, 0, 0 },
-		{ "influx_endpoint", DATA_TYPE_STRING, s->endpoint, sizeof(s->endpoint)-1, "http://localhost:8086", 0, },
+		{ "influx_timeout", DATA_TYPE_INT, &s->timeout, 0, "10", 0, 0, 0, 0, 0, 0, 1, writer_set, s },
+		{ "influx_endpoint", DATA_TYPE_STRING, s->endpoint, sizeof(s->endpoint)-1, "http://localhost:8086", 0, 0, 0, 0, 0, 0, 0, writer_set, s },
 //                        0, 0, 0, 1, (char *[]){ "InfluxDB endpoint" }, 0, 1, 0 },
-		{ "influx_database", DATA_TYPE_STRING, s->database, sizeof(s->database)-1, "", 0, },
+		{ "influx_database", DATA_TYPE_STRING, s->database, sizeof(s->database)-1, "", 0, 0, 0, 0, 0, 0, 0, writer_set, s },
 //                        0, 0, 0, 1, (char *[]){ "InfluxDB database" }, 0, 1, 0 },
-		{ "influx_username", DATA_TYPE_STRING, s->username, sizeof(s->username)-1, "", 0, },
+		{ "influx_username", DATA_TYPE_STRING, s->username, sizeof(s->username)-1, "", 0, 0, 0, 0, 0, 0, 0, writer_set, s },
 //                        0, 0, 0, 1, (char *[]){ "InfluxDB username" }, 0, 1, 0 },
-		{ "influx_password", DATA_TYPE_STRING, s->password, sizeof(s->password)-1, "", 0, },
+		{ "influx_password", DATA_TYPE_STRING, s->password, sizeof(s->password)-1, "", 0, 0, 0, 0, 0, 0, 0, writer_set, s },
 //                        0, 0, 0, 1, (char *[]){ "InfluxDB password" }, 0, 1, 0 },
-		{ "influx_token", DATA_TYPE_STRING, s->token, sizeof(s->token)-1, "", 0, },
+		{ "influx_token", DATA_TYPE_STRING, s->token, sizeof(s->token)-1, "", 0, 0, 0, 0, 0, 0, 0, writer_set, s },
 //                        0, 0, 0, 1, (char *[]){ "InfluxDB API token (for v2)" }, 0, 1, 0 },
+		{ "influx_batch", DATA_TYPE_BOOL, &s->batch, 0, "yes", 0, 0, 0, 0, 0, 0, 1, 0, 0 },
+		{ "influx_batch_size", DATA_TYPE_INT, &s->batch_size, 0, "65536", 0, 0, 0, 0, 0, 0, 1, writer_set, s },
+		{ "influx_batch_age", DATA_TYPE_INT, &s->batch_age, 0, "1000", 0, 0, 0, 0, 0, 0, 1, writer_set, s },
+		{ "influx_batch_max", DATA_TYPE_INT, &s->batch_max, 0, "1048576", 0, 0, 0, 0, 0, 0, 1, 0, 0 },
+		{ "influx_gzip", DATA_TYPE_BOOL, &s->gzip, 0, "yes", 0, 0, 0, 0, 0, 0, 1, writer_set, s },
+		{ "influx_spool", DATA_TYPE_BOOL, &s->spool, 0, "yes", 0, 0, 0, 0, 0, 0, 1, writer_set, s },
+		{ "influx_spool_dir", DATA_TYPE_STRING, s->spool_dir, sizeof(s->spool_dir)-1, "", 0, 0, 0, 0, 0, 0, 0, writer_set, s },
+		{ "influx_spool_max", DATA_TYPE_INT, &s->spool_max, 0, "64", 0, 0, 0, 0, 0, 0, 1, writer_set, s },
+		{ "influx_cache_ttl", DATA_TYPE_INT, &s->cache_ttl, 0, "0", 0, 0, 0, 0, 0, 0, 1, 0, 0 },
+		{ "influx_rollup", DATA_TYPE_STRING, s->rollup_windows, sizeof(s->rollup_windows)-1, "", 0, },
+		{ "influx_rollup_energy", DATA_TYPE_STRING, s->rollup_energy, sizeof(s->rollup_energy)-1, INFLUX_ROLLUP_ENERGY, 0, },
+		{ "influx_rollup_raw", DATA_TYPE_BOOL, &s->rollup_raw, 0, "yes", 0, 0, 0, 0, 0, 0, 1, 0, 0 },
 		{ 0 }
 	};
 
@@ -1082,7 +1004,6 @@ void influx_add_props(influx_session_t *s, config_t *cp, char *name) {
 #endif
 
 int influx_write_json(influx_session_t *s, char *name, json_value_t *rv) {
-	influx_response_t *r;
 	json_object_t *o;
 	char value[2048], *string;
 	int strsize,stridx,newidx,len,count;
@@ -1138,10 +1059,8 @@ int influx_write_json(influx_session_t *s, char *name, json_value_t *rv) {
 		count++;
 	}
 	dprintf(dlevel,"string: %s\n", string);
-	r = influx_write(s,name,string);
-	error = r->error;
+	error = influx_write_line(s,name,string);
 	free(string);
-	influx_release_response(r);
 	dprintf(dlevel,"returning: %d\n", error);
 	return error;
 }
@@ -1158,17 +1077,46 @@ int influx_write_json(influx_session_t *s, char *name, json_value_t *rv) {
 
 extern int js_mem_used_pct(JSContext *cx);
 
+static jsval js_influx_value(JSContext *cx, influx_series_t *sp, int row, int col) {
+	influx_column_t *cp;
+	JSString *str;
+	char *p;
+	jsval val;
+
+	if (influx_series_isnull(sp,row,col)) return JSVAL_NULL;
+	cp = &sp->cols[col];
+	val = JSVAL_NULL;
+	switch(cp->type) {
+	case INFLUX_TYPE_DOUBLE:
+		JS_NewNumberValue(cx, cp->data.d[row], &val);
+		break;
+	case INFLUX_TYPE_INT64:
+	case INFLUX_TYPE_TIME:
+		JS_NewNumberValue(cx, (jsdouble)cp->data.i[row], &val);
+		break;
+	case INFLUX_TYPE_BOOL:
+		val = BOOLEAN_TO_JSVAL(cp->data.i[row] != 0);
+		break;
+	case INFLUX_TYPE_STRING:
+		p = sp->strings + cp->data.i[row];
+		str = JS_NewStringCopyZ(cx, p);
+		if (str) val = STRING_TO_JSVAL(str);
+		break;
+	}
+	return val;
+}
+
 JSObject *js_influx_values_new(JSContext *cx, JSObject *obj, influx_series_t *sp) {
 	JSObject *js_values,*vo,*dateobj;
 	jsval ie,ke;
-	int i,j,time_col,doconv,count;
-	influx_value_t *vp;
+	int i,j,time_col;
 	JSString *str;
+	char *p;
 	jsdouble d;
 
 	int ldlevel = dlevel;
 
-	/* values is an array of influx_value pointers */
+	/* values is an array of rows */
 	dprintf(ldlevel,"value_count: %d\n", sp->value_count);
 	js_values = JS_NewArrayObject(cx, 0, NULL);
 	dprintf(ldlevel,"js_values: %p\n", js_values);
@@ -1178,23 +1126,14 @@ JSObject *js_influx_values_new(JSContext *cx, JSObject *obj, influx_series_t *sp
 	if (!JS_AddRoot(cx, &js_values)) return 0;
 
 	/* Get the time column */
-	time_col = -1;
-	dprintf(ldlevel,"column_count: %d\n", sp->column_count);
-	for(i=0; i < sp->column_count; i++) {
-//		printf("columns[%d]: %p\n", i, sp->columns[i]);
-		if (strcmp(sp->columns[i],"time") == 0) {
-			time_col = i;
-			break;
-		}
-	}
-	dprintf(ldlevel,"value_count: %d\n", sp->value_count);
-	count = 0;
+	time_col = influx_series_column(sp,"time");
+	dprintf(ldlevel,"column_count: %d, time_col: %d\n", sp->column_count, time_col);
 	vo = NULL;
 	for(i=0; i < sp->value_count; i++) {
 		/* XXX req'd as strange things happen otherwise */
 		if (js_mem_used_pct(cx) == 100) break;
 		vo = JS_NewArrayObject(cx, 0, NULL);
-		dprintf(ldlevel,"vo: %p\n", vo);
+		dprintf(ldlevel+1,"vo: %p\n", vo);
 		if (!vo) break;
 
 		/* Root vo to protect it from GC while populating */
@@ -1205,29 +1144,16 @@ JSObject *js_influx_values_new(JSContext *cx, JSObject *obj, influx_series_t *sp
 		}
 
 		for(j=0; j < sp->column_count; j++) {
-			vp = sp->values[i][j];
-			if (!vp) {
-				ke = JSVAL_NULL;
-				JS_SetElement(cx, vo, j, &ke);
-				continue;
-			}
-			doconv = 1;
+			ke = JSVAL_VOID;
 			/* Automatically convert the time field into a date object */
-			if (j == time_col && sp->convdt) {
-				char value[128];
-
-				/* In case time is a number */
-				conv_type(DATA_TYPE_STRING,value,sizeof(value),vp->type,vp->data,vp->len);
-				str = JS_NewString(cx, value, strlen(value));
+			if (j == time_col && sp->convdt && (p = influx_series_string(sp,i,j)) != 0) {
+				str = JS_NewString(cx, p, strlen(p));
 				if (str && date_parseString(str,&d)) {
 					dateobj = js_NewDateObjectMsec(cx,d);
-					if (dateobj) {
-						ke = OBJECT_TO_JSVAL(dateobj);
-						doconv = 0;
-					}
+					if (dateobj) ke = OBJECT_TO_JSVAL(dateobj);
 				}
 			}
-			if (doconv) ke = type_to_jsval(cx,vp->type,vp->data,vp->len);
+			if (ke == JSVAL_VOID) ke = js_influx_value(cx,sp,i,j);
 			JS_SetElement(cx, vo, j, &ke);
 		}
 		ie = OBJECT_TO_JSVAL(vo);
@@ -1235,15 +1161,12 @@ JSObject *js_influx_values_new(JSContext *cx, JSObject *obj, influx_series_t *sp
 
 		/* Unroot vo now that it's safely stored in js_values */
 		JS_RemoveRoot(cx, &vo);
-
 		vo = NULL;
-		count++;
 	}
 
 	/* If loop exited early and vo is still rooted, unroot it */
 	if (vo) JS_RemoveRoot(cx, &vo);
 
-	/* fix up the array object with the real count */
 	dprintf(ldlevel,"returning: %p\n", js_values);
 
 	/* Unroot before returning */
@@ -1252,10 +1175,149 @@ JSObject *js_influx_values_new(JSContext *cx, JSObject *obj, influx_series_t *sp
 	return js_values;
 }
 
+/********************************************************************************/
+/*
+*** COLUMN
+*/
+
+/* Read-only, indexed view of one column (col[i], col.length) that reads
+   straight from the series storage - no per-row objects */
+struct js_influx_column {
+	influx_series_t *sp;
+	int col;
+};
+
+static void js_influx_column_free(JSContext *cx, JSObject *obj) {
+	struct js_influx_column *cp;
+
+	cp = JS_GetPrivate(cx, obj);
+	dprintf(dlevel,"cp: %p\n", cp);
+	if (cp) {
+		if (cp->sp->refs) cp->sp->refs--;
+		influx_destroy_series(cp->sp);
+		JS_free(cx, cp);
+	}
+}
+
+static JSBool js_influx_column_getprop(JSContext *cx, JSObject *obj, jsval id, jsval *rval) {
+	struct js_influx_column *cp;
+	int row;
+
+	cp = JS_GetPrivate(cx, obj);
+	if (!cp) {
+		JS_ReportError(cx, "private is null!");
+		return JS_FALSE;
+	}
+	/* Only indexes, everything else is a real property */
+	if (JSVAL_IS_INT(id)) {
+		row = JSVAL_TO_INT(id);
+		if (row >= 0 && row < cp->sp->value_count) *rval = js_influx_value(cx,cp->sp,row,cp->col);
+		else *rval = JSVAL_VOID;
+	}
+	return JS_TRUE;
+}
+
+static JSClass js_influx_column_class = {
+	"InfluxColumn",		/* Name */
+	JSCLASS_HAS_PRIVATE,	/* Flags */
+	JS_PropertyStub,	/* addProperty */
+	JS_PropertyStub,	/* delProperty */
+	js_influx_column_getprop,/* getProperty */
+	JS_PropertyStub,	/* setProperty */
+	JS_EnumerateStub,	/* enumerate */
+	JS_ResolveStub,		/* resolve */
+	JS_ConvertStub,		/* convert */
+	js_influx_column_free,	/* finalize */
+	JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+JSObject *js_InitInfluxColumnClass(JSContext *cx, JSObject *parent) {
+	JSObject *obj;
+
+	dprintf(dlevel,"creating %s class...\n",js_influx_column_class.name);
+	obj = JS_InitClass(cx, parent, 0, &js_influx_column_class, 0, 0, 0, 0, 0, 0);
+	dprintf(dlevel,"obj: %p\n", obj);
+	if (!obj) {
+		JS_ReportError(cx,"unable to initialize %s class", js_influx_column_class.name);
+		return 0;
+	}
+	return obj;
+}
+
+static JSObject *js_influx_column_new(JSContext *cx, JSObject *parent, influx_series_t *sp, int col) {
+	char *types[] = { "null", "double", "integer", "time", "string", "boolean" };
+	struct js_influx_column *cp;
+	JSObject *newobj;
+	JSString *str;
+	jsval val;
+	int type;
+
+	newobj = JS_NewObject(cx, &js_influx_column_class, 0, parent);
+	dprintf(dlevel,"newobj: %p\n", newobj);
+	if (!newobj) return 0;
+	cp = JS_malloc(cx, sizeof(*cp));
+	if (!cp) return 0;
+	cp->sp = sp;
+	cp->col = col;
+	JS_SetPrivate(cx,newobj,cp);
+	sp->refs++;
+
+	JS_DefineProperty(cx, newobj, "length", INT_TO_JSVAL(sp->value_count), 0, 0, JSPROP_ENUMERATE | JSPROP_READONLY | JSPROP_PERMANENT);
+	str = JS_NewStringCopyZ(cx, sp->columns[col]);
+	val = (str ? STRING_TO_JSVAL(str) : JSVAL_NULL);
+	JS_DefineProperty(cx, newobj, "name", val, 0, 0, JSPROP_ENUMERATE | JSPROP_READONLY | JSPROP_PERMANENT);
+	type = sp->cols[col].type;
+	str = JS_NewStringCopyZ(cx, types[type >= 0 && type <= INFLUX_TYPE_BOOL ? type : 0]);
+	val = (str ? STRING_TO_JSVAL(str) : JSVAL_NULL);
+	JS_DefineProperty(cx, newobj, "type", val, 0, 0, JSPROP_ENUMERATE | JSPROP_READONLY | JSPROP_PERMANENT);
+	return newobj;
+}
+
+static JSBool js_influx_series_column(JSContext *cx, uintN argc, jsval *vp) {
+	influx_series_t *sp;
+	JSObject *obj,*newobj;
+	jsval *argv = vp + 2;
+	char *name;
+	int col;
+
+	obj = JS_THIS_OBJECT(cx, vp);
+	if (!obj) return JS_FALSE;
+	sp = JS_GetPrivate(cx, obj);
+	if (!sp) {
+		JS_ReportError(cx, "private is null!");
+		return JS_FALSE;
+	}
+	if (argc != 1) goto js_influx_series_column_usage;
+	if (JSVAL_IS_INT(argv[0])) {
+		col = JSVAL_TO_INT(argv[0]);
+	} else if (JSVAL_IS_STRING(argv[0])) {
+		name = (char *)JS_EncodeString(cx,JSVAL_TO_STRING(argv[0]));
+		col = influx_series_column(sp,name);
+		JS_free(cx,name);
+	} else {
+		goto js_influx_series_column_usage;
+	}
+	*vp = JSVAL_NULL;
+	if (col < 0 || col >= sp->column_count) return JS_TRUE;
+	newobj = js_influx_column_new(cx, obj, sp, col);
+	if (newobj) *vp = OBJECT_TO_JSVAL(newobj);
+	return JS_TRUE;
+
+js_influx_series_column_usage:
+	JS_ReportError(cx,"InfluxSeries.column requires 1 argument (name:string OR index:number)");
+	return JS_FALSE;
+}
+
+/********************************************************************************/
+/*
+*** SERIES
+*/
+
 enum SERIES_PROPERTY_ID {
 	SERIES_PROPERTY_ID_NAME=1,
 	SERIES_PROPERTY_ID_COLUMNS,
 	SERIES_PROPERTY_ID_VALUES,
+	SERIES_PROPERTY_ID_TAGS,
 };
 
 static void js_influx_series_free(JSContext *cx, JSObject *obj) {
@@ -1296,6 +1358,22 @@ static JSBool js_influx_series_getprop(JSContext *cx, JSObject *obj, jsval id, j
 //			*rval = sp->columns_val;
 			*rval = type_to_jsval(cx,DATA_TYPE_STRING_ARRAY,sp->columns,sp->column_count);
 			break;
+		case SERIES_PROPERTY_ID_TAGS:
+			{
+				JSObject *tobj;
+				JSString *str;
+				int i;
+
+				tobj = JS_NewObject(cx, 0, 0, obj);
+				if (!tobj) return JS_FALSE;
+				*rval = OBJECT_TO_JSVAL(tobj);
+				for(i=0; i < sp->tag_count; i++) {
+					str = JS_NewStringCopyZ(cx, sp->tag_values[i]);
+					if (!str) return JS_FALSE;
+					JS_DefineProperty(cx, tobj, sp->tag_names[i], STRING_TO_JSVAL(str), 0, 0, JSPROP_ENUMERATE);
+				}
+			}
+			break;
 		case SERIES_PROPERTY_ID_VALUES:
 			*rval = OBJECT_TO_JSVAL(js_influx_values_new(cx,obj,sp));
 #if 0
@@ -1339,12 +1417,17 @@ JSObject *js_InitInfluxSeriesClass(JSContext *cx, JSObject *parent) {
 		{ "name",		SERIES_PROPERTY_ID_NAME,	JSPROP_ENUMERATE | JSPROP_READONLY },
 		{ "columns",		SERIES_PROPERTY_ID_COLUMNS,	JSPROP_ENUMERATE | JSPROP_READONLY },
 		{ "values",		SERIES_PROPERTY_ID_VALUES,	JSPROP_ENUMERATE | JSPROP_READONLY },
+		{ "tags",		SERIES_PROPERTY_ID_TAGS,	JSPROP_ENUMERATE | JSPROP_READONLY },
+		{0}
+	};
+	JSFunctionSpec series_funcs[] = {
+		JS_FN("column",js_influx_series_column,1,1,0),
 		{0}
 	};
 	JSObject *obj;
 
 	dprintf(dlevel,"creating %s class...\n",js_influx_series_class.name);
-	obj = JS_InitClass(cx, parent, 0, &js_influx_series_class, 0, 0, series_props, 0, 0, 0);
+	obj = JS_InitClass(cx, parent, 0, &js_influx_series_class, 0, 0, series_props, series_funcs, 0, 0);
 	dprintf(dlevel,"obj: %p\n", obj);
 	if (!obj) {
 		JS_ReportError(cx,"unable to initialize %s class", js_influx_series_class.name);
@@ -1714,6 +1797,7 @@ static JSBool influx_setprop(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
 		default:
 			break;
 		}
+		influx_writer_update(s);
 	}
 	return JS_TRUE;
 }
@@ -1820,7 +1904,13 @@ static JSBool js_influx_write(JSContext *cx, uintN argc, jsval *vp) {
 	if (strcmp(type,"string") == 0) {
 		char *value = (char *)JS_EncodeString(cx,JSVAL_TO_STRING(argv[1]));
 		dprintf(dlevel,"value: %s\n", value);
-		r = influx_write(s,name,value);
+		/* Batched writes are queued, there's no response */
+		if (s->batch) {
+			influx_write_line(s,name,value);
+			r = 0;
+		} else {
+			r = influx_write(s,name,value);
+		}
 		JS_free(cx,value);
 
 	/* Otherwise it's an object - gets the keys and values */
@@ -1893,7 +1983,12 @@ static JSBool js_influx_write(JSContext *cx, uintN argc, jsval *vp) {
 		JS_DestroyIdArray(cx, ida);
 		string[stridx] = 0;
 		dprintf(dlevel,"string: %s\n", string);
-		r = influx_write(s,name,string);
+		if (s->batch) {
+			influx_write_line(s,name,string);
+			r = 0;
+		} else {
+			r = influx_write(s,name,string);
+		}
 		free(string);
 	} else {
 		JS_free(cx,name);
@@ -2018,6 +2113,7 @@ int influx_jsinit(JSEngine *e) {
 	JS_EngineAddInitClass(e, "js_InitInfluxResponseClass", js_InitInfluxResponseClass);
 	JS_EngineAddInitClass(e, "js_InitInfluxResultClass", js_InitInfluxResultClass);
 	JS_EngineAddInitClass(e, "js_InitInfluxSeriesClass", js_InitInfluxSeriesClass);
+	JS_EngineAddInitClass(e, "js_InitInfluxColumnClass", js_InitInfluxColumnClass);
 	return 0;
 }
 #endif /* JS */
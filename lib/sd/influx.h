@@ -10,6 +10,7 @@ LICENSE file in the root directory of this source tree.
 #ifndef __INFLUX_H
 #define __INFLUX_H
 
+#include <stdint.h>
 #include "list.h"
 
 struct influx_session;
@@ -19,20 +20,40 @@ typedef struct influx_result influx_result_t;
 struct influx_response;
 typedef struct influx_response influx_response_t;
 
-struct influx_value {
+/* Column value types */
+#define INFLUX_TYPE_NULL	0	/* No values yet */
+#define INFLUX_TYPE_DOUBLE	1
+#define INFLUX_TYPE_INT64	2
+#define INFLUX_TYPE_TIME	3	/* int64 in the query's epoch units */
+#define INFLUX_TYPE_STRING	4	/* Offset into the series string pool */
+#define INFLUX_TYPE_BOOL	5
+
+/* Values are stored by column in contiguous arrays */
+struct influx_column {
+	char *name;
 	int type;
-	void *data;
-	int len;
+	union {
+		double *d;
+		int64_t *i;
+	} data;
+	uint8_t *nulls;
 };
-typedef struct influx_value influx_value_t;
+typedef struct influx_column influx_column_t;
 
 // Series/Results/Responses are all lists so they can be deleted when no more JS refs
 struct influx_series {
 	char name[128];
-	char **columns;
+	char **columns;			/* Column names */
 	int column_count;
-	influx_value_t ***values;
-	int value_count;
+	influx_column_t *cols;
+	int value_count;		/* Rows */
+	int value_size;			/* Rows allocated */
+	char *strings;			/* String value pool */
+	int strings_len;
+	int strings_size;
+	char **tag_names;		/* Series tags (GROUP BY) */
+	char **tag_values;
+	int tag_count;
 #ifdef JS
 	bool convdt;
 #endif
@@ -77,8 +98,19 @@ int influx_health(influx_session_t *s);
 int influx_connect(influx_session_t *s);
 int influx_connected(influx_session_t *s);
 influx_response_t *influx_query(influx_session_t *s, char *query);
+influx_response_t *influx_cache_get(influx_session_t *s, char *query, int ttl);
 influx_response_t *influx_write(influx_session_t *s, char *mm, char *string);
+int influx_write_line(influx_session_t *s, char *mm, char *fields);
 int influx_get_first_value(influx_response_t *r, double *d, char *t, int l);
+struct stats_hist;
+void influx_set_stats(influx_session_t *s, struct stats_hist *write_hist);
+/* Who owns the spool (agent/client name), keeps it apart from others in the same dir */
+void influx_set_spool_name(influx_session_t *s, char *name);
+int influx_series_column(influx_series_t *sp, char *name);
+int influx_series_isnull(influx_series_t *sp, int row, int col);
+double influx_series_double(influx_series_t *sp, int row, int col);
+char *influx_series_string(influx_series_t *sp, int row, int col);
+char *influx_series_tag(influx_series_t *sp, char *name);
 
 #ifndef NO_CONFIG
 #include "config.h"
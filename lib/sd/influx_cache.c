@@ -0,0 +1,428 @@
+#ifdef INFLUX
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include "common.h"
+#include "influx_internal.h"
+#include <pthread.h>
+#include <sys/time.h>
+
+/* Query result cache: results are kept by query text for ttl ms, and a worker
+   thread with its own connection re-runs queries that are still being asked
+   for shortly before they expire, so callers get them from memory instead of
+   waiting on the server.  The worker only fetches the raw result; it's parsed
+   into a response on the session's own thread the next time it's asked for,
+   so responses (and the session's list of them) are never touched by two
+   threads. */
+
+struct influx_cache_entry {
+	char *query;
+	int ttl;			/* ms */
+	int uses;
+	int prefetch;			/* Keep it fresh in the background */
+	int busy;			/* Worker is fetching it */
+	influx_response_t *r;		/* Latest result (session thread only) */
+	uint64_t fetched;		/* When r was fetched (monotime_ms) */
+	uint64_t used;			/* Last asked for */
+	uint64_t next;			/* Next prefetch */
+	char *body;			/* Newer result from the worker */
+	int len;
+	uint64_t body_time;
+};
+typedef struct influx_cache_entry influx_cache_entry_t;
+
+struct influx_cache {
+	influx_session_t *s;
+	pthread_t th;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int running;
+	int stop;
+	list entries;
+	uint64_t swept;
+	CURL *curl;			/* Worker's own connection */
+	struct curl_slist *hs;
+	char *buf;			/* Result being received */
+	int len;
+	int size;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long fetches;
+	unsigned long errors;
+};
+typedef struct influx_cache influx_cache_t;
+
+static size_t influx_cache_getdata(void *ptr, size_t size, size_t nmemb, void *ctx) {
+	influx_cache_t *c = ctx;
+	int bytes = size * nmemb;
+	char *p;
+
+	if (c->len + bytes + 1 > c->size) {
+		int newsize = ((c->len + bytes) / INFLUX_INIT_BUFSIZE + 1) * INFLUX_INIT_BUFSIZE;
+
+		p = realloc(c->buf, newsize);
+		if (!p) {
+			log_syserror("influx_cache: realloc(%d)", newsize);
+			return 0;
+		}
+		c->buf = p;
+		c->size = newsize;
+	}
+	memcpy(c->buf + c->len, ptr, bytes);
+	c->len += bytes;
+	c->buf[c->len] = 0;
+	return bytes;
+}
+
+/* Run a query on the worker's connection; the result is left in c->buf */
+static int influx_cache_fetch(influx_cache_t *c, char *query) {
+	influx_session_t *s = c->s;
+	char *url,*eq;
+	CURLcode res;
+	long rc;
+	int size;
+
+	dprintf(dlevel,"query: %s\n", query);
+	eq = curl_easy_escape(c->curl, query, strlen(query));
+	if (!eq) return 1;
+	size = strlen(s->endpoint) + strlen(s->database) + strlen(s->epoch) + strlen(eq) + 32;
+	url = malloc(size);
+	if (!url) {
+		curl_free(eq);
+		return 1;
+	}
+	snprintf(url, size, "%s/query?db=%s%s%s&q=%s", strlen(s->endpoint) ? s->endpoint : "http://localhost:8086",
+		s->database, strlen(s->epoch) ? "&epoch=" : "", s->epoch, eq);
+	curl_free(eq);
+
+	curl_slist_free_all(c->hs);
+	c->hs = curl_slist_append(0, "Content-Type: application/x-www-form-urlencoded");
+	if (strlen(s->token)) {
+		char auth_header[INFLUX_TOKEN_SIZE + 32];
+		sprintf(auth_header, "Authorization: Token %s", s->token);
+		c->hs = curl_slist_append(c->hs, auth_header);
+	} else if (strlen(s->username)) {
+		char userpwd[INFLUX_USERNAME_SIZE + INFLUX_PASSWORD_SIZE + 2];
+		sprintf(userpwd, "%s:%s", s->username, s->password);
+		curl_easy_setopt(c->curl, CURLOPT_HTTPAUTH, CURLAUTH_BASIC);
+		curl_easy_setopt(c->curl, CURLOPT_USERPWD, userpwd);
+	}
+	curl_easy_setopt(c->curl, CURLOPT_HTTPHEADER, c->hs);
+	curl_easy_setopt(c->curl, CURLOPT_VERBOSE, s->verbose);
+	curl_easy_setopt(c->curl, CURLOPT_URL, url);
+	curl_easy_setopt(c->curl, CURLOPT_HTTPGET, 1L);
+	curl_easy_setopt(c->curl, CURLOPT_TIMEOUT, (long)s->timeout);
+	c->len = 0;
+	res = curl_easy_perform(c->curl);
+	free(url);
+	if (res != CURLE_OK) {
+		log_error("influx_cache: %s\n", curl_easy_strerror(res));
+		return 1;
+	}
+	rc = 0;
+	curl_easy_getinfo(c->curl, CURLINFO_RESPONSE_CODE, &rc);
+	dprintf(dlevel,"rc: %ld, len: %d\n", rc, c->len);
+	if (rc != 200) {
+		log_error("influx_cache: query failed: rc: %ld\n", rc);
+		return 1;
+	}
+	return 0;
+}
+
+/* Next entry due for a prefetch, else 0 with *deadline set to the soonest one */
+static influx_cache_entry_t *influx_cache_due(influx_cache_t *c, uint64_t now, uint64_t *deadline) {
+	influx_cache_entry_t *e;
+
+	*deadline = 0;
+	list_reset(c->entries);
+	while((e = list_get_next(c->entries)) != 0) {
+		/* Nobody has asked for it in a while */
+		if (!e->prefetch || e->busy || now - e->used > (uint64_t)e->ttl * INFLUX_CACHE_IDLE) continue;
+		if (e->next <= now) return e;
+		if (!*deadline || e->next < *deadline) *deadline = e->next;
+	}
+	return 0;
+}
+
+static void *influx_cache_thread(void *ctx) {
+	influx_cache_t *c = ctx;
+	influx_cache_entry_t *e;
+	struct timespec ts;
+	struct timeval tv;
+	uint64_t now,deadline,start;
+	char *query,*body;
+	int error;
+
+	dprintf(dlevel,"starting\n");
+	pthread_mutex_lock(&c->lock);
+	while(!c->stop) {
+		now = monotime_ms();
+		e = influx_cache_due(c, now, &deadline);
+		if (e) {
+			/* Entries aren't removed while busy */
+			e->busy = 1;
+			query = strdup(e->query);
+			pthread_mutex_unlock(&c->lock);
+			start = monotime_ms();
+			error = (query ? influx_cache_fetch(c, query) : 1);
+			body = (error ? 0 : malloc(c->len + 1));
+			if (body) memcpy(body, c->buf, c->len + 1);
+			free(query);
+			pthread_mutex_lock(&c->lock);
+			e->busy = 0;
+			c->fetches++;
+			if (body) {
+				free(e->body);
+				e->body = body;
+				e->len = c->len;
+				e->body_time = start;
+				/* Again a bit before this one expires */
+				e->next = start + e->ttl - (e->ttl / INFLUX_CACHE_AHEAD);
+			} else {
+				c->errors++;
+				e->next = monotime_ms() + (e->ttl < INFLUX_CACHE_RETRY ? e->ttl : INFLUX_CACHE_RETRY);
+			}
+			continue;
+		}
+		if (deadline) {
+			gettimeofday(&tv,0);
+			ts.tv_sec = tv.tv_sec + ((deadline - now) / 1000);
+			ts.tv_nsec = (tv.tv_usec * 1000) + (((deadline - now) % 1000) * 1000000);
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&c->cond, &c->lock, &ts);
+		} else {
+			pthread_cond_wait(&c->cond, &c->lock);
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+	dprintf(dlevel,"done\n");
+	return 0;
+}
+
+static influx_cache_t *influx_cache_new(influx_session_t *s) {
+	influx_cache_t *c;
+
+	c = calloc(1,sizeof(*c));
+	if (!c) {
+		log_syserror("influx_cache_new: calloc");
+		return 0;
+	}
+	c->s = s;
+	c->entries = list_create();
+	c->curl = curl_easy_init();
+	if (!c->entries || !c->curl) {
+		log_error("influx_cache_new: unable to initialize\n");
+		if (c->entries) list_destroy(c->entries);
+		if (c->curl) curl_easy_cleanup(c->curl);
+		free(c);
+		return 0;
+	}
+	curl_easy_setopt(c->curl, CURLOPT_SSL_VERIFYPEER, 0L);
+	curl_easy_setopt(c->curl, CURLOPT_SSL_VERIFYHOST, 0L);
+	curl_easy_setopt(c->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(c->curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(c->curl, CURLOPT_WRITEFUNCTION, influx_cache_getdata);
+	curl_easy_setopt(c->curl, CURLOPT_WRITEDATA, c);
+	pthread_mutex_init(&c->lock, 0);
+	pthread_cond_init(&c->cond, 0);
+	if (pthread_create(&c->th, 0, influx_cache_thread, c)) {
+		log_syserror("influx_cache_new: pthread_create");
+		pthread_mutex_destroy(&c->lock);
+		pthread_cond_destroy(&c->cond);
+		curl_easy_cleanup(c->curl);
+		list_destroy(c->entries);
+		free(c);
+		return 0;
+	}
+	c->running = 1;
+	return c;
+}
+
+static void influx_cache_free_entry(influx_cache_entry_t *e) {
+	influx_release_response(e->r);
+	free(e->body);
+	free(e->query);
+}
+
+void influx_cache_destroy(influx_session_t *s) {
+	influx_cache_t *c = s->cache;
+	influx_cache_entry_t *e;
+
+	if (!c) return;
+	dprintf(dlevel,"hits: %lu, misses: %lu, fetches: %lu, errors: %lu\n", c->hits, c->misses, c->fetches, c->errors);
+	pthread_mutex_lock(&c->lock);
+	c->stop = 1;
+	pthread_cond_signal(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+	if (c->running) pthread_join(c->th, 0);
+	list_reset(c->entries);
+	while((e = list_get_next(c->entries)) != 0) influx_cache_free_entry(e);
+	list_destroy(c->entries);
+	curl_slist_free_all(c->hs);
+	curl_easy_cleanup(c->curl);
+	pthread_mutex_destroy(&c->lock);
+	pthread_cond_destroy(&c->cond);
+	free(c->buf);
+	free(c);
+	s->cache = 0;
+}
+
+/* Drop what nobody has asked for in a while (lock held) */
+static void influx_cache_sweep(influx_cache_t *c, uint64_t now) {
+	influx_cache_entry_t *e;
+
+	if (now - c->swept < 1000) return;
+	c->swept = now;
+	list_reset(c->entries);
+	while((e = list_get_next(c->entries)) != 0) {
+		if (e->busy || now - e->used <= (uint64_t)e->ttl * INFLUX_CACHE_IDLE) continue;
+		dprintf(dlevel,"dropping: %s\n", e->query);
+		influx_cache_free_entry(e);
+		list_delete(c->entries,e);
+	}
+}
+
+/* Find (or add) the entry for a query and bring in anything the worker got (lock held) */
+static influx_cache_entry_t *influx_cache_entry(influx_session_t *s, influx_cache_t *c, char *query, int ttl) {
+	influx_cache_entry_t *e,newentry;
+	influx_response_t *r;
+	uint64_t now;
+
+	now = monotime_ms();
+	influx_cache_sweep(c, now);
+	list_reset(c->entries);
+	while((e = list_get_next(c->entries)) != 0) {
+		if (strcmp(e->query,query) == 0) break;
+	}
+	if (!e) {
+		memset(&newentry,0,sizeof(newentry));
+		newentry.query = strdup(query);
+		if (!newentry.query) return 0;
+		newentry.ttl = ttl;
+		e = list_add(c->entries,&newentry,sizeof(newentry));
+		if (!e) {
+			free(newentry.query);
+			return 0;
+		}
+	}
+	e->used = now;
+	e->uses++;
+	if (e->body) {
+		r = influx_parse_response(s, e->body, e->len);
+		if (r && !r->error) {
+			influx_release_response(e->r);
+			e->r = r;
+			e->fetched = e->body_time;
+		} else {
+			influx_release_response(r);
+		}
+		free(e->body);
+		e->body = 0;
+	}
+	return e;
+}
+
+static influx_cache_t *influx_cache_get_cache(influx_session_t *s) {
+	if (!s->cache) s->cache = influx_cache_new(s);
+	return s->cache;
+}
+
+static void influx_cache_prefetch(influx_cache_t *c, influx_cache_entry_t *e) {
+	if (e->prefetch) return;
+	e->prefetch = 1;
+	/* Start now if we have nothing, else before what we have expires */
+	e->next = (e->r ? e->fetched + e->ttl - (e->ttl / INFLUX_CACHE_AHEAD) : 0);
+	pthread_cond_signal(&c->cond);
+}
+
+/* For influx_query: a result no older than the session's TTL, or 0 */
+influx_response_t *influx_cache_lookup(influx_session_t *s, char *query) {
+	influx_cache_t *c;
+	influx_cache_entry_t *e;
+	influx_response_t *r;
+
+	c = influx_cache_get_cache(s);
+	if (!c) return 0;
+	r = 0;
+	pthread_mutex_lock(&c->lock);
+	e = influx_cache_entry(s, c, query, s->cache_ttl);
+	if (e) {
+		e->ttl = s->cache_ttl;
+		/* Asked for more than once - keep it fresh */
+		if (e->uses > 1) influx_cache_prefetch(c, e);
+		if (e->r && monotime_ms() - e->fetched < e->ttl) {
+			r = e->r;
+			r->refs++;
+		}
+	}
+	if (r) c->hits++;
+	else c->misses++;
+	pthread_mutex_unlock(&c->lock);
+	dprintf(dlevel,"query: %s, r: %p\n", query, r);
+	return r;
+}
+
+/* influx_query fetched it itself */
+void influx_cache_store(influx_session_t *s, char *query, influx_response_t *r) {
+	influx_cache_t *c = s->cache;
+	influx_cache_entry_t *e;
+
+	if (!c || r->error) return;
+	pthread_mutex_lock(&c->lock);
+	list_reset(c->entries);
+	while((e = list_get_next(c->entries)) != 0) {
+		if (strcmp(e->query,query) == 0) {
+			influx_release_response(e->r);
+			e->r = r;
+			r->refs++;
+			e->fetched = monotime_ms();
+			break;
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+}
+
+/* Never waits on the server: the latest result for query if there is one that
+   isn't too stale, else 0 (and the worker starts fetching it).  Results are
+   refreshed in the background every ttl ms (0 = the session's TTL, or
+   INFLUX_CACHE_TTL) for as long as they keep being asked for.  Release the
+   response when done with it. */
+influx_response_t *influx_cache_get(influx_session_t *s, char *query, int ttl) {
+	influx_cache_t *c;
+	influx_cache_entry_t *e;
+	influx_response_t *r;
+
+	if (!s || !s->enabled || !query || !strlen(query)) return 0;
+	if (ttl <= 0) ttl = (s->cache_ttl > 0 ? s->cache_ttl : INFLUX_CACHE_TTL);
+	c = influx_cache_get_cache(s);
+	if (!c) return 0;
+	r = 0;
+	pthread_mutex_lock(&c->lock);
+	e = influx_cache_entry(s, c, query, ttl);
+	if (e) {
+		e->ttl = ttl;
+		influx_cache_prefetch(c, e);
+		if (e->r && monotime_ms() - e->fetched < (uint64_t)e->ttl * INFLUX_CACHE_STALE) {
+			r = e->r;
+			r->refs++;
+		}
+	}
+	if (r) c->hits++;
+	else c->misses++;
+	pthread_mutex_unlock(&c->lock);
+	dprintf(dlevel,"query: %s, r: %p\n", query, r);
+	return r;
+}
+#endif
@@ -0,0 +1,136 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_INFLUX_INTERNAL_H
+#define __SD_INFLUX_INTERNAL_H
+
+#include <curl/curl.h>
+#include "influx.h"
+
+#define INFLUX_ENDPOINT_SIZE 128
+#define INFLUX_DATABASE_SIZE 64
+#define INFLUX_USERNAME_SIZE 32
+#define INFLUX_PASSWORD_SIZE 32
+#define INFLUX_TOKEN_SIZE 128
+
+#define INFLUX_INIT_BUFSIZE 4096
+#define SESSION_ID_SIZE 128
+
+/* Batch defaults */
+#define INFLUX_BATCH_SIZE 65536		/* Flush when this many bytes are pending */
+#define INFLUX_BATCH_AGE 1000		/* Flush when the oldest point is this old (ms) */
+#define INFLUX_BATCH_MAX 1048576	/* Drop oldest points beyond this many bytes */
+
+/* Spool defaults */
+#define INFLUX_SPOOL_SEGSIZE 4194304	/* Segment file size */
+#define INFLUX_SPOOL_MAX 64		/* Max spool size (MB) */
+#define INFLUX_SPOOL_RETRY 10000	/* Ping interval while the server is down (ms) */
+
+/* Rollup defaults */
+#define INFLUX_ROLLUP_MAX 4		/* Max windows */
+#define INFLUX_ROLLUP_GAP 300000	/* Don't integrate across gaps longer than this (ms) */
+#define INFLUX_ROLLUP_ENERGY "*power"	/* Fields integrated to Wh */
+
+/* Query cache defaults */
+#define INFLUX_CACHE_TTL 10000		/* influx_cache_get TTL if the session has none (ms) */
+#define INFLUX_CACHE_AHEAD 5		/* Refresh 1/N of the TTL before it expires */
+#define INFLUX_CACHE_STALE 3		/* influx_cache_get gives up on results N TTLs old */
+#define INFLUX_CACHE_IDLE 4		/* Forget results not asked for in N TTLs */
+#define INFLUX_CACHE_RETRY 5000		/* Retry a failed prefetch (ms) */
+
+struct influx_writer;
+struct influx_rollup;
+struct influx_cache;
+
+struct influx_session {
+	bool enabled;
+	char endpoint[INFLUX_ENDPOINT_SIZE];
+	char database[INFLUX_DATABASE_SIZE];
+	char username[INFLUX_USERNAME_SIZE];
+	char password[INFLUX_PASSWORD_SIZE];
+	char token[INFLUX_TOKEN_SIZE];
+	char epoch[16];
+	bool connected;
+	int errcode;
+	char errmsg[128];
+	CURL *curl;
+	struct curl_slist *hs;
+	char version[8];
+	char session_id[SESSION_ID_SIZE];
+	struct influx_parser *parser;	/* Response being parsed */
+	list responses;
+	char *login_fields;
+	char *read_fields;
+	char *config_fields;
+	bool verbose;
+	bool convdt;
+	int timeout;
+	bool ctor;
+	bool batch;			/* Queue writes for the flush thread */
+	int batch_size;
+	int batch_age;
+	int batch_max;
+	bool gzip;			/* Compress batches */
+	struct influx_writer *writer;
+	bool spool;			/* Spool undelivered batches to disk */
+	char spool_dir[256];
+	int spool_max;
+	char spool_name[64];		/* Owner part of the spool file names */
+	struct stats_hist *write_hist;	/* Write (POST) latency (us, see stats.h) */
+	char rp[32];			/* Retention policy to write to, "" = default */
+	char rollup_windows[128];	/* "window[:rp],..." e.g. "10s,1m:month,15m:forever" */
+	char rollup_energy[128];	/* Field patterns to integrate */
+	bool rollup_raw;		/* Still write the raw points */
+	struct influx_rollup *rollup;
+	int cache_ttl;			/* Serve repeated queries from memory for this long (ms, 0 = off) */
+	struct influx_cache *cache;
+};
+
+/* influx.c */
+influx_session_t *influx_clone(influx_session_t *s);
+influx_response_t *influx_parse_response(influx_session_t *s, char *data, int len);
+
+/* influx_spool.c */
+struct influx_spool;
+typedef struct influx_spool influx_spool_t;
+typedef int (influx_spool_func_t)(void *ctx, char *data, int len);
+
+influx_spool_t *influx_spool_open(char *dir, char *name, int max_mb);
+void influx_spool_close(influx_spool_t *sp);
+int influx_spool_empty(influx_spool_t *sp);
+int influx_spool_put(influx_spool_t *sp, char *data, int len);
+int influx_spool_replay(influx_spool_t *sp, int batch_size, influx_spool_func_t *func, void *ctx);
+unsigned long influx_spool_dropped(influx_spool_t *sp);
+
+/* influx_parse.c */
+struct influx_parser;
+typedef struct influx_parser influx_parser_t;
+
+influx_parser_t *influx_parser_new(influx_response_t *r);
+int influx_parser_feed(influx_parser_t *p, char *data, int len);
+int influx_parser_finish(influx_parser_t *p);
+void influx_parser_free(influx_parser_t *p);
+void influx_series_free(influx_series_t *sp);
+
+/* influx_writer.c */
+int influx_writer_add(influx_session_t *s, char *line, int len);
+void influx_writer_update(influx_session_t *s);
+void influx_writer_destroy(influx_session_t *s);
+
+/* influx_cache.c */
+influx_response_t *influx_cache_lookup(influx_session_t *s, char *query);
+void influx_cache_store(influx_session_t *s, char *query, influx_response_t *r);
+void influx_cache_destroy(influx_session_t *s);
+
+/* influx_rollup.c */
+int influx_rollup_add(influx_session_t *s, char *mm, char *fields, uint64_t now);
+void influx_rollup_flush(influx_session_t *s);
+void influx_rollup_destroy(influx_session_t *s);
+
+#endif /* __SD_INFLUX_INTERNAL_H */
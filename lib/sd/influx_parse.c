@@ -0,0 +1,483 @@
+#ifdef INFLUX
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 5
+#include "debug.h"
+
+#include "common.h"
+#include "influx_internal.h"
+#include <ctype.h>
+
+/* Streaming parser for query responses.  The JSON is tokenized as it comes
+   off the wire and the values go straight into per-column arrays, so a large
+   result never exists as a DOM or as one allocation per value:
+
+	{ "results": [ { "statement_id": 0, "error": "...",
+		"series": [ { "name": "...", "tags": { "...": "...", ... },
+			"columns": [ ... ], "values": [ [ ... ], ... ] } ] } ] }
+*/
+
+#define PARSE_MAX_DEPTH 16
+#define PARSE_KEY_SIZE 32
+#define PARSE_INIT_ROWS 64
+
+enum {
+	LEX_NONE,
+	LEX_STRING,
+	LEX_ESCAPE,
+	LEX_UNICODE,
+	LEX_BARE,			/* number/true/false/null */
+};
+
+struct parse_level {
+	char type;			/* { or [ */
+	char key[PARSE_KEY_SIZE];	/* Last key seen (objects) */
+};
+
+struct influx_parser {
+	influx_response_t *r;
+	int lex;
+	int expect_key;
+	int depth;
+	struct parse_level stack[PARSE_MAX_DEPTH];
+	char *tok;
+	int toklen;
+	int toksize;
+	int ulen;			/* \uXXXX digits seen */
+	char ubuf[5];
+	influx_result_t result;		/* Being built */
+	influx_series_t series;
+	int col;			/* Current column in row */
+	int error;
+};
+
+#define KEY(n) (p->stack[n].key)
+
+static int parse_tokadd(influx_parser_t *p, char c) {
+	if (p->toklen + 1 >= p->toksize) {
+		char *newtok;
+		int newsize;
+
+		newsize = (p->toksize ? p->toksize * 2 : 256);
+		newtok = realloc(p->tok, newsize);
+		if (!newtok) {
+			log_syserror("influx_parser: realloc(%d)", newsize);
+			return 1;
+		}
+		p->tok = newtok;
+		p->toksize = newsize;
+	}
+	p->tok[p->toklen++] = c;
+	return 0;
+}
+
+/* Make room for another row */
+static int series_grow(influx_series_t *sp) {
+	influx_column_t *cp;
+	int i,newsize;
+	void *d,*n;
+
+	newsize = (sp->value_size ? sp->value_size * 2 : PARSE_INIT_ROWS);
+	dprintf(dlevel+1,"newsize: %d\n", newsize);
+	for(i=0; i < sp->column_count; i++) {
+		cp = &sp->cols[i];
+		d = realloc(cp->data.d, newsize * sizeof(double));
+		if (!d) goto series_grow_error;
+		cp->data.d = d;
+		n = realloc(cp->nulls, newsize);
+		if (!n) goto series_grow_error;
+		cp->nulls = n;
+		memset(cp->nulls + sp->value_size, 1, newsize - sp->value_size);
+	}
+	sp->value_size = newsize;
+	return 0;
+
+series_grow_error:
+	log_syserror("influx_parser: realloc(%d rows)", newsize);
+	return 1;
+}
+
+static int series_add_column(influx_series_t *sp, char *name) {
+	influx_column_t *newcols;
+	char **newnames;
+
+	newcols = realloc(sp->cols, (sp->column_count + 1) * sizeof(*newcols));
+	if (!newcols) return 1;
+	sp->cols = newcols;
+	newnames = realloc(sp->columns, (sp->column_count + 1) * sizeof(char *));
+	if (!newnames) return 1;
+	sp->columns = newnames;
+	memset(&sp->cols[sp->column_count],0,sizeof(*newcols));
+	sp->cols[sp->column_count].name = strdup(name);
+	if (!sp->cols[sp->column_count].name) return 1;
+	sp->columns[sp->column_count] = sp->cols[sp->column_count].name;
+	sp->column_count++;
+	return 0;
+}
+
+static int series_add_tag(influx_series_t *sp, char *name, char *value) {
+	char **newnames,**newvalues;
+
+	newnames = realloc(sp->tag_names, (sp->tag_count + 1) * sizeof(char *));
+	if (!newnames) return 1;
+	sp->tag_names = newnames;
+	newvalues = realloc(sp->tag_values, (sp->tag_count + 1) * sizeof(char *));
+	if (!newvalues) return 1;
+	sp->tag_values = newvalues;
+	sp->tag_names[sp->tag_count] = strdup(name);
+	sp->tag_values[sp->tag_count] = strdup(value);
+	if (!sp->tag_names[sp->tag_count] || !sp->tag_values[sp->tag_count]) {
+		free(sp->tag_names[sp->tag_count]);
+		free(sp->tag_values[sp->tag_count]);
+		return 1;
+	}
+	sp->tag_count++;
+	return 0;
+}
+
+static int series_add_string(influx_series_t *sp, char *str, int len) {
+	int off;
+
+	if (sp->strings_len + len + 1 > sp->strings_size) {
+		char *newpool;
+		int newsize;
+
+		newsize = (sp->strings_size ? sp->strings_size * 2 : 1024);
+		while(newsize < sp->strings_len + len + 1) newsize *= 2;
+		newpool = realloc(sp->strings, newsize);
+		if (!newpool) {
+			log_syserror("influx_parser: realloc(strings,%d)", newsize);
+			return -1;
+		}
+		sp->strings = newpool;
+		sp->strings_size = newsize;
+	}
+	off = sp->strings_len;
+	memcpy(sp->strings + off, str, len);
+	sp->strings[off+len] = 0;
+	sp->strings_len += len + 1;
+	return off;
+}
+
+/* Store a value in the current row */
+static int series_set(influx_series_t *sp, int col, int string, char *tok, int len) {
+	influx_column_t *cp;
+	int row,i,isint;
+	int64_t ival;
+	double dval;
+	char *e;
+
+	if (col >= sp->column_count) return 0;
+	cp = &sp->cols[col];
+	row = sp->value_count;
+
+	if (string) {
+		/* Numeric column - a string doesn't fit */
+		if (cp->type != INFLUX_TYPE_NULL && cp->type != INFLUX_TYPE_STRING) return 0;
+		cp->type = INFLUX_TYPE_STRING;
+		i = series_add_string(sp, tok, len);
+		if (i < 0) return 1;
+		cp->data.i[row] = i;
+		cp->nulls[row] = 0;
+		return 0;
+	}
+	if (strcmp(tok,"null") == 0) return 0;
+
+	/* Keep the text in a string column */
+	if (cp->type == INFLUX_TYPE_STRING) return series_set(sp, col, 1, tok, len);
+
+	if (strcmp(tok,"true") == 0 || strcmp(tok,"false") == 0) {
+		ival = (*tok == 't');
+		if (cp->type == INFLUX_TYPE_NULL) cp->type = INFLUX_TYPE_BOOL;
+		if (cp->type == INFLUX_TYPE_DOUBLE) cp->data.d[row] = ival;
+		else cp->data.i[row] = ival;
+		cp->nulls[row] = 0;
+		return 0;
+	}
+
+	isint = (strpbrk(tok,".eE") == 0);
+	if (isint) {
+		ival = strtoll(tok,&e,10);
+		if (*e) return 0;
+		if (cp->type == INFLUX_TYPE_NULL || cp->type == INFLUX_TYPE_BOOL)
+			cp->type = (strcmp(cp->name,"time") == 0 ? INFLUX_TYPE_TIME : INFLUX_TYPE_INT64);
+		if (cp->type == INFLUX_TYPE_DOUBLE) cp->data.d[row] = ival;
+		else cp->data.i[row] = ival;
+	} else {
+		dval = strtod(tok,&e);
+		if (*e) return 0;
+		if (cp->type != INFLUX_TYPE_DOUBLE) {
+			/* Promote the column, ints and doubles are the same size */
+			for(i=0; i < row; i++) cp->data.d[i] = cp->data.i[i];
+			cp->type = INFLUX_TYPE_DOUBLE;
+		}
+		cp->data.d[row] = dval;
+	}
+	cp->nulls[row] = 0;
+	return 0;
+}
+
+static void series_free(influx_series_t *sp) {
+	int i;
+
+	for(i=0; i < sp->column_count; i++) {
+		free(sp->cols[i].name);
+		if (sp->cols[i].data.d) free(sp->cols[i].data.d);
+		if (sp->cols[i].nulls) free(sp->cols[i].nulls);
+	}
+	if (sp->cols) free(sp->cols);
+	if (sp->columns) free(sp->columns);
+	if (sp->strings) free(sp->strings);
+	for(i=0; i < sp->tag_count; i++) {
+		free(sp->tag_names[i]);
+		free(sp->tag_values[i]);
+	}
+	if (sp->tag_names) free(sp->tag_names);
+	if (sp->tag_values) free(sp->tag_values);
+	sp->cols = 0;
+	sp->columns = 0;
+	sp->strings = 0;
+	sp->tag_names = sp->tag_values = 0;
+	sp->column_count = sp->value_count = sp->value_size = sp->tag_count = 0;
+}
+
+static void result_free(influx_result_t *rp) {
+	influx_series_t *sp;
+
+	if (!rp->series) return;
+	list_reset(rp->series);
+	while((sp = list_get_next(rp->series)) != 0) series_free(sp);
+	list_destroy(rp->series);
+	rp->series = 0;
+}
+
+/* Where are we?  See the layout at the top */
+#define IN_RESULTS (p->depth >= 2 && p->stack[0].type == '{' && strcmp(KEY(0),"results") == 0 && p->stack[1].type == '[')
+#define IN_SERIES (IN_RESULTS && p->depth >= 4 && p->stack[2].type == '{' && strcmp(KEY(2),"series") == 0 && p->stack[3].type == '[')
+
+static void parse_begin(influx_parser_t *p, char type) {
+	if (p->depth == 3 && type == '{' && IN_RESULTS) {
+		memset(&p->result,0,sizeof(p->result));
+		p->result.series = list_create_arena(0);
+	} else if (p->depth == 5 && type == '{' && IN_SERIES) {
+		memset(&p->series,0,sizeof(p->series));
+	} else if (p->depth == 7 && type == '[' && IN_SERIES && p->stack[4].type == '{' && strcmp(KEY(4),"values") == 0) {
+		p->col = 0;
+		if (p->series.value_count >= p->series.value_size && series_grow(&p->series)) p->error = 1;
+	}
+}
+
+static void parse_end(influx_parser_t *p, char type) {
+	influx_series_t *sp;
+
+	if (p->depth == 7 && type == '[' && IN_SERIES && strcmp(KEY(4),"values") == 0) {
+		if (p->series.value_count < p->series.value_size) p->series.value_count++;
+	} else if (p->depth == 5 && type == '{' && IN_SERIES) {
+		dprintf(dlevel,"series: %s, columns: %d, values: %d\n", p->series.name, p->series.column_count, p->series.value_count);
+		/* need columns or its invalid */
+		if (!p->series.column_count || !p->result.series) {
+			series_free(&p->series);
+			return;
+		}
+		sp = list_add(p->result.series,&p->series,sizeof(p->series));
+		if (!sp) series_free(&p->series);
+		memset(&p->series,0,sizeof(p->series));
+	} else if (p->depth == 3 && type == '{' && IN_RESULTS) {
+		if (!p->result.series || !list_add(p->r->results,&p->result,sizeof(p->result))) result_free(&p->result);
+		memset(&p->result,0,sizeof(p->result));
+	}
+}
+
+static void parse_value(influx_parser_t *p, int string) {
+	if (p->depth == 1 && strcmp(KEY(0),"error") == 0 && string) {
+		p->r->error = true;
+		strncpy(p->r->errmsg,p->tok,sizeof(p->r->errmsg)-1);
+	} else if (p->depth == 3 && IN_RESULTS && p->stack[2].type == '{') {
+		if (strcmp(KEY(2),"statement_id") == 0 && !string) {
+			p->result.statement_id = atoi(p->tok);
+		} else if (strcmp(KEY(2),"error") == 0 && string) {
+			strncpy(p->result.errmsg,p->tok,sizeof(p->result.errmsg)-1);
+		}
+	} else if (p->depth == 5 && IN_SERIES && p->stack[4].type == '{') {
+		if (strcmp(KEY(4),"name") == 0 && string) strncpy(p->series.name,p->tok,sizeof(p->series.name)-1);
+	} else if (p->depth == 6 && IN_SERIES && p->stack[5].type == '{') {
+		if (strcmp(KEY(4),"tags") == 0 && string && series_add_tag(&p->series,KEY(5),p->tok)) p->error = 1;
+	} else if (p->depth == 6 && IN_SERIES && p->stack[5].type == '[') {
+		/* Columns must come before values */
+		if (strcmp(KEY(4),"columns") == 0 && string && !p->series.value_size) {
+			if (series_add_column(&p->series,p->tok)) p->error = 1;
+		}
+	} else if (p->depth == 7 && IN_SERIES && p->stack[6].type == '[' && strcmp(KEY(4),"values") == 0) {
+		if (p->series.value_count < p->series.value_size && series_set(&p->series, p->col, string, p->tok, p->toklen)) p->error = 1;
+		p->col++;
+	}
+}
+
+static void parse_token(influx_parser_t *p, int string) {
+	p->tok[p->toklen] = 0;
+	dprintf(dlevel+2,"depth: %d, string: %d, tok: %s\n", p->depth, string, p->tok);
+	if (string && p->expect_key && p->depth && p->stack[p->depth-1].type == '{') {
+		strncpy(p->stack[p->depth-1].key,p->tok,PARSE_KEY_SIZE-1);
+		p->stack[p->depth-1].key[PARSE_KEY_SIZE-1] = 0;
+	} else {
+		parse_value(p, string);
+	}
+	p->toklen = 0;
+}
+
+influx_parser_t *influx_parser_new(influx_response_t *r) {
+	influx_parser_t *p;
+
+	p = calloc(1,sizeof(*p));
+	if (!p) {
+		log_syserror("influx_parser_new: calloc");
+		return 0;
+	}
+	p->r = r;
+	if (parse_tokadd(p,0)) {
+		free(p);
+		return 0;
+	}
+	p->toklen = 0;
+	return p;
+}
+
+int influx_parser_feed(influx_parser_t *p, char *data, int len) {
+	register char c;
+	int i;
+
+	for(i=0; i < len && !p->error; i++) {
+		c = data[i];
+		switch(p->lex) {
+		case LEX_STRING:
+			if (c == '"') {
+				parse_token(p, 1);
+				p->lex = LEX_NONE;
+			} else if (c == '\\') {
+				p->lex = LEX_ESCAPE;
+			} else if (parse_tokadd(p,c)) {
+				p->error = 1;
+			}
+			continue;
+		case LEX_ESCAPE:
+			p->lex = LEX_STRING;
+			switch(c) {
+			case 'n': c = '\n'; break;
+			case 't': c = '\t'; break;
+			case 'r': c = '\r'; break;
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'u':
+				p->lex = LEX_UNICODE;
+				p->ulen = 0;
+				continue;
+			}
+			if (parse_tokadd(p,c)) p->error = 1;
+			continue;
+		case LEX_UNICODE:
+			p->ubuf[p->ulen++] = c;
+			if (p->ulen == 4) {
+				unsigned int u;
+
+				p->ubuf[4] = 0;
+				u = strtoul(p->ubuf,0,16);
+				/* UTF-8 encode (BMP only) */
+				if (u < 0x80) {
+					p->error = parse_tokadd(p,u);
+				} else if (u < 0x800) {
+					p->error = parse_tokadd(p,0xC0 | (u >> 6)) || parse_tokadd(p,0x80 | (u & 0x3F));
+				} else {
+					p->error = parse_tokadd(p,0xE0 | (u >> 12)) || parse_tokadd(p,0x80 | ((u >> 6) & 0x3F)) || parse_tokadd(p,0x80 | (u & 0x3F));
+				}
+				p->lex = LEX_STRING;
+			}
+			continue;
+		case LEX_BARE:
+			if (isalnum((int)c) || c == '-' || c == '+' || c == '.') {
+				if (parse_tokadd(p,c)) p->error = 1;
+				continue;
+			}
+			parse_token(p, 0);
+			p->lex = LEX_NONE;
+			/* Fall through to handle the delimiter */
+			break;
+		}
+		switch(c) {
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+			break;
+		case '{':
+		case '[':
+			if (p->depth >= PARSE_MAX_DEPTH) {
+				p->error = 1;
+				break;
+			}
+			p->stack[p->depth].type = c;
+			p->stack[p->depth].key[0] = 0;
+			p->depth++;
+			p->expect_key = (c == '{');
+			parse_begin(p, c);
+			break;
+		case '}':
+		case ']':
+			if (!p->depth) {
+				p->error = 1;
+				break;
+			}
+			parse_end(p, p->stack[p->depth-1].type);
+			p->depth--;
+			p->expect_key = 0;
+			break;
+		case ',':
+			if (p->depth && p->stack[p->depth-1].type == '{') p->expect_key = 1;
+			break;
+		case ':':
+			p->expect_key = 0;
+			break;
+		case '"':
+			p->lex = LEX_STRING;
+			p->toklen = 0;
+			break;
+		default:
+			p->lex = LEX_BARE;
+			p->toklen = 0;
+			if (parse_tokadd(p,c)) p->error = 1;
+			break;
+		}
+	}
+	return p->error;
+}
+
+/* Returns 1 if the response was incomplete or bad */
+int influx_parser_finish(influx_parser_t *p) {
+	int error;
+
+	if (p->lex == LEX_BARE) parse_token(p, 0);
+	error = (p->error || p->depth || p->lex != LEX_NONE);
+	dprintf(dlevel,"error: %d, depth: %d, lex: %d\n", p->error, p->depth, p->lex);
+	/* Partial result/series */
+	if (p->depth > 4) series_free(&p->series);
+	if (p->depth > 2) result_free(&p->result);
+	return error;
+}
+
+void influx_parser_free(influx_parser_t *p) {
+	if (!p) return;
+	if (p->tok) free(p->tok);
+	free(p);
+}
+
+/* Free a series's storage (not the series itself) */
+void influx_series_free(influx_series_t *sp) {
+	series_free(sp);
+}
+#endif
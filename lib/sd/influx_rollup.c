@@ -0,0 +1,399 @@
+#ifdef INFLUX
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include "common.h"
+#include "influx_internal.h"
+#include <math.h>
+#include <fnmatch.h>
+
+/* Rollup aggregates: every numeric field written to a measurement is folded
+   into streaming min/max/mean/last/count accumulators for each configured
+   window, and fields matching the energy patterns are also integrated over
+   time (Wh).  When a point lands in a new window the finished one is written
+   as <measurement>_<window> with <field>_min, _max, _mean, _last, _count (and
+   _wh), timestamped at the start of the window.  Windows are aligned to the
+   wall clock so every agent's 1m points line up.  A window may name a
+   retention policy ("1m:month"), in which case its points go out through a
+   session of their own that writes to that policy. */
+
+struct influx_rollup_acc {
+	double min;
+	double max;
+	double sum;
+	double last;
+	double wh;
+	int count;
+};
+
+struct influx_rollup_field {
+	char name[64];
+	int energy;
+	double prev;			/* Last value and when (for the integral) */
+	uint64_t prev_time;		/* ms, 0 = none yet */
+	struct influx_rollup_acc acc[INFLUX_ROLLUP_MAX];
+};
+
+struct influx_rollup_mm {
+	char name[64];
+	uint64_t start[INFLUX_ROLLUP_MAX];	/* Window start (ms), 0 = empty */
+	struct influx_rollup_field *fields;
+	int count;
+	int size;
+};
+
+struct influx_rollup_window {
+	int interval;			/* ms */
+	char label[16];
+	influx_session_t *out;		/* Retention policy session, 0 = ours */
+};
+
+struct influx_rollup {
+	char spec[sizeof(((influx_session_t *)0)->rollup_windows)];
+	char energy[sizeof(((influx_session_t *)0)->rollup_energy)];
+	struct influx_rollup_window windows[INFLUX_ROLLUP_MAX];
+	int window_count;
+	list mms;
+	char *buf;			/* Line being built */
+	int len;
+	int size;
+};
+typedef struct influx_rollup influx_rollup_t;
+
+/* 10s, 1m, 15m, 1h, 1d - plain numbers are seconds */
+static int influx_rollup_interval(char *str) {
+	char *p;
+	double v;
+
+	v = strtod(str,&p);
+	if (p == str || v <= 0) return 0;
+	switch(*p) {
+	case 0:
+	case 's':
+		break;
+	case 'm':
+		v *= 60;
+		break;
+	case 'h':
+		v *= 3600;
+		break;
+	case 'd':
+		v *= 86400;
+		break;
+	default:
+		return 0;
+	}
+	return v * 1000;
+}
+
+static void influx_rollup_free_windows(influx_rollup_t *ru) {
+	int i;
+
+	for(i=0; i < ru->window_count; i++) {
+		if (ru->windows[i].out) influx_destroy_session(ru->windows[i].out);
+	}
+	ru->window_count = 0;
+}
+
+static void influx_rollup_free_mms(influx_rollup_t *ru) {
+	struct influx_rollup_mm *mp;
+
+	list_reset(ru->mms);
+	while((mp = list_get_next(ru->mms)) != 0) free(mp->fields);
+	list_purge(ru->mms);
+}
+
+/* (Re)build the windows from the session's config */
+static int influx_rollup_config(influx_session_t *s, influx_rollup_t *ru) {
+	struct influx_rollup_window *wp;
+	char temp[sizeof(ru->spec)],*p,*rp;
+	int i;
+
+	dprintf(dlevel,"windows: %s, energy: %s\n", s->rollup_windows, s->rollup_energy);
+	influx_rollup_free_windows(ru);
+	influx_rollup_free_mms(ru);
+	strcpy(ru->spec,s->rollup_windows);
+	strcpy(ru->energy,s->rollup_energy);
+	strcpy(temp,ru->spec);
+	for(i=0; i < INFLUX_ROLLUP_MAX; i++) {
+		p = strele(i,",",temp);
+		if (!strlen(p)) break;
+		rp = strchr(p,':');
+		if (rp) *rp++ = 0;
+		wp = &ru->windows[ru->window_count];
+		memset(wp,0,sizeof(*wp));
+		wp->interval = influx_rollup_interval(trim(p));
+		if (!wp->interval) {
+			log_error("influx_rollup: invalid window: %s\n", p);
+			continue;
+		}
+		strncpy(wp->label,p,sizeof(wp->label)-1);
+		if (rp && strlen(trim(rp))) {
+			wp->out = influx_clone(s);
+			if (!wp->out) {
+				log_error("influx_rollup: unable to create session for retention policy %s\n", rp);
+				continue;
+			}
+			strncpy(wp->out->rp,rp,sizeof(wp->out->rp)-1);
+		}
+		dprintf(dlevel,"window: %s, interval: %d, rp: %s\n", wp->label, wp->interval, wp->out ? wp->out->rp : "");
+		ru->window_count++;
+	}
+	return 0;
+}
+
+static influx_rollup_t *influx_rollup_new(void) {
+	influx_rollup_t *ru;
+
+	ru = calloc(1,sizeof(*ru));
+	if (!ru) {
+		log_syserror("influx_rollup_new: calloc");
+		return 0;
+	}
+	ru->mms = list_create();
+	return ru;
+}
+
+void influx_rollup_destroy(influx_session_t *s) {
+	influx_rollup_t *ru = s->rollup;
+
+	if (!ru) return;
+	influx_rollup_flush(s);
+	influx_rollup_free_windows(ru);
+	influx_rollup_free_mms(ru);
+	list_destroy(ru->mms);
+	free(ru->buf);
+	free(ru);
+	s->rollup = 0;
+}
+
+static int influx_rollup_energy(influx_rollup_t *ru, char *name) {
+	char temp[sizeof(ru->energy)],*p;
+	int i;
+
+	strcpy(temp,ru->energy);
+	for(i=0; ; i++) {
+		p = strele(i,",",temp);
+		if (!strlen(p)) break;
+		if (fnmatch(trim(p),name,0) == 0) return 1;
+	}
+	return 0;
+}
+
+static struct influx_rollup_mm *influx_rollup_get_mm(influx_rollup_t *ru, char *name) {
+	struct influx_rollup_mm *mp,newmm;
+
+	list_reset(ru->mms);
+	while((mp = list_get_next(ru->mms)) != 0) {
+		if (strcmp(mp->name,name) == 0) return mp;
+	}
+	memset(&newmm,0,sizeof(newmm));
+	strncpy(newmm.name,name,sizeof(newmm.name)-1);
+	return list_add(ru->mms,&newmm,sizeof(newmm));
+}
+
+/* Fields usually come in the same order every time, so try the same slot first */
+static struct influx_rollup_field *influx_rollup_get_field(influx_rollup_t *ru, struct influx_rollup_mm *mp, int hint, char *name) {
+	struct influx_rollup_field *fp;
+	int i;
+
+	if (hint < mp->count && strcmp(mp->fields[hint].name,name) == 0) return &mp->fields[hint];
+	for(i=0; i < mp->count; i++) {
+		if (strcmp(mp->fields[i].name,name) == 0) return &mp->fields[i];
+	}
+	if (mp->count == mp->size) {
+		fp = realloc(mp->fields,(mp->size + 16) * sizeof(*fp));
+		if (!fp) {
+			log_syserror("influx_rollup: realloc");
+			return 0;
+		}
+		mp->fields = fp;
+		mp->size += 16;
+	}
+	fp = &mp->fields[mp->count++];
+	memset(fp,0,sizeof(*fp));
+	strncpy(fp->name,name,sizeof(fp->name)-1);
+	fp->energy = influx_rollup_energy(ru,fp->name);
+	return fp;
+}
+
+static int influx_rollup_append(influx_rollup_t *ru, char *fmt, ...) {
+	va_list ap;
+	char *p;
+	int len,size;
+
+	while(1) {
+		va_start(ap,fmt);
+		len = vsnprintf(ru->buf + ru->len, ru->size - ru->len, fmt, ap);
+		va_end(ap);
+		if (ru->len + len < ru->size) break;
+		size = ru->size ? ru->size * 2 : INFLUX_INIT_BUFSIZE;
+		while(size <= ru->len + len) size *= 2;
+		p = realloc(ru->buf,size);
+		if (!p) {
+			log_syserror("influx_rollup: realloc(%d)",size);
+			return 1;
+		}
+		ru->buf = p;
+		ru->size = size;
+	}
+	ru->len += len;
+	return 0;
+}
+
+/* Write out window w of a measurement and start over */
+static void influx_rollup_emit(influx_session_t *s, influx_rollup_t *ru, struct influx_rollup_mm *mp, int w) {
+	struct influx_rollup_window *wp = &ru->windows[w];
+	struct influx_rollup_field *fp;
+	struct influx_rollup_acc *ap;
+	int i,count;
+
+	ru->len = 0;
+	count = 0;
+	if (influx_rollup_append(ru,"%s_%s ",mp->name,wp->label)) return;
+	for(i=0; i < mp->count; i++) {
+		fp = &mp->fields[i];
+		ap = &fp->acc[w];
+		if (!ap->count) continue;
+		influx_rollup_append(ru,"%s%s_min=%.10g,%s_max=%.10g,%s_mean=%.10g,%s_last=%.10g,%s_count=%d",
+			(count ? "," : ""), fp->name, ap->min, fp->name, ap->max, fp->name, ap->sum / ap->count,
+			fp->name, ap->last, fp->name, ap->count);
+		if (fp->energy) influx_rollup_append(ru,",%s_wh=%.10g",fp->name,ap->wh);
+		memset(ap,0,sizeof(*ap));
+		count++;
+	}
+	if (count && influx_rollup_append(ru," %lld\n",(long long)mp->start[w] * 1000000LL) == 0) {
+		dprintf(dlevel+1,"line: %s", ru->buf);
+		if (influx_writer_add(wp->out ? wp->out : s,ru->buf,ru->len))
+			log_error("influx_rollup: unable to queue %s_%s\n", mp->name, wp->label);
+	}
+	mp->start[w] = 0;
+}
+
+/* Next name=value from a line protocol field set.  Returns 1 with *val set
+   if the value is numeric, 0 if it's not and -1 at the end */
+static int influx_rollup_next(char **pp, char *name, int size, double *val) {
+	char *p = *pp,*v,*e;
+	int len,quoted;
+
+	while(*p == ',' || *p == ' ') p++;
+	if (!*p) return -1;
+	v = strchr(p,'=');
+	if (!v) return -1;
+	len = v - p;
+	if (len >= size) len = size - 1;
+	memcpy(name,p,len);
+	name[len] = 0;
+	v++;
+	/* Strings may contain commas */
+	quoted = 0;
+	for(e = v; *e; e++) {
+		if (*e == '\\' && e[1]) e++;
+		else if (*e == '"') quoted = !quoted;
+		else if (!quoted && (*e == ',' || *e == ' ' || *e == '\n')) break;
+	}
+	*pp = e;
+	if (*v == '"') return 0;
+	if (*v == 't' || *v == 'T') {
+		*val = 1;
+		return 1;
+	}
+	if (*v == 'f' || *v == 'F') {
+		*val = 0;
+		return 1;
+	}
+	*val = strtod(v,&p);
+	/* Integer fields have a trailing i */
+	if (p == v || (p != e && !(*p == 'i' && p + 1 == e))) return 0;
+	return !isnan(*val) && !isinf(*val);
+}
+
+/* Fold a point into the windows.  Returns 1 if the point was all numbers (so
+   the rollup has everything that was in it) */
+int influx_rollup_add(influx_session_t *s, char *mm, char *fields, uint64_t now) {
+	influx_rollup_t *ru;
+	struct influx_rollup_mm *mp;
+	struct influx_rollup_field *fp;
+	struct influx_rollup_acc *ap;
+	char name[64],*p;
+	double val,wh;
+	int i,w,r,numeric,other;
+	uint64_t start;
+
+	if (!s->rollup) {
+		if (!strlen(s->rollup_windows)) return 0;
+		s->rollup = influx_rollup_new();
+		if (!s->rollup) return 0;
+	}
+	ru = s->rollup;
+	/* Config changed */
+	if (strcmp(ru->spec,s->rollup_windows) != 0 || strcmp(ru->energy,s->rollup_energy) != 0) {
+		influx_rollup_flush(s);
+		influx_rollup_config(s,ru);
+	}
+	if (!ru->window_count) return 0;
+
+	mp = influx_rollup_get_mm(ru,mm);
+	if (!mp) return 0;
+
+	/* Close out any window this point isn't in */
+	for(w=0; w < ru->window_count; w++) {
+		start = now - (now % ru->windows[w].interval);
+		if (mp->start[w] && mp->start[w] != start) influx_rollup_emit(s,ru,mp,w);
+		mp->start[w] = start;
+	}
+
+	p = fields;
+	numeric = other = 0;
+	for(i=0; (r = influx_rollup_next(&p,name,sizeof(name),&val)) >= 0; i++) {
+		if (!r) {
+			other++;
+			continue;
+		}
+		fp = influx_rollup_get_field(ru,mp,i,name);
+		if (!fp) continue;
+		numeric++;
+		/* Trapezoid since the last value, unless there was a gap */
+		wh = 0;
+		if (fp->energy && fp->prev_time && now > fp->prev_time && now - fp->prev_time <= INFLUX_ROLLUP_GAP)
+			wh = ((fp->prev + val) / 2) * (now - fp->prev_time) / 3600000.0;
+		fp->prev = val;
+		fp->prev_time = now;
+		for(w=0; w < ru->window_count; w++) {
+			ap = &fp->acc[w];
+			if (!ap->count || val < ap->min) ap->min = val;
+			if (!ap->count || val > ap->max) ap->max = val;
+			ap->sum += val;
+			ap->last = val;
+			ap->wh += wh;
+			ap->count++;
+		}
+	}
+	dprintf(dlevel+1,"mm: %s, numeric: %d, other: %d\n", mm, numeric, other);
+	return (numeric && !other);
+}
+
+/* Write out whatever the current windows have so far */
+void influx_rollup_flush(influx_session_t *s) {
+	influx_rollup_t *ru = s->rollup;
+	struct influx_rollup_mm *mp;
+	int w;
+
+	if (!ru) return;
+	list_reset(ru->mms);
+	while((mp = list_get_next(ru->mms)) != 0) {
+		for(w=0; w < ru->window_count; w++) {
+			if (mp->start[w]) influx_rollup_emit(s,ru,mp,w);
+		}
+	}
+}
+#endif
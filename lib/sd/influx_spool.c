@@ -0,0 +1,400 @@
+#ifdef INFLUX
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include "common.h"
+#include "influx_internal.h"
+
+/* Store-and-forward spool for line protocol the server didn't take.
+   The spool is a run of fixed size, memory mapped segment files
+   (<dir>/influx-<name>.<seq>.spool, name being [<owner>-]<db>[.<rp>]) each
+   holding a header with the read and write positions followed by CRC
+   protected records.  Segments are consumed oldest first and removed once
+   replayed.  The spool is locked (<dir>/influx-<name>.lock) while open so
+   another process can't write or replay the same segments. */
+
+#ifndef __WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#define SPOOL_MAGIC 0x4C4F4F53		/* SOOL */
+#define SPOOL_REC_MAGIC 0x43455253	/* SREC */
+#define SPOOL_VERSION 1
+
+struct spool_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;			/* Segment size */
+	uint32_t wpos;			/* Next record goes here */
+	uint32_t rpos;			/* Next record to replay */
+	uint32_t pad;
+};
+
+struct spool_record {
+	uint32_t magic;
+	uint32_t len;			/* Data length */
+	uint32_t crc;			/* CRC32 of data */
+	uint32_t pad;
+	uint64_t stamp;			/* Time spooled (ns) */
+};
+
+/* Records are 8-byte aligned */
+#define SPOOL_ALIGN(n) (((n) + 7) & ~7)
+#define SPOOL_DATA_MAX (INFLUX_SPOOL_SEGSIZE - sizeof(struct spool_header) - sizeof(struct spool_record))
+
+struct spool_segment {
+	uint32_t seq;
+	int fd;
+	char *map;
+	struct spool_header *hdr;
+};
+
+struct influx_spool {
+	char dir[256];
+	char name[INFLUX_DATABASE_SIZE+100];
+	int lockfd;			/* flock'd while we have it open */
+	int max;			/* Max segments */
+	uint32_t first;			/* Oldest segment */
+	uint32_t last;			/* Segment being written */
+	struct spool_segment w;
+	struct spool_segment r;
+	unsigned long dropped;		/* Bytes lost to max size/corruption */
+};
+
+static uint32_t crc_table[256];
+
+static uint32_t spool_crc32(const char *data, int len) {
+	uint32_t crc,c;
+	int i,j;
+
+	if (!crc_table[1]) {
+		for(i=0; i < 256; i++) {
+			c = i;
+			for(j=0; j < 8; j++) c = (c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1);
+			crc_table[i] = c;
+		}
+	}
+	crc = 0xFFFFFFFF;
+	for(i=0; i < len; i++) crc = crc_table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFF;
+}
+
+static void spool_path(influx_spool_t *sp, uint32_t seq, char *path, int size) {
+	snprintf(path,size,"%s/influx-%s.%08u.spool",sp->dir,sp->name,seq);
+}
+
+static void spool_unmap(struct spool_segment *seg) {
+	if (seg->map) {
+		msync(seg->map, INFLUX_SPOOL_SEGSIZE, MS_ASYNC);
+		munmap(seg->map, INFLUX_SPOOL_SEGSIZE);
+	}
+	if (seg->fd >= 0) close(seg->fd);
+	seg->map = 0;
+	seg->hdr = 0;
+	seg->fd = -1;
+}
+
+static int spool_map(influx_spool_t *sp, struct spool_segment *seg, uint32_t seq) {
+	char path[512];
+	struct stat sb;
+	int init;
+
+	spool_path(sp,seq,path,sizeof(path));
+	dprintf(dlevel,"path: %s\n", path);
+	seg->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (seg->fd < 0) {
+		log_syserror("influx_spool: open(%s)", path);
+		return 1;
+	}
+	if (fstat(seg->fd,&sb) < 0) goto spool_map_error;
+	init = (sb.st_size != INFLUX_SPOOL_SEGSIZE);
+	if (init && ftruncate(seg->fd, INFLUX_SPOOL_SEGSIZE) < 0) {
+		log_syserror("influx_spool: ftruncate(%s)", path);
+		goto spool_map_error;
+	}
+	seg->map = mmap(0, INFLUX_SPOOL_SEGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, seg->fd, 0);
+	if (seg->map == MAP_FAILED) {
+		log_syserror("influx_spool: mmap(%s)", path);
+		seg->map = 0;
+		goto spool_map_error;
+	}
+	seg->hdr = (struct spool_header *)seg->map;
+	if (!init && (seg->hdr->magic != SPOOL_MAGIC || seg->hdr->version != SPOOL_VERSION || seg->hdr->size != INFLUX_SPOOL_SEGSIZE
+			|| seg->hdr->wpos > INFLUX_SPOOL_SEGSIZE || seg->hdr->rpos > seg->hdr->wpos)) {
+		log_error("influx_spool: %s: bad header, discarding\n", path);
+		init = 1;
+	}
+	if (init) {
+		memset(seg->hdr,0,sizeof(*seg->hdr));
+		seg->hdr->magic = SPOOL_MAGIC;
+		seg->hdr->version = SPOOL_VERSION;
+		seg->hdr->size = INFLUX_SPOOL_SEGSIZE;
+		seg->hdr->wpos = seg->hdr->rpos = sizeof(struct spool_header);
+	}
+	seg->seq = seq;
+	return 0;
+
+spool_map_error:
+	spool_unmap(seg);
+	return 1;
+}
+
+static void spool_remove(influx_spool_t *sp, uint32_t seq) {
+	char path[512];
+
+	spool_path(sp,seq,path,sizeof(path));
+	dprintf(dlevel,"removing: %s\n", path);
+	unlink(path);
+}
+
+influx_spool_t *influx_spool_open(char *dir, char *name, int max_mb) {
+	influx_spool_t *sp;
+	char prefix[sizeof(sp->name)+16],path[512];
+	struct dirent *ent;
+	unsigned int seq;
+	int plen,found;
+	DIR *dp;
+
+	sp = calloc(1,sizeof(*sp));
+	if (!sp) {
+		log_syserror("influx_spool_open: calloc");
+		return 0;
+	}
+	strncpy(sp->dir,dir,sizeof(sp->dir)-1);
+	strncpy(sp->name,(name && strlen(name) ? name : "default"),sizeof(sp->name)-1);
+	sp->max = (max_mb * 1048576) / INFLUX_SPOOL_SEGSIZE;
+	if (sp->max < 2) sp->max = 2;
+	sp->w.fd = sp->r.fd = -1;
+
+	dp = opendir(sp->dir);
+	if (!dp && errno == ENOENT && mkdir(sp->dir,0755) == 0) dp = opendir(sp->dir);
+	if (!dp) {
+		log_syserror("influx_spool_open: opendir(%s)", sp->dir);
+		free(sp);
+		return 0;
+	}
+
+	/* Only one of us at a time */
+	snprintf(path,sizeof(path),"%s/influx-%s.lock",sp->dir,sp->name);
+	sp->lockfd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (sp->lockfd < 0) {
+		log_syserror("influx_spool_open: open(%s)", path);
+		goto influx_spool_open_error;
+	}
+	if (flock(sp->lockfd, LOCK_EX | LOCK_NB) < 0) {
+		if (errno == EWOULDBLOCK) log_error("influx_spool: %s is in use by another process, not spooling\n", path);
+		else log_syserror("influx_spool_open: flock(%s)", path);
+		goto influx_spool_open_error;
+	}
+
+	/* Find any segments left from before */
+	plen = snprintf(prefix,sizeof(prefix),"influx-%s.",sp->name);
+	found = 0;
+	while((ent = readdir(dp)) != 0) {
+		if (strncmp(ent->d_name,prefix,plen) != 0) continue;
+		if (sscanf(ent->d_name + plen,"%u.spool",&seq) != 1) continue;
+		if (!found || seq < sp->first) sp->first = seq;
+		if (!found || seq > sp->last) sp->last = seq;
+		found = 1;
+	}
+	closedir(dp);
+	if (!found) sp->first = sp->last = 1;
+	dprintf(dlevel,"first: %u, last: %u, max: %d\n", sp->first, sp->last, sp->max);
+	if (spool_map(sp, &sp->w, sp->last)) {
+		close(sp->lockfd);
+		free(sp);
+		return 0;
+	}
+	return sp;
+
+influx_spool_open_error:
+	closedir(dp);
+	if (sp->lockfd >= 0) close(sp->lockfd);
+	free(sp);
+	return 0;
+}
+
+void influx_spool_close(influx_spool_t *sp) {
+	if (!sp) return;
+	spool_unmap(&sp->r);
+	if (sp->w.map) msync(sp->w.map, INFLUX_SPOOL_SEGSIZE, MS_SYNC);
+	spool_unmap(&sp->w);
+	close(sp->lockfd);
+	free(sp);
+}
+
+int influx_spool_empty(influx_spool_t *sp) {
+	if (!sp) return 1;
+	if (!sp->w.hdr) return (sp->first == sp->last);
+	return (sp->first == sp->last && sp->w.hdr->rpos == sp->w.hdr->wpos);
+}
+
+/* Start a new segment, dropping the oldest if we're full */
+static int spool_rotate(influx_spool_t *sp) {
+	msync(sp->w.map, INFLUX_SPOOL_SEGSIZE, MS_ASYNC);
+	spool_unmap(&sp->w);
+	sp->last++;
+	while((int)(sp->last - sp->first) >= sp->max) {
+		log_error("influx_spool: spool full, dropping segment %u\n", sp->first);
+		if (sp->r.map && sp->r.seq == sp->first) spool_unmap(&sp->r);
+		spool_remove(sp, sp->first);
+		sp->dropped += INFLUX_SPOOL_SEGSIZE;
+		sp->first++;
+	}
+	return spool_map(sp, &sp->w, sp->last);
+}
+
+static int spool_put_record(influx_spool_t *sp, char *data, int len, uint64_t stamp) {
+	struct spool_record *rec;
+	uint32_t need;
+
+	if (!sp->w.map && spool_map(sp, &sp->w, sp->last)) return 1;
+	need = SPOOL_ALIGN(sizeof(*rec) + len);
+	if (sp->w.hdr->wpos + need > INFLUX_SPOOL_SEGSIZE && spool_rotate(sp)) return 1;
+	rec = (struct spool_record *)(sp->w.map + sp->w.hdr->wpos);
+	rec->len = len;
+	rec->crc = spool_crc32(data,len);
+	rec->pad = 0;
+	rec->stamp = stamp;
+	memcpy((char *)rec + sizeof(*rec), data, len);
+	/* Publish the record before moving the write pos */
+	__atomic_store_n(&rec->magic, SPOOL_REC_MAGIC, __ATOMIC_RELEASE);
+	__atomic_store_n(&sp->w.hdr->wpos, sp->w.hdr->wpos + need, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Append line protocol, splitting it on line boundaries if it won't fit in a segment */
+int influx_spool_put(influx_spool_t *sp, char *data, int len) {
+	struct timeval tv;
+	uint64_t stamp;
+	char *p;
+	int n;
+
+	if (!sp) return 1;
+	dprintf(dlevel,"len: %d\n", len);
+	gettimeofday(&tv,0);
+	stamp = ((uint64_t)tv.tv_sec * 1000000000ULL) + ((uint64_t)tv.tv_usec * 1000ULL);
+	while(len > 0) {
+		n = len;
+		if (n > SPOOL_DATA_MAX) {
+			n = SPOOL_DATA_MAX;
+			for(p = data + n - 1; p > data && *p != '\n'; p--);
+			if (p > data) n = (p - data) + 1;
+		}
+		if (spool_put_record(sp, data, n, stamp)) return 1;
+		data += n;
+		len -= n;
+	}
+	msync(sp->w.map, INFLUX_SPOOL_SEGSIZE, MS_ASYNC);
+	return 0;
+}
+
+/* Get the oldest segment with unread data */
+static struct spool_segment *spool_read_segment(influx_spool_t *sp) {
+	while(1) {
+		if (sp->first == sp->last) {
+			spool_unmap(&sp->r);
+			return (sp->w.map ? &sp->w : 0);
+		}
+		if (!sp->r.map || sp->r.seq != sp->first) {
+			spool_unmap(&sp->r);
+			if (spool_map(sp, &sp->r, sp->first)) return 0;
+		}
+		if (sp->r.hdr->rpos < sp->r.hdr->wpos) return &sp->r;
+		/* Done with this one */
+		spool_unmap(&sp->r);
+		spool_remove(sp, sp->first);
+		sp->first++;
+	}
+}
+
+/* Send spooled data to func in batches of up to batch_size bytes, oldest first.
+   Returns 0 when the spool has been drained, 1 if func failed */
+int influx_spool_replay(influx_spool_t *sp, int batch_size, influx_spool_func_t *func, void *ctx) {
+	struct spool_segment *seg;
+	struct spool_record *rec;
+	uint32_t pos,end;
+	uint64_t since;
+	char *buf,*newbuf;
+	int len,size,count;
+
+	if (!sp) return 0;
+	buf = 0;
+	size = 0;
+	while((seg = spool_read_segment(sp)) != 0) {
+		pos = seg->hdr->rpos;
+		end = __atomic_load_n(&seg->hdr->wpos, __ATOMIC_ACQUIRE);
+		if (pos >= end) break;
+
+		/* Collect records up to batch_size */
+		len = count = 0;
+		since = 0;
+		while(pos < end) {
+			rec = (struct spool_record *)(seg->map + pos);
+			if (rec->magic != SPOOL_REC_MAGIC || pos + sizeof(*rec) + rec->len > end
+					|| rec->crc != spool_crc32((char *)rec + sizeof(*rec), rec->len)) {
+				log_error("influx_spool: segment %u: bad record at %u, skipping rest of segment\n", seg->seq, pos);
+				sp->dropped += end - pos;
+				pos = end;
+				break;
+			}
+			if (count && len + rec->len > batch_size) break;
+			if (len + rec->len > size) {
+				newbuf = realloc(buf, len + rec->len);
+				if (!newbuf) {
+					log_syserror("influx_spool_replay: realloc(%d)", len + rec->len);
+					free(buf);
+					return 1;
+				}
+				buf = newbuf;
+				size = len + rec->len;
+			}
+			memcpy(buf + len, (char *)rec + sizeof(*rec), rec->len);
+			len += rec->len;
+			if (!count) since = rec->stamp;
+			count++;
+			pos += SPOOL_ALIGN(sizeof(*rec) + rec->len);
+		}
+		if (len) {
+			dprintf(dlevel,"segment: %u, records: %d, len: %d, spooled: %llu\n", seg->seq, count, len, (unsigned long long)since);
+			if (func(ctx, buf, len)) {
+				free(buf);
+				return 1;
+			}
+		}
+		seg->hdr->rpos = pos;
+		/* Reuse the write segment once it's been drained */
+		if (seg == &sp->w && seg->hdr->rpos == seg->hdr->wpos)
+			seg->hdr->wpos = seg->hdr->rpos = sizeof(struct spool_header);
+		msync(seg->map, INFLUX_SPOOL_SEGSIZE, MS_ASYNC);
+	}
+	if (buf) free(buf);
+	return (seg ? 0 : 1);
+}
+
+unsigned long influx_spool_dropped(influx_spool_t *sp) {
+	return (sp ? sp->dropped : 0);
+}
+#else
+/* No mmap - nothing is spooled */
+influx_spool_t *influx_spool_open(char *dir, char *name, int max_mb) { return 0; }
+void influx_spool_close(influx_spool_t *sp) { }
+int influx_spool_empty(influx_spool_t *sp) { return 1; }
+int influx_spool_put(influx_spool_t *sp, char *data, int len) { return 1; }
+int influx_spool_replay(influx_spool_t *sp, int batch_size, influx_spool_func_t *func, void *ctx) { return 0; }
+unsigned long influx_spool_dropped(influx_spool_t *sp) { return 0; }
+#endif
+#endif
@@ -0,0 +1,488 @@
+#ifdef INFLUX
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include "common.h"
+#include "influx_internal.h"
+#include <pthread.h>
+#include <sys/time.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* Write-behind batcher: points are appended to a line-protocol buffer and a
+   background thread POSTs it when it gets big or old enough.  The thread never
+   touches the session: it works from a copy of the settings it needs, taken
+   under the writer lock whenever they change (influx_writer_update). */
+
+enum {
+	INFLUX_POST_OK,
+	INFLUX_POST_RETRY,		/* Server unreachable/busy - keep the data */
+	INFLUX_POST_FAIL,		/* Server rejected the data - drop it */
+};
+
+struct influx_writer {
+	influx_session_t *s;
+	pthread_t th;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int running;
+	int stop;
+	char *buf;			/* Pending line protocol */
+	int len;
+	int size;
+	uint64_t first;			/* monotime_ms of oldest pending point */
+	CURL *curl;			/* Our own handle so the connection stays open */
+	struct curl_slist *hs;
+	influx_spool_t *spool;
+	/* Settings (under lock) */
+	char *url;			/* Write URL */
+	char ping[INFLUX_ENDPOINT_SIZE+8];
+	char auth[INFLUX_TOKEN_SIZE+32];	/* Authorization header, "" = none */
+	char userpwd[INFLUX_USERNAME_SIZE+INFLUX_PASSWORD_SIZE+2];	/* Basic auth, "" = none */
+	long timeout;
+	int gzip;
+	int verbose;
+	struct stats_hist *hist;	/* Write latency */
+	int batch_size;
+	int batch_age;
+	int spool_enabled;
+	int spool_max;
+	char spool_dir[SOLARD_PATH_MAX];
+	char spool_name[INFLUX_DATABASE_SIZE+100];
+	int down;			/* Server unreachable - spool until a ping succeeds */
+	uint64_t retry;			/* Next ping (monotime_ms) */
+	unsigned long points;
+	unsigned long dropped;
+	unsigned long errors;
+	unsigned long flushes;
+};
+typedef struct influx_writer influx_writer_t;
+
+static size_t influx_writer_discard(void *ptr, size_t size, size_t nmemb, void *ctx) {
+	return size * nmemb;
+}
+
+#ifdef HAVE_ZLIB
+static char *influx_writer_gzip(char *data, int len, int *outlen) {
+	z_stream zs;
+	char *out;
+	int size;
+
+	memset(&zs,0,sizeof(zs));
+	/* 15 + 16 = gzip wrapper instead of zlib */
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+	size = deflateBound(&zs, len);
+	out = malloc(size);
+	if (!out) {
+		deflateEnd(&zs);
+		return 0;
+	}
+	zs.next_in = (Bytef *)data;
+	zs.avail_in = len;
+	zs.next_out = (Bytef *)out;
+	zs.avail_out = size;
+	if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+		deflateEnd(&zs);
+		free(out);
+		return 0;
+	}
+	*outlen = zs.total_out;
+	deflateEnd(&zs);
+	dprintf(dlevel,"len: %d, outlen: %d\n", len, *outlen);
+	return out;
+}
+#endif
+
+static int influx_writer_post(influx_writer_t *w, char *data, int len) {
+	char *url,*zdata,auth[sizeof(w->auth)],userpwd[sizeof(w->userpwd)];
+	CURLcode res;
+	struct stats_hist *hist;
+	uint64_t start;
+	long rc,timeout;
+	int gzip,verbose;
+
+	dprintf(dlevel,"len: %d\n", len);
+
+	pthread_mutex_lock(&w->lock);
+	url = (w->url ? strdup(w->url) : 0);
+	strcpy(auth, w->auth);
+	strcpy(userpwd, w->userpwd);
+	timeout = w->timeout;
+	gzip = w->gzip;
+	verbose = w->verbose;
+	hist = w->hist;
+	pthread_mutex_unlock(&w->lock);
+	if (!url) return INFLUX_POST_RETRY;
+
+	curl_slist_free_all(w->hs);
+	w->hs = curl_slist_append(0, "Content-Type: text/plain; charset=utf-8");
+	if (*auth) w->hs = curl_slist_append(w->hs, auth);
+	/* Settings can change, don't keep old credentials on the handle */
+	curl_easy_setopt(w->curl, CURLOPT_HTTPAUTH, (*auth || !*userpwd) ? CURLAUTH_NONE : CURLAUTH_BASIC);
+	curl_easy_setopt(w->curl, CURLOPT_USERPWD, (*auth || !*userpwd) ? (char *)0 : userpwd);
+	zdata = 0;
+#ifdef HAVE_ZLIB
+	if (gzip) {
+		int zlen;
+
+		zdata = influx_writer_gzip(data, len, &zlen);
+		if (zdata) {
+			w->hs = curl_slist_append(w->hs, "Content-Encoding: gzip");
+			data = zdata;
+			len = zlen;
+		}
+	}
+#endif
+	curl_easy_setopt(w->curl, CURLOPT_HTTPHEADER, w->hs);
+	curl_easy_setopt(w->curl, CURLOPT_VERBOSE, (long)verbose);
+	curl_easy_setopt(w->curl, CURLOPT_URL, url);
+	curl_easy_setopt(w->curl, CURLOPT_POST, 1L);
+	curl_easy_setopt(w->curl, CURLOPT_TIMEOUT, timeout);
+	curl_easy_setopt(w->curl, CURLOPT_POSTFIELDS, data);
+	curl_easy_setopt(w->curl, CURLOPT_POSTFIELDSIZE, (long)len);
+	start = (hist ? monotime_us() : 0);
+	res = curl_easy_perform(w->curl);
+	stats_hist_since(hist,start);
+	free(url);
+	if (zdata) free(zdata);
+	if (res != CURLE_OK) {
+		log_error("influx_writer: %s\n", curl_easy_strerror(res));
+		return INFLUX_POST_RETRY;
+	}
+	rc = 0;
+	curl_easy_getinfo(w->curl, CURLINFO_RESPONSE_CODE, &rc);
+	dprintf(dlevel,"rc: %ld\n", rc);
+	if (rc == 200 || rc == 204) return INFLUX_POST_OK;
+	log_error("influx_writer: write failed: rc: %ld\n", rc);
+	/* Throttled or server side problem, try again later */
+	if (rc == 429 || rc >= 500) return INFLUX_POST_RETRY;
+	return INFLUX_POST_FAIL;
+}
+
+/* Is the server back? */
+static int influx_writer_ping(influx_writer_t *w) {
+	char url[sizeof(w->ping)];
+	CURLcode res;
+	long rc,timeout;
+
+	pthread_mutex_lock(&w->lock);
+	strcpy(url, w->ping);
+	timeout = w->timeout;
+	pthread_mutex_unlock(&w->lock);
+	curl_easy_setopt(w->curl, CURLOPT_URL, url);
+	curl_easy_setopt(w->curl, CURLOPT_HTTPGET, 1L);
+	curl_easy_setopt(w->curl, CURLOPT_TIMEOUT, timeout);
+	res = curl_easy_perform(w->curl);
+	rc = 0;
+	if (res == CURLE_OK) curl_easy_getinfo(w->curl, CURLINFO_RESPONSE_CODE, &rc);
+	dprintf(dlevel,"res: %d, rc: %ld\n", res, rc);
+	return (rc == 204 || rc == 200);
+}
+
+static void influx_writer_spool_open(influx_writer_t *w) {
+	char path[sizeof(w->spool_dir)],name[sizeof(w->spool_name)];
+	int max;
+
+	pthread_mutex_lock(&w->lock);
+	strcpy(path, w->spool_dir);
+	strcpy(name, w->spool_name);
+	max = w->spool_max;
+	pthread_mutex_unlock(&w->lock);
+	w->spool = influx_spool_open(path, name, max);
+}
+
+/* Save a batch we couldn't send */
+static void influx_writer_spool(influx_writer_t *w, char *data, int len) {
+	int enabled;
+
+	dprintf(dlevel,"len: %d\n", len);
+	pthread_mutex_lock(&w->lock);
+	enabled = w->spool_enabled;
+	pthread_mutex_unlock(&w->lock);
+	if (!w->spool && enabled) influx_writer_spool_open(w);
+	if (influx_spool_put(w->spool, data, len)) {
+		log_error("influx_writer: unable to spool %d bytes, dropping\n", len);
+		w->dropped++;
+	}
+}
+
+static int influx_writer_replay_func(void *ctx, char *data, int len) {
+	influx_writer_t *w = ctx;
+	int rc;
+
+	rc = influx_writer_post(w, data, len);
+	if (rc == INFLUX_POST_RETRY) return 1;
+	/* The server won't ever take it, don't hold up the rest */
+	if (rc == INFLUX_POST_FAIL) w->errors++;
+	return 0;
+}
+
+/* Send whatever was spooled while the server was down */
+static void influx_writer_replay(influx_writer_t *w) {
+	if (influx_spool_empty(w->spool)) return;
+	log_info("influx_writer: replaying spooled data\n");
+	if (influx_spool_replay(w->spool, w->batch_size, influx_writer_replay_func, w)) {
+		w->down = 1;
+		w->retry = monotime_ms() + INFLUX_SPOOL_RETRY;
+	}
+}
+
+static void influx_writer_recover(influx_writer_t *w) {
+	if (influx_writer_ping(w)) {
+		log_info("influx_writer: server is back\n");
+		w->down = 0;
+		influx_writer_replay(w);
+	} else {
+		w->retry = monotime_ms() + INFLUX_SPOOL_RETRY;
+	}
+}
+
+static void influx_writer_flush(influx_writer_t *w, char *data, int len) {
+	int rc;
+
+	w->flushes++;
+	/* Don't wait on timeouts while it's down */
+	if (w->down) {
+		influx_writer_spool(w, data, len);
+		return;
+	}
+	rc = influx_writer_post(w, data, len);
+	if (rc == INFLUX_POST_RETRY) {
+		w->down = 1;
+		w->retry = monotime_ms() + INFLUX_SPOOL_RETRY;
+		influx_writer_spool(w, data, len);
+	} else {
+		if (rc == INFLUX_POST_FAIL) w->errors++;
+		influx_writer_replay(w);
+	}
+}
+
+static void *influx_writer_thread(void *ctx) {
+	influx_writer_t *w = ctx;
+	struct timespec ts;
+	struct timeval tv;
+	uint64_t now,deadline;
+	char *data;
+	int len;
+
+	dprintf(dlevel,"starting\n");
+	pthread_mutex_lock(&w->lock);
+	while(1) {
+		now = monotime_ms();
+		deadline = w->first + w->batch_age;
+		if (w->len && (w->stop || w->len >= w->batch_size || now >= deadline)) {
+			/* Take the buffer and send it without holding the lock */
+			data = w->buf;
+			len = w->len;
+			w->buf = 0;
+			w->len = w->size = 0;
+			pthread_mutex_unlock(&w->lock);
+			influx_writer_flush(w, data, len);
+			free(data);
+			pthread_mutex_lock(&w->lock);
+			continue;
+		}
+		if (w->stop) break;
+		if (w->down && now >= w->retry) {
+			pthread_mutex_unlock(&w->lock);
+			influx_writer_recover(w);
+			pthread_mutex_lock(&w->lock);
+			continue;
+		}
+		if (!w->len) deadline = 0;
+		if (w->down && (!deadline || w->retry < deadline)) deadline = w->retry;
+		if (deadline) {
+			gettimeofday(&tv,0);
+			ts.tv_sec = tv.tv_sec + ((deadline - now) / 1000);
+			ts.tv_nsec = (tv.tv_usec * 1000) + (((deadline - now) % 1000) * 1000000);
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&w->cond, &w->lock, &ts);
+		} else {
+			pthread_cond_wait(&w->cond, &w->lock);
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+	dprintf(dlevel,"done\n");
+	return 0;
+}
+
+/* Copy what the thread needs from the session (on the session's thread) */
+void influx_writer_update(influx_session_t *s) {
+	influx_writer_t *w;
+	char *url;
+	int len;
+
+	if (!s || !s->writer) return;
+	w = s->writer;
+	url = influx_mkurl(s,"write",0);
+	pthread_mutex_lock(&w->lock);
+	if (url) {
+		free(w->url);
+		w->url = url;
+	}
+	snprintf(w->ping,sizeof(w->ping),"%s/ping",strlen(s->endpoint) ? s->endpoint : "http://localhost:8086");
+	*w->auth = *w->userpwd = 0;
+	if (strlen(s->token)) snprintf(w->auth,sizeof(w->auth),"Authorization: Token %s",s->token);
+	else if (strlen(s->username)) snprintf(w->userpwd,sizeof(w->userpwd),"%s:%s",s->username,s->password);
+	w->timeout = s->timeout;
+	w->gzip = s->gzip;
+	w->verbose = s->verbose;
+	w->hist = s->write_hist;
+	w->batch_size = (s->batch_size > 0 ? s->batch_size : INFLUX_BATCH_SIZE);
+	w->batch_age = (s->batch_age > 0 ? s->batch_age : INFLUX_BATCH_AGE);
+	w->spool_enabled = s->spool;
+	w->spool_max = (s->spool_max > 0 ? s->spool_max : INFLUX_SPOOL_MAX);
+	memset(w->spool_dir,0,sizeof(w->spool_dir));
+	if (strlen(s->spool_dir)) strncpy(w->spool_dir,s->spool_dir,sizeof(w->spool_dir)-1);
+	else if (strlen(SOLARD_TEMPDIR)) strncpy(w->spool_dir,SOLARD_TEMPDIR,sizeof(w->spool_dir)-1);
+	else tmpdir(w->spool_dir,sizeof(w->spool_dir)-1);
+	/* Each owner and retention policy has its own spool */
+	len = 0;
+	if (strlen(s->spool_name)) len = snprintf(w->spool_name,sizeof(w->spool_name),"%s-",s->spool_name);
+	if (strlen(s->rp)) snprintf(w->spool_name+len,sizeof(w->spool_name)-len,"%s.%s",s->database,s->rp);
+	else snprintf(w->spool_name+len,sizeof(w->spool_name)-len,"%s",s->database);
+	pthread_mutex_unlock(&w->lock);
+}
+
+static influx_writer_t *influx_writer_new(influx_session_t *s) {
+	influx_writer_t *w;
+
+	w = calloc(1,sizeof(*w));
+	if (!w) {
+		log_syserror("influx_writer_new: calloc");
+		return 0;
+	}
+	w->s = s;
+	w->curl = curl_easy_init();
+	if (!w->curl) {
+		log_error("influx_writer_new: curl_easy_init failed\n");
+		free(w);
+		return 0;
+	}
+	curl_easy_setopt(w->curl, CURLOPT_SSL_VERIFYPEER, 0L);
+	curl_easy_setopt(w->curl, CURLOPT_SSL_VERIFYHOST, 0L);
+	curl_easy_setopt(w->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(w->curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(w->curl, CURLOPT_WRITEFUNCTION, influx_writer_discard);
+	pthread_mutex_init(&w->lock, 0);
+	pthread_cond_init(&w->cond, 0);
+	s->writer = w;
+	influx_writer_update(s);
+
+	/* Pick up anything left from a previous run */
+	if (w->spool_enabled) {
+		influx_writer_spool_open(w);
+		if (!influx_spool_empty(w->spool)) w->down = 1;
+	}
+
+	if (pthread_create(&w->th, 0, influx_writer_thread, w)) {
+		log_syserror("influx_writer_new: pthread_create");
+		influx_writer_destroy(s);
+		return 0;
+	}
+	w->running = 1;
+	return w;
+}
+
+/* Drop the oldest whole lines to make room for need bytes */
+static void influx_writer_trim(influx_writer_t *w, int need) {
+	char *p,*end;
+	int count;
+
+	p = w->buf;
+	end = w->buf + w->len;
+	count = 0;
+	while(p < end && (end - p) + need > w->s->batch_max) {
+		p = memchr(p, '\n', end - p);
+		if (!p) p = end;
+		else p++;
+		count++;
+	}
+	dprintf(dlevel,"dropping %d points (%d bytes)\n", count, (int)(p - w->buf));
+	w->len = end - p;
+	memmove(w->buf, p, w->len);
+	w->dropped += count;
+}
+
+/* Queue a complete line (including the trailing newline) */
+int influx_writer_add(influx_session_t *s, char *line, int len) {
+	influx_writer_t *w;
+	int wake;
+
+	if (!s->writer) {
+		if (s->batch_size <= 0) s->batch_size = INFLUX_BATCH_SIZE;
+		if (s->batch_age <= 0) s->batch_age = INFLUX_BATCH_AGE;
+		if (s->batch_max < s->batch_size) s->batch_max = INFLUX_BATCH_MAX;
+		if (!influx_writer_new(s)) return 1;
+	}
+	w = s->writer;
+
+	pthread_mutex_lock(&w->lock);
+	if (len > s->batch_max) {
+		w->dropped++;
+		pthread_mutex_unlock(&w->lock);
+		return 1;
+	}
+	if (w->len + len > s->batch_max) influx_writer_trim(w, len);
+	if (w->len + len > w->size) {
+		char *newbuf;
+		int newsize;
+
+		newsize = ((w->len + len) / INFLUX_INIT_BUFSIZE + 1) * INFLUX_INIT_BUFSIZE;
+		newbuf = realloc(w->buf, newsize);
+		if (!newbuf) {
+			log_syserror("influx_writer_add: realloc(%d)", newsize);
+			w->dropped++;
+			pthread_mutex_unlock(&w->lock);
+			return 1;
+		}
+		w->buf = newbuf;
+		w->size = newsize;
+	}
+	if (!w->len) w->first = monotime_ms();
+	wake = (!w->len || w->len + len >= s->batch_size);
+	memcpy(w->buf + w->len, line, len);
+	w->len += len;
+	w->points++;
+	if (wake) pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	return 0;
+}
+
+/* Flush anything pending and stop the thread */
+void influx_writer_destroy(influx_session_t *s) {
+	influx_writer_t *w = s->writer;
+
+	if (!w) return;
+	dprintf(dlevel,"points: %lu, dropped: %lu, errors: %lu, flushes: %lu\n", w->points, w->dropped, w->errors, w->flushes);
+	if (w->running) {
+		pthread_mutex_lock(&w->lock);
+		w->stop = 1;
+		pthread_cond_signal(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+		pthread_join(w->th, 0);
+	}
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+	influx_spool_close(w->spool);
+	curl_slist_free_all(w->hs);
+	curl_easy_cleanup(w->curl);
+	if (w->buf) free(w->buf);
+	free(w->url);
+	free(w);
+	s->writer = 0;
+}
+#endif
@@ -29,10 +29,33 @@ LICENSE file in the root directory of this source tree.
 #endif
 #include "list.h"
 
+/* Nodes and small copied items come from per-size pools that are carved out of
+   slabs and never given back; build with -DLIST_POOL=0 to use malloc/free directly
+   (e.g. when hunting memory errors with valgrind/asan) */
+#ifndef LIST_POOL
+#define LIST_POOL 1
+#endif
+#if LIST_POOL && !THREAD_SAFE
+#include <pthread.h>
+#endif
+
+#define LIST_SLAB_SIZE 4096		/* Pool slab size */
+#define LIST_POOL_MIN 16		/* Smallest pooled item */
+#define LIST_POOL_MAX 256		/* Largest pooled item */
+#define LIST_POOL_CLASSES 6		/* Node + 16, 32, 64, 128, 256 */
+#define LIST_ARENA_SIZE 4096		/* Default arena chunk size */
+#define LIST_ALIGN 16
+
+/* Last change made to the list (lets iterators skip a rescan) */
+#define LIST_CHANGE_OTHER 0
+#define LIST_CHANGE_ADD 1
+#define LIST_CHANGE_DELETE 2
+
 /* Define the list item */
 struct _list_item {
 	void *item;
 	int size;
+	unsigned long serial;		/* Never reused within a list (iterators find nodes by it) */
 	struct _list_item *prev;
 	struct _list_item *next;
 };
@@ -42,11 +65,17 @@ typedef struct _list_item * list_item;
 /* Define the list */
 struct _llist {
 	int type;			/* Data type in list */
-	list_item_free_t item_free;
+	list_item_free_t item_free;	/* Called for items added by reference (size 0) */
 	list_item first;		/* First item in list */
 	list_item last;			/* Last item in list */
 	list_item next;			/* Next item in list */
 	list_item saved_next;		/* Saved next item */
+	struct list_arena *arena;	/* Arena chunks (arena mode) */
+	int arena_size;			/* Arena chunk size */
+	unsigned long version;		/* Bumped on every add/delete/sort */
+	unsigned long serial;		/* Last node serial given out */
+	int change;			/* What the last change was */
+	unsigned long changed;		/* Serial of the node added/deleted by the last change */
 #if THREAD_SAFE
 	pthread_mutex_t mutex;
 #endif
@@ -88,17 +117,163 @@ void list_checkitem(list_item ip) {
 	}
 }
 
-static list_item _newitem(void *item, int size) {
+#if LIST_POOL
+struct list_pool {
+	void *free;			/* Free blocks, linked through the 1st word */
+	int size;			/* Block size */
+	int count;			/* Blocks allocated from slabs */
+	int avail;			/* Blocks on the free list */
+};
+
+union list_slab {
+	union list_slab *next;
+	char align[LIST_ALIGN];
+};
+
+static struct list_pool pools[LIST_POOL_CLASSES];
+static union list_slab *slabs;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *_pool_alloc(int cls) {
+	struct list_pool *pp;
+	union list_slab *sp;
+	char *p;
+	int i,count;
+
+	pthread_mutex_lock(&pool_lock);
+	pp = &pools[cls];
+	if (!pp->size) pp->size = (cls ? LIST_POOL_MIN << (cls-1) : (LIST_ITEM_SIZE + LIST_ALIGN - 1) & ~(LIST_ALIGN - 1));
+	if (!pp->free) {
+		count = (LIST_SLAB_SIZE - sizeof(*sp)) / pp->size;
+		sp = malloc(sizeof(*sp) + (count * pp->size));
+		if (!sp) {
+			pthread_mutex_unlock(&pool_lock);
+			return 0;
+		}
+		dprintf(dlevel,"new slab: cls: %d, size: %d, count: %d\n", cls, pp->size, count);
+		/* Keep slabs on a chain so they stay reachable */
+		sp->next = slabs;
+		slabs = sp;
+		p = (char *)(sp + 1);
+		for(i=0; i < count; i++, p += pp->size) {
+			*(void **)p = pp->free;
+			pp->free = p;
+		}
+		pp->count += count;
+		pp->avail += count;
+	}
+	p = pp->free;
+	pp->free = *(void **)p;
+	pp->avail--;
+	pthread_mutex_unlock(&pool_lock);
+	return p;
+}
+
+static void _pool_free(int cls, void *p) {
+	struct list_pool *pp;
+
+	pthread_mutex_lock(&pool_lock);
+	pp = &pools[cls];
+	*(void **)p = pp->free;
+	pp->free = p;
+	pp->avail++;
+	pthread_mutex_unlock(&pool_lock);
+}
+
+/* Size class of a copied item, 0 if not pooled */
+static int _item_class(int size) {
+	int cls,bsize;
+
+	if (size > LIST_POOL_MAX) return 0;
+	for(cls = 1, bsize = LIST_POOL_MIN; bsize < size; cls++) bsize <<= 1;
+	return cls;
+}
+
+void list_pool_stats(int *total, int *avail) {
+	int i;
+
+	*total = *avail = 0;
+	pthread_mutex_lock(&pool_lock);
+	for(i=0; i < LIST_POOL_CLASSES; i++) {
+		*total += pools[i].count;
+		*avail += pools[i].avail;
+	}
+	pthread_mutex_unlock(&pool_lock);
+}
+#else
+#define _pool_alloc(c) malloc(LIST_ITEM_SIZE)
+#define _pool_free(c,p) free(p)
+#define _item_class(s) 0
+
+void list_pool_stats(int *total, int *avail) {
+	*total = *avail = 0;
+}
+#endif
+
+struct list_arena {
+	struct list_arena *next;
+	int size;
+	int used;
+};
+#define LIST_ARENA_HDR ((sizeof(struct list_arena) + LIST_ALIGN - 1) & ~(LIST_ALIGN - 1))
+
+static void *_arena_alloc(list lp, int size) {
+	struct list_arena *ap;
+	int asize;
+
+	size = (size + LIST_ALIGN - 1) & ~(LIST_ALIGN - 1);
+	ap = lp->arena;
+	if (!ap || ap->used + size > ap->size) {
+		asize = (size > lp->arena_size ? size : lp->arena_size);
+		ap = malloc(LIST_ARENA_HDR + asize);
+		if (!ap) return 0;
+		dprintf(dlevel,"new chunk: size: %d\n", asize);
+		ap->size = asize;
+		ap->used = 0;
+		ap->next = lp->arena;
+		lp->arena = ap;
+	}
+	ap->used += size;
+	return (char *)ap + LIST_ARENA_HDR + (ap->used - size);
+}
+
+static void _arena_free(list lp) {
+	struct list_arena *ap,*next;
+
+	for(ap = lp->arena; ap; ap = next) {
+		next = ap->next;
+		free(ap);
+	}
+	lp->arena = 0;
+}
+
+static void *_item_alloc(list lp, int size) {
+	int cls;
+
+	if (lp->arena_size) return _arena_alloc(lp,size);
+	cls = _item_class(size);
+	return (cls ? _pool_alloc(cls) : malloc(size));
+}
+
+static void _changed(list lp, int change, unsigned long serial) {
+	lp->version++;
+	lp->change = change;
+	lp->changed = serial;
+}
+
+static list_item _newitem(list lp, void *item, int size) {
 	list_item new_item;
 
 	dprintf(dlevel,"_newitem: item: %p, size: %d\n", item, size);
-	new_item = (list_item) calloc(1,LIST_ITEM_SIZE);
+	new_item = (list_item) (lp->arena_size ? _arena_alloc(lp,LIST_ITEM_SIZE) : _pool_alloc(0));
 	if (!new_item) return 0;
+	memset(new_item,0,LIST_ITEM_SIZE);
+	new_item->serial = ++lp->serial;
 
 	if (size) {
-		new_item->item = (void *) malloc((size_t)size);
+		new_item->item = _item_alloc(lp,size);
 		if (!new_item->item) {
-			free(new_item);
+			if (!lp->arena_size) _pool_free(0,new_item);
 			dprintf(dlevel,"_newitem: returning: 0");
 			return 0;
 		}
@@ -118,13 +293,18 @@ void *list_add(list lp, void *item, int size) {
 	dprintf(dlevel,"list_add: lp: %p, item: %p, size: %d\n", lp, item, size);
 	if (!lp) return 0;
 
-	/* Create a new item */
-	new_item = _newitem(item,size);
-	if (!new_item) return 0;
-
 #if THREAD_SAFE
 	pthread_mutex_lock(&lp->mutex);
 #endif
+	/* Create a new item */
+	new_item = _newitem(lp,item,size);
+	if (!new_item) {
+#if THREAD_SAFE
+		pthread_mutex_unlock(&lp->mutex);
+#endif
+		return 0;
+	}
+
 	/* Add it to the list */
 	dprintf(dlevel,"lp->first: %p\n", lp->first);
 	if (!lp->first)
@@ -136,6 +316,7 @@ void *list_add(list lp, void *item, int size) {
 		new_item->prev = ip;		/* Point to it */
 		lp->last = new_item;            /* Make this last */
 	}
+	_changed(lp,LIST_CHANGE_ADD,new_item->serial);
 	time(&lp->last_update);
 #if THREAD_SAFE
 	pthread_mutex_unlock(&lp->mutex);
@@ -197,12 +378,9 @@ int list_count(list lp) {
 list list_create(void) {
 	list lp;
 
-	lp = (list) malloc(LIST_SIZE);
+	lp = (list) calloc(1,LIST_SIZE);
 	dprintf(dlevel,"list_create: lp: %p\n", lp);
 	if (!lp) return 0;
-	lp->item_free = free;
-
-	lp->first = lp->last = lp->next = (list_item) 0;
 
 #if THREAD_SAFE
 	dprintf(dlevel,"initializing lock...\n");
@@ -214,7 +392,39 @@ list list_create(void) {
 	return lp;
 }
 
-static void _delete_item(list lp,list_item ip) {
+/* Arena lists allocate nodes and copied items from chunks owned by the list;
+   nothing is released until the list is purged or destroyed */
+list list_create_arena(int size) {
+	list lp;
+
+	lp = list_create();
+	if (!lp) return 0;
+	lp->arena_size = (size > 0 ? size : LIST_ARENA_SIZE);
+	return lp;
+}
+
+void list_set_item_free(list lp, list_item_free_t func) {
+	if (!lp) return;
+	lp->item_free = func;
+}
+
+/* Copied items are ours, referenced items belong to item_free (if set) */
+static void _free_item(list lp,list_item ip) {
+	int cls;
+
+	if (ip->size) {
+		if (lp->arena_size) return;
+		cls = _item_class(ip->size);
+		if (cls) _pool_free(cls,ip->item);
+		else free(ip->item);
+	} else if (lp->item_free) lp->item_free(ip->item);
+}
+
+static void _free_node(list lp,list_item ip) {
+	if (!lp->arena_size) _pool_free(0,ip);
+}
+
+static void _delete_item(list lp,list_item ip,int dofree) {
 	list_item prev = ip->prev;        /* Get the pointers */
 	list_item next = ip->next;
 
@@ -231,8 +441,9 @@ static void _delete_item(list lp,list_item ip) {
 	/* Was this the next item? */
 	if (ip == lp->next) lp->next = next;
 
-	if (ip->size) lp->item_free(ip->item); /* Free the item */
-	free(ip);		/* Free the ptr */
+	_changed(lp,LIST_CHANGE_DELETE,ip->serial);
+	if (dofree) _free_item(lp,ip); /* Free the item */
+	_free_node(lp,ip);	/* Free the ptr */
 	time(&lp->last_update);
 }
 
@@ -255,7 +466,7 @@ int list_delete(list lp,void *item) {
 		dprintf(dlevel,"item: %p, ip->item: %p\n", item, ip->item);
 		if (item == ip->item) {
 			dprintf(dlevel,"found\n");
-			_delete_item(lp,ip);
+			_delete_item(lp,ip,1);
 			found = 1;
 			break;
 		}
@@ -280,14 +491,16 @@ int list_purge(list lp) {
 
 	ip = lp->first;                         /* Start at beginning */
 	while(ip) {
-		if (ip->size) lp->item_free(ip->item);	/* Free the item data */
+		_free_item(lp,ip);		/* Free the item data */
 		next = ip->next;                /* Get next pointer */
-		free(ip);			/* Free current item */
+		_free_node(lp,ip);		/* Free current item */
 		ip = next;                      /* Set current item to next */
 	}
+	_arena_free(lp);
 
 	/* fixup first/last/next */
 	lp->first = lp->last = lp->next = (list_item) 0;
+	_changed(lp,LIST_CHANGE_OTHER,0);
 
 #if THREAD_SAFE
 	pthread_mutex_unlock(&lp->mutex);
@@ -308,11 +521,12 @@ int list_destroy(list lp) {
 	dprintf(dlevel,"lp->first: %p\n", lp->first);
 	ip = lp->first;                         /* Start at beginning */
 	while(ip) {
-		if (ip->size) lp->item_free(ip->item);	/* Free the item data */
+		_free_item(lp,ip);		/* Free the item data */
 		next = ip->next;                /* Get next pointer */
-		free(ip);			/* Free current item */
+		_free_node(lp,ip);		/* Free current item */
 		ip = next;                      /* Set current item to next */
 	}
+	_arena_free(lp);
 
 #if THREAD_SAFE
 	pthread_mutex_unlock(&lp->mutex);
@@ -368,7 +582,13 @@ void *list_pop(list lp) {
 	if (lp->first) {
 		ip = lp->first;
 		item = ip->item;
-		_delete_item(lp,ip);
+		/* Caller now owns the item - hand back malloc'd memory it can free */
+		if (ip->size && (lp->arena_size || _item_class(ip->size))) {
+			item = malloc(ip->size);
+			if (item) memcpy(item,ip->item,ip->size);
+			_free_item(lp,ip);
+		}
+		_delete_item(lp,ip,0);
 	}
 
 #if THREAD_SAFE
@@ -502,6 +722,7 @@ int list_sort(list lp, list_compare compare, int order) {
 		} else
 			ip1 = ip1->next;
 	}
+	_changed(lp,LIST_CHANGE_OTHER,0);
 	time(&lp->last_update);
 #if THREAD_SAFE
 	pthread_mutex_unlock(&lp->mutex);
@@ -531,6 +752,89 @@ void list_restore_next(list lp) {
 #endif
 }
 
+void list_iter_init(list_iter_t *it, list lp) {
+	memset(it,0,sizeof(*it));
+	if (!lp) return;
+	it->lp = lp;
+#if THREAD_SAFE
+	pthread_mutex_lock(&lp->mutex);
+#endif
+	it->ip = lp->first;
+	if (lp->first) {
+		it->next = lp->first->serial;
+		if (lp->first->next) it->after = lp->first->next->serial;
+	}
+	it->version = lp->version;
+#if THREAD_SAFE
+	pthread_mutex_unlock(&lp->mutex);
+#endif
+}
+
+/* Find our place again after changes we can't follow: walking only the nodes
+   still in the list, resume at the next or the one after it, or else after the
+   last one returned.  If all of those went, carry on from the same position. */
+static list_item _iter_find(list lp, list_iter_t *it) {
+	list_item ip;
+	int i;
+
+	for(ip = lp->first; ip; ip = ip->next) {
+		if (ip->serial == it->next || ip->serial == it->after) return ip;
+		if (ip->serial == it->last) return ip->next;
+	}
+	dprintf(dlevel,"lost place, index: %d\n", it->index);
+	for(ip = lp->first, i = 1; ip && i < it->index; i++) ip = ip->next;
+	return ip;
+}
+
+/* Iterators only follow a saved node pointer while it's known to be good: after
+   an append (nothing was freed) or after a delete of something other than the next
+   node.  Anything else and we find our place again by node serial. */
+void *list_iter_next(list_iter_t *it) {
+	list lp = it->lp;
+	list_item ip,cur;
+	void *item;
+
+	if (!lp) return 0;
+
+#if THREAD_SAFE
+	pthread_mutex_lock(&lp->mutex);
+#endif
+	ip = it->ip;
+	cur = it->cur;
+	if (it->version != lp->version) {
+		if (it->version + 1 == lp->version && lp->change == LIST_CHANGE_ADD && cur) {
+			/* Pick up anything added after the last one */
+			ip = cur->next;
+		} else if (it->version + 1 == lp->version && lp->change == LIST_CHANGE_DELETE && lp->changed != it->next) {
+			/* Next is still good */
+			if (lp->changed == it->last) cur = 0;
+		} else if (!it->index) {
+			ip = lp->first;
+		} else {
+			dprintf(dlevel,"rescan: index: %d\n", it->index);
+			cur = 0;
+			ip = _iter_find(lp,it);
+		}
+	}
+	item = 0;
+	if (ip) {
+		item = ip->item;
+		cur = ip;
+		it->last = ip->serial;
+		it->index++;
+		ip = ip->next;
+	}
+	it->ip = ip;
+	it->cur = cur;
+	it->next = (ip ? ip->serial : 0);
+	it->after = (ip && ip->next ? ip->next->serial : 0);
+	it->version = lp->version;
+#if THREAD_SAFE
+	pthread_mutex_unlock(&lp->mutex);
+#endif
+	return item;
+}
+
 #if 0
 #ifdef JS
 static JSClass js_list_array_class = {
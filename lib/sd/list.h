@@ -21,8 +21,8 @@ extern "C" {
 
 typedef void (*list_item_free_t)(void *);
 list list_create( void );
-void list_set_item_free(list_item_free_t);
-list list_create( void );
+list list_create_arena( int );
+void list_set_item_free(list, list_item_free_t);
 int list_destroy( list );
 list list_dup( list );
 void *list_add( list, void *, int );
@@ -43,6 +43,24 @@ time_t list_updated(list);
 void list_save_next(list);
 void list_restore_next(list);
 
+/* Iterators keep their own position so loops can nest and the same list can
+   be walked from several places at once; items may be added or deleted (the one
+   just returned included) between calls */
+struct list_iter {
+	list lp;
+	void *ip;			/* Next node */
+	void *cur;			/* Node last returned */
+	unsigned long last;		/* Serials of the node last returned, */
+	unsigned long next;		/* the next node */
+	unsigned long after;		/* and the one after that */
+	int index;			/* Number of items returned */
+	unsigned long version;		/* List version at the last call */
+};
+typedef struct list_iter list_iter_t;
+void list_iter_init(list_iter_t *, list);
+void *list_iter_next(list_iter_t *);
+void list_pool_stats(int *, int *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -48,52 +48,94 @@ void solard_message_dump(solard_message_t *msg, int level) {
 }
 
 
+static void _copy_level(char *dest, int size, topic_level_t *lp) {
+	int len;
+
+	len = (lp->len < size-1 ? lp->len : size-1);
+	memcpy(dest,lp->name,len);
+	dest[len] = 0;
+}
+
+#define LEVEL_IS(l,s) ((l)->len == sizeof(s)-1 && memcmp((l)->name,s,sizeof(s)-1) == 0)
+
 /* Topic format:  SolarD/<id|name>/func (status,info,data,etc) */
-int solard_getmsg(solard_message_t *msg, char *topic, char *message, int msglen, char *replyto) {
-	char *root,*p;
+solard_message_t *solard_message_new(char *topic, char *message, int msglen, char *replyto) {
+	solard_message_t *msg;
+	solard_topic_t t;
+	topic_level_t levels[SOLARD_TOPIC_MAX_LEVELS];
+	int size,type;
 
 	dprintf(4,"topic: %s, msglen: %d, replyto: %s\n", topic, msglen, replyto);
 
-	/* Clear out dest before we start */
-	memset(msg,0,sizeof(*msg));
+	/* Split the topic once; the router matches on the level ids */
+	if (topic_parse(&t,topic,levels)) return 0;
 
 	/* All messages must start with SOLARD_TOPIC_ROOT */
-	root = strele(0,"/",topic);
-	dprintf(4,"root: %s\n", root);
-	if (strcmp(root,SOLARD_TOPIC_ROOT) != 0) return 1;
-	strncpy(msg->topic,topic,sizeof(msg->topic)-1);
+	if (t.count < 2 || !LEVEL_IS(&levels[0],SOLARD_TOPIC_ROOT)) return 0;
 
 	/* Next must be agents or clients */
-	p = strele(1,"/",topic);
-	dprintf(4,"type: %s\n", p);
-	if (strcmp(p,SOLARD_TOPIC_AGENTS) == 0) {
-		msg->type = SOLARD_MESSAGE_TYPE_AGENT;
-		/* Next is agent name */
-		strncpy(msg->name,strele(2,"/",topic),sizeof(msg->name)-1);
-		/* Next is agent func */
-		strncpy(msg->func,strele(3,"/",topic),sizeof(msg->func)-1);
-	} else if (strcmp(p,SOLARD_TOPIC_CLIENTS) == 0) {
-		msg->type = SOLARD_MESSAGE_TYPE_CLIENT;
-		/* Next is client id */
-		strncpy(msg->id,strele(2,"/",topic),sizeof(msg->id)-1);
-	} else {
-		return 1;
+	if (LEVEL_IS(&levels[1],SOLARD_TOPIC_AGENTS)) type = SOLARD_MESSAGE_TYPE_AGENT;
+	else if (LEVEL_IS(&levels[1],SOLARD_TOPIC_CLIENTS)) type = SOLARD_MESSAGE_TYPE_CLIENT;
+	else return 0;
+	dprintf(4,"type: %d\n", type);
+
+	size = (message ? msglen : 0);
+	if (size >= SOLARD_MAX_PAYLOAD_SIZE) {
+		log_warning("solard_message_new: msglen(%d) > %d",msglen,SOLARD_MAX_PAYLOAD_SIZE);
+		size = SOLARD_MAX_PAYLOAD_SIZE-1;
 	}
 
-	if (message && msglen) {
-		if (msglen >= SOLARD_MAX_PAYLOAD_SIZE) {
-			log_warning("solard_getmsg: msglen(%d) > %d",msglen,SOLARD_MAX_PAYLOAD_SIZE);
-			msg->size = SOLARD_MAX_PAYLOAD_SIZE-1;
-		} else {
-			msg->size = msglen;
-		}
-		memcpy(msg->data,message,msg->size);
-		msg->data[msg->size] = 0;
+	/* Header and payload in one block */
+	msg = malloc(sizeof(*msg) + size + 1);
+	if (!msg) {
+		log_syserror("solard_message_new: malloc(%d)",(int)(sizeof(*msg) + size + 1));
+		return 0;
+	}
+	memset(msg,0,sizeof(*msg));
+	strncpy(msg->topic,topic,sizeof(msg->topic)-1);
+	msg->levels = t;
+	msg->type = type;
+	if (type == SOLARD_MESSAGE_TYPE_AGENT) {
+		/* Next is agent name, then agent func */
+		if (t.count > 2) _copy_level(msg->name,sizeof(msg->name),&levels[2]);
+		if (t.count > 3) _copy_level(msg->func,sizeof(msg->func),&levels[3]);
+	} else {
+		/* Next is client id */
+		if (t.count > 2) _copy_level(msg->id,sizeof(msg->id),&levels[2]);
 	}
+
+	if (size) memcpy(msg->data,message,size);
+	msg->data[size] = 0;
+	msg->size = size;
 	if (replyto) strncpy(msg->replyto,replyto,sizeof(msg->replyto)-1);
+	msg->refs = 1;
 //	dprintf(4,"replyto: %s\n", msg->replyto);
 //	solard_message_dump(msg,0);
-	return 0;
+	return msg;
+}
+
+solard_message_t *solard_message_ref(solard_message_t *msg) {
+	if (msg) __atomic_add_fetch(&msg->refs, 1, __ATOMIC_RELAXED);
+	return msg;
+}
+
+void solard_message_unref(solard_message_t *msg) {
+	if (!msg) return;
+	dprintf(dlevel,"msg: %p, refs: %d\n", msg, msg->refs);
+	if (__atomic_sub_fetch(&msg->refs, 1, __ATOMIC_ACQ_REL) == 0) free(msg);
+}
+
+static void _message_item_free(void *item) {
+	solard_message_unref(item);
+}
+
+/* Message queues hold a reference to each message (add with list_add(l,msg,0)) */
+list solard_message_list_create(void) {
+	list l;
+
+	l = list_create();
+	if (l) list_set_item_free(l,_message_item_free);
+	return l;
 }
 
 int solard_message_reply(mqtt_session_t *m, solard_message_t *msg, int status, char *message) {
@@ -114,75 +156,65 @@ int solard_message_reply(mqtt_session_t *m, solard_message_t *msg, int status, c
 	/* Replyto is expected to be the UUID of the sender */
 	sprintf(topic,"%s/%s",SOLARD_TOPIC_ROOT,msg->replyto);
 	dprintf(1,"topic: %s\n", topic);
-	r = mqtt_pub(m,topic,str,1,0);
+	r = mqtt_pub(m,topic,str,0,0);
 	free(str);
 	return r;
 }
 
-int solard_message_wait(list lp, int timeout) {
-	time_t cur,upd;
-	int count;
+/* Drain the inbox into mq until match finds a message or timeout (ms, -1 = forever) */
+static solard_message_t *_wait(struct inbox *ib, list mq, int (*match)(solard_message_t *, char *), char *arg, int timeout) {
+	solard_message_t *msg;
+	list_iter_t it;
+	uint64_t end,now;
+	int left;
 
+	end = (timeout >= 0 ? monotime_ms() + timeout : 0);
+	left = timeout;
 	while(1) {
-		count = list_count(lp);
-		if (count) break;
+		inbox_drain(ib,mq);
+		list_iter_init(&it,mq);
+		while((msg = list_iter_next(&it)) != 0) {
+			if (match(msg,arg)) return msg;
+		}
 		if (timeout >= 0) {
-			time(&cur);
-			upd = list_updated(lp);
-			dprintf(4,"cur: %ld, upd: %ld, diff: %ld\n", cur, upd, cur-upd);
-			if ((cur - upd) >= timeout) break;
+			now = monotime_ms();
+			if (now >= end) break;
+			left = end - now;
 		}
-		sleep(1);
+		/* Woken by the MQTT thread as soon as something arrives */
+		if (!inbox_wait(ib,left) && timeout >= 0) break;
 	}
-	return count;
+	return 0;
 }
 
-solard_message_t *solard_message_wait_id(list lp, char *id, int timeout) {
-	solard_message_t *msg;
-	time_t cur,upd;
+static int _match_any(solard_message_t *msg, char *arg) {
+	return 1;
+}
 
-	dprintf(1,"==> want id: %s\n", id);
+static int _match_id(solard_message_t *msg, char *id) {
+	return (strcmp(msg->replyto,id) == 0);
+}
 
-	while(1) {
-		list_reset(lp);
-		while((msg = list_get_next(lp)) != 0) {
-			dprintf(1,"msg->id: %s\n", msg->id);
-			if (strcmp(msg->replyto,id) == 0) {
-				dprintf(1,"found\n");
-				return msg;
-			}
-		}
-		if (timeout >= 0) {
-			time(&cur);
-			upd = list_updated(lp);
-			dprintf(4,"cur: %ld, upd: %ld, diff: %ld\n", cur, upd, cur-upd);
-			if ((cur - upd) >= timeout) break;
-		}
-		sleep(1);
-	}
-	dprintf(1,"NOT found\n");
-	return 0;
+static int _match_target(solard_message_t *msg, char *target) {
+	return (strcmp(msg->name,target) == 0);
 }
 
-solard_message_t *solard_message_wait_target(list lp, char *target, int timeout) {
+int solard_message_wait(struct inbox *ib, list mq, int timeout) {
+	_wait(ib,mq,_match_any,0,timeout);
+	return list_count(mq);
+}
+
+solard_message_t *solard_message_wait_id(struct inbox *ib, list mq, char *id, int timeout) {
 	solard_message_t *msg;
-	time_t cur,upd;
 
-	while(1) {
-		list_reset(lp);
-		while((msg = list_get_next(lp)) != 0) {
-			if (strcmp(msg->name, target) == 0)
-				return msg;
-		}
-		if (timeout >= 0) {
-			time(&cur);
-			upd = list_updated(lp);
-			dprintf(4,"cur: %ld, upd: %ld, diff: %ld\n", cur, upd, cur-upd);
-			if ((cur - upd) >= timeout) break;
-		}
-		sleep(1);
-	}
-	return 0;
+	dprintf(1,"==> want id: %s\n", id);
+	msg = _wait(ib,mq,_match_id,id,timeout);
+	dprintf(1,"%s\n", msg ? "found" : "NOT found");
+	return msg;
+}
+
+solard_message_t *solard_message_wait_target(struct inbox *ib, list mq, char *target, int timeout) {
+	return _wait(ib,mq,_match_target,target,timeout);
 }
 
 int solard_message_delete(list lp, solard_message_t *msg) {
@@ -229,6 +261,17 @@ static JSBool message_getprop(JSContext *cx, JSObject *obj, jsval id, jsval *rva
 	return JS_TRUE;
 }
 
+static void message_finalize(JSContext *cx, JSObject *obj) {
+	solard_message_t *msg;
+
+	msg = JS_GetPrivate(cx,obj);
+	dprintf(dlevel,"msg: %p\n", msg);
+	if (msg) {
+		JS_SetPrivate(cx,obj,0);
+		solard_message_unref(msg);
+	}
+}
+
 static JSClass js_message_class = {
 	"Message",		/* Name */
 	JSCLASS_HAS_PRIVATE,	/* Flags */
@@ -239,7 +282,7 @@ static JSClass js_message_class = {
 	JS_EnumerateStub,	/* enumerate */
 	JS_ResolveStub,		/* resolve */
 	JS_ConvertStub,		/* convert */
-	JS_FinalizeStub,	/* finalize */
+	message_finalize,	/* finalize */
 	JSCLASS_NO_OPTIONAL_MEMBERS
 };
 
@@ -298,7 +341,8 @@ JSObject *js_message_new(JSContext *cx, JSObject *parent, solard_message_t *m) {
 	newobj = JS_NewObject(cx, &js_message_class, 0, parent);
 	if (!newobj) return 0;
 
-	JS_SetPrivate(cx,newobj,m);
+	/* Object keeps the message alive even if it's deleted from the queue */
+	JS_SetPrivate(cx,newobj,solard_message_ref(m));
 
 	dprintf(dlevel,"newobj: %p\n", newobj);
 	return newobj;
@@ -21,6 +21,18 @@ LICENSE file in the root directory of this source tree.
 
 #define SOLARD_MAX_PAYLOAD_SIZE 131072
 
+/* Topic split into interned level ids (see router.h) */
+#define SOLARD_TOPIC_MAX_LEVELS 8
+struct solard_topic {
+	int count;
+	int deep;					/* more than MAX_LEVELS, ids are the first ones */
+	uint32_t gen;					/* intern generation the ids were looked up in */
+	uint32_t ids[SOLARD_TOPIC_MAX_LEVELS];
+};
+typedef struct solard_topic solard_topic_t;
+
+/* Messages are allocated in a single block sized to the payload and refcounted
+   so the queue and any JS Message objects can share them */
 struct solard_message {
 	char topic[SOLARD_TOPIC_SIZE];			/* orig topic */
 	int type;					/* 0 = agent, 1 = client */
@@ -30,20 +42,28 @@ struct solard_message {
 	};
 	char func[SOLARD_FUNC_LEN];			/* agent func, if any */
 	char replyto[SOLARD_ID_LEN];			/* MQTT5 replyto addr */
-	char data[SOLARD_MAX_PAYLOAD_SIZE];		/* message data */
+	char corrid[SOLARD_ID_LEN];			/* MQTT5 corrid (rpc.h) */
+	solard_topic_t levels;				/* topic, parsed once */
+	int refs;					/* reference count */
 	int size;					/* message size (strlen(data) */
+	char data[];					/* message data (size+1 bytes) */
 };
 typedef struct solard_message solard_message_t;
 
-int solard_getmsg(solard_message_t *, char *, char *, int, char *);
+solard_message_t *solard_message_new(char *topic, char *message, int msglen, char *replyto);
+solard_message_t *solard_message_ref(solard_message_t *);
+void solard_message_unref(solard_message_t *);
+list solard_message_list_create(void);
 void solard_message_dump(solard_message_t *,int);
-int solard_message_wait(list, int);
 int solard_message_delete(list, solard_message_t *);
 
 typedef int (solard_msghandler_t)(void *,solard_message_t *);
 
-solard_message_t *solard_message_wait_id(list lp, char *id, int timeout);
-solard_message_t *solard_message_wait_target(list lp, char *target, int timeout);
+/* Move messages from the inbox to mq until one turns up (ms, -1 = forever) */
+struct inbox;
+int solard_message_wait(struct inbox *ib, list mq, int timeout);
+solard_message_t *solard_message_wait_id(struct inbox *ib, list mq, char *id, int timeout);
+solard_message_t *solard_message_wait_target(struct inbox *ib, list mq, char *target, int timeout);
 
 #ifdef JS
 JSObject *js_InitMessageClass(JSContext *cx, JSObject *parent);
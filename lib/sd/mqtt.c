@@ -13,13 +13,14 @@ LICENSE file in the root directory of this source tree.
 
 #include <string.h>
 #include <MQTTClient.h>
-#include <MQTTAsync.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include "mqtt.h"
 #include "utils.h"
 #include "config.h"
 #include "uuid.h"
+#include "common.h"
+#include "reactor.h"
 
 #define DEFAULT_PORT "1883"
 #define TIMEOUT 10000L
@@ -28,6 +29,9 @@ static list mqtt_sessions = 0;
 static list js_ctxs = 0;
 #endif
 
+static mqtt_buffer_t *mqtt_get_buffer(mqtt_session_t *s);
+static void mqtt_drain(mqtt_session_t *s);
+
 void mqtt_dump(mqtt_session_t *s) {
 	char *topic;
 
@@ -41,6 +45,32 @@ void mqtt_dump(mqtt_session_t *s) {
 	printf(SFMT,"username",s->username);
 	printf(SFMT,"lwt_topic",s->lwt_topic);
 	printf(DFMT,"interval",s->interval);
+	printf(DFMT,"default_qos",s->default_qos);
+	printf(SFMT,"qos_map",s->qos_map_text);
+	printf(DFMT,"window",s->window);
+	printf("%-15s: %lu\n","published",s->stats.published);
+	printf("%-15s: %lu\n","acked",s->stats.acked);
+	printf("%-15s: %lu\n","dropped",s->stats.dropped);
+	printf("%-15s: %lu\n","errors",s->stats.errors);
+	printf(DFMT,"inflight",s->stats.inflight);
+	printf(DFMT,"inflight_max",s->stats.inflight_max);
+	printf("%-15s: %llu\n","ack_avg_us",(unsigned long long)(s->stats.acked ? s->stats.ack_total / s->stats.acked : 0));
+	printf("%-15s: %llu\n","ack_max_us",(unsigned long long)s->stats.ack_max);
+	printf(DFMT,"buffer_count",s->buffer_count);
+	printf(DFMT,"buffer_size",s->buffer_size);
+	printf(DFMT,"buffer_burst",s->buffer_burst);
+	printf(SFMT,"buffer_file",s->buffer_file);
+	if (s->buffer) {
+		mqtt_stats_t stats;
+
+		memset(&stats,0,sizeof(stats));
+		mqtt_buffer_get_stats(s->buffer,&stats);
+		printf(DFMT,"buffer_depth",stats.buffer_depth);
+		printf("%-15s: %lu\n","buffered",stats.buffered);
+		printf("%-15s: %lu\n","buffer_dropped",stats.buffer_dropped);
+		printf("%-15s: %lu\n","coalesced",stats.coalesced);
+		printf("%-15s: %lu\n","replayed",stats.replayed);
+	}
 	printf(DFMT,"sub count",list_count(s->subs));
 	list_reset(s->subs);
 	while((topic = list_get_next(s->subs)) != 0) printf("  %s\n", topic);
@@ -114,11 +144,67 @@ void logProperties(MQTTProperties *props) {
 	}
 }
 
+/* Unacked messages are gone once the session is (clean) restarted */
+static void mqtt_reset_window(mqtt_session_t *s) {
+	int i;
+
+	pthread_mutex_lock(&s->pub_lock);
+	for(i=0; i < MQTT_WINDOW_MAX; i++) {
+		if (s->slots[i].busy && !s->slots[i].pending) {
+			s->slots[i].busy = false;
+			s->stats.inflight--;
+			s->stats.dropped++;
+		}
+	}
+	s->early_count = 0;
+	pthread_cond_broadcast(&s->pub_cond);
+	pthread_mutex_unlock(&s->pub_lock);
+}
+
 static void mqtt_conlost(void *ctx, char *cause) {
 	mqtt_session_t *s = ctx;
 
 	dprintf(-1,"cause: %s\n", cause);
 	s->connected = false;
+	mqtt_reset_window(s);
+}
+
+static void mqtt_complete_slot(mqtt_session_t *s, struct mqtt_inflight *ip) {
+	uint64_t lat;
+
+	lat = monotime_us() - ip->start;
+	s->stats.ack_total += lat;
+	if (lat > s->stats.ack_max) s->stats.ack_max = lat;
+	s->stats.acked++;
+	s->stats.inflight--;
+	stats_hist_record(s->ack_hist,lat);
+	ip->busy = false;
+	pthread_cond_broadcast(&s->pub_cond);
+}
+
+/* Called from the paho thread when a QoS 1/2 publish is acknowledged */
+void mqtt_delivered(void *ctx, MQTTClient_deliveryToken token) {
+	mqtt_session_t *s = ctx;
+	int i;
+
+	dprintf(dlevel+1,"token: %d\n", token);
+	pthread_mutex_lock(&s->pub_lock);
+	for(i=0; i < MQTT_WINDOW_MAX; i++) {
+		if (s->slots[i].busy && !s->slots[i].pending && s->slots[i].token == token) {
+			mqtt_complete_slot(s,&s->slots[i]);
+			break;
+		}
+	}
+	/* Not ours yet - one of the publish calls still going has it */
+	if (i == MQTT_WINDOW_MAX && s->pending) {
+		/* Can only be full of stale ones (slots dropped on a reconnect), lose the oldest */
+		if (s->early_count == MQTT_WINDOW_MAX) {
+			memmove(&s->early[0],&s->early[1],(MQTT_WINDOW_MAX - 1) * sizeof(s->early[0]));
+			s->early_count--;
+		}
+		s->early[s->early_count++] = token;
+	}
+	pthread_mutex_unlock(&s->pub_lock);
 }
 
 static void mqtt_get_reason(mqtt_session_t *s, int rc) {
@@ -137,7 +223,7 @@ static void mqtt_get_reason(mqtt_session_t *s, int rc) {
 static int mqtt_getmsg(void *ctx, char *topicName, int topicLen, MQTTClient_message *message) {
 	char topic[256],*replyto;
 	mqtt_session_t *s = ctx;
-	int len;
+	int i,len;
 
 	/* Ignore zero length messages */
 	dprintf(dlevel,"payloadlen: %d\n", message->payloadlen);
@@ -157,20 +243,26 @@ static int mqtt_getmsg(void *ctx, char *topicName, int topicLen, MQTTClient_mess
 
 //	logProperties(&message->properties);
 
-	/* Do we have a replyto user property? */
+	/* Do we have replyto/corrid user properties? */
 	replyto = 0;
-	dprintf(dlevel,"hasProperty UP: %d\n", MQTTProperties_hasProperty(&message->properties, MQTTPROPERTY_CODE_USER_PROPERTY));
-	if (MQTTProperties_hasProperty(&message->properties, MQTTPROPERTY_CODE_USER_PROPERTY)) {
-		MQTTProperty *prop;
+	*s->corrid = 0;
+	for(i=0; i < message->properties.count; i++) {
+		MQTTProperty *prop = &message->properties.array[i];
 
-		prop = MQTTProperties_getProperty(&message->properties, MQTTPROPERTY_CODE_USER_PROPERTY);
-		if (strncmp(prop->value.data.data,"replyto",prop->value.data.len) == 0) {
+		if (prop->identifier != MQTTPROPERTY_CODE_USER_PROPERTY) continue;
+		if (prop->value.data.len == 7 && strncmp(prop->value.data.data,"replyto",7) == 0) {
 			replyto = prop->value.value.data;
+		} else if (prop->value.data.len == 6 && strncmp(prop->value.data.data,"corrid",6) == 0) {
+			len = prop->value.value.len < sizeof(s->corrid)-1 ? prop->value.value.len : sizeof(s->corrid)-1;
+			memcpy(s->corrid,prop->value.value.data,len);
+			s->corrid[len] = 0;
 		}
 	}
+	dprintf(dlevel,"replyto: %s, corrid: %s\n", replyto, s->corrid);
 
 	dprintf(dlevel,"cb: %p\n", s->cb);
 	if (s->cb) s->cb(s->ctx, topic, message->payload, message->payloadlen, replyto);
+	*s->corrid = 0;
 
 mqtt_getmsg_skip:
 	MQTTClient_freeMessage(&message);
@@ -205,13 +297,26 @@ int mqtt_newclient(mqtt_session_t *s) {
 
 	/* Set callback BEFORE connect */
 	dprintf(dlevel,"setting callbacks...\n");
-	rc = MQTTClient_setCallbacks(s->c, s, mqtt_conlost, mqtt_getmsg, 0);
+	rc = MQTTClient_setCallbacks(s->c, s, mqtt_conlost, mqtt_getmsg, mqtt_delivered);
 	dprintf(dlevel,"setcb rc: %d\n", rc);
 	if (rc != MQTTCLIENT_SUCCESS) {
 		strcpy(s->errmsg,"MQTTClient_setCallbacks failed");
 		return 1;
 	}
 
+	/* Build the replyto property once */
+	MQTTProperties_free(&s->pubprops);
+	if (!s->v3) {
+		MQTTProperty property;
+
+		property.identifier = MQTTPROPERTY_CODE_USER_PROPERTY;
+		property.value.data.data = "replyto";
+		property.value.data.len = strlen(property.value.data.data);
+		property.value.value.data = s->clientid;
+		property.value.value.len = strlen(property.value.value.data);
+		MQTTProperties_add(&s->pubprops, &property);
+	}
+
 	return 0;
 }
 
@@ -233,7 +338,15 @@ struct mqtt_session *mqtt_new(bool v3, mqtt_callback_t *cb, void *ctx) {
 		return 0;
 	}
 	s->ctor = false;
-	s->mq = list_create();
+	s->mq = solard_message_list_create();
+	s->default_qos = MQTT_DEFAULT_QOS;
+	s->window = MQTT_WINDOW;
+	s->buffer_count = MQTT_BUFFER_COUNT;
+	s->buffer_size = MQTT_BUFFER_SIZE;
+	s->buffer_burst = MQTT_BUFFER_BURST;
+	mqtt_set_qos_map(s,MQTT_QOS_MAP);
+	pthread_mutex_init(&s->pub_lock,0);
+	pthread_cond_init(&s->pub_cond,0);
 
 	if (!mqtt_sessions) mqtt_sessions = list_create();
 	list_add(mqtt_sessions, s, 0);
@@ -313,6 +426,7 @@ int mqtt_connect(mqtt_session_t *s, int interval) {
 		if (have_ssl) conn_opts.ssl = &ssl_opts;
 		conn_opts.serverURIcount = 0;
 		conn_opts.serverURIs = NULL;
+		conn_opts.maxInflightMessages = s->window;
 		rc = MQTTClient_connect(s->c, &conn_opts);
 	} else {
 		dprintf(dlevel,"connectv5\n");
@@ -326,6 +440,7 @@ int mqtt_connect(mqtt_session_t *s, int interval) {
 			dprintf(dlevel,"username: %s, password: %s\n", conn_opts5.username, conn_opts5.password);
 		}
 		conn_opts5.ssl = s->ssl_opts;
+		conn_opts5.maxInflightMessages = s->window;
 		if (strlen(s->lwt_topic)) conn_opts5.will = &will_opts;
 		if (have_ssl) conn_opts5.ssl = &ssl_opts;
 		response = MQTTClient_connect5(s->c, &conn_opts5, 0, 0);
@@ -343,11 +458,15 @@ int mqtt_connect(mqtt_session_t *s, int interval) {
 		return 1;
 	}
 	s->connected = true;
-	if (strlen(s->lwt_topic)) mqtt_pub(s,s->lwt_topic,"Online",1,1);
+	mqtt_reset_window(s);
+	if (strlen(s->lwt_topic)) mqtt_pub(s,s->lwt_topic,"Online",0,1);
 
 	/* If we have a list of subs, resub */
 	dprintf(dlevel,"count: %d\n", list_count(s->subs));
 	if (list_count(s->subs)) mqtt_resub(s);
+
+	/* Start replaying anything published while we were away (or before a restart) */
+	if (mqtt_get_buffer(s)) mqtt_drain(s);
 	return 0;
 }
 
@@ -447,8 +566,15 @@ int mqtt_destroy_session(mqtt_session_t *s) {
 		MQTTClient_destroy(&s->c);
 	}
 	s->c = 0;
+	rpc_destroy(s->rpc);
 	list_destroy(s->subs);
+	inbox_destroy(s->inbox);
 	list_destroy(s->mq);
+	MQTTProperties_free(&s->pubprops);
+	mqtt_buffer_destroy(s->buffer);
+	router_destroy(s->router);
+	pthread_cond_destroy(&s->pub_cond);
+	pthread_mutex_destroy(&s->pub_lock);
 
 	if (mqtt_sessions) list_delete(mqtt_sessions,s);
 	free(s);
@@ -480,45 +606,147 @@ void mqtt_shutdown(void) {
 #endif
 }
 
-int mqtt_pub(mqtt_session_t *s, char *topic, char *message, int wait, int retain) {
+/* Parse "name=qos,..." where name is matched against the last topic level */
+int mqtt_set_qos_map(mqtt_session_t *s, char *map) {
+	char temp[128],*p,*e;
+	int i;
+
+	if (!s) return 1;
+	if (!map) map = "";
+	dprintf(dlevel,"map: %s\n", map);
+	if (s->qos_map_text != map) strncpy(s->qos_map_text,map,sizeof(s->qos_map_text)-1);
+	strncpy(temp,map,sizeof(temp)-1);
+	temp[sizeof(temp)-1] = 0;
+	s->qos_map_count = 0;
+	for(i=0; i < MQTT_QOS_MAP_MAX; i++) {
+		p = strele(i,",",temp);
+		if (!strlen(p)) break;
+		e = strchr(p,'=');
+		if (!e) {
+			log_error("mqtt_set_qos_map: invalid entry: %s\n", p);
+			continue;
+		}
+		*e++ = 0;
+		strncpy(s->qos_map[s->qos_map_count].name,trim(p),sizeof(s->qos_map[0].name)-1);
+		s->qos_map[s->qos_map_count].qos = atoi(e);
+		dprintf(dlevel,"name: %s, qos: %d\n", s->qos_map[s->qos_map_count].name, s->qos_map[s->qos_map_count].qos);
+		s->qos_map_count++;
+	}
+	return 0;
+}
+
+static int mqtt_topic_qos(mqtt_session_t *s, char *topic) {
+	char *p;
+	int i;
+
+	if (s->qos_map_count) {
+		p = strrchr(topic,'/');
+		p = (p ? p + 1 : topic);
+		for(i=0; i < s->qos_map_count; i++) {
+			if (strcmp(s->qos_map[i].name,p) == 0) return s->qos_map[i].qos;
+		}
+	}
+	return s->default_qos;
+}
+
+/* Wait for room in the window and claim a slot */
+struct mqtt_inflight *mqtt_claim_slot(mqtt_session_t *s) {
+	struct mqtt_inflight *ip;
+	struct timespec ts;
+	int i,window;
+
+	window = s->window;
+	if (window > MQTT_WINDOW_MAX) window = MQTT_WINDOW_MAX;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += TIMEOUT / 1000;
+	pthread_mutex_lock(&s->pub_lock);
+	while(s->stats.inflight >= window) {
+		dprintf(dlevel,"window full (%d), waiting...\n", s->stats.inflight);
+		if (pthread_cond_timedwait(&s->pub_cond, &s->pub_lock, &ts) != 0) break;
+	}
+	ip = 0;
+	if (s->stats.inflight < window) {
+		for(i=0; i < MQTT_WINDOW_MAX; i++) {
+			if (!s->slots[i].busy) {
+				ip = &s->slots[i];
+				ip->busy = ip->pending = true;
+				ip->start = monotime_us();
+				s->pending++;
+				s->stats.inflight++;
+				if (s->stats.inflight > s->stats.inflight_max) s->stats.inflight_max = s->stats.inflight;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&s->pub_lock);
+	return ip;
+}
+
+void mqtt_release_slot(mqtt_session_t *s, struct mqtt_inflight *ip, MQTTClient_deliveryToken token, int ok) {
+	int i;
+
+	pthread_mutex_lock(&s->pub_lock);
+	ip->pending = false;
+	s->pending--;
+	if (!ok) {
+		ip->busy = false;
+		s->stats.inflight--;
+		pthread_cond_broadcast(&s->pub_cond);
+	} else {
+		ip->token = token;
+		/* Did the ack get here first? */
+		for(i=0; i < s->early_count; i++) {
+			if (s->early[i] == token) {
+				s->early[i] = s->early[--s->early_count];
+				mqtt_complete_slot(s,ip);
+				break;
+			}
+		}
+	}
+	/* Nothing left for any early ack to be for */
+	if (!s->pending) s->early_count = 0;
+	pthread_mutex_unlock(&s->pub_lock);
+}
+
+/* Stats are read under pub_lock by mqtt_get_stats */
+static void mqtt_count_error(mqtt_session_t *s) {
+	pthread_mutex_lock(&s->pub_lock);
+	s->stats.errors++;
+	pthread_mutex_unlock(&s->pub_lock);
+}
+
+/* Single publish attempt.  QoS comes from the topic, QoS 1/2 messages are limited
+   to window unacked at a time and only waited for if asked to */
+static int mqtt_pubmsg(mqtt_session_t *s, char *topic, char *message, int wait, int retain, MQTTProperties *props) {
 	MQTTClient_message pubmsg = MQTTClient_message_initializer;
 	MQTTClient_deliveryToken token;
-	MQTTProperty property;
 	MQTTResponse response = MQTTResponse_initializer;
-	int rc,rt,retry;
+	struct mqtt_inflight *ip;
+	int rc;
 
 	int ldlevel = dlevel;
 
-	dprintf(ldlevel,"s: %p, topic: %s, message: %s, wait: %d, retain: %d\n",
-		s,topic,message,wait,retain);
-
-	if (!s) return 1;
-
-	dprintf(ldlevel,"enabled: %d\n", s->enabled);
-	if (!s->enabled) return 0;
-
 	if (message) {
 		pubmsg.payload = message;
 		pubmsg.payloadlen = strlen(message);
 	}
 
-	/* Add a replyto user property */
-	rt = 1;
-	if (rt) {
-		property.identifier = MQTTPROPERTY_CODE_USER_PROPERTY;
-		property.value.data.data = "replyto";
-		property.value.data.len = strlen(property.value.data.data);
-		property.value.value.data = s->clientid;
-		property.value.value.len = strlen(property.value.value.data);
-		MQTTProperties_add(&pubmsg.properties, &property);
-//		logProperties(&pubmsg.properties);
-	}
+	/* replyto user property (the client copies it) */
+	if (!s->v3) pubmsg.properties = (props ? *props : s->pubprops);
 
-	pubmsg.qos = 2;
+	pubmsg.qos = mqtt_topic_qos(s,topic);
 	pubmsg.retained = retain;
+	dprintf(ldlevel,"qos: %d\n", pubmsg.qos);
+	ip = 0;
+	if (pubmsg.qos && s->window > 0) {
+		ip = mqtt_claim_slot(s);
+		if (!ip) {
+			strcpy(s->errmsg,"mqtt_pub: timeout waiting for publish window");
+			return 1;
+		}
+	}
 	token = 0;
-	retry = 0;
-again:
 	dprintf(ldlevel,"publishing...\n");
 	if (s->v3) {
 		rc = MQTTClient_publishMessage(s->c, topic, &pubmsg, &token);
@@ -528,46 +756,172 @@ again:
 		MQTTResponse_free(response);
 	}
 	dprintf(ldlevel,"rc: %d\n", rc);
+	if (ip) mqtt_release_slot(s,ip,token,rc == MQTTCLIENT_SUCCESS);
 	if (rc != MQTTCLIENT_SUCCESS) {
 		dprintf(ldlevel,"publish error\n");
 		mqtt_get_reason(s,rc);
-		if (!retry) {
-			dprintf(ldlevel,"calling reconnect!\n");
-			mqtt_reconnect(s);
-			retry = 1;
-			goto again;
-		} else {
-			return 1;
-		}
+		return 1;
 	}
-	if (wait) {
+	pthread_mutex_lock(&s->pub_lock);
+	s->stats.published++;
+	pthread_mutex_unlock(&s->pub_lock);
+	if (wait && pubmsg.qos) {
 		dprintf(ldlevel,"waiting...\n");
 		rc = MQTTClient_waitForCompletion(s->c, token, TIMEOUT);
 		dprintf(ldlevel,"rc: %d\n", rc);
 		if (rc != MQTTCLIENT_SUCCESS) {
 			mqtt_get_reason(s,rc);
-			if (!retry) {
-				dprintf(ldlevel,"calling reconnect!\n");
-				mqtt_reconnect(s);
-				retry = 1;
-				goto again;
-			} else {
-				return 1;
-			}
+			return 1;
 		}
 	}
-	dprintf(ldlevel,"delivered message... token: %d\n",token);
-	if (rt) MQTTProperties_free(&pubmsg.properties);
-	dprintf(ldlevel,"done!\n");
+	dprintf(ldlevel,"published message... token: %d\n",token);
 	return 0;
 }
 
+/* Reconnect unless we tried too recently; backs off while the broker stays down */
+static int mqtt_try_reconnect(mqtt_session_t *s) {
+	uint64_t now;
+
+	now = monotime_ms();
+	dprintf(dlevel,"now: %llu, next: %llu\n", (unsigned long long)now, (unsigned long long)s->reconnect_next);
+	if (now < s->reconnect_next) return 1;
+
+	/* Set before trying so publishes made by connect don't recurse */
+	if (!s->reconnect_delay) s->reconnect_delay = MQTT_RECONNECT_MIN;
+	else if ((s->reconnect_delay *= 2) > MQTT_RECONNECT_MAX) s->reconnect_delay = MQTT_RECONNECT_MAX;
+	s->reconnect_next = now + s->reconnect_delay;
+	if (mqtt_reconnect(s)) {
+		dprintf(dlevel,"reconnect failed, next try in %d ms\n", s->reconnect_delay);
+		return 1;
+	}
+	s->reconnect_delay = 0;
+	s->reconnect_next = 0;
+	return 0;
+}
+
+static mqtt_buffer_t *mqtt_get_buffer(mqtt_session_t *s) {
+	if (!s->buffer && s->buffer_count > 0)
+		s->buffer = mqtt_buffer_new(s->buffer_count, s->buffer_size * 1024, s->buffer_file);
+	return s->buffer;
+}
+
+static int mqtt_buffer_send(void *ctx, char *topic, char *message, int retain) {
+	return mqtt_pubmsg(ctx,topic,message,0,retain,0);
+}
+
+/* Replay at most buffer_burst messages so a reconnect doesn't flood the broker */
+static void mqtt_drain(mqtt_session_t *s) {
+	if (!mqtt_buffer_count(s->buffer)) return;
+	mqtt_buffer_drain(s->buffer, s->buffer_burst, mqtt_buffer_send, s);
+}
+
+/* Publish without waiting for the broker unless asked to.  If the broker can't be
+   reached messages that aren't waited for are buffered and replayed in order */
+static int _mqtt_pub(mqtt_session_t *s, char *topic, char *message, int wait, int retain) {
+	int buffer;
+
+	dprintf(dlevel,"s: %p, topic: %s, message: %s, wait: %d, retain: %d\n",
+		s,topic,message,wait,retain);
+
+	if (!s) return 1;
+
+	dprintf(dlevel,"enabled: %d\n", s->enabled);
+	if (!s->enabled) return 0;
+
+	buffer = (!wait && s->buffer_count > 0);
+
+	/* While anything is buffered new messages go behind it */
+	if (buffer && (!s->connected || mqtt_buffer_count(s->buffer))) {
+		if (!s->connected) mqtt_try_reconnect(s);
+		if (s->connected) mqtt_drain(s);
+		if (!s->connected || mqtt_buffer_count(s->buffer)) {
+			if (!mqtt_get_buffer(s)) goto error;
+			return mqtt_buffer_put(s->buffer,topic,message,retain);
+		}
+	}
+
+	if (!mqtt_pubmsg(s,topic,message,wait,retain,0)) return 0;
+
+	dprintf(dlevel,"calling reconnect!\n");
+	if (buffer) {
+		if (!mqtt_try_reconnect(s) && !mqtt_pubmsg(s,topic,message,wait,retain,0)) return 0;
+		if (mqtt_get_buffer(s) && !mqtt_buffer_put(s->buffer,topic,message,retain)) return 0;
+	} else {
+		if (!mqtt_reconnect(s) && !mqtt_pubmsg(s,topic,message,wait,retain,0)) return 0;
+	}
+error:
+	mqtt_count_error(s);
+	return 1;
+}
+
+int mqtt_pub(mqtt_session_t *s, char *topic, char *message, int wait, int retain) {
+	uint64_t start;
+	int r;
+
+	if (!s) return 1;
+	if (!s->pub_hist) return _mqtt_pub(s,topic,message,wait,retain);
+	start = monotime_us();
+	r = _mqtt_pub(s,topic,message,wait,retain);
+	stats_hist_since(s->pub_hist,start);
+	return r;
+}
+
+/* Publish with a correlation id (requests and their replies).  Not buffered -
+   a late reply is no use to anyone. */
+int mqtt_pubcorr(mqtt_session_t *s, char *topic, char *message, char *corrid) {
+	MQTTProperties props = MQTTProperties_initializer;
+	MQTTProperty property;
+	int r;
+
+	dprintf(dlevel,"topic: %s, corrid: %s\n", topic, corrid);
+
+	if (!s) return 1;
+	if (!s->enabled) return 0;
+	if (!corrid || !*corrid || s->v3) return mqtt_pub(s,topic,message,0,0);
+
+	property.identifier = MQTTPROPERTY_CODE_USER_PROPERTY;
+	property.value.data.data = "replyto";
+	property.value.data.len = strlen(property.value.data.data);
+	property.value.value.data = s->clientid;
+	property.value.value.len = strlen(property.value.value.data);
+	MQTTProperties_add(&props, &property);
+	property.value.data.data = "corrid";
+	property.value.data.len = strlen(property.value.data.data);
+	property.value.value.data = corrid;
+	property.value.value.len = strlen(property.value.value.data);
+	MQTTProperties_add(&props, &property);
+
+	r = mqtt_pubmsg(s,topic,message,0,0,&props);
+	if (r && !mqtt_reconnect(s)) r = mqtt_pubmsg(s,topic,message,0,0,&props);
+	if (r) mqtt_count_error(s);
+	MQTTProperties_free(&props);
+	return r;
+}
+
+/* Correlation id of the message being delivered (only valid inside the callback) */
+char *mqtt_get_corrid(mqtt_session_t *s) {
+	return (s && *s->corrid ? s->corrid : 0);
+}
+
+void mqtt_get_stats(mqtt_session_t *s, mqtt_stats_t *stats) {
+	if (!s) {
+		memset(stats,0,sizeof(*stats));
+		return;
+	}
+	pthread_mutex_lock(&s->pub_lock);
+	*stats = s->stats;
+	pthread_mutex_unlock(&s->pub_lock);
+	mqtt_buffer_get_stats(s->buffer,stats);
+}
+
 int mqtt_setcb(mqtt_session_t *s, void *ctx, MQTTClient_connectionLost *cl, MQTTClient_messageArrived *ma, MQTTClient_deliveryComplete *dc) {
 	int rc;
 
 	dprintf(dlevel,"s: %p, ctx: %p, ma: %p\n", s, ctx, ma);
 	rc = MQTTClient_setCallbacks(s->c, ctx, cl, ma, dc);
 	dprintf(dlevel,"rc: %d\n", rc);
+	/* Acks no longer come to us, so stop tracking the window */
+	if (!rc) s->window = 0;
 	if (rc) log_write(LOG_ERROR,"MQTTClient_setCallbacks: rc: %d\n", rc);
 	return rc;
 }
@@ -737,6 +1091,12 @@ static int mqtt_set_uri(void *ctx, config_property_t *p, void *old_value) {
 	return 0;
 }
 
+static int mqtt_qos_map_set(void *ctx, config_property_t *p, void *old_value) {
+	mqtt_session_t *s = ctx;
+
+	return mqtt_set_qos_map(s,s->qos_map_text);
+}
+
 void mqtt_add_props(mqtt_session_t *s, config_t *cp, char *name) {
 	config_property_t mqtt_props[] = {
 		/* name, type, dest, dsize, def, flags, scope, values, labels, units, scale, precision, trigger, arg */
@@ -745,6 +1105,13 @@ void mqtt_add_props(mqtt_session_t *s, config_t *cp, char *name) {
 		{ "mqtt_clientid", DATA_TYPE_STRING, s->clientid, sizeof(s->clientid)-1, "", 0, 0, 0, 0, 0, 0, 0 },
 		{ "mqtt_username", DATA_TYPE_STRING, s->username, sizeof(s->username)-1, "", 0, 0, 0, 0, 0, 0, 0 },
 		{ "mqtt_password", DATA_TYPE_STRING, s->password, sizeof(s->password)-1, "", 0, 0, 0, 0, 0, 0, 0 },
+		{ "mqtt_qos", DATA_TYPE_INT, &s->default_qos, 0, STRINGIFY(MQTT_DEFAULT_QOS), 0, "select", "0,1,2", 0, 0, 0, 0 },
+		{ "mqtt_qos_map", DATA_TYPE_STRING, s->qos_map_text, sizeof(s->qos_map_text)-1, MQTT_QOS_MAP, 0, 0, 0, 0, 0, 0, 0, mqtt_qos_map_set, s },
+		{ "mqtt_window", DATA_TYPE_INT, &s->window, 0, STRINGIFY(MQTT_WINDOW), 0, "range", "1,"STRINGIFY(MQTT_WINDOW_MAX)",1", 0, 0, 0, 0 },
+		{ "mqtt_buffer", DATA_TYPE_INT, &s->buffer_count, 0, STRINGIFY(MQTT_BUFFER_COUNT), 0, 0, 0, 0, 0, 0, 0 },
+		{ "mqtt_buffer_size", DATA_TYPE_INT, &s->buffer_size, 0, STRINGIFY(MQTT_BUFFER_SIZE), 0, 0, 0, 0, "KB", 0, 0 },
+		{ "mqtt_buffer_burst", DATA_TYPE_INT, &s->buffer_burst, 0, STRINGIFY(MQTT_BUFFER_BURST), 0, 0, 0, 0, 0, 0, 0 },
+		{ "mqtt_buffer_file", DATA_TYPE_STRING, s->buffer_file, sizeof(s->buffer_file)-1, "", 0, 0, 0, 0, 0, 0, 0 },
 		{ 0 }
 	};
 
@@ -834,10 +1201,12 @@ static JSBool js_mqtt_getprop(JSContext *cx, JSObject *obj, jsval id, jsval *rva
 			*rval = type_to_jsval(cx,DATA_TYPE_BOOL,&s->connected,0);
 			break;
 		case MQTT_PROPERTY_ID_MQ:
-			if (s->ctor)
+			if (s->ctor) {
+				inbox_drain(s->inbox,s->mq);
 				*rval = OBJECT_TO_JSVAL(js_create_messages_array(cx, obj, s->mq));
-			else
+			} else {
 				*rval = JSVAL_VOID;
+			}
 			break;
 		case MQTT_PROPERTY_ID_SUBS:
 			{
@@ -1095,12 +1464,18 @@ struct _getmsg_ctx {
 #if 1
 static void _js_mqtt_getmsg(void *_ctx, char *topic, char *message, int msglen, char *replyto) {
 	struct _getmsg_ctx *ctx = _ctx;
-	solard_message_t newmsg;
+	solard_message_t *msg;
 
 	dprintf(dlevel,"topic: %s\n", topic);
-	if (solard_getmsg(&newmsg,topic,message,msglen,replyto)) return;
-//	solard_message_dump(&newmsg,0);
-	list_add(ctx->s->mq,&newmsg,sizeof(newmsg));
+	msg = solard_message_new(topic,message,msglen,replyto);
+	if (!msg) return;
+//	solard_message_dump(msg,0);
+	if (rpc_intercept(ctx->s,msg) == 0) {
+		solard_message_unref(msg);
+		return;
+	}
+	/* Runs on the MQTT thread, JS drains it via mq */
+	inbox_put(ctx->s->inbox,msg);
 }
 #else
 static void _js_mqtt_getmsg(void *_ctx, char *topic, char *message, int msglen, char *replyto) {
@@ -1143,10 +1518,166 @@ static JSBool js_mqtt_purgemq(JSContext *cx, uintN argc, jsval *vp) {
 		JS_ReportError(cx,"js_mqtt_purgemq: mqtt private is null!\n");
 		return JS_FALSE;
 	}
+	inbox_drain(s->inbox,s->mq);
 	list_purge(s->mq);
 	return JS_TRUE;
 }
 
+struct js_mqtt_route_info {
+	JSContext *cx;
+	jsval func;
+};
+
+/* Handler returns false to leave the message in the queue */
+static int _js_mqtt_route_handler(void *ctx, solard_message_t *msg) {
+	struct js_mqtt_route_info *info = ctx;
+	JSObject *mobj;
+	jsval arg,rval;
+	JSBool ok;
+
+	mobj = js_message_new(info->cx, JS_GetGlobalObject(info->cx), msg);
+	if (!mobj) return 1;
+	arg = OBJECT_TO_JSVAL(mobj);
+	rval = JSVAL_VOID;
+	ok = JS_CallFunctionValue(info->cx, JS_GetGlobalObject(info->cx), info->func, 1, &arg, &rval);
+	dprintf(dlevel,"call ok: %d\n", ok);
+	if (!ok) return 1;
+	return (rval == JSVAL_FALSE);
+}
+
+static void _js_mqtt_route_free(void *ctx) {
+	struct js_mqtt_route_info *info = ctx;
+
+	JS_EngineRemoveRoot(info->cx,&info->func);
+	free(info);
+}
+
+static JSBool js_mqtt_route(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
+	mqtt_session_t *s;
+	struct js_mqtt_route_info *info;
+	char *pattern;
+	jsval func;
+	int r;
+
+	s = JS_GetPrivate(cx, obj);
+	if (!s) {
+		JS_ReportError(cx, "private is null!");
+		return JS_FALSE;
+	}
+	pattern = 0;
+	func = 0;
+	if (!JS_ConvertArguments(cx, argc, argv, "s v", &pattern, &func)) return JS_FALSE;
+	if (!VALUE_IS_FUNCTION(cx, func)) {
+		JS_free(cx,pattern);
+		JS_ReportError(cx, "route: arguments: required: topic(string), handler(function)");
+		return JS_FALSE;
+	}
+	if (!s->router) s->router = router_create();
+	info = malloc(sizeof(*info));
+	if (!s->router || !info) {
+		if (info) free(info);
+		JS_free(cx,pattern);
+		JS_ReportError(cx, "js_mqtt_route: internal error: malloc");
+		return JS_FALSE;
+	}
+	info->cx = cx;
+	info->func = func;
+	JS_EngineAddRoot(cx,"mqtt_route",&info->func);
+	r = router_add(s->router,pattern,_js_mqtt_route_handler,info,_js_mqtt_route_free);
+	if (r) _js_mqtt_route_free(info);
+	JS_free(cx,pattern);
+	*rval = BOOLEAN_TO_JSVAL(r == 0);
+	return JS_TRUE;
+}
+
+static JSBool js_mqtt_unroute(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
+	mqtt_session_t *s;
+	char *pattern;
+
+	s = JS_GetPrivate(cx, obj);
+	if (!s) {
+		JS_ReportError(cx, "private is null!");
+		return JS_FALSE;
+	}
+	pattern = 0;
+	if (!JS_ConvertArguments(cx, argc, argv, "s", &pattern)) return JS_FALSE;
+	*rval = BOOLEAN_TO_JSVAL(router_remove(s->router,pattern,0,0) == 0);
+	JS_free(cx,pattern);
+	return JS_TRUE;
+}
+
+/* Run the queue through the routes, removing what was handled */
+static JSBool js_mqtt_dispatch(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
+	mqtt_session_t *s;
+	solard_message_t *msg;
+	list_iter_t it;
+	int count;
+
+	s = JS_GetPrivate(cx, obj);
+	if (!s) {
+		JS_ReportError(cx, "private is null!");
+		return JS_FALSE;
+	}
+	count = 0;
+	if (s->ctor && s->router) {
+		inbox_drain(s->inbox,s->mq);
+		list_iter_init(&it,s->mq);
+		while((msg = list_iter_next(&it)) != 0) {
+			if (router_dispatch(s->router,msg)) {
+				list_delete(s->mq,msg);
+				count++;
+			}
+		}
+	}
+	*rval = INT_TO_JSVAL(count);
+	return JS_TRUE;
+}
+
+/* wait(timeout) - block until something is in the queue (ms, -1 = forever), returns the queue length */
+static JSBool js_mqtt_wait(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
+	mqtt_session_t *s;
+	int timeout;
+
+	s = JS_GetPrivate(cx, obj);
+	if (!s) {
+		JS_ReportError(cx, "private is null!");
+		return JS_FALSE;
+	}
+	timeout = RPC_DEFAULT_TIMEOUT;
+	if (!JS_ConvertArguments(cx, argc, argv, "/ i", &timeout)) return JS_FALSE;
+	*rval = INT_TO_JSVAL(s->ctor ? solard_message_wait(s->inbox,s->mq,timeout) : 0);
+	return JS_TRUE;
+}
+
+/* call(agent, request) - send request to agent, returns an RPCRequest to wait on */
+static JSBool js_mqtt_call(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
+	mqtt_session_t *s;
+	rpc_request_t *req;
+	char *agent,*request;
+	JSObject *newobj;
+
+	s = JS_GetPrivate(cx, obj);
+	if (!s) {
+		JS_ReportError(cx, "private is null!");
+		return JS_FALSE;
+	}
+	agent = request = 0;
+	if (!JS_ConvertArguments(cx, argc, argv, "s s", &agent, &request)) return JS_FALSE;
+	*rval = JSVAL_NULL;
+	req = (rpc_create(s) ? rpc_call(s->rpc,agent,request) : 0);
+	JS_free(cx,agent);
+	JS_free(cx,request);
+	if (!req) return JS_TRUE;
+	newobj = js_rpc_request_new(cx,obj,req);
+	if (!newobj) {
+		rpc_release(req);
+		JS_ReportError(cx, "js_mqtt_call: unable to create RPCRequest");
+		return JS_FALSE;
+	}
+	*rval = OBJECT_TO_JSVAL(newobj);
+	return JS_TRUE;
+}
+
 static JSBool js_mqtt_ctor(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
 	char *uri;
 //	jsval func,arg;
@@ -1195,6 +1726,11 @@ static JSBool js_mqtt_ctor(JSContext *cx, JSObject *obj, uintN argc, jsval *argv
 		return JS_FALSE;
 	}
 	ctx->s->ctor = true;
+	ctx->s->inbox = inbox_create(INBOX_DEFAULT_SIZE);
+	if (!ctx->s->inbox) {
+		JS_ReportError(cx, "js_mqtt_ctor: unable to create inbox");
+		return JS_FALSE;
+	}
 	mqtt_parse_config(ctx->s,uri ? uri : "localhost");
 	if (uri) JS_free(cx,uri);
 	ctx->s->enabled = true;
@@ -1239,6 +1775,11 @@ JSObject * js_InitMQTTClass(JSContext *cx, JSObject *global_object) {
 		{ "connect",js_mqtt_con,1 },
 		{ "reconnect",js_mqtt_rc,1 },
 		{ "resub",js_mqtt_rs,1 },
+		{ "route",js_mqtt_route,2 },
+		{ "unroute",js_mqtt_unroute,1 },
+		{ "dispatch",js_mqtt_dispatch,0 },
+		{ "call",js_mqtt_call,2 },
+		{ "wait",js_mqtt_wait,1 },
 		{ 0 }
 	};
 	JSObject *obj;
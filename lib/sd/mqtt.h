@@ -15,6 +15,8 @@ LICENSE file in the root directory of this source tree.
 
 /* We use the paho mqtt.c library */
 #include <MQTTClient.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #define MQTT_URI_LEN 128
 #define MQTT_USER_LEN 512
@@ -23,6 +25,58 @@ LICENSE file in the root directory of this source tree.
 #define MQTT_TOPIC_LEN 128
 #define MQTT_MAX_MESSAGE_SIZE 262144
 
+/* Publish defaults */
+#define MQTT_DEFAULT_QOS 1
+#define MQTT_QOS_MAP "Data=0,Config=1"	/* QoS by the last topic level */
+#define MQTT_WINDOW 16			/* Max unacked QoS 1/2 messages */
+#define MQTT_WINDOW_MAX 256
+#define MQTT_QOS_MAP_MAX 8
+
+/* Offline buffer defaults */
+#define MQTT_BUFFER_COUNT 1000		/* Max buffered messages (0 = disabled) */
+#define MQTT_BUFFER_SIZE 1024		/* Max buffered bytes (KB) */
+#define MQTT_BUFFER_BURST 50		/* Max replayed per publish */
+#define MQTT_RECONNECT_MIN 1000		/* Reconnect backoff (ms) */
+#define MQTT_RECONNECT_MAX 60000
+
+struct mqtt_qos_map {
+	char name[16];
+	int qos;
+};
+
+struct mqtt_inflight {
+	MQTTClient_deliveryToken token;
+	uint64_t start;			/* monotime_us when published */
+	bool busy;
+	bool pending;			/* publish call has not returned yet */
+};
+
+struct mqtt_stats {
+	unsigned long published;	/* Messages handed to the client */
+	unsigned long acked;		/* QoS 1/2 deliveries confirmed by the broker */
+	unsigned long dropped;		/* Unacked messages lost to a disconnect */
+	unsigned long errors;		/* Publish failures */
+	int inflight;			/* Currently unacked */
+	int inflight_max;		/* High water mark */
+	uint64_t ack_total;		/* Sum of ack latencies (us) */
+	uint64_t ack_max;		/* Worst ack latency (us) */
+	int buffer_depth;		/* Messages waiting for the broker */
+	unsigned long buffered;		/* Messages captured while offline */
+	unsigned long buffer_dropped;	/* Oldest messages lost to the buffer limits */
+	unsigned long coalesced;	/* Retained messages replaced by a newer value */
+	unsigned long replayed;		/* Buffered messages sent after reconnect */
+};
+typedef struct mqtt_stats mqtt_stats_t;
+
+struct mqtt_buffer;
+typedef struct mqtt_buffer mqtt_buffer_t;
+
+struct router;
+struct rpc;
+struct stats_hist;
+
+#define MQTT_CORRID_LEN 40
+
 typedef void (mqtt_callback_t)(void *ctx, char *topic, char *payload, int len, char *replyto);
 
 struct mqtt_session {
@@ -43,7 +97,35 @@ struct mqtt_session {
 	char errmsg[256];
 	/* for CTOR only */
 	bool ctor;
+	struct inbox *inbox;
 	list mq;
+	/* Publish pipeline */
+	int default_qos;
+	char qos_map_text[128];
+	struct mqtt_qos_map qos_map[MQTT_QOS_MAP_MAX];
+	int qos_map_count;
+	int window;			/* 0 = not tracked */
+	MQTTProperties pubprops;	/* replyto, built once per client */
+	pthread_mutex_t pub_lock;
+	pthread_cond_t pub_cond;
+	struct mqtt_inflight slots[MQTT_WINDOW_MAX];
+	MQTTClient_deliveryToken early[MQTT_WINDOW_MAX];	/* Acks that beat the publish call back */
+	int early_count;
+	int pending;			/* Slots whose publish call hasn't returned */
+	mqtt_stats_t stats;
+	/* Offline buffer */
+	int buffer_count;
+	int buffer_size;
+	int buffer_burst;
+	char buffer_file[256];
+	mqtt_buffer_t *buffer;
+	uint64_t reconnect_next;	/* monotime_ms of next reconnect attempt */
+	int reconnect_delay;
+	struct router *router;		/* JS routes (see router.h) */
+	char corrid[MQTT_CORRID_LEN];	/* corrid of the message being delivered */
+	struct rpc *rpc;		/* Pending requests (see rpc.h) */
+	struct stats_hist *pub_hist;	/* Time spent in mqtt_pub (us, see stats.h) */
+	struct stats_hist *ack_hist;	/* Broker ack latency (us) */
 };
 typedef struct mqtt_session mqtt_session_t;
 
@@ -86,9 +168,29 @@ int mqtt_unsub(mqtt_session_t *s, char *topic);
 int mqtt_setcb(mqtt_session_t *s, void *ctx, MQTTClient_connectionLost *cl, MQTTClient_messageArrived *ma, MQTTClient_deliveryComplete *dc);
 int mqtt_resub(mqtt_session_t *s);
 int mqtt_pub(mqtt_session_t *s, char *topic, char *message, int wait, int retain);
+int mqtt_pubcorr(mqtt_session_t *s, char *topic, char *message, char *corrid);
+char *mqtt_get_corrid(mqtt_session_t *s);
+int mqtt_set_qos_map(mqtt_session_t *s, char *map);
+void mqtt_get_stats(mqtt_session_t *s, mqtt_stats_t *stats);
+
+/* QoS 1/2 publish window: a slot is claimed before the publish call, released
+   with the token after it, and completed by the delivery callback */
+struct mqtt_inflight *mqtt_claim_slot(mqtt_session_t *s);
+void mqtt_release_slot(mqtt_session_t *s, struct mqtt_inflight *ip, MQTTClient_deliveryToken token, int ok);
+void mqtt_delivered(void *ctx, MQTTClient_deliveryToken token);
 void mqtt_set_lwt(mqtt_session_t *s, char *new_topic);
 
 int mqtt_dosend(mqtt_session_t *m, char *topic, char *message);
+
+/* mqtt_buffer.c */
+typedef int (mqtt_buffer_func_t)(void *ctx, char *topic, char *message, int retain);
+mqtt_buffer_t *mqtt_buffer_new(int max, int max_bytes, char *path);
+void mqtt_buffer_destroy(mqtt_buffer_t *b);
+int mqtt_buffer_put(mqtt_buffer_t *b, char *topic, char *message, int retain);
+int mqtt_buffer_count(mqtt_buffer_t *b);
+int mqtt_buffer_drain(mqtt_buffer_t *b, int max, mqtt_buffer_func_t *func, void *ctx);
+void mqtt_buffer_get_stats(mqtt_buffer_t *b, mqtt_stats_t *stats);
+
 int mqtt_fullsend(char *address, char *clientid, char *message, char *topic, char *user, char *pass);
 
 void mqtt_add_props(mqtt_session_t *, config_t *, char *);
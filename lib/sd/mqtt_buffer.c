@@ -0,0 +1,325 @@
+#ifdef MQTT
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "mqtt.h"
+#include "utils.h"
+#include "common.h"
+
+/* Outbound publishes captured while the broker is unreachable.  Messages are
+   kept in a fixed size ring, oldest first; a retained publish replaces any
+   buffered retained message for the same topic so only the latest state is
+   replayed.  When a journal file is given every message is appended to it
+   and the file is reloaded on the next start. */
+
+#define BUFFER_MAGIC 0x4D425546		/* MBUF */
+#define BUFFER_NOMSG 0xFFFFFFFF
+
+struct mqtt_buffer_entry {
+	char *topic;
+	char *message;			/* 0 = empty publish */
+	int len;			/* Bytes used (topic + message) */
+	bool retain;
+	bool live;			/* false = replaced by a later retained value */
+};
+
+struct mqtt_buffer_record {
+	uint32_t magic;
+	uint32_t topic_len;
+	uint32_t message_len;		/* BUFFER_NOMSG = empty publish */
+	uint32_t retain;
+};
+
+struct mqtt_buffer {
+	struct mqtt_buffer_entry *entries;
+	int max;			/* Max entries */
+	int max_bytes;
+	int head;			/* Oldest */
+	int count;			/* Used slots (live and dead) */
+	int live;
+	int bytes;
+	char path[256];
+	FILE *fp;			/* Journal */
+	long jbytes;			/* Journal size */
+	unsigned long buffered;
+	unsigned long dropped;
+	unsigned long coalesced;
+	unsigned long replayed;
+};
+
+static void _free_entry(mqtt_buffer_t *b, struct mqtt_buffer_entry *ep) {
+	if (ep->live) {
+		b->live--;
+		b->bytes -= ep->len;
+	}
+	free(ep->topic);
+	if (ep->message) free(ep->message);
+	memset(ep,0,sizeof(*ep));
+}
+
+/* Remove the oldest slot */
+static void _pop(mqtt_buffer_t *b, int drop) {
+	struct mqtt_buffer_entry *ep;
+
+	ep = &b->entries[b->head];
+	if (drop && ep->live) {
+		dprintf(dlevel,"dropping: %s\n", ep->topic);
+		b->dropped++;
+	}
+	_free_entry(b,ep);
+	b->head = (b->head + 1) % b->max;
+	b->count--;
+}
+
+static int _add(mqtt_buffer_t *b, char *topic, char *message, int retain) {
+	struct mqtt_buffer_entry *ep;
+	int i,idx,len;
+
+	len = strlen(topic) + (message ? strlen(message) : 0);
+	if (len > b->max_bytes) {
+		log_error("mqtt_buffer: message for %s too large (%d bytes)\n", topic, len);
+		b->dropped++;
+		return 1;
+	}
+
+	/* Only the latest retained value matters */
+	if (retain) {
+		for(i=0; i < b->count; i++) {
+			ep = &b->entries[(b->head + i) % b->max];
+			if (ep->live && ep->retain && strcmp(ep->topic,topic) == 0) {
+				dprintf(dlevel,"coalescing: %s\n", topic);
+				free(ep->topic);
+				if (ep->message) free(ep->message);
+				ep->topic = ep->message = 0;
+				ep->live = false;
+				b->live--;
+				b->bytes -= ep->len;
+				b->coalesced++;
+				break;
+			}
+		}
+	}
+
+	while(b->count && (b->count >= b->max || b->bytes + len > b->max_bytes)) _pop(b,1);
+
+	idx = (b->head + b->count) % b->max;
+	ep = &b->entries[idx];
+	ep->topic = strdup(topic);
+	ep->message = (message ? strdup(message) : 0);
+	if (!ep->topic || (message && !ep->message)) {
+		log_syserror("mqtt_buffer: strdup");
+		if (ep->topic) free(ep->topic);
+		if (ep->message) free(ep->message);
+		memset(ep,0,sizeof(*ep));
+		return 1;
+	}
+	ep->len = len;
+	ep->retain = (retain != 0);
+	ep->live = true;
+	b->count++;
+	b->live++;
+	b->bytes += len;
+	return 0;
+}
+
+static int _write_record(FILE *fp, char *topic, char *message, int retain, long *jbytes) {
+	struct mqtt_buffer_record rec;
+
+	rec.magic = BUFFER_MAGIC;
+	rec.topic_len = strlen(topic);
+	rec.message_len = (message ? strlen(message) : BUFFER_NOMSG);
+	rec.retain = retain;
+	if (fwrite(&rec,sizeof(rec),1,fp) != 1) return 1;
+	if (fwrite(topic,rec.topic_len,1,fp) != 1) return 1;
+	if (message && rec.message_len && fwrite(message,rec.message_len,1,fp) != 1) return 1;
+	*jbytes += sizeof(rec) + rec.topic_len + (message ? rec.message_len : 0);
+	return 0;
+}
+
+/* Rewrite the journal with just the live entries */
+static int _compact(mqtt_buffer_t *b) {
+	struct mqtt_buffer_entry *ep;
+	char temp[264];
+	FILE *fp;
+	int i;
+
+	if (!b->fp) return 0;
+	dprintf(dlevel,"live: %d\n", b->live);
+	if (!b->live) {
+		fflush(b->fp);
+		if (ftruncate(fileno(b->fp),0) < 0) log_syserror("mqtt_buffer: ftruncate(%s)",b->path);
+		rewind(b->fp);
+		b->jbytes = 0;
+		return 0;
+	}
+	snprintf(temp,sizeof(temp),"%s.tmp",b->path);
+	fp = fopen(temp,"w");
+	if (!fp) {
+		log_syserror("mqtt_buffer: fopen(%s)",temp);
+		return 1;
+	}
+	b->jbytes = 0;
+	for(i=0; i < b->count; i++) {
+		ep = &b->entries[(b->head + i) % b->max];
+		if (!ep->live) continue;
+		if (_write_record(fp,ep->topic,ep->message,ep->retain,&b->jbytes)) {
+			log_syserror("mqtt_buffer: write(%s)",temp);
+			fclose(fp);
+			unlink(temp);
+			return 1;
+		}
+	}
+	fclose(b->fp);
+	b->fp = 0;
+	if (rename(temp,b->path) < 0) {
+		log_syserror("mqtt_buffer: rename(%s,%s)",temp,b->path);
+		fclose(fp);
+		unlink(temp);
+		b->fp = fopen(b->path,"a");
+		return 1;
+	}
+	b->fp = fp;
+	return 0;
+}
+
+static int _load(mqtt_buffer_t *b) {
+	struct mqtt_buffer_record rec;
+	char *topic,*message;
+	FILE *fp;
+	int r;
+
+	fp = fopen(b->path,"r");
+	if (!fp) return 0;
+	r = 0;
+	while(fread(&rec,sizeof(rec),1,fp) == 1) {
+		if (rec.magic != BUFFER_MAGIC || rec.topic_len == 0 || rec.topic_len > MQTT_TOPIC_LEN ||
+		    (rec.message_len != BUFFER_NOMSG && rec.message_len > MQTT_MAX_MESSAGE_SIZE)) {
+			log_error("mqtt_buffer: %s: bad record, ignoring rest of file\n", b->path);
+			break;
+		}
+		topic = malloc(rec.topic_len+1);
+		message = (rec.message_len != BUFFER_NOMSG ? malloc(rec.message_len+1) : 0);
+		if (!topic || (rec.message_len != BUFFER_NOMSG && !message)) {
+			log_syserror("mqtt_buffer: malloc");
+			if (topic) free(topic);
+			if (message) free(message);
+			r = 1;
+			break;
+		}
+		if (fread(topic,rec.topic_len,1,fp) != 1 || (message && rec.message_len && fread(message,rec.message_len,1,fp) != 1)) {
+			log_error("mqtt_buffer: %s: short record, ignoring rest of file\n", b->path);
+			free(topic);
+			if (message) free(message);
+			break;
+		}
+		topic[rec.topic_len] = 0;
+		if (message) message[rec.message_len] = 0;
+		_add(b,topic,message,rec.retain);
+		free(topic);
+		if (message) free(message);
+	}
+	fclose(fp);
+	dprintf(dlevel,"loaded %d messages from %s\n", b->live, b->path);
+	return r;
+}
+
+mqtt_buffer_t *mqtt_buffer_new(int max, int max_bytes, char *path) {
+	mqtt_buffer_t *b;
+
+	dprintf(dlevel,"max: %d, max_bytes: %d, path: %s\n", max, max_bytes, path);
+	if (max < 1) return 0;
+
+	b = calloc(sizeof(*b),1);
+	if (!b) {
+		log_syserror("mqtt_buffer_new: calloc");
+		return 0;
+	}
+	b->entries = calloc(sizeof(struct mqtt_buffer_entry),max);
+	if (!b->entries) {
+		log_syserror("mqtt_buffer_new: calloc entries");
+		free(b);
+		return 0;
+	}
+	b->max = max;
+	b->max_bytes = (max_bytes > 0 ? max_bytes : MQTT_BUFFER_SIZE * 1024);
+	if (path && strlen(path)) {
+		strncpy(b->path,path,sizeof(b->path)-1);
+		_load(b);
+		/* Start the journal over with what survived */
+		b->fp = fopen(b->path,"a");
+		if (!b->fp) log_syserror("mqtt_buffer_new: fopen(%s)",b->path);
+		else _compact(b);
+	}
+	return b;
+}
+
+void mqtt_buffer_destroy(mqtt_buffer_t *b) {
+	if (!b) return;
+	while(b->count) _pop(b,0);
+	if (b->fp) fclose(b->fp);
+	free(b->entries);
+	free(b);
+}
+
+int mqtt_buffer_put(mqtt_buffer_t *b, char *topic, char *message, int retain) {
+
+	dprintf(dlevel,"topic: %s, retain: %d\n", topic, retain);
+	if (!b) return 1;
+	if (_add(b,topic,message,retain)) return 1;
+	b->buffered++;
+	if (b->fp) {
+		if (_write_record(b->fp,topic,message,retain,&b->jbytes) || fflush(b->fp)) log_syserror("mqtt_buffer: write(%s)",b->path);
+		/* Dropped and replaced messages are still in the journal */
+		else if (b->jbytes > 2L * b->max_bytes) _compact(b);
+	}
+	return 0;
+}
+
+int mqtt_buffer_count(mqtt_buffer_t *b) {
+	return (b ? b->live : 0);
+}
+
+/* Send up to max messages oldest first, stopping at the first failure */
+int mqtt_buffer_drain(mqtt_buffer_t *b, int max, mqtt_buffer_func_t *func, void *ctx) {
+	struct mqtt_buffer_entry *ep;
+	int sent;
+
+	if (!b) return 0;
+	dprintf(dlevel,"live: %d, max: %d\n", b->live, max);
+	sent = 0;
+	while(b->count && (max < 1 || sent < max)) {
+		ep = &b->entries[b->head];
+		if (ep->live) {
+			if (func(ctx,ep->topic,ep->message,ep->retain)) break;
+			sent++;
+			b->replayed++;
+		}
+		_pop(b,0);
+	}
+	if (sent) _compact(b);
+	dprintf(dlevel,"sent: %d, left: %d\n", sent, b->live);
+	return sent;
+}
+
+void mqtt_buffer_get_stats(mqtt_buffer_t *b, mqtt_stats_t *stats) {
+	if (!b) return;
+	stats->buffer_depth = b->live;
+	stats->buffered = b->buffered;
+	stats->buffer_dropped = b->dropped;
+	stats->coalesced = b->coalesced;
+	stats->replayed = b->replayed;
+}
+#endif
@@ -0,0 +1,347 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 6
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include "reactor.h"
+#include "list.h"
+#include "log.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#define REACTOR_EPOLL 1
+#elif !defined(__WIN32)
+#include <poll.h>
+#define REACTOR_POLL 1
+#else
+#include <windows.h>
+#endif
+
+struct reactor_fd {
+	int fd;
+	reactor_func_t *func;
+	void *ctx;
+};
+
+struct reactor {
+#ifdef REACTOR_EPOLL
+	int efd;			/* epoll fd */
+	int wfd;			/* eventfd for wakeups */
+	int tfd;			/* timerfd for deadlines */
+#elif defined(REACTOR_POLL)
+	int pipe[2];			/* wakeup pipe */
+#else
+	volatile int wake;
+#endif
+#if defined(REACTOR_EPOLL) || defined(REACTOR_POLL)
+	list fds;
+#endif
+};
+
+#ifdef REACTOR_EPOLL
+/* epoll data.ptr for our own fds (user fds have their reactor_fd) */
+static char reactor_wake_tag;
+static char reactor_timer_tag;
+#endif
+
+uint64_t monotime_us(void) {
+#ifdef __WIN32
+	LARGE_INTEGER freq, count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64_t)((count.QuadPart * 1000000) / freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+#endif
+}
+
+uint64_t monotime_ms(void) {
+	return monotime_us() / 1000;
+}
+
+reactor_t *reactor_create(void) {
+	reactor_t *r;
+
+	r = calloc(1,sizeof(*r));
+	if (!r) {
+		log_syserror("reactor_create: calloc");
+		return 0;
+	}
+#if defined(REACTOR_EPOLL) || defined(REACTOR_POLL)
+	r->fds = list_create();
+#endif
+#ifdef REACTOR_EPOLL
+	{
+		struct epoll_event ev;
+
+		r->wfd = r->tfd = -1;
+		r->efd = epoll_create1(EPOLL_CLOEXEC);
+		if (r->efd < 0) {
+			log_syserror("reactor_create: epoll_create1");
+			goto reactor_create_error;
+		}
+		r->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (r->wfd < 0) {
+			log_syserror("reactor_create: eventfd");
+			goto reactor_create_error;
+		}
+		r->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (r->tfd < 0) {
+			log_syserror("reactor_create: timerfd_create");
+			goto reactor_create_error;
+		}
+		memset(&ev,0,sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = &reactor_wake_tag;
+		if (epoll_ctl(r->efd, EPOLL_CTL_ADD, r->wfd, &ev) < 0) goto reactor_create_error;
+		ev.data.ptr = &reactor_timer_tag;
+		if (epoll_ctl(r->efd, EPOLL_CTL_ADD, r->tfd, &ev) < 0) goto reactor_create_error;
+	}
+#elif defined(REACTOR_POLL)
+	if (pipe(r->pipe) < 0) {
+		log_syserror("reactor_create: pipe");
+		goto reactor_create_error;
+	}
+	fcntl(r->pipe[0], F_SETFL, fcntl(r->pipe[0], F_GETFL) | O_NONBLOCK);
+	fcntl(r->pipe[1], F_SETFL, fcntl(r->pipe[1], F_GETFL) | O_NONBLOCK);
+#endif
+	dprintf(dlevel,"r: %p\n", r);
+	return r;
+
+#if defined(REACTOR_EPOLL) || defined(REACTOR_POLL)
+reactor_create_error:
+	reactor_destroy(r);
+	return 0;
+#endif
+}
+
+void reactor_destroy(reactor_t *r) {
+#if defined(REACTOR_EPOLL) || defined(REACTOR_POLL)
+	struct reactor_fd *rf;
+#endif
+
+	dprintf(dlevel,"r: %p\n", r);
+	if (!r) return;
+
+#ifdef REACTOR_EPOLL
+	if (r->tfd >= 0) close(r->tfd);
+	if (r->wfd >= 0) close(r->wfd);
+	if (r->efd >= 0) close(r->efd);
+#elif defined(REACTOR_POLL)
+	if (r->pipe[0] > 0) close(r->pipe[0]);
+	if (r->pipe[1] > 0) close(r->pipe[1]);
+#endif
+#if defined(REACTOR_EPOLL) || defined(REACTOR_POLL)
+	list_reset(r->fds);
+	while((rf = list_get_next(r->fds)) != 0) free(rf);
+	list_destroy(r->fds);
+#endif
+	free(r);
+}
+
+int reactor_add_fd(reactor_t *r, int fd, reactor_func_t *func, void *ctx) {
+#if defined(REACTOR_EPOLL) || defined(REACTOR_POLL)
+	struct reactor_fd *rf;
+
+	dprintf(dlevel,"r: %p, fd: %d\n", r, fd);
+	if (!r || fd < 0) return 1;
+
+	rf = calloc(1,sizeof(*rf));
+	if (!rf) {
+		log_syserror("reactor_add_fd: calloc");
+		return 1;
+	}
+	rf->fd = fd;
+	rf->func = func;
+	rf->ctx = ctx;
+#ifdef REACTOR_EPOLL
+	{
+		struct epoll_event ev;
+
+		memset(&ev,0,sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = rf;
+		if (epoll_ctl(r->efd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			log_syserror("reactor_add_fd: epoll_ctl");
+			free(rf);
+			return 1;
+		}
+	}
+#endif
+	list_add(r->fds,rf,0);
+	return 0;
+#else
+	/* No fd support */
+	return 1;
+#endif
+}
+
+int reactor_del_fd(reactor_t *r, int fd) {
+#if defined(REACTOR_EPOLL) || defined(REACTOR_POLL)
+	struct reactor_fd *rf;
+
+	dprintf(dlevel,"r: %p, fd: %d\n", r, fd);
+	if (!r) return 1;
+
+	list_reset(r->fds);
+	while((rf = list_get_next(r->fds)) != 0) {
+		if (rf->fd == fd) {
+#ifdef REACTOR_EPOLL
+			epoll_ctl(r->efd, EPOLL_CTL_DEL, fd, 0);
+#endif
+			list_delete(r->fds,rf);
+			free(rf);
+			return 0;
+		}
+	}
+#endif
+	return 1;
+}
+
+/* Safe to call from any thread */
+void reactor_wakeup(reactor_t *r) {
+	if (!r) return;
+#ifdef REACTOR_EPOLL
+	{
+		uint64_t one = 1;
+		if (write(r->wfd, &one, sizeof(one)) < 0 && errno != EAGAIN) log_syserror("reactor_wakeup: write");
+	}
+#elif defined(REACTOR_POLL)
+	if (write(r->pipe[1], "w", 1) < 0 && errno != EAGAIN) log_syserror("reactor_wakeup: write");
+#else
+	r->wake = 1;
+#endif
+}
+
+/* Wait until an fd is ready, we're woken up or the deadline (monotime_ms) passes; 0 = no deadline
+   Returns the number of events handled (0 = deadline reached), -1 on error */
+int reactor_wait(reactor_t *r, uint64_t deadline) {
+	int count;
+
+	if (!r) return -1;
+
+	dprintf(dlevel,"deadline: %llu, now: %llu\n", (unsigned long long)deadline, (unsigned long long)monotime_ms());
+	count = 0;
+#ifdef REACTOR_EPOLL
+	{
+		struct epoll_event events[16];
+		struct itimerspec its;
+		struct reactor_fd *rf;
+		uint64_t val;
+		int i,n;
+
+		memset(&its,0,sizeof(its));
+		/* an absolute deadline in the past fires immediately, 0 disarms */
+		if (deadline) {
+			its.it_value.tv_sec = deadline / 1000;
+			its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+		}
+		if (timerfd_settime(r->tfd, TFD_TIMER_ABSTIME, &its, 0) < 0) {
+			log_syserror("reactor_wait: timerfd_settime");
+			return -1;
+		}
+		do {
+			n = epoll_wait(r->efd, events, sizeof(events)/sizeof(events[0]), -1);
+		} while(n < 0 && errno == EINTR);
+		if (n < 0) {
+			log_syserror("reactor_wait: epoll_wait");
+			return -1;
+		}
+		for(i=0; i < n; i++) {
+			if (events[i].data.ptr == &reactor_wake_tag) {
+				while(read(r->wfd, &val, sizeof(val)) > 0);
+				count++;
+			} else if (events[i].data.ptr == &reactor_timer_tag) {
+				while(read(r->tfd, &val, sizeof(val)) > 0);
+			} else {
+				rf = events[i].data.ptr;
+				if (rf->func) rf->func(rf->ctx, rf->fd);
+				count++;
+			}
+		}
+	}
+#elif defined(REACTOR_POLL)
+	{
+		struct pollfd *pfds;
+		struct reactor_fd *rf;
+		uint64_t now;
+		char buf[64];
+		int i,n,nfds,timeout;
+
+		nfds = list_count(r->fds) + 1;
+		pfds = calloc(nfds,sizeof(*pfds));
+		if (!pfds) {
+			log_syserror("reactor_wait: calloc");
+			return -1;
+		}
+		pfds[0].fd = r->pipe[0];
+		pfds[0].events = POLLIN;
+		i = 1;
+		list_reset(r->fds);
+		while((rf = list_get_next(r->fds)) != 0) {
+			pfds[i].fd = rf->fd;
+			pfds[i].events = POLLIN;
+			i++;
+		}
+		if (deadline) {
+			now = monotime_ms();
+			timeout = (deadline > now ? (int)(deadline - now) : 0);
+		} else {
+			timeout = -1;
+		}
+		do {
+			n = poll(pfds, nfds, timeout);
+		} while(n < 0 && errno == EINTR);
+		if (n < 0) {
+			log_syserror("reactor_wait: poll");
+			free(pfds);
+			return -1;
+		}
+		if (pfds[0].revents & POLLIN) {
+			while(read(r->pipe[0], buf, sizeof(buf)) > 0);
+			count++;
+		}
+		i = 1;
+		list_reset(r->fds);
+		while((rf = list_get_next(r->fds)) != 0) {
+			if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				if (rf->func) rf->func(rf->ctx, rf->fd);
+				count++;
+			}
+			i++;
+		}
+		free(pfds);
+	}
+#else
+	/* No fd support, sleep in small slices so wakeups are still noticed */
+	while(!r->wake) {
+		if (deadline && monotime_ms() >= deadline) break;
+		Sleep(10);
+	}
+	if (r->wake) {
+		r->wake = 0;
+		count++;
+	}
+#endif
+	dprintf(dlevel,"count: %d\n", count);
+	return count;
+}
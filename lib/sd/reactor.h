@@ -0,0 +1,33 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_REACTOR_H
+#define __SD_REACTOR_H
+
+#include <stdint.h>
+
+/* Wait for fd readiness, a wakeup from another thread, or a monotonic deadline */
+
+typedef void (reactor_func_t)(void *ctx, int fd);
+
+struct reactor;
+typedef struct reactor reactor_t;
+
+reactor_t *reactor_create(void);
+void reactor_destroy(reactor_t *);
+int reactor_add_fd(reactor_t *, int fd, reactor_func_t *func, void *ctx);
+int reactor_del_fd(reactor_t *, int fd);
+void reactor_wakeup(reactor_t *);
+int reactor_wait(reactor_t *, uint64_t deadline);
+
+/* Monotonic clock (not affected by time changes) */
+uint64_t monotime_ms(void);
+uint64_t monotime_us(void);
+
+#endif /* __SD_REACTOR_H */
@@ -0,0 +1,551 @@
+#ifdef MQTT
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include <pthread.h>
+#include "common.h"
+#include "router.h"
+
+/* Level interning.  The table is shared by every router and is read from the
+   MQTT thread (message parsing) while routes are added on the agent thread. */
+
+struct topic_atom {
+	uint32_t hash;
+	uint32_t id;
+	char *name;
+	int len;
+};
+
+static pthread_mutex_t atom_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct topic_atom *atoms;
+static int atom_size;
+static int atom_count;
+static char **atom_names;		/* id -> name */
+static int atom_names_size;
+static uint32_t atom_gen;		/* Bumped on every new atom */
+
+#define ATOM_FIRST_ID 3			/* after NONE/PLUS/HASH */
+
+static uint32_t _hash(char *name, int len) {
+	uint32_t h;
+	int i;
+
+	h = 2166136261U;
+	for(i=0; i < len; i++) {
+		h ^= (uint8_t)name[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static struct topic_atom *_atom_find(uint32_t hash, char *name, int len) {
+	struct topic_atom *ap;
+	int i;
+
+	if (!atom_size) return 0;
+	for(i = hash & (atom_size-1); ; i = (i + 1) & (atom_size-1)) {
+		ap = &atoms[i];
+		if (!ap->name) return ap;
+		if (ap->hash == hash && ap->len == len && memcmp(ap->name,name,len) == 0) return ap;
+	}
+}
+
+static int _atom_grow(void) {
+	struct topic_atom *old,*ap;
+	int i,old_size;
+
+	old = atoms;
+	old_size = atom_size;
+	atom_size = (old_size ? old_size * 2 : 256);
+	atoms = calloc(atom_size,sizeof(*atoms));
+	if (!atoms) {
+		log_syserror("topic_intern: calloc");
+		atoms = old;
+		atom_size = old_size;
+		return 1;
+	}
+	for(i=0; i < old_size; i++) {
+		if (!old[i].name) continue;
+		ap = _atom_find(old[i].hash,old[i].name,old[i].len);
+		*ap = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+uint32_t topic_intern(char *name, int len) {
+	struct topic_atom *ap;
+	uint32_t hash,id;
+
+	if (len == 1 && *name == '+') return TOPIC_ID_PLUS;
+	if (len == 1 && *name == '#') return TOPIC_ID_HASH;
+
+	hash = _hash(name,len);
+	id = TOPIC_ID_NONE;
+	pthread_mutex_lock(&atom_lock);
+	if ((atom_count + 1) * 2 > atom_size && _atom_grow()) goto done;
+	ap = _atom_find(hash,name,len);
+	if (ap->name) {
+		id = ap->id;
+		goto done;
+	}
+	if (atom_count + ATOM_FIRST_ID >= atom_names_size) {
+		char **names;
+		int size;
+
+		size = (atom_names_size ? atom_names_size * 2 : 256);
+		names = realloc(atom_names,size * sizeof(char *));
+		if (!names) {
+			log_syserror("topic_intern: realloc");
+			goto done;
+		}
+		memset(&names[atom_names_size],0,(size - atom_names_size) * sizeof(char *));
+		atom_names = names;
+		atom_names_size = size;
+	}
+	ap->name = malloc(len+1);
+	if (!ap->name) {
+		log_syserror("topic_intern: malloc");
+		goto done;
+	}
+	memcpy(ap->name,name,len);
+	ap->name[len] = 0;
+	ap->len = len;
+	ap->hash = hash;
+	ap->id = atom_count + ATOM_FIRST_ID;
+	atom_names[ap->id] = ap->name;
+	atom_count++;
+	__atomic_store_n(&atom_gen, atom_gen + 1, __ATOMIC_RELEASE);
+	id = ap->id;
+	dprintf(dlevel,"interned %s as %d\n", ap->name, id);
+done:
+	pthread_mutex_unlock(&atom_lock);
+	return id;
+}
+
+uint32_t topic_lookup(char *name, int len) {
+	struct topic_atom *ap;
+	uint32_t hash,id;
+
+	hash = _hash(name,len);
+	pthread_mutex_lock(&atom_lock);
+	ap = _atom_find(hash,name,len);
+	id = (ap && ap->name ? ap->id : TOPIC_ID_NONE);
+	pthread_mutex_unlock(&atom_lock);
+	return id;
+}
+
+char *topic_name(uint32_t id) {
+	char *name;
+
+	switch(id) {
+	case TOPIC_ID_NONE: return "";
+	case TOPIC_ID_PLUS: return "+";
+	case TOPIC_ID_HASH: return "#";
+	}
+	pthread_mutex_lock(&atom_lock);
+	name = (id < atom_names_size && atom_names[id] ? atom_names[id] : "");
+	pthread_mutex_unlock(&atom_lock);
+	return name;
+}
+
+uint32_t topic_generation(void) {
+	return __atomic_load_n(&atom_gen, __ATOMIC_ACQUIRE);
+}
+
+/* Split topic on / in a single pass, looking up each level (levels is optional).
+   Past SOLARD_TOPIC_MAX_LEVELS only the first ones are kept and deep is set. */
+int topic_parse(solard_topic_t *t, char *topic, topic_level_t *levels) {
+	char *p,*s;
+
+	t->count = t->deep = 0;
+	/* Before the lookups, so an atom added during them makes it stale */
+	t->gen = topic_generation();
+	s = topic;
+	for(p = topic; ; p++) {
+		if (*p != '/' && *p != 0) continue;
+		if (t->count >= SOLARD_TOPIC_MAX_LEVELS) {
+			dprintf(dlevel,"%s: more than %d levels\n", topic, SOLARD_TOPIC_MAX_LEVELS);
+			t->deep = 1;
+			break;
+		}
+		if (levels) {
+			levels[t->count].name = s;
+			levels[t->count].len = p - s;
+		}
+		t->ids[t->count++] = topic_lookup(s,p - s);
+		if (!*p) break;
+		s = p + 1;
+	}
+	return 0;
+}
+
+/* MQTT topic match by string, for what doesn't fit the trie */
+int topic_match(char *pattern, char *topic) {
+	char *p,*t;
+
+	p = pattern;
+	t = topic;
+	while(1) {
+		/* # matches this level and everything under it */
+		if (p[0] == '#' && !p[1]) return 1;
+		if (p[0] == '+' && (p[1] == '/' || !p[1])) {
+			while(*t && *t != '/') t++;
+			p++;
+		} else {
+			while(*p && *p != '/' && *p == *t) {
+				p++;
+				t++;
+			}
+			if ((*p && *p != '/') || (*t && *t != '/')) return 0;
+		}
+		if (!*p) return !*t;
+		/* a/# also matches a */
+		if (!*t) return (strcmp(p,"/#") == 0);
+		p++;
+		t++;
+	}
+}
+
+/* Routes */
+
+struct router_handler {
+	solard_msghandler_t *func;	/* 0 = removed during dispatch */
+	void *ctx;
+	router_free_t *ctx_free;
+	char *pattern;			/* For matching deep topics */
+	struct router_handler *next;
+};
+
+struct router_node {
+	struct router_node *plus;	/* + child */
+	struct router_handler *handlers;	/* Pattern ends here */
+	struct router_handler *hash;	/* Pattern ends here with # */
+	struct router_node *all;	/* Every node, for destroy */
+};
+
+/* Child links, hashed on (parent, level id) */
+struct router_edge {
+	struct router_node *parent;
+	uint32_t id;
+	struct router_node *child;
+};
+
+struct router {
+	struct router_node root;
+	struct router_handler *deep;	/* Patterns too deep for the trie */
+	struct router_edge *edges;
+	int edge_size;
+	int edge_count;
+	int count;			/* Handlers */
+	int dispatching;
+	int dead;			/* Handlers removed while dispatching */
+};
+
+static inline int _edge_slot(router_t *r, struct router_node *parent, uint32_t id) {
+	return (((uintptr_t)parent >> 4) * 2654435761U ^ id * 2246822519U) & (r->edge_size-1);
+}
+
+static struct router_edge *_edge_find(router_t *r, struct router_node *parent, uint32_t id) {
+	struct router_edge *ep;
+	int i;
+
+	for(i = _edge_slot(r,parent,id); ; i = (i + 1) & (r->edge_size-1)) {
+		ep = &r->edges[i];
+		if (!ep->parent) return ep;
+		if (ep->parent == parent && ep->id == id) return ep;
+	}
+}
+
+static int _edge_grow(router_t *r) {
+	struct router_edge *old,*ep;
+	int i,old_size;
+
+	old = r->edges;
+	old_size = r->edge_size;
+	r->edge_size = (old_size ? old_size * 2 : 64);
+	r->edges = calloc(r->edge_size,sizeof(*r->edges));
+	if (!r->edges) {
+		log_syserror("router: calloc");
+		r->edges = old;
+		r->edge_size = old_size;
+		return 1;
+	}
+	for(i=0; i < old_size; i++) {
+		if (!old[i].parent) continue;
+		ep = _edge_find(r,old[i].parent,old[i].id);
+		*ep = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+static struct router_node *_new_node(router_t *r) {
+	struct router_node *n;
+
+	n = calloc(1,sizeof(*n));
+	if (!n) {
+		log_syserror("router: calloc");
+		return 0;
+	}
+	n->all = r->root.all;
+	r->root.all = n;
+	return n;
+}
+
+static struct router_node *_child(router_t *r, struct router_node *n, uint32_t id, int create) {
+	struct router_edge *ep;
+
+	if (id == TOPIC_ID_PLUS) {
+		if (!n->plus && create) n->plus = _new_node(r);
+		return n->plus;
+	}
+	if (!r->edge_size) {
+		if (!create || _edge_grow(r)) return 0;
+	}
+	ep = _edge_find(r,n,id);
+	if (ep->parent) return ep->child;
+	if (!create) return 0;
+	if ((r->edge_count + 1) * 2 > r->edge_size) {
+		if (_edge_grow(r)) return 0;
+		ep = _edge_find(r,n,id);
+	}
+	ep->child = _new_node(r);
+	if (!ep->child) return 0;
+	ep->parent = n;
+	ep->id = id;
+	r->edge_count++;
+	return ep->child;
+}
+
+/* Walk the pattern to the handler list it ends in */
+static struct router_handler **_pattern_list(router_t *r, char *pattern, int create) {
+	solard_topic_t t;
+	topic_level_t levels[SOLARD_TOPIC_MAX_LEVELS];
+	struct router_node *n;
+	uint32_t id;
+	int i;
+
+	/* Patterns intern their levels so messages can match them */
+	topic_parse(&t,pattern,levels);
+	if (t.deep) return &r->deep;
+	n = &r->root;
+	for(i=0; i < t.count; i++) {
+		if (levels[i].len == 1 && *levels[i].name == '+') id = TOPIC_ID_PLUS;
+		else if (levels[i].len == 1 && *levels[i].name == '#') id = TOPIC_ID_HASH;
+		else id = (create ? topic_intern(levels[i].name,levels[i].len) : t.ids[i]);
+		if (id == TOPIC_ID_NONE) return 0;
+		if (id == TOPIC_ID_HASH) {
+			if (i != t.count-1) {
+				log_error("router: %s: # must be the last level\n", pattern);
+				return 0;
+			}
+			return &n->hash;
+		}
+		n = _child(r,n,id,create);
+		if (!n) return 0;
+	}
+	return &n->handlers;
+}
+
+router_t *router_create(void) {
+	router_t *r;
+
+	r = calloc(1,sizeof(*r));
+	if (!r) {
+		log_syserror("router_create: calloc");
+		return 0;
+	}
+	return r;
+}
+
+static void _free_handlers(struct router_handler *h) {
+	struct router_handler *next;
+
+	while(h) {
+		next = h->next;
+		if (h->ctx_free) h->ctx_free(h->ctx);
+		free(h->pattern);
+		free(h);
+		h = next;
+	}
+}
+
+void router_destroy(router_t *r) {
+	struct router_node *n,*next;
+
+	if (!r) return;
+	_free_handlers(r->deep);
+	_free_handlers(r->root.handlers);
+	_free_handlers(r->root.hash);
+	for(n = r->root.all; n; n = next) {
+		next = n->all;
+		_free_handlers(n->handlers);
+		_free_handlers(n->hash);
+		free(n);
+	}
+	if (r->edges) free(r->edges);
+	free(r);
+}
+
+int router_add(router_t *r, char *pattern, solard_msghandler_t *func, void *ctx, router_free_t *ctx_free) {
+	struct router_handler **hp,*h;
+
+	dprintf(dlevel,"pattern: %s, func: %p, ctx: %p\n", pattern, func, ctx);
+	if (!r || !func) return 1;
+
+	hp = _pattern_list(r,pattern,1);
+	if (!hp) return 1;
+	h = calloc(1,sizeof(*h));
+	if (h) h->pattern = strdup(pattern);
+	if (!h || !h->pattern) {
+		log_syserror("router_add: calloc");
+		free(h);
+		return 1;
+	}
+	h->func = func;
+	h->ctx = ctx;
+	h->ctx_free = ctx_free;
+	while(*hp) hp = &(*hp)->next;
+	*hp = h;
+	r->count++;
+	return 0;
+}
+
+static void _reap(struct router_handler **hp) {
+	struct router_handler *h;
+
+	while((h = *hp) != 0) {
+		if (!h->func) {
+			*hp = h->next;
+			if (h->ctx_free) h->ctx_free(h->ctx);
+			free(h->pattern);
+			free(h);
+		} else {
+			hp = &h->next;
+		}
+	}
+}
+
+/* func 0 removes every handler on the pattern */
+int router_remove(router_t *r, char *pattern, solard_msghandler_t *func, void *ctx) {
+	struct router_handler **hp,*h;
+	int found;
+
+	dprintf(dlevel,"pattern: %s, func: %p, ctx: %p\n", pattern, func, ctx);
+	if (!r) return 1;
+
+	hp = _pattern_list(r,pattern,0);
+	if (!hp) return 1;
+	found = 0;
+	for(h = *hp; h; h = h->next) {
+		if (!h->func) continue;
+		if (hp == &r->deep && strcmp(h->pattern,pattern) != 0) continue;
+		if (func && (h->func != func || h->ctx != ctx)) continue;
+		h->func = 0;
+		r->count--;
+		found++;
+		if (func) break;
+	}
+	if (!found) return 1;
+	/* Don't pull it out from under a dispatch */
+	if (r->dispatching) r->dead = 1;
+	else _reap(hp);
+	return 0;
+}
+
+static int _call(struct router_handler *h, solard_message_t *msg) {
+	int handled;
+
+	handled = 0;
+	for(; h; h = h->next) {
+		if (h->func && h->func(h->ctx,msg) == 0) handled++;
+	}
+	return handled;
+}
+
+static int _call_match(struct router_handler *h, solard_message_t *msg) {
+	int handled;
+
+	handled = 0;
+	for(; h; h = h->next) {
+		if (h->func && topic_match(h->pattern,msg->topic) && h->func(h->ctx,msg) == 0) handled++;
+	}
+	return handled;
+}
+
+/* Deep topics can't be walked down the trie - try every pattern */
+static int _match_all(router_t *r, solard_message_t *msg) {
+	struct router_node *n;
+	int handled;
+
+	handled = _call_match(r->root.hash,msg) + _call_match(r->root.handlers,msg);
+	for(n = r->root.all; n; n = n->all) {
+		handled += _call_match(n->hash,msg);
+		handled += _call_match(n->handlers,msg);
+	}
+	return handled;
+}
+
+static int _match(router_t *r, struct router_node *n, solard_topic_t *t, int level, solard_message_t *msg) {
+	struct router_node *child;
+	int handled;
+
+	/* # also matches the parent level */
+	handled = _call(n->hash,msg);
+	if (level == t->count) return handled + _call(n->handlers,msg);
+	if (t->ids[level] != TOPIC_ID_NONE && r->edge_size) {
+		child = _child(r,n,t->ids[level],0);
+		if (child) handled += _match(r,child,t,level+1,msg);
+	}
+	if (n->plus) handled += _match(r,n->plus,t,level+1,msg);
+	return handled;
+}
+
+static void _reap_all(router_t *r) {
+	struct router_node *n;
+
+	_reap(&r->deep);
+	_reap(&r->root.handlers);
+	_reap(&r->root.hash);
+	for(n = r->root.all; n; n = n->all) {
+		_reap(&n->handlers);
+		_reap(&n->hash);
+	}
+	r->dead = 0;
+}
+
+/* Returns the number of handlers that consumed the message */
+int router_dispatch(router_t *r, solard_message_t *msg) {
+	solard_topic_t fresh,*t;
+	int handled;
+
+	if (!r || !msg || !msg->levels.count) return 0;
+	t = &msg->levels;
+	if (!t->deep && t->gen != topic_generation()) {
+		/* Levels were interned since it was parsed; the message may be shared, so not in place */
+		topic_parse(&fresh,msg->topic,0);
+		t = &fresh;
+	}
+	r->dispatching++;
+	if (t->deep) handled = _match_all(r,msg);
+	else handled = _match(r,&r->root,t,0,msg);
+	handled += _call_match(r->deep,msg);
+	if (--r->dispatching == 0 && r->dead) _reap_all(r);
+	dprintf(dlevel,"topic: %s, handled: %d\n", msg->topic, handled);
+	return handled;
+}
+
+int router_count(router_t *r) {
+	return (r ? r->count : 0);
+}
+#endif
@@ -0,0 +1,53 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_ROUTER_H
+#define __SD_ROUTER_H
+
+#include "message.h"
+
+/* Topic levels are interned into small integer ids so routing never compares
+   strings.  Only levels that appear in a route pattern are interned; any other
+   level parses to TOPIC_ID_NONE, which can only be matched by a wildcard.
+   Interning bumps a generation; a topic parsed in an older one is looked up
+   again when it's dispatched, so a route added after a message was received
+   still sees it.  Topics and patterns with more than SOLARD_TOPIC_MAX_LEVELS
+   levels are matched by string instead. */
+
+#define TOPIC_ID_NONE	0
+#define TOPIC_ID_PLUS	1		/* + */
+#define TOPIC_ID_HASH	2		/* # */
+
+struct topic_level {
+	char *name;			/* Points into the topic */
+	int len;
+};
+typedef struct topic_level topic_level_t;
+
+uint32_t topic_intern(char *name, int len);
+uint32_t topic_lookup(char *name, int len);
+char *topic_name(uint32_t id);
+uint32_t topic_generation(void);
+int topic_parse(solard_topic_t *t, char *topic, topic_level_t *levels);
+int topic_match(char *pattern, char *topic);
+
+/* Wildcard aware (+ and #) trie of topic patterns -> handlers.  A handler
+   returns 0 if it consumed the message. */
+struct router;
+typedef struct router router_t;
+typedef void (router_free_t)(void *ctx);
+
+router_t *router_create(void);
+void router_destroy(router_t *r);
+int router_add(router_t *r, char *pattern, solard_msghandler_t *func, void *ctx, router_free_t *ctx_free);
+int router_remove(router_t *r, char *pattern, solard_msghandler_t *func, void *ctx);
+int router_dispatch(router_t *r, solard_message_t *msg);
+int router_count(router_t *r);
+
+#endif /* __SD_ROUTER_H */
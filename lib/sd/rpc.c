@@ -0,0 +1,389 @@
+#ifdef MQTT
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+#include "common.h"
+#include "rpc.h"
+
+struct rpc_request {
+	rpc_t *r;
+	char corrid[MQTT_CORRID_LEN];
+	char agent[SOLARD_NAME_LEN];
+	uint64_t start;			/* monotime_us */
+	solard_message_t *reply;
+	pthread_cond_t cond;
+	struct rpc_request *next;
+};
+
+struct rpc {
+	mqtt_session_t *m;		/* 0 once the session is gone */
+	pthread_mutex_t lock;
+	rpc_request_t *pending;		/* Oldest first */
+	int refs;			/* Session + outstanding requests */
+	unsigned int seq;
+	unsigned int boot;
+	rpc_stats_t stats;
+};
+
+static void _rpc_unref(rpc_t *r) {
+	int refs;
+
+	pthread_mutex_lock(&r->lock);
+	refs = --r->refs;
+	pthread_mutex_unlock(&r->lock);
+	if (refs) return;
+	dprintf(dlevel,"freeing r: %p\n", r);
+	pthread_mutex_destroy(&r->lock);
+	free(r);
+}
+
+rpc_t *rpc_create(mqtt_session_t *m) {
+	char topic[SOLARD_TOPIC_LEN];
+	rpc_t *r;
+
+	dprintf(dlevel,"m: %p\n", m);
+	if (!m) return 0;
+	if (m->rpc) return m->rpc;
+
+	r = calloc(1,sizeof(*r));
+	if (!r) {
+		log_syserror("rpc_create: calloc");
+		return 0;
+	}
+	pthread_mutex_init(&r->lock,0);
+	r->m = m;
+	r->refs = 1;
+	r->boot = time(0);
+	m->rpc = r;
+
+	/* Replies come back to SolarD/Clients/<clientid>/<agent> */
+	snprintf(topic,sizeof(topic),"%s/%s/%s/+",SOLARD_TOPIC_ROOT,SOLARD_TOPIC_CLIENTS,m->clientid);
+	if (mqtt_sub(m,topic)) log_error("rpc_create: unable to subscribe to %s: %s\n", topic, m->errmsg);
+	return r;
+}
+
+/* Session is going away - requests still held by callers stay valid */
+void rpc_destroy(rpc_t *r) {
+	rpc_request_t *req;
+
+	if (!r) return;
+	pthread_mutex_lock(&r->lock);
+	if (r->m) r->m->rpc = 0;
+	r->m = 0;
+	for(req = r->pending; req; req = req->next) pthread_cond_broadcast(&req->cond);
+	pthread_mutex_unlock(&r->lock);
+	_rpc_unref(r);
+}
+
+rpc_request_t *rpc_call(rpc_t *r, char *agent, char *request) {
+	char topic[SOLARD_TOPIC_LEN];
+	rpc_request_t *req,**rp;
+	mqtt_session_t *m;
+
+	dprintf(dlevel,"agent: %s, request: %s\n", agent, request);
+	if (!r || !agent || !request) return 0;
+
+	req = calloc(1,sizeof(*req));
+	if (!req) {
+		log_syserror("rpc_call: calloc");
+		return 0;
+	}
+	pthread_cond_init(&req->cond,0);
+	strncpy(req->agent,agent,sizeof(req->agent)-1);
+	req->r = r;
+
+	/* Register before publishing so a fast reply can't beat us */
+	pthread_mutex_lock(&r->lock);
+	m = r->m;
+	if (!m) {
+		pthread_mutex_unlock(&r->lock);
+		pthread_cond_destroy(&req->cond);
+		free(req);
+		return 0;
+	}
+	snprintf(req->corrid,sizeof(req->corrid),"%x.%x",r->boot,++r->seq);
+	req->start = monotime_us();
+	for(rp = &r->pending; *rp; rp = &(*rp)->next);
+	*rp = req;
+	r->refs++;
+	r->stats.calls++;
+	pthread_mutex_unlock(&r->lock);
+
+	snprintf(topic,sizeof(topic),"%s/%s/%s",SOLARD_TOPIC_ROOT,SOLARD_TOPIC_AGENTS,agent);
+	dprintf(dlevel,"topic: %s, corrid: %s\n", topic, req->corrid);
+	if (mqtt_pubcorr(m,topic,request,req->corrid)) {
+		log_error("rpc_call: %s: %s\n", topic, m->errmsg);
+		rpc_release(req);
+		return 0;
+	}
+	return req;
+}
+
+/* Called from the MQTT thread; returns 0 if the message was a reply we were waiting for */
+int rpc_deliver(rpc_t *r, solard_message_t *msg) {
+	rpc_request_t *req;
+	char prefix[16],*agent;
+	uint64_t lat;
+
+	if (!r || !msg || msg->type != SOLARD_MESSAGE_TYPE_CLIENT) return 1;
+
+	/* Replies are SolarD/Clients/<clientid>/<agent> */
+	if (msg->levels.count != 4) return 1;
+	agent = strrchr(msg->topic,'/') + 1;
+	dprintf(dlevel,"agent: %s, corrid: %s\n", agent, msg->corrid);
+
+	pthread_mutex_lock(&r->lock);
+	for(req = r->pending; req; req = req->next) {
+		if (req->reply) continue;
+		if (*msg->corrid) {
+			if (strcmp(req->corrid,msg->corrid) == 0) break;
+		} else if (strcmp(req->agent,agent) == 0) {
+			break;
+		}
+	}
+	if (!req) {
+		/* One of ours that was given up on - swallow it */
+		snprintf(prefix,sizeof(prefix),"%x.",r->boot);
+		if (*msg->corrid && strncmp(msg->corrid,prefix,strlen(prefix)) == 0) {
+			r->stats.late++;
+			pthread_mutex_unlock(&r->lock);
+			return 0;
+		}
+		pthread_mutex_unlock(&r->lock);
+		return 1;
+	}
+	req->reply = solard_message_ref(msg);
+	lat = monotime_us() - req->start;
+	r->stats.replies++;
+	r->stats.lat_total += lat;
+	if (lat > r->stats.lat_max) r->stats.lat_max = lat;
+	pthread_cond_signal(&req->cond);
+	pthread_mutex_unlock(&r->lock);
+	dprintf(dlevel,"matched corrid %s in %llu us\n", req->corrid, (unsigned long long)lat);
+	return 0;
+}
+
+/* For the session message callbacks: tag msg with the corrid being delivered
+   and returns 0 if it was a reply to one of our requests */
+int rpc_intercept(mqtt_session_t *m, solard_message_t *msg) {
+	char *corrid;
+
+	if (!m) return 1;
+	corrid = mqtt_get_corrid(m);
+	if (corrid) strncpy(msg->corrid,corrid,sizeof(msg->corrid)-1);
+	return (m->rpc ? rpc_deliver(m->rpc,msg) : 1);
+}
+
+/* Wait up to timeout ms (< 0 = forever) for the reply.  Returns 0 if it arrived. */
+int rpc_wait(rpc_request_t *req, int timeout) {
+	struct timespec ts;
+	struct timeval tv;
+	rpc_t *r;
+	int rc;
+
+	if (!req) return 1;
+	r = req->r;
+	if (timeout >= 0) {
+		gettimeofday(&tv,0);
+		ts.tv_sec = tv.tv_sec + timeout / 1000;
+		ts.tv_nsec = (tv.tv_usec * 1000) + ((timeout % 1000) * 1000000);
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+	rc = 0;
+	pthread_mutex_lock(&r->lock);
+	while(!req->reply && r->m && rc == 0) {
+		if (timeout < 0) rc = pthread_cond_wait(&req->cond,&r->lock);
+		else rc = pthread_cond_timedwait(&req->cond,&r->lock,&ts);
+	}
+	rc = (req->reply == 0);
+	if (rc) r->stats.timeouts++;
+	pthread_mutex_unlock(&r->lock);
+	dprintf(dlevel,"corrid: %s, rc: %d\n", req->corrid, rc);
+	return rc;
+}
+
+int rpc_done(rpc_request_t *req) {
+	int done;
+
+	if (!req) return 1;
+	pthread_mutex_lock(&req->r->lock);
+	done = (req->reply != 0);
+	pthread_mutex_unlock(&req->r->lock);
+	return done;
+}
+
+/* The reply belongs to the request (valid until rpc_release) */
+solard_message_t *rpc_reply(rpc_request_t *req) {
+	solard_message_t *msg;
+
+	if (!req) return 0;
+	pthread_mutex_lock(&req->r->lock);
+	msg = req->reply;
+	pthread_mutex_unlock(&req->r->lock);
+	return msg;
+}
+
+void rpc_release(rpc_request_t *req) {
+	rpc_request_t **rp;
+	rpc_t *r;
+
+	if (!req) return;
+	r = req->r;
+	pthread_mutex_lock(&r->lock);
+	for(rp = &r->pending; *rp; rp = &(*rp)->next) {
+		if (*rp == req) {
+			*rp = req->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&r->lock);
+	solard_message_unref(req->reply);
+	pthread_cond_destroy(&req->cond);
+	free(req);
+	_rpc_unref(r);
+}
+
+void rpc_get_stats(rpc_t *r, rpc_stats_t *stats) {
+	if (!r) {
+		memset(stats,0,sizeof(*stats));
+		return;
+	}
+	pthread_mutex_lock(&r->lock);
+	*stats = r->stats;
+	pthread_mutex_unlock(&r->lock);
+}
+
+#ifdef JS
+enum RPC_REQUEST_PROPERTY_ID {
+	RPC_REQUEST_PROPERTY_ID_DONE=1,
+	RPC_REQUEST_PROPERTY_ID_CORRID,
+	RPC_REQUEST_PROPERTY_ID_AGENT,
+	RPC_REQUEST_PROPERTY_ID_DATA,
+};
+
+static JSBool rpc_request_getprop(JSContext *cx, JSObject *obj, jsval id, jsval *rval) {
+	rpc_request_t *req;
+	solard_message_t *msg;
+	int prop_id;
+
+	req = JS_GetPrivate(cx,obj);
+	if (!req) {
+		JS_ReportError(cx, "rpc_request_getprop: internal error: private is null!");
+		return JS_FALSE;
+	}
+	if(JSVAL_IS_INT(id)) {
+		prop_id = JSVAL_TO_INT(id);
+		dprintf(dlevel,"prop_id: %d\n", prop_id);
+		switch(prop_id) {
+		case RPC_REQUEST_PROPERTY_ID_DONE:
+			*rval = BOOLEAN_TO_JSVAL(rpc_done(req));
+			break;
+		case RPC_REQUEST_PROPERTY_ID_CORRID:
+			*rval = type_to_jsval(cx,DATA_TYPE_STRING,req->corrid,strlen(req->corrid));
+			break;
+		case RPC_REQUEST_PROPERTY_ID_AGENT:
+			*rval = type_to_jsval(cx,DATA_TYPE_STRING,req->agent,strlen(req->agent));
+			break;
+		case RPC_REQUEST_PROPERTY_ID_DATA:
+			msg = rpc_reply(req);
+			*rval = (msg ? type_to_jsval(cx,DATA_TYPE_STRING,msg->data,msg->size) : JSVAL_VOID);
+			break;
+		}
+	}
+	return JS_TRUE;
+}
+
+static void rpc_request_finalize(JSContext *cx, JSObject *obj) {
+	rpc_request_t *req;
+
+	req = JS_GetPrivate(cx,obj);
+	dprintf(dlevel,"req: %p\n", req);
+	if (req) {
+		JS_SetPrivate(cx,obj,0);
+		rpc_release(req);
+	}
+}
+
+static JSClass js_rpc_request_class = {
+	"RPCRequest",		/* Name */
+	JSCLASS_HAS_PRIVATE,	/* Flags */
+	JS_PropertyStub,	/* addProperty */
+	JS_PropertyStub,	/* delProperty */
+	rpc_request_getprop,	/* getProperty */
+	JS_PropertyStub,	/* setProperty */
+	JS_EnumerateStub,	/* enumerate */
+	JS_ResolveStub,		/* resolve */
+	JS_ConvertStub,		/* convert */
+	rpc_request_finalize,	/* finalize */
+	JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+/* wait([timeout ms]) - returns the reply data or undefined on timeout */
+static JSBool js_rpc_request_wait(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
+	rpc_request_t *req;
+	solard_message_t *msg;
+	int timeout;
+
+	req = JS_GetPrivate(cx,obj);
+	if (!req) {
+		JS_ReportError(cx, "js_rpc_request_wait: internal error: private is null!");
+		return JS_FALSE;
+	}
+	timeout = RPC_DEFAULT_TIMEOUT;
+	if (!JS_ConvertArguments(cx, argc, argv, "/ i", &timeout)) return JS_FALSE;
+	*rval = JSVAL_VOID;
+	if (rpc_wait(req,timeout) == 0) {
+		msg = rpc_reply(req);
+		*rval = type_to_jsval(cx,DATA_TYPE_STRING,msg->data,msg->size);
+	}
+	return JS_TRUE;
+}
+
+JSObject *js_InitRPCRequestClass(JSContext *cx, JSObject *parent) {
+	JSPropertySpec rpc_request_props[] = {
+		{ "done", RPC_REQUEST_PROPERTY_ID_DONE, JSPROP_ENUMERATE | JSPROP_READONLY },
+		{ "corrid", RPC_REQUEST_PROPERTY_ID_CORRID, JSPROP_ENUMERATE | JSPROP_READONLY },
+		{ "agent", RPC_REQUEST_PROPERTY_ID_AGENT, JSPROP_ENUMERATE | JSPROP_READONLY },
+		{ "data", RPC_REQUEST_PROPERTY_ID_DATA, JSPROP_ENUMERATE | JSPROP_READONLY },
+		{ 0 }
+	};
+	JSFunctionSpec rpc_request_funcs[] = {
+		{ "wait",js_rpc_request_wait,1 },
+		{ 0 }
+	};
+	JSObject *obj;
+
+	dprintf(2,"creating %s class\n", js_rpc_request_class.name);
+	obj = JS_InitClass(cx, parent, 0, &js_rpc_request_class, 0, 0, rpc_request_props, rpc_request_funcs, 0, 0);
+	if (!obj) {
+		JS_ReportError(cx,"unable to initialize %s class", js_rpc_request_class.name);
+		return 0;
+	}
+	dprintf(dlevel,"done!\n");
+	return obj;
+}
+
+JSObject *js_rpc_request_new(JSContext *cx, JSObject *parent, rpc_request_t *req) {
+	JSObject *newobj;
+
+	newobj = JS_NewObject(cx, &js_rpc_request_class, 0, parent);
+	if (!newobj) return 0;
+	JS_SetPrivate(cx,newobj,req);
+	return newobj;
+}
+#endif
+#endif
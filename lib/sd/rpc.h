@@ -0,0 +1,55 @@
+#ifdef MQTT
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_RPC_H
+#define __SD_RPC_H
+
+#include "message.h"
+
+/* Agent requests (config get/set/funcs).  Each request gets a correlation id
+   which the agent echoes in its reply; the MQTT thread hands the reply straight
+   to the waiting request and wakes it.  Replies from agents that don't echo the
+   id are matched to the oldest unanswered request for that agent. */
+
+#define RPC_DEFAULT_TIMEOUT 5000	/* ms */
+
+struct rpc;
+typedef struct rpc rpc_t;
+struct rpc_request;
+typedef struct rpc_request rpc_request_t;
+
+struct rpc_stats {
+	unsigned long calls;
+	unsigned long replies;
+	unsigned long timeouts;
+	unsigned long late;		/* Replies nobody was waiting for */
+	uint64_t lat_total;		/* Call to reply (us) */
+	uint64_t lat_max;
+};
+typedef struct rpc_stats rpc_stats_t;
+
+rpc_t *rpc_create(mqtt_session_t *m);
+void rpc_destroy(rpc_t *r);
+rpc_request_t *rpc_call(rpc_t *r, char *agent, char *request);
+int rpc_wait(rpc_request_t *req, int timeout);
+int rpc_done(rpc_request_t *req);
+solard_message_t *rpc_reply(rpc_request_t *req);
+void rpc_release(rpc_request_t *req);
+int rpc_deliver(rpc_t *r, solard_message_t *msg);
+int rpc_intercept(mqtt_session_t *m, solard_message_t *msg);
+void rpc_get_stats(rpc_t *r, rpc_stats_t *stats);
+
+#ifdef JS
+JSObject *js_InitRPCRequestClass(JSContext *cx, JSObject *parent);
+JSObject *js_rpc_request_new(JSContext *cx, JSObject *parent, rpc_request_t *req);
+#endif
+
+#endif /* __SD_RPC_H */
+#endif /* MQTT */
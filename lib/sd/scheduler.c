@@ -0,0 +1,299 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "reactor.h"
+#include "scheduler.h"
+
+struct scheduler_task {
+	scheduler_stats_t st;		/* name/period/priority/jitter/flags + counters */
+	scheduler_func_t *func;
+	void *ctx;
+	scheduler_free_t *ctx_free;
+	uint64_t deadline;		/* ms */
+	int slot;			/* -1 = not on the wheel */
+	int removed;
+	struct scheduler_task *wnext;	/* Slot chain */
+	struct scheduler_task *rnext;	/* Due this run */
+	struct scheduler_task *next;	/* All tasks */
+};
+
+struct scheduler {
+	scheduler_task_t *slots[SCHEDULER_SLOTS];
+	scheduler_task_t *tasks;
+	uint64_t tick;			/* Last tick processed */
+	int count;
+	int running;			/* In scheduler_run - removals are deferred */
+};
+
+static void _wheel_insert(scheduler_t *s, scheduler_task_t *t) {
+	uint64_t k;
+
+	/* Never before the deadline, never in a tick that's already been processed */
+	k = (t->deadline + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS;
+	if (k <= s->tick) k = s->tick + 1;
+	t->slot = k % SCHEDULER_SLOTS;
+	t->wnext = s->slots[t->slot];
+	s->slots[t->slot] = t;
+}
+
+static void _wheel_remove(scheduler_t *s, scheduler_task_t *t) {
+	scheduler_task_t **tp;
+
+	if (t->slot < 0) return;
+	for(tp = &s->slots[t->slot]; *tp; tp = &(*tp)->wnext) {
+		if (*tp == t) {
+			*tp = t->wnext;
+			break;
+		}
+	}
+	t->slot = -1;
+}
+
+static void _free_task(scheduler_task_t *t) {
+	if (t->ctx_free) t->ctx_free(t->ctx);
+	free(t);
+}
+
+/* Free removed tasks (not while running) */
+static void _reap(scheduler_t *s) {
+	scheduler_task_t **tp,*t;
+
+	tp = &s->tasks;
+	while((t = *tp) != 0) {
+		if (t->removed) {
+			*tp = t->next;
+			_wheel_remove(s,t);
+			dprintf(dlevel,"freeing: %s\n", t->st.name);
+			_free_task(t);
+			s->count--;
+		} else {
+			tp = &t->next;
+		}
+	}
+}
+
+scheduler_t *scheduler_create(void) {
+	scheduler_t *s;
+
+	s = calloc(1,sizeof(*s));
+	if (!s) {
+		log_syserror("scheduler_create: calloc");
+		return 0;
+	}
+	s->tick = monotime_ms() / SCHEDULER_TICK_MS;
+	return s;
+}
+
+void scheduler_destroy(scheduler_t *s) {
+	scheduler_task_t *t,*next;
+
+	if (!s) return;
+	for(t = s->tasks; t; t = next) {
+		next = t->next;
+		_free_task(t);
+	}
+	free(s);
+}
+
+scheduler_task_t *scheduler_find(scheduler_t *s, char *name) {
+	scheduler_task_t *t;
+
+	if (!s || !name) return 0;
+	for(t = s->tasks; t; t = t->next) {
+		if (!t->removed && strcmp(t->st.name,name) == 0) return t;
+	}
+	return 0;
+}
+
+/* Adding a task with the name of an existing one replaces it */
+scheduler_task_t *scheduler_add(scheduler_t *s, char *name, int period, int priority, int jitter, int flags,
+		scheduler_func_t *func, void *ctx, scheduler_free_t *ctx_free) {
+	scheduler_task_t *t;
+
+	dprintf(dlevel,"name: %s, period: %d, priority: %d, jitter: %d, flags: %x\n", name, period, priority, jitter, flags);
+	if (!s || !name || !*name || !func) return 0;
+	if (period < 1 && !(flags & SCHEDULER_FLAG_ONESHOT)) {
+		log_error("scheduler_add: %s: period must be > 0\n", name);
+		return 0;
+	}
+	if (period < 0) period = 0;
+
+	t = calloc(1,sizeof(*t));
+	if (!t) {
+		log_syserror("scheduler_add: calloc");
+		return 0;
+	}
+	scheduler_remove(s,name);
+	strncpy(t->st.name,name,sizeof(t->st.name)-1);
+	t->st.period = period;
+	t->st.priority = priority;
+	t->st.jitter = (jitter < 0 ? 0 : jitter);
+	t->st.flags = flags;
+	t->func = func;
+	t->ctx = ctx;
+	t->ctx_free = ctx_free;
+	t->deadline = monotime_ms() + period;
+	_wheel_insert(s,t);
+	t->next = s->tasks;
+	s->tasks = t;
+	s->count++;
+	return t;
+}
+
+int scheduler_remove(scheduler_t *s, char *name) {
+	scheduler_task_t *t;
+
+	t = scheduler_find(s,name);
+	if (!t) return 1;
+	dprintf(dlevel,"removing: %s\n", name);
+	t->removed = 1;
+	_wheel_remove(s,t);
+	if (!s->running) _reap(s);
+	return 0;
+}
+
+/* Restarts the period from now */
+int scheduler_set_period(scheduler_t *s, scheduler_task_t *t, int period) {
+	if (!s || !t || t->removed || period < 1) return 1;
+	t->st.period = period;
+	/* If it's due this run it'll be rescheduled with the new period */
+	if (t->slot < 0) return 0;
+	_wheel_remove(s,t);
+	t->deadline = monotime_ms() + period;
+	_wheel_insert(s,t);
+	return 0;
+}
+
+/* Insert into the due list, highest priority first then earliest deadline */
+static void _ready_add(scheduler_task_t **ready, scheduler_task_t *t) {
+	scheduler_task_t **tp;
+
+	for(tp = ready; *tp; tp = &(*tp)->rnext) {
+		if (t->st.priority > (*tp)->st.priority) break;
+		if (t->st.priority == (*tp)->st.priority && t->deadline < (*tp)->deadline) break;
+	}
+	t->rnext = *tp;
+	*tp = t;
+}
+
+/* Run everything due by now (ms); returns the number of tasks run */
+int scheduler_run(scheduler_t *s, uint64_t now) {
+	scheduler_task_t *ready,*t,**tp;
+	uint64_t cur,n,i,start,end,late,elapsed,k;
+	int count;
+
+	if (!s || !s->count) return 0;
+	cur = now / SCHEDULER_TICK_MS;
+	if (cur <= s->tick) return 0;
+
+	/* Collect from every tick since the last run (at most one full turn) */
+	ready = 0;
+	n = cur - s->tick;
+	if (n > SCHEDULER_SLOTS) n = SCHEDULER_SLOTS;
+	for(i = 1; i <= n; i++) {
+		tp = &s->slots[(s->tick + i) % SCHEDULER_SLOTS];
+		while((t = *tp) != 0) {
+			/* Later turns of the wheel stay put */
+			if (t->deadline > now) {
+				tp = &t->wnext;
+				continue;
+			}
+			*tp = t->wnext;
+			t->slot = -1;
+			_ready_add(&ready,t);
+		}
+	}
+	s->tick = cur;
+
+	count = 0;
+	s->running = 1;
+	while((t = ready) != 0) {
+		ready = t->rnext;
+		if (t->removed) continue;
+
+		start = monotime_us();
+		late = (start / 1000 > t->deadline ? (start / 1000) - t->deadline : 0);
+		if (late > t->st.jitter) {
+			dprintf(dlevel,"%s: late by %llu ms\n", t->st.name, (unsigned long long)late);
+			t->st.late++;
+		}
+		if (late > t->st.late_max) t->st.late_max = late;
+
+		t->func(t->ctx);
+
+		end = monotime_us();
+		elapsed = end - start;
+		t->st.runs++;
+		t->st.run_total += elapsed;
+		if (elapsed > t->st.run_max) t->st.run_max = elapsed;
+		count++;
+
+		if (t->removed) continue;
+		if (t->st.flags & SCHEDULER_FLAG_ONESHOT) {
+			t->removed = 1;
+			continue;
+		}
+
+		/* Stay on the original cadence; skip any periods we've already missed */
+		end /= 1000;
+		t->deadline += t->st.period;
+		if (t->deadline <= end) {
+			k = (end - t->deadline) / t->st.period + 1;
+			dprintf(dlevel,"%s: overrun, skipping %llu\n", t->st.name, (unsigned long long)k);
+			t->st.overruns++;
+			t->st.skipped += k;
+			t->deadline += k * t->st.period;
+		}
+		_wheel_insert(s,t);
+	}
+	s->running = 0;
+	_reap(s);
+	return count;
+}
+
+/* Next time (ms) scheduler_run has something to do, 0 if no tasks */
+uint64_t scheduler_next(scheduler_t *s) {
+	scheduler_task_t *t;
+	uint64_t next,min;
+
+	if (!s) return 0;
+	next = 0;
+	for(t = s->tasks; t; t = t->next) {
+		if (t->removed) continue;
+		if (!next || t->deadline < next) next = t->deadline;
+	}
+	if (!next) return 0;
+	/* Tasks run on tick boundaries */
+	next = ((next + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS) * SCHEDULER_TICK_MS;
+	min = (s->tick + 1) * SCHEDULER_TICK_MS;
+	return (next < min ? min : next);
+}
+
+int scheduler_count(scheduler_t *s) {
+	return (s ? s->count : 0);
+}
+
+int scheduler_get_stats(scheduler_t *s, scheduler_stats_t *stats, int max) {
+	scheduler_task_t *t;
+	int i;
+
+	if (!s) return 0;
+	i = 0;
+	for(t = s->tasks; t && i < max; t = t->next) {
+		if (t->removed) continue;
+		stats[i++] = t->st;
+	}
+	return i;
+}
@@ -0,0 +1,65 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_SCHEDULER_H
+#define __SD_SCHEDULER_H
+
+#include <stdint.h>
+
+/* Named periodic and one-shot tasks on the monotonic clock.  Tasks are kept in
+   a hashed timer wheel (SCHEDULER_SLOTS slots of SCHEDULER_TICK_MS each) so
+   adding or rescheduling one is O(1) no matter how many there are.  Tasks that
+   come due together run highest priority first.  A task that starts more than
+   its jitter budget after its deadline is counted late; one that misses whole
+   periods (or runs longer than its period) is counted as an overrun and skips
+   ahead rather than running back to back to catch up. */
+
+#define SCHEDULER_TICK_MS	10
+#define SCHEDULER_SLOTS		512
+#define SCHEDULER_NAME_LEN	32
+
+#define SCHEDULER_FLAG_ONESHOT	0x01		/* Run once then remove */
+
+typedef void (scheduler_func_t)(void *ctx);
+typedef void (scheduler_free_t)(void *ctx);
+
+struct scheduler;
+typedef struct scheduler scheduler_t;
+struct scheduler_task;
+typedef struct scheduler_task scheduler_task_t;
+
+struct scheduler_stats {
+	char name[SCHEDULER_NAME_LEN];
+	int period;			/* ms */
+	int priority;
+	int jitter;			/* ms */
+	int flags;
+	unsigned long runs;
+	unsigned long late;		/* Started more than jitter ms after the deadline */
+	unsigned long overruns;		/* Missed at least one whole period */
+	unsigned long skipped;		/* Periods missed */
+	uint64_t late_max;		/* ms */
+	uint64_t run_total;		/* us */
+	uint64_t run_max;		/* us */
+};
+typedef struct scheduler_stats scheduler_stats_t;
+
+scheduler_t *scheduler_create(void);
+void scheduler_destroy(scheduler_t *s);
+scheduler_task_t *scheduler_add(scheduler_t *s, char *name, int period, int priority, int jitter, int flags,
+		scheduler_func_t *func, void *ctx, scheduler_free_t *ctx_free);
+int scheduler_remove(scheduler_t *s, char *name);
+scheduler_task_t *scheduler_find(scheduler_t *s, char *name);
+int scheduler_set_period(scheduler_t *s, scheduler_task_t *t, int period);
+int scheduler_run(scheduler_t *s, uint64_t now);
+uint64_t scheduler_next(scheduler_t *s);
+int scheduler_count(scheduler_t *s);
+int scheduler_get_stats(scheduler_t *s, scheduler_stats_t *stats, int max);
+
+#endif /* __SD_SCHEDULER_H */
@@ -37,9 +37,7 @@ function sdconfig(instance,agent_name,func_name) {
 		dprintf(dlevel,"creating new instance ...\n");
 		sdm = sd.mqtt_instance = new MQTT(instance.mqtt.config);
 		dprintf(dlevel,"NEW sdm: %s\n", sdm);
-		let my_id = sdm.clientid;
-		dprintf(dlevel,"my clientid: %s\n", my_id);
-		sdm.sub(sprintf("%s/%s/%s/#",SOLARD_TOPIC_ROOT,SOLARD_TOPIC_CLIENTS,my_id));
+		dprintf(dlevel,"my clientid: %s\n", sdm.clientid);
     }
 
 	// Do we have this info already?
@@ -49,9 +47,9 @@ function sdconfig(instance,agent_name,func_name) {
 	let info = agent_info[agent_name];
 	dprintf(dlevel,"info: %s\n", info);
 	if (typeof(info) == 'undefined') {
-		// sub to the agent info topic
+		// sub to the agent info topic (retained) and wait for it to arrive
 		sdm.sub(info_topic);
-		delay(500);
+		sdm.wait();
 		dprintf(dlevel,"sdm.mq.length: %d\n", sdm.mq.length);
 		if (!sdm.mq.length) return _mkerror("unable to get info for agent "+agent_name);
 		for(let i=sdm.mq.length-1; i >= 0; i--) {
@@ -92,35 +90,18 @@ function sdconfig(instance,agent_name,func_name) {
 	if (func.nargs > 1) req += "]";
 	req += "]}"
 
-	/* XXX drain out any messages before sending new req */
-	delay(500);
-	sdm.purgemq();
-
+	// The reply is matched to this request by correlation id, so there is
+	// nothing to drain first and no polling of mq
 	dprintf(dlevel,"req: %s\n", req);
-	sdm.pub(agent_topic,req);
-	let retries = 10;
-	dprintf(dlevel,">>> sdm.mq.length: %d\n", sdm.mq.length);
-	while(retries--) {
-		if (sdm.mq.length) break;
-		delay(500);
-	}
-	dprintf(dlevel,"retries: %d\n", retries);
-	if (retries < 0) return _mkerror("agent "+agent_name+" not responding");;
-	dprintf(dlevel,"sdm.mq.length: %d\n", sdm.mq.length);
-	let data = "";
-	for(let i=sdm.mq.length-1; i >= 0; i--) {
-		msg = sdm.mq[i];
-//		dumpobj(msg);
-		dprintf(dlevel,"func: %s\n", msg.func);
-		if (msg.func.length) continue;
-		data = msg.data;
-	}
+	let h = sdm.call(agent_name,req);
+	if (!h) return _mkerror("unable to send request to agent "+agent_name);
+	let data = h.wait(5000);
+	if (typeof(data) == "undefined") return _mkerror("agent "+agent_name+" not responding");
     dprintf(dlevel,"data.length: %d\n", data.length);
-	if (!data.length) _mkerror("internal error: no data received");
+	if (!data.length) return _mkerror("internal error: no data received");
 	// JSON.parse returns FALSE and stops execution if json string is not valid - use test_json instead
 	if (!test_json(data)) return _mkerror("error parsing reply from agent "+agent_name);
 	let r = JSON.parse(data);
     if (debug >= dlevel) dumpobj(r,"agent reply");
-	sdm.purgemq();
 	return r;
 }
@@ -0,0 +1,402 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include "log.h"
+#include "shmdata.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SHMDATA_MAGIC		0x53444d53	/* SDMS */
+#define SHMDATA_VERSION		2
+#define SHMDATA_DIR		"/dev/shm"
+#define SHMDATA_READ_TRIES	1000		/* Give up if the writer died mid update */
+
+/* The sequence word sits on its own cache line so readers polling it don't
+   share a line with the (read mostly) identity fields, and the data starts on
+   a fresh line after it */
+struct shmdata_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t type;
+	uint32_t size;				/* Data size */
+	int32_t pid;				/* Writer (0 = closed) */
+	uint32_t interval;			/* Writer's update interval (ms), 0 = unknown */
+	char name[SHMDATA_NAME_LEN];
+	char agent[SHMDATA_NAME_LEN];		/* Writer's driver name */
+	uint32_t seq __attribute__((aligned(64)));	/* Odd = write in progress */
+	uint32_t waiters;			/* Readers sleeping on seq */
+	uint64_t updated;			/* Wall clock of the last write (us) */
+	unsigned char data[] __attribute__((aligned(64)));
+};
+
+struct shmdata {
+	struct shmdata_header *h;
+	size_t len;				/* Mapped length */
+	char path[SHMDATA_NAME_LEN+16];		/* shm_open name */
+	int writer;
+};
+
+static int _futex(uint32_t *addr, int op, uint32_t val, struct timespec *ts) {
+	return syscall(SYS_futex, addr, op, val, ts, 0, 0);
+}
+
+static uint64_t _now_us(void) {
+	struct timeval tv;
+
+	gettimeofday(&tv,0);
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static void _mkpath(char *path, int pathsz, char *name) {
+	char *p;
+
+	snprintf(path,pathsz,"/%s%s",SHMDATA_PREFIX,name);
+	/* shm names can't have any more slashes */
+	for(p = path+1; *p; p++) if (*p == '/') *p = '_';
+}
+
+shmdata_t *shmdata_create(char *name, char *agent, int type, int size) {
+	struct shmdata_header *h;
+	shmdata_t *sd;
+	size_t len;
+	int fd;
+
+	dprintf(dlevel,"name: %s, agent: %s, type: %d, size: %d\n", name, agent, type, size);
+	if (!name || !*name || size < 1) return 0;
+
+	sd = calloc(1,sizeof(*sd));
+	if (!sd) {
+		log_syserror("shmdata_create: calloc");
+		return 0;
+	}
+	_mkpath(sd->path,sizeof(sd->path),name);
+	len = sizeof(*h) + size;
+	fd = shm_open(sd->path, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		log_syserror("shmdata_create: shm_open(%s)",sd->path);
+		goto shmdata_create_error;
+	}
+	if (ftruncate(fd,len) < 0) {
+		log_syserror("shmdata_create: ftruncate(%s)",sd->path);
+		close(fd);
+		goto shmdata_create_error;
+	}
+	h = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (h == MAP_FAILED) {
+		log_syserror("shmdata_create: mmap(%s)",sd->path);
+		goto shmdata_create_error;
+	}
+
+	/* Left over from a previous run (maybe mid write) - keep seq moving forward */
+	if (h->magic != SHMDATA_MAGIC || h->version != SHMDATA_VERSION || h->type != type || h->size != size) {
+		memset(h,0,len);
+		h->magic = SHMDATA_MAGIC;
+		h->version = SHMDATA_VERSION;
+		h->type = type;
+		h->size = size;
+	}
+	strncpy(h->name,name,sizeof(h->name)-1);
+	if (agent) strncpy(h->agent,agent,sizeof(h->agent)-1);
+	h->pid = getpid();
+	if (h->seq & 1) __atomic_store_n(&h->seq, h->seq + 1, __ATOMIC_RELEASE);
+
+	sd->h = h;
+	sd->len = len;
+	sd->writer = 1;
+	return sd;
+
+shmdata_create_error:
+	free(sd);
+	return 0;
+}
+
+/* Single writer per segment */
+int shmdata_write(shmdata_t *sd, void *data) {
+	struct shmdata_header *h;
+	uint32_t seq;
+
+	if (!sd || !sd->writer) return 1;
+	h = sd->h;
+	seq = h->seq;
+	__atomic_store_n(&h->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(h->data,data,h->size);
+	__atomic_store_n(&h->updated, _now_us(), __ATOMIC_RELAXED);
+	/* seq_cst pairs with the waiter's increment so one side always sees the other */
+	__atomic_store_n(&h->seq, seq + 2, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&h->waiters, __ATOMIC_SEQ_CST)) _futex(&h->seq, FUTEX_WAKE, INT_MAX, 0);
+	return 0;
+}
+
+/* How often the writer updates (ms), so readers can tell when it's stalled */
+void shmdata_set_interval(shmdata_t *sd, int interval) {
+	if (!sd || !sd->writer) return;
+	__atomic_store_n(&sd->h->interval, (interval > 0 ? interval : 0), __ATOMIC_RELAXED);
+}
+
+shmdata_t *shmdata_open(char *name) {
+	struct shmdata_header *h;
+	struct stat st;
+	shmdata_t *sd;
+	int fd;
+
+	dprintf(dlevel,"name: %s\n", name);
+	if (!name || !*name) return 0;
+
+	sd = calloc(1,sizeof(*sd));
+	if (!sd) {
+		log_syserror("shmdata_open: calloc");
+		return 0;
+	}
+	_mkpath(sd->path,sizeof(sd->path),name);
+	/* RW so we can register as a waiter */
+	fd = shm_open(sd->path, O_RDWR, 0);
+	if (fd < 0) {
+		dprintf(dlevel,"shm_open(%s): %s\n", sd->path, strerror(errno));
+		goto shmdata_open_error;
+	}
+	if (fstat(fd,&st) < 0 || st.st_size < sizeof(*h)) {
+		close(fd);
+		goto shmdata_open_error;
+	}
+	h = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (h == MAP_FAILED) {
+		log_syserror("shmdata_open: mmap(%s)",sd->path);
+		goto shmdata_open_error;
+	}
+	if (h->magic != SHMDATA_MAGIC || h->version != SHMDATA_VERSION || sizeof(*h) + h->size > st.st_size) {
+		log_error("shmdata_open: %s: bad header\n", sd->path);
+		munmap(h,st.st_size);
+		goto shmdata_open_error;
+	}
+	sd->h = h;
+	sd->len = st.st_size;
+	return sd;
+
+shmdata_open_error:
+	free(sd);
+	return 0;
+}
+
+/* Seqlock read side for zero-copy access:
+	do { seq = shmdata_read_begin(sd); ... use shmdata_data(sd) ... } while(shmdata_read_retry(sd,seq));
+*/
+uint32_t shmdata_read_begin(shmdata_t *sd) {
+	uint32_t seq;
+
+	while((seq = __atomic_load_n(&sd->h->seq, __ATOMIC_ACQUIRE)) & 1) sched_yield();
+	return seq;
+}
+
+int shmdata_read_retry(shmdata_t *sd, uint32_t seq) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&sd->h->seq, __ATOMIC_RELAXED) != seq;
+}
+
+void *shmdata_data(shmdata_t *sd) {
+	return (sd ? sd->h->data : 0);
+}
+
+/* Copy out a consistent snapshot; seq (if given) gets the version copied */
+int shmdata_read(shmdata_t *sd, void *dest, int size, uint32_t *seq) {
+	struct shmdata_header *h;
+	uint32_t s1,s2;
+	int tries;
+
+	if (!sd) return 1;
+	h = sd->h;
+	if (size > h->size) size = h->size;
+	for(tries = 0; tries < SHMDATA_READ_TRIES; tries++) {
+		s1 = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE);
+		if (s1 & 1) {
+			sched_yield();
+			continue;
+		}
+		memcpy(dest,h->data,size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&h->seq, __ATOMIC_RELAXED);
+		if (s1 == s2) {
+			if (seq) *seq = s1;
+			/* Nothing written yet */
+			return (s1 == 0);
+		}
+	}
+	dprintf(dlevel,"%s: gave up after %d tries\n", sd->path, tries);
+	return 1;
+}
+
+/* Sleep until seq moves past the given value or timeout ms (< 0 = forever).  Returns 0 if it changed. */
+int shmdata_wait(shmdata_t *sd, uint32_t seq, int timeout) {
+	struct shmdata_header *h;
+	struct timespec ts,*tp;
+	uint32_t cur;
+	int r;
+
+	if (!sd) return 1;
+	h = sd->h;
+	tp = 0;
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
+		tp = &ts;
+	}
+	__atomic_add_fetch(&h->waiters, 1, __ATOMIC_SEQ_CST);
+	while(1) {
+		cur = __atomic_load_n(&h->seq, __ATOMIC_SEQ_CST);
+		/* Wait out a write in progress too */
+		if (cur != seq && !(cur & 1)) {
+			r = 0;
+			break;
+		}
+		/* Relative timeout restarts on a spurious wake - good enough for a data feed */
+		if (_futex(&h->seq, FUTEX_WAIT, cur, tp) < 0 && errno == ETIMEDOUT) {
+			r = 1;
+			break;
+		}
+	}
+	__atomic_sub_fetch(&h->waiters, 1, __ATOMIC_ACQ_REL);
+	return r;
+}
+
+void shmdata_close(shmdata_t *sd) {
+	struct shmdata_header *h;
+	uint32_t seq;
+
+	if (!sd) return;
+	dprintf(dlevel,"path: %s, writer: %d\n", sd->path, sd->writer);
+	if (sd->writer) {
+		/* Readers that still have it mapped see it closed and wake up to notice */
+		h = sd->h;
+		__atomic_store_n(&h->pid, 0, __ATOMIC_RELAXED);
+		seq = h->seq;
+		__atomic_store_n(&h->seq, (seq & 1 ? seq + 1 : seq + 2), __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&h->waiters, __ATOMIC_SEQ_CST)) _futex(&h->seq, FUTEX_WAKE, INT_MAX, 0);
+		/* Nobody should read data from a writer that's gone */
+		if (shm_unlink(sd->path) < 0) log_syserror("shmdata_close: shm_unlink(%s)",sd->path);
+	}
+	munmap(sd->h,sd->len);
+	free(sd);
+}
+
+char *shmdata_name(shmdata_t *sd) {
+	return (sd ? sd->h->name : 0);
+}
+
+char *shmdata_agent(shmdata_t *sd) {
+	return (sd ? sd->h->agent : 0);
+}
+
+int shmdata_type(shmdata_t *sd) {
+	return (sd ? sd->h->type : SHMDATA_TYPE_NONE);
+}
+
+int shmdata_size(shmdata_t *sd) {
+	return (sd ? sd->h->size : 0);
+}
+
+uint32_t shmdata_seq(shmdata_t *sd) {
+	return (sd ? __atomic_load_n(&sd->h->seq, __ATOMIC_ACQUIRE) : 0);
+}
+
+uint64_t shmdata_updated(shmdata_t *sd) {
+	return (sd ? __atomic_load_n(&sd->h->updated, __ATOMIC_RELAXED) : 0);
+}
+
+/* Is the writer still running and updating? */
+int shmdata_alive(shmdata_t *sd) {
+	uint64_t updated,maxage;
+	int32_t pid;
+
+	if (!sd) return 0;
+	pid = __atomic_load_n(&sd->h->pid, __ATOMIC_RELAXED);
+	if (!pid || (kill(pid,0) < 0 && errno != EPERM)) return 0;
+	/* Running but stuck (or stopped writing) is just as dead to a reader */
+	maxage = (uint64_t)__atomic_load_n(&sd->h->interval, __ATOMIC_RELAXED) * 1000 * SHMDATA_STALE_INTERVALS;
+	if (maxage) {
+		updated = shmdata_updated(sd);
+		if (!updated || _now_us() - updated > maxage) {
+			dprintf(dlevel,"%s: stale\n", sd->path);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int shmdata_scan(int type, shmdata_scan_func_t *func, void *ctx) {
+	struct shmdata_header h;
+	struct dirent *ent;
+	char path[300];
+	int fd,count,plen;
+	DIR *dir;
+
+	dir = opendir(SHMDATA_DIR);
+	if (!dir) return 0;
+	plen = strlen(SHMDATA_PREFIX);
+	count = 0;
+	while((ent = readdir(dir)) != 0) {
+		if (strncmp(ent->d_name,SHMDATA_PREFIX,plen) != 0) continue;
+		/* Just peek at the header */
+		snprintf(path,sizeof(path),"/%s",ent->d_name);
+		fd = shm_open(path, O_RDONLY, 0);
+		if (fd < 0) continue;
+		if (pread(fd,&h,sizeof(h),0) == sizeof(h) && h.magic == SHMDATA_MAGIC && h.version == SHMDATA_VERSION &&
+		    (!type || h.type == type)) {
+			dprintf(dlevel,"found: %s (type %d)\n", ent->d_name, h.type);
+			h.name[sizeof(h.name)-1] = 0;
+			count++;
+			if (func && func(ctx,h.name,h.type)) {
+				close(fd);
+				break;
+			}
+		}
+		close(fd);
+	}
+	closedir(dir);
+	return count;
+}
+#else
+shmdata_t *shmdata_create(char *name, char *agent, int type, int size) { return 0; }
+int shmdata_write(shmdata_t *sd, void *data) { return 1; }
+void shmdata_set_interval(shmdata_t *sd, int interval) { }
+shmdata_t *shmdata_open(char *name) { return 0; }
+int shmdata_read(shmdata_t *sd, void *dest, int size, uint32_t *seq) { return 1; }
+uint32_t shmdata_read_begin(shmdata_t *sd) { return 0; }
+int shmdata_read_retry(shmdata_t *sd, uint32_t seq) { return 0; }
+void *shmdata_data(shmdata_t *sd) { return 0; }
+int shmdata_wait(shmdata_t *sd, uint32_t seq, int timeout) { return 1; }
+void shmdata_close(shmdata_t *sd) { }
+char *shmdata_name(shmdata_t *sd) { return 0; }
+char *shmdata_agent(shmdata_t *sd) { return 0; }
+int shmdata_type(shmdata_t *sd) { return SHMDATA_TYPE_NONE; }
+int shmdata_size(shmdata_t *sd) { return 0; }
+uint32_t shmdata_seq(shmdata_t *sd) { return 0; }
+uint64_t shmdata_updated(shmdata_t *sd) { return 0; }
+int shmdata_alive(shmdata_t *sd) { return 0; }
+int shmdata_scan(int type, shmdata_scan_func_t *func, void *ctx) { return 0; }
+#endif
@@ -0,0 +1,62 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_SHMDATA_H
+#define __SD_SHMDATA_H
+
+#include <stdint.h>
+
+/* Local data plane.  An agent publishes its latest typed data (solard_battery_t,
+   solard_pvinverter_t, si_data_t, ...) into a named shared memory segment
+   (/dev/shm/solard.<name>) so consumers on the same host can read it without
+   going through the broker and JSON.  Each segment has a single writer and is
+   guarded by a seqlock; the sequence word doubles as a futex so readers can
+   sleep until the next update.  MQTT is still used for remote consumers. */
+
+#define SHMDATA_PREFIX		"solard."
+#define SHMDATA_NAME_LEN	32
+#define SHMDATA_STALE_INTERVALS	3	/* Writer is dead if it's missed this many updates */
+
+enum SHMDATA_TYPE {
+	SHMDATA_TYPE_NONE,
+	SHMDATA_TYPE_BATTERY,		/* solard_battery_t */
+	SHMDATA_TYPE_PVINVERTER,	/* solard_pvinverter_t */
+	SHMDATA_TYPE_AGENT,		/* Agent defined (e.g. si_data_t) - check agent and size */
+};
+
+struct shmdata;
+typedef struct shmdata shmdata_t;
+
+/* Writer */
+shmdata_t *shmdata_create(char *name, char *agent, int type, int size);
+int shmdata_write(shmdata_t *sd, void *data);
+void shmdata_set_interval(shmdata_t *sd, int interval);
+
+/* Reader */
+shmdata_t *shmdata_open(char *name);
+int shmdata_read(shmdata_t *sd, void *dest, int size, uint32_t *seq);
+uint32_t shmdata_read_begin(shmdata_t *sd);
+int shmdata_read_retry(shmdata_t *sd, uint32_t seq);
+void *shmdata_data(shmdata_t *sd);
+int shmdata_wait(shmdata_t *sd, uint32_t seq, int timeout);
+
+void shmdata_close(shmdata_t *sd);
+char *shmdata_name(shmdata_t *sd);
+char *shmdata_agent(shmdata_t *sd);
+int shmdata_type(shmdata_t *sd);
+int shmdata_size(shmdata_t *sd);
+uint32_t shmdata_seq(shmdata_t *sd);
+uint64_t shmdata_updated(shmdata_t *sd);
+int shmdata_alive(shmdata_t *sd);
+
+/* Call func for every segment of type (0 = all) on this host */
+typedef int (shmdata_scan_func_t)(void *ctx, char *name, int type);
+int shmdata_scan(int type, shmdata_scan_func_t *func, void *ctx);
+
+#endif /* __SD_SHMDATA_H */
@@ -0,0 +1,196 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#define dlevel 4
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "stats.h"
+
+struct stats {
+	pthread_mutex_t lock;
+	stats_hist_t *hist[STATS_MAX_HIST];
+	int count;
+};
+
+static int _bucket(uint64_t value) {
+	int e;
+
+	if (value < STATS_SUB_COUNT) return value;
+	if (value >> STATS_MAX_BITS) return STATS_BUCKETS - 1;
+	e = 63 - __builtin_clzll(value);
+	return ((e - STATS_SUB_BITS + 1) << STATS_SUB_BITS) + ((value >> (e - STATS_SUB_BITS)) & (STATS_SUB_COUNT - 1));
+}
+
+/* Highest value that lands in bucket i */
+static uint64_t _bucket_value(int i) {
+	int e,sub;
+
+	if (i < STATS_SUB_COUNT) return i;
+	e = (i >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+	sub = i & (STATS_SUB_COUNT - 1);
+	return (((uint64_t)(STATS_SUB_COUNT + sub) << (e - STATS_SUB_BITS)) + ((uint64_t)1 << (e - STATS_SUB_BITS))) - 1;
+}
+
+void stats_hist_record(stats_hist_t *h, uint64_t value) {
+	uint64_t cur;
+
+	if (!h) return;
+	__atomic_fetch_add(&h->buckets[_bucket(value)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+	cur = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	while(value > cur && !__atomic_compare_exchange_n(&h->max, &cur, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	/* min is stored +1 so 0 means unset */
+	cur = __atomic_load_n(&h->min, __ATOMIC_RELAXED);
+	while((!cur || value + 1 < cur) && !__atomic_compare_exchange_n(&h->min, &cur, value + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* Copy (and optionally clear) a histogram that may be being recorded to */
+void stats_hist_snapshot(stats_hist_t *h, stats_hist_t *dest, int reset) {
+	uint64_t count;
+	int i;
+
+	memcpy(dest->name,h->name,sizeof(dest->name));
+	memcpy(dest->unit,h->unit,sizeof(dest->unit));
+	count = 0;
+	for(i=0; i < STATS_BUCKETS; i++) {
+		if (reset) dest->buckets[i] = __atomic_exchange_n(&h->buckets[i], 0, __ATOMIC_RELAXED);
+		else dest->buckets[i] = __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+		count += dest->buckets[i];
+	}
+	if (reset) {
+		__atomic_exchange_n(&h->count, 0, __ATOMIC_RELAXED);
+		dest->sum = __atomic_exchange_n(&h->sum, 0, __ATOMIC_RELAXED);
+		dest->min = __atomic_exchange_n(&h->min, 0, __ATOMIC_RELAXED);
+		dest->max = __atomic_exchange_n(&h->max, 0, __ATOMIC_RELAXED);
+	} else {
+		dest->sum = __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+		dest->min = __atomic_load_n(&h->min, __ATOMIC_RELAXED);
+		dest->max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	}
+	/* The buckets are what the percentiles come from */
+	dest->count = count;
+	dest->min = (dest->min ? dest->min - 1 : 0);
+}
+
+uint64_t stats_hist_percentile(stats_hist_t *h, double pct) {
+	uint64_t want,seen,v;
+	int i;
+
+	if (!h->count) return 0;
+	want = (uint64_t)((pct / 100.0) * h->count + 0.5);
+	if (want < 1) want = 1;
+	if (want > h->count) want = h->count;
+	seen = 0;
+	for(i=0; i < STATS_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= want) break;
+	}
+	v = _bucket_value(i < STATS_BUCKETS ? i : STATS_BUCKETS - 1);
+	return (h->max && v > h->max ? h->max : v);
+}
+
+json_object_t *stats_hist_to_json(stats_hist_t *h) {
+	json_object_t *o;
+
+	o = json_create_object();
+	if (!o) return 0;
+	json_object_set_number(o,"count",h->count);
+	json_object_set_number(o,"min",h->min);
+	json_object_set_number(o,"mean",(h->count ? h->sum / h->count : 0));
+	json_object_set_number(o,"p50",stats_hist_percentile(h,50.0));
+	json_object_set_number(o,"p90",stats_hist_percentile(h,90.0));
+	json_object_set_number(o,"p99",stats_hist_percentile(h,99.0));
+	json_object_set_number(o,"max",h->max);
+	if (*h->unit) json_object_set_string(o,"unit",h->unit);
+	return o;
+}
+
+stats_t *stats_create(void) {
+	stats_t *s;
+
+	s = calloc(1,sizeof(*s));
+	if (!s) {
+		log_syserror("stats_create: calloc");
+		return 0;
+	}
+	pthread_mutex_init(&s->lock,0);
+	return s;
+}
+
+/* Whatever recorded into these must have let go of them first */
+void stats_destroy(stats_t *s) {
+	int i;
+
+	if (!s) return;
+	for(i=0; i < s->count; i++) free(s->hist[i]);
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
+
+/* Find or create */
+stats_hist_t *stats_get(stats_t *s, char *name, char *unit) {
+	stats_hist_t *h;
+	int i;
+
+	if (!s || !name) return 0;
+	h = 0;
+	pthread_mutex_lock(&s->lock);
+	for(i=0; i < s->count; i++) {
+		if (strcmp(s->hist[i]->name,name) == 0) {
+			h = s->hist[i];
+			goto done;
+		}
+	}
+	if (s->count >= STATS_MAX_HIST) {
+		log_error("stats_get: %s: too many histograms\n", name);
+		goto done;
+	}
+	h = calloc(1,sizeof(*h));
+	if (!h) {
+		log_syserror("stats_get: calloc");
+		goto done;
+	}
+	strncpy(h->name,name,sizeof(h->name)-1);
+	if (unit) strncpy(h->unit,unit,sizeof(h->unit)-1);
+	s->hist[s->count++] = h;
+done:
+	pthread_mutex_unlock(&s->lock);
+	return h;
+}
+
+/* { name: { count, min, mean, p50, p90, p99, max, unit }, ... } - histograms with no samples are left out */
+json_object_t *stats_to_json(stats_t *s, int reset) {
+	stats_hist_t *snap;
+	json_object_t *o,*ho;
+	int i,count;
+
+	o = json_create_object();
+	if (!o || !s) return o;
+	snap = malloc(sizeof(*snap));
+	if (!snap) {
+		log_syserror("stats_to_json: malloc");
+		return o;
+	}
+	pthread_mutex_lock(&s->lock);
+	count = s->count;
+	pthread_mutex_unlock(&s->lock);
+	for(i=0; i < count; i++) {
+		stats_hist_snapshot(s->hist[i],snap,reset);
+		if (!snap->count) continue;
+		ho = stats_hist_to_json(snap);
+		if (ho) json_object_set_object(o,snap->name,ho);
+	}
+	free(snap);
+	return o;
+}
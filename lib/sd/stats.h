@@ -0,0 +1,59 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_STATS_H
+#define __SD_STATS_H
+
+#include <stdint.h>
+#include "json.h"
+
+/* Runtime telemetry.  A stats_hist_t is a fixed size log-linear histogram
+   (HDR style): values below 16 are exact, above that each power of 2 is split
+   into 16 buckets so percentiles are within ~6%.  Recording is a handful of
+   atomic adds and never allocates, so it can be called from any thread.
+   Anything that records takes a stats_hist_t pointer and skips the clock reads
+   entirely when it's null - that is how stats are turned off. */
+
+#define STATS_SUB_BITS		4
+#define STATS_SUB_COUNT		(1 << STATS_SUB_BITS)
+#define STATS_MAX_BITS		40		/* Larger values are clamped */
+#define STATS_BUCKETS		((STATS_MAX_BITS - STATS_SUB_BITS + 1) * STATS_SUB_COUNT)
+#define STATS_NAME_LEN		32
+#define STATS_MAX_HIST		32
+
+struct stats_hist {
+	char name[STATS_NAME_LEN];
+	char unit[8];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint32_t buckets[STATS_BUCKETS];
+};
+typedef struct stats_hist stats_hist_t;
+
+struct stats;
+typedef struct stats stats_t;
+
+/* Histogram */
+void stats_hist_record(stats_hist_t *h, uint64_t value);
+void stats_hist_snapshot(stats_hist_t *h, stats_hist_t *dest, int reset);
+uint64_t stats_hist_percentile(stats_hist_t *h, double pct);
+json_object_t *stats_hist_to_json(stats_hist_t *h);
+
+/* Elapsed time since start (us), if h is set */
+#define stats_hist_since(h,start) do { if (h) stats_hist_record((h), monotime_us() - (start)); } while(0)
+
+/* A named set of histograms */
+stats_t *stats_create(void);
+void stats_destroy(stats_t *s);
+stats_hist_t *stats_get(stats_t *s, char *name, char *unit);
+json_object_t *stats_to_json(stats_t *s, int reset);
+
+#endif /* __SD_STATS_H */
@@ -0,0 +1,149 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#if !defined(WINDOWS) && !defined(__APPLE__)
+
+#include "sdtest.h"
+#include "canmux.h"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/can/raw.h>
+
+/* No CAN here: the bus gets one end of a socketpair, we play the wire on the other */
+static int wire = -1;
+
+/* Last kernel filter the bus asked for */
+static struct can_filter kfilters[8];
+static int kcount;
+
+int can_socket(char *interface, int bitrate) {
+	int sv[2];
+
+	if (socketpair(AF_UNIX,SOCK_DGRAM,0,sv) < 0) return -1;
+	wire = sv[1];
+	return sv[0];
+}
+
+int setsockopt(int fd, int level, int name, const void *val, socklen_t len) {
+	if (level != SOL_CAN_RAW) return syscall(SYS_setsockopt,fd,level,name,val,len);
+	if (name == CAN_RAW_FILTER) {
+		kcount = len / sizeof(struct can_filter);
+		if (kcount > 8) kcount = 8;
+		memcpy(kfilters,val,kcount * sizeof(struct can_filter));
+	}
+	return 0;
+}
+
+/* Is id/mask in the kernel filter */
+static int _kfilter(canid_t id, canid_t mask) {
+	int i;
+
+	for(i=0; i < kcount; i++) {
+		if (kfilters[i].can_id == id && kfilters[i].can_mask == mask) return 1;
+	}
+	return 0;
+}
+
+/* Put a frame on the wire */
+static int _send(canid_t id, uint8_t b) {
+	struct can_frame frame;
+
+	memset(&frame,0,sizeof(frame));
+	frame.can_id = id;
+	frame.can_dlc = 1;
+	frame.data[0] = b;
+	return (write(wire,&frame,sizeof(frame)) != sizeof(frame));
+}
+
+/* Next frame for sub is id (0 = nothing within timeout) */
+static int _recv(canmux_sub_t *sub, canid_t id, int timeout) {
+	struct can_frame frame;
+	uint64_t stamp;
+	int r;
+
+	r = canmux_read(sub,&frame,&stamp,timeout);
+	if (!id) return (r != 0);
+	if (r != sizeof(frame) || frame.can_id != id || !stamp) {
+		printf("want %03x, got %d (%03x)\n", id, r, r > 0 ? frame.can_id : 0);
+		return 1;
+	}
+	return 0;
+}
+
+int canmux_test(void) {
+	struct can_filter af[] = { { 0x300, 0x7f0 } };
+	struct can_filter bf[] = { { 0x351, 0x7ff }, { 0x300, 0x7f0 } };
+	canmux_sub_t *a,*b,*c;
+	struct can_frame frame;
+	struct timespec t0,t1;
+	int ms;
+
+	a = canmux_create();
+	b = canmux_create();
+	c = canmux_create();
+	CHECK(a && b && c);
+
+	/* Kernel filter is the union, without duplicates */
+	CHECK(canmux_filter(a,af,1) == 0);
+	CHECK(canmux_filter(b,bf,2) == 0);
+	CHECK(canmux_open(a,"can0",250000) == 0);
+	CHECK(kcount == 1 && _kfilter(0x300,0x7f0));
+	CHECK(canmux_open(b,"can0",250000) == 0);
+	CHECK(kcount == 2 && _kfilter(0x300,0x7f0) && _kfilter(0x351,0x7ff));
+	CHECK(canmux_fd(a) == canmux_fd(b));
+
+	/* Anyone wanting everything opens it right up */
+	CHECK(canmux_open(c,"can0",250000) == 0);
+	CHECK(kcount == 1 && _kfilter(0,0));
+
+	/* Each frame goes to everyone whose filters match */
+	CHECK(_send(0x305,1) == 0);
+	CHECK(_send(0x351,2) == 0);
+	CHECK(_send(0x400,3) == 0);
+	CHECK(_recv(a,0x305,1000) == 0);
+	CHECK(_recv(b,0x305,1000) == 0);
+	CHECK(_recv(b,0x351,1000) == 0);
+	CHECK(_recv(c,0x305,1000) == 0);
+	CHECK(_recv(c,0x351,1000) == 0);
+	CHECK(_recv(c,0x400,1000) == 0);
+	CHECK(_recv(a,0,50) == 0);
+	CHECK(_recv(b,0,50) == 0);
+
+	/* Written frames go out and to the others, not back to the writer */
+	memset(&frame,0,sizeof(frame));
+	frame.can_id = 0x351;
+	frame.can_dlc = 1;
+	CHECK(canmux_write(a,&frame) == sizeof(frame));
+	CHECK(read(wire,&frame,sizeof(frame)) == sizeof(frame) && frame.can_id == 0x351);
+	CHECK(_recv(b,0x351,0) == 0);
+	CHECK(_recv(c,0x351,0) == 0);
+	CHECK(_recv(a,0,0) == 0);
+
+	/* Timeout is a timeout */
+	clock_gettime(CLOCK_MONOTONIC,&t0);
+	CHECK(canmux_read(a,&frame,0,100) == 0);
+	clock_gettime(CLOCK_MONOTONIC,&t1);
+	ms = ((t1.tv_sec - t0.tv_sec) * 1000) + ((t1.tv_nsec - t0.tv_nsec) / 1000000);
+	CHECK(ms >= 90 && ms < 1000);
+
+	/* Leaving takes its filter out */
+	CHECK(canmux_close(c) == 0);
+	CHECK(kcount == 2);
+	CHECK(canmux_close(b) == 0);
+	CHECK(kcount == 1 && _kfilter(0x300,0x7f0));
+	CHECK(canmux_read(b,&frame,0,0) == -1);
+
+	canmux_destroy(a);
+	canmux_destroy(b);
+	canmux_destroy(c);
+	close(wire);
+	return 0;
+}
+#endif
@@ -0,0 +1,186 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "sdtest.h"
+#include "cansig.h"
+
+/* The SI 0x307 bits as the agent used to mask them: 16-bit word, mask */
+static struct {
+	char *name;
+	int word;
+	uint16_t mask;
+} si_bits[] = {
+	/* RS - relay state */
+	{ "relay1", 0, 0x0001 },
+	{ "relay2", 0, 0x0002 },
+	{ "s1_relay1", 0, 0x0004 },
+	{ "s1_relay2", 0, 0x0008 },
+	{ "s2_relay1", 0, 0x0010 },
+	{ "s2_relay2", 0, 0x0020 },
+	{ "s3_relay1", 0, 0x0040 },
+	{ "s3_relay2", 0, 0x0080 },
+	{ "GnRn", 0, 0x0100 },
+	{ "s1_GnRn", 0, 0x0200 },
+	{ "s2_GnRn", 0, 0x0400 },
+	{ "s3_GnRn", 0, 0x0800 },
+	/* RB1 - relay function bit 1 */
+	{ "AutoGn", 1, 0x0001 },
+	{ "AutoLodExt", 1, 0x0002 },
+	{ "AutoLodSoc", 1, 0x0004 },
+	{ "Tm1", 1, 0x0008 },
+	{ "Tm2", 1, 0x0010 },
+	{ "ExtPwrDer", 1, 0x0020 },
+	{ "ExtVfOk", 1, 0x0040 },
+	{ "GdOn", 1, 0x0080 },
+	{ "Error", 1, 0x0100 },
+	{ "Run", 1, 0x0200 },
+	{ "BatFan", 1, 0x0400 },
+	{ "AcdCir", 1, 0x0800 },
+	{ "MccBatFan", 1, 0x1000 },
+	{ "MccAutoLod", 1, 0x2000 },
+	{ "Chp", 1, 0x4000 },
+	{ "ChpAdd", 1, 0x8000 },
+	/* RB2 - relay function bit 2 */
+	{ "SiComRemote", 2, 0x0001 },
+	{ "OverLoad", 2, 0x0002 },
+	{ "ExtSrcConn", 2, 0x0100 },
+	{ "Silent", 2, 0x0200 },
+	{ "Current", 2, 0x0400 },
+	{ "FeedSelfC", 2, 0x0800 },
+	{ "Esave", 2, 0x1000 },
+	{ 0 }
+};
+#define NBITS ((sizeof(si_bits)/sizeof(si_bits[0]))-1)
+
+/* Set the word the way the SI sends it (little endian) */
+static void _setword(struct can_frame *frame, int word, uint16_t val) {
+	frame->data[word*2] = val & 0xff;
+	frame->data[(word*2)+1] = val >> 8;
+}
+
+/* Turn each old mask on in turn; only the matching signal may follow it */
+static int _si_bits(void) {
+	cansig_def_t defs[NBITS+1];
+	cansig_table_t *t;
+	struct can_frame frame;
+	int vals[NBITS],i,j,bit;
+
+	memset(defs,0,sizeof(defs));
+	for(i=0; i < NBITS; i++) {
+		for(bit=0; bit < 16 && !(si_bits[i].mask & (1 << bit)); bit++);
+		defs[i].name = si_bits[i].name;
+		defs[i].id = 0x307;
+		defs[i].start = (si_bits[i].word * 16) + bit;
+		defs[i].size = 1;
+		defs[i].scale = 1;
+		defs[i].unit = "";
+		defs[i].type = DATA_TYPE_BOOL;
+		defs[i].dest = &vals[i];
+	}
+	t = cansig_create(0x300,0x310);
+	CHECK(t != 0);
+	CHECK(cansig_add_table(t,defs) == 0);
+
+	memset(&frame,0,sizeof(frame));
+	frame.can_id = 0x307;
+	frame.can_dlc = 8;
+	for(i=0; i < NBITS; i++) {
+		memset(frame.data,0,sizeof(frame.data));
+		_setword(&frame,si_bits[i].word,si_bits[i].mask);
+		CHECK(cansig_decode(t,&frame) == NBITS);
+		for(j=0; j < NBITS; j++) {
+			if (vals[j] != (j == i)) {
+				printf("mask %s: %s = %d\n", si_bits[i].name, si_bits[j].name, vals[j]);
+				return 1;
+			}
+		}
+	}
+
+	/* All at once, against the old (word & mask) != 0 */
+	memset(frame.data,0,sizeof(frame.data));
+	_setword(&frame,0,0x0a5a);
+	_setword(&frame,1,0xc3a5);
+	_setword(&frame,2,0x1503);
+	CHECK(cansig_decode(t,&frame) == NBITS);
+	for(i=0; i < NBITS; i++) {
+		j = frame.data[si_bits[i].word*2] | (frame.data[(si_bits[i].word*2)+1] << 8);
+		CHECK(vals[i] == ((j & si_bits[i].mask) != 0));
+		CHECK(cansig_find(t,si_bits[i].name)->value == vals[i]);
+	}
+	cansig_destroy(t);
+	return 0;
+}
+
+int cansig_test(void) {
+	cansig_table_t *t;
+	struct can_frame frame;
+	double volts,temp;
+	uint8_t state;
+	cansig_t *sig;
+	cansig_def_t defs[] = {
+		{ "volts", 0x305, 0, 16, CANSIG_SIGNED, .1, 0, "V", DATA_TYPE_DOUBLE, &volts },
+		{ "temp", 0x305, 32, 16, CANSIG_SIGNED, .1, -40, "C", DATA_TYPE_DOUBLE, &temp },
+		{ "state", 0x306, 24, 8, 0, 1, 0, "", DATA_TYPE_U8, &state },
+		/* Big endian 12 bits, MSB at bit 7 of byte 0 */
+		{ "motorola", 0x308, 7, 12, CANSIG_MOTOROLA, 1, 0, "" },
+		{ 0 }
+	};
+
+	if (_si_bits()) return 1;
+
+	t = cansig_create(0x300,0x310);
+	CHECK(t != 0);
+	CHECK(cansig_add_table(t,defs) == 0);
+	memset(&frame,0,sizeof(frame));
+
+	/* Signed and scaled, little endian */
+	frame.can_id = 0x305;
+	frame.can_dlc = 8;
+	_setword(&frame,0,521);
+	_setword(&frame,2,(uint16_t)-55);
+	CHECK(cansig_decode(t,&frame) == 2);
+	CHECK(volts > 52.09 && volts < 52.11);
+	CHECK(temp > -45.51 && temp < -45.49);
+
+	/* A short frame leaves the signals past its end alone */
+	_setword(&frame,0,530);
+	_setword(&frame,2,100);
+	frame.can_dlc = 4;
+	CHECK(cansig_decode(t,&frame) == 1);
+	CHECK(volts > 52.99 && volts < 53.01);
+	CHECK(temp > -45.51 && temp < -45.49);
+	sig = cansig_find(t,"temp");
+	CHECK(sig != 0 && sig->count == 1);
+
+	/* Unsigned byte */
+	memset(frame.data,0,sizeof(frame.data));
+	frame.can_id = 0x306;
+	frame.can_dlc = 8;
+	frame.data[3] = 0xfe;
+	CHECK(cansig_decode(t,&frame) == 1);
+	CHECK(state == 0xfe);
+
+	/* Motorola: 0xabc in the top 12 bits */
+	memset(frame.data,0,sizeof(frame.data));
+	frame.can_id = 0x308;
+	frame.can_dlc = 2;
+	frame.data[0] = 0xab;
+	frame.data[1] = 0xcf;
+	CHECK(cansig_decode(t,&frame) == 1);
+	CHECK(cansig_find(t,"motorola")->value == 0xabc);
+
+	/* No signals on this id, or out of range */
+	frame.can_id = 0x30a;
+	CHECK(cansig_decode(t,&frame) == 0);
+	frame.can_id = 0x400;
+	CHECK(cansig_decode(t,&frame) == 0);
+
+	cansig_destroy(t);
+	return 0;
+}
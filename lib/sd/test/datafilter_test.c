@@ -0,0 +1,118 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "sdtest.h"
+
+#define LONG_NAME "a_field_name_that_is_longer_than_32"
+
+/* Apply data at now, returns what would be published (caller frees) */
+static char *_apply(datafilter_t *f, char *data, uint64_t now) {
+	json_value_t *v;
+	char *r;
+
+	v = json_parse(data);
+	if (!v) return 0;
+	r = datafilter_apply(f,json_value_object(v),now);
+	json_destroy_value(v);
+	return r;
+}
+
+/* Apply and check which fields were sent ("a,b,c" or 0 for nothing) */
+static int _expect(datafilter_t *f, char *data, uint64_t now, char *want) {
+	char names[256],*r;
+	json_value_t *v;
+	json_object_t *o;
+	int i,ok;
+
+	r = _apply(f,data,now);
+	*names = 0;
+	if (r) {
+		v = json_parse(r);
+		o = json_value_object(v);
+		for(i=0; o && i < o->count; i++) {
+			if (i) strcat(names,",");
+			strncat(names,o->names[i],sizeof(names)-strlen(names)-2);
+		}
+		json_destroy_value(v);
+	}
+	if (!want) ok = (r == 0);
+	else ok = (r && strcmp(names,want) == 0);
+	if (!ok) printf("at %d: %s: got %s, want %s\n", (int)now, data, r ? r : "(none)", want ? want : "(none)");
+	free(r);
+	return !ok;
+}
+
+/* Fold a published document into state and check one number */
+static int _merged(json_value_t **state, char *doc, char *name, double want) {
+	CHECK(datafilter_merge(state,json_parse(doc)) == 0);
+	CHECK(json_object_get_number(json_value_object(*state),name) == want);
+	return 0;
+}
+
+int datafilter_test(void) {
+	json_value_t *state;
+	datafilter_t *f;
+
+	f = datafilter_create();
+	CHECK(f != 0);
+	CHECK(datafilter_set_rules(f,"voltage=0.05,current=0.5:2:10,*=0.1," LONG_NAME "=1") == 0);
+	datafilter_set_keyframe(f,30);
+
+	/* Full mode: first is a keyframe, then only moves past a deadband publish */
+	CHECK(_expect(f,"{\"voltage\":52.1,\"current\":3.0,\"temps\":[20,21]}",1000,
+		"voltage,current,temps") == 0);
+	CHECK(_expect(f,"{\"voltage\":52.12,\"current\":3.2,\"temps\":[20,21.05]}",2000,0) == 0);
+	CHECK(_expect(f,"{\"voltage\":52.2,\"current\":3.0,\"temps\":[20,21]}",2500,
+		"voltage,current,temps") == 0);
+	/* Arrays use the default deadband element by element */
+	CHECK(_expect(f,"{\"voltage\":52.2,\"current\":3.0,\"temps\":[20,21.2]}",2600,
+		"voltage,current,temps") == 0);
+	/* current: not more often than 2s, at least every 10s */
+	CHECK(_expect(f,"{\"voltage\":52.2,\"current\":5.0,\"temps\":[20,21.2]}",2700,0) == 0);
+	CHECK(_expect(f,"{\"voltage\":52.2,\"current\":5.0,\"temps\":[20,21.2]}",4600,
+		"voltage,current,temps") == 0);
+	CHECK(_expect(f,"{\"voltage\":52.2,\"current\":5.0,\"temps\":[20,21.2]}",14000,0) == 0);
+	CHECK(_expect(f,"{\"voltage\":52.2,\"current\":5.0,\"temps\":[20,21.2]}",14600,
+		"voltage,current,temps") == 0);
+	/* A type change counts as a change */
+	CHECK(_expect(f,"{\"voltage\":\"n/a\",\"current\":5.0,\"temps\":[20,21.2]}",14700,
+		"voltage,current,temps") == 0);
+
+	/* Delta mode: keyframe, then just the changed fields, then a keyframe 30s on */
+	datafilter_set_delta(f,1);
+	state = 0;
+	CHECK(_expect(f,"{\"name\":\"b1\",\"voltage\":52.1,\"soc\":80}",40000,
+		"name,voltage,soc") == 0);
+	if (_merged(&state,"{\"name\":\"b1\",\"voltage\":52.1,\"soc\":80}","voltage",52.1)) return 1;
+	CHECK(_expect(f,"{\"name\":\"b1\",\"voltage\":52.3,\"soc\":80}",41000,
+		DATAFILTER_DELTA ",voltage") == 0);
+	if (_merged(&state,"{\"" DATAFILTER_DELTA "\":true,\"voltage\":52.3}","voltage",52.3)) return 1;
+	CHECK(json_object_get_number(json_value_object(state),"soc") == 80);
+	CHECK(json_object_get_value(json_value_object(state),DATAFILTER_DELTA) == 0);
+	CHECK(_expect(f,"{\"name\":\"b1\",\"voltage\":52.3,\"soc\":80}",42000,0) == 0);
+	CHECK(_expect(f,"{\"name\":\"b1\",\"voltage\":52.3,\"soc\":80}",69900,0) == 0);
+	CHECK(_expect(f,"{\"name\":\"b1\",\"voltage\":52.3,\"soc\":80}",70000,
+		"name,voltage,soc") == 0);
+	json_destroy_value(state);
+
+	/* A delta without a keyframe can't be used */
+	state = 0;
+	CHECK(datafilter_merge(&state,json_parse("{\"" DATAFILTER_DELTA "\":true,\"voltage\":1}")) == 1);
+	CHECK(state == 0);
+
+	/* Names too long to track are sent every time rather than mixed up */
+	datafilter_reset(f);
+	CHECK(_expect(f,"{\"voltage\":52.3,\"" LONG_NAME "1\":1,\"" LONG_NAME "2\":2}",80000,
+		"voltage," LONG_NAME "1," LONG_NAME "2") == 0);
+	CHECK(_expect(f,"{\"voltage\":52.3,\"" LONG_NAME "1\":1,\"" LONG_NAME "2\":2}",81000,
+		DATAFILTER_DELTA "," LONG_NAME "1," LONG_NAME "2") == 0);
+
+	datafilter_destroy(f);
+	return 0;
+}
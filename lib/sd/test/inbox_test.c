@@ -0,0 +1,164 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifdef MQTT
+
+#include <pthread.h>
+#include "sdtest.h"
+
+#define INBOX_TEST_PRODUCERS	4
+#define INBOX_TEST_COUNT	20000
+
+static inbox_t *_ib;
+
+static int _put(inbox_t *ib, char *topic, int val) {
+	char data[16];
+
+	sprintf(data,"%d",val);
+	return inbox_put(ib,solard_message_new(topic,data,strlen(data),0));
+}
+
+/* Drain and check the values are first, first+1, ... */
+static int _expect(inbox_t *ib, list mq, int first, int count) {
+	solard_message_t *msg;
+	int n;
+
+	CHECK(inbox_drain(ib,mq) == count);
+	n = 0;
+	list_reset(mq);
+	while((msg = list_get_next(mq)) != 0) {
+		CHECK(atoi(msg->data) == first + n);
+		n++;
+	}
+	CHECK(n == count);
+	list_purge(mq);
+	return 0;
+}
+
+static void *_producer(void *arg) {
+	char topic[64];
+	long id = (long)arg;
+	int i;
+
+	sprintf(topic,"SolarD/Agents/p%ld/Data",id);
+	for(i=0; i < INBOX_TEST_COUNT; i++) _put(_ib,topic,i);
+	return 0;
+}
+
+/* Reply for the waiter after a while */
+static void *_replier(void *arg) {
+	solard_message_t *msg;
+
+	usleep(50000);
+	_put(_ib,"SolarD/Agents/other/Data",0);
+	msg = solard_message_new("SolarD/Clients/1234/si","1",1,"req-1");
+	inbox_put(_ib,msg);
+	return 0;
+}
+
+int inbox_test(void) {
+	pthread_t th[INBOX_TEST_PRODUCERS];
+	int last[INBOX_TEST_PRODUCERS];
+	inbox_stats_t stats;
+	solard_message_t *msg;
+	inbox_t *ib;
+	uint64_t t;
+	list mq;
+	int i,j,p,v,running;
+
+	mq = solard_message_list_create();
+
+	/* Rounded up to a power of 2 */
+	ib = inbox_create(3);
+	CHECK(ib != 0);
+
+	/* Wrap: many times round a small ring */
+	for(i=0; i < 1000; i++) {
+		for(j=0; j < 3; j++) CHECK(_put(ib,"SolarD/Agents/si/Data",(i*3)+j) == 0);
+		if (_expect(ib,mq,i*3,3)) return 1;
+	}
+
+	/* Overflow: the oldest go, the newest 4 are kept */
+	for(i=0; i < 10; i++) CHECK(_put(ib,"SolarD/Agents/si/Data",i) == 0);
+	inbox_get_stats(ib,&stats);
+	CHECK(stats.dropped == 6);
+	if (_expect(ib,mq,6,4)) return 1;
+	CHECK(inbox_drain(ib,mq) == 0);
+
+	/* Latest: only the newest of a matching topic is kept */
+	CHECK(inbox_set_latest(ib,"SolarD/Agents/a/#") == 0);
+	_put(ib,"SolarD/Agents/a/Data",1);
+	_put(ib,"SolarD/Agents/b/Data",2);
+	_put(ib,"SolarD/Agents/a/Data",3);
+	CHECK(inbox_drain(ib,mq) == 3);
+	CHECK(list_count(mq) == 2);
+	list_reset(mq);
+	msg = list_get_next(mq);
+	CHECK(strcmp(msg->topic,"SolarD/Agents/b/Data") == 0);
+	msg = list_get_next(mq);
+	CHECK(atoi(msg->data) == 3);
+	list_purge(mq);
+	inbox_get_stats(ib,&stats);
+	CHECK(stats.coalesced == 1);
+	CHECK(inbox_set_latest(ib,"") == 0);
+
+	/* Undrained messages are released */
+	_put(ib,"SolarD/Agents/si/Data",1);
+	inbox_destroy(ib);
+
+	/* Producers overrunning the consumer: each producer's messages stay in order */
+	_ib = ib = inbox_create(64);
+	for(p=0; p < INBOX_TEST_PRODUCERS; p++) {
+		last[p] = -1;
+		pthread_create(&th[p],0,_producer,(void *)(long)p);
+	}
+	running = 1;
+	while(running) {
+		inbox_get_stats(ib,&stats);
+		running = (stats.enqueued < INBOX_TEST_PRODUCERS * INBOX_TEST_COUNT);
+		inbox_drain(ib,mq);
+		list_reset(mq);
+		while((msg = list_get_next(mq)) != 0) {
+			p = msg->name[1] - '0';
+			v = atoi(msg->data);
+			CHECK(p >= 0 && p < INBOX_TEST_PRODUCERS);
+			CHECK(v > last[p]);
+			last[p] = v;
+		}
+		list_purge(mq);
+	}
+	for(p=0; p < INBOX_TEST_PRODUCERS; p++) pthread_join(th[p],0);
+	inbox_drain(ib,mq);
+	list_purge(mq);
+	inbox_get_stats(ib,&stats);
+	CHECK(stats.enqueued == INBOX_TEST_PRODUCERS * INBOX_TEST_COUNT);
+	CHECK(stats.dequeued + stats.dropped == stats.enqueued);
+	inbox_destroy(ib);
+
+	/* Waiting: nothing there times out, a reply wakes the waiter */
+	_ib = ib = inbox_create(0);
+	t = monotime_ms();
+	CHECK(solard_message_wait(ib,mq,100) == 0);
+	CHECK(monotime_ms() - t >= 100);
+	CHECK(inbox_wait(ib,0) == 0);
+	t = monotime_ms();
+	pthread_create(&th[0],0,_replier,0);
+	msg = solard_message_wait_id(ib,mq,"req-1",5000);
+	pthread_join(th[0],0);
+	CHECK(msg != 0);
+	CHECK(strcmp(msg->topic,"SolarD/Clients/1234/si") == 0);
+	CHECK(monotime_ms() - t < 1000);
+	CHECK(list_count(mq) == 2);
+	list_purge(mq);
+	inbox_destroy(ib);
+
+	list_destroy(mq);
+	return 0;
+}
+#endif
@@ -0,0 +1,129 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "sdtest.h"
+
+/* A list of copied strings: "ABCD" -> A,B,C,D */
+static list _make(char *names) {
+	char name[2];
+	list l;
+
+	l = list_create();
+	if (!l) return 0;
+	name[1] = 0;
+	for(; *names; names++) {
+		name[0] = *names;
+		list_add(l,name,2);
+	}
+	return l;
+}
+
+static char *_find(list l, char *name) {
+	char *p;
+
+	list_reset(l);
+	while((p = list_get_next(l)) != 0) {
+		if (strcmp(p,name) == 0) return p;
+	}
+	return 0;
+}
+
+static int _del(list l, char *name) {
+	return list_delete(l,_find(l,name));
+}
+
+/* The rest of the walk, as a string */
+static char *_rest(list_iter_t *it, char *buf) {
+	char *p;
+
+	*buf = 0;
+	while((p = list_iter_next(it)) != 0) strcat(buf,p);
+	return buf;
+}
+
+/* Walk "ABCD", stop after at, run the change, return what the walk gives after that */
+static char *_walk(char *names, char *at, char *what, char *buf) {
+	list_iter_t it;
+	char *p,name[2];
+	list l;
+
+	*buf = 0;
+	l = _make(names);
+	if (!l) return buf;
+	list_iter_init(&it,l);
+	while((p = list_iter_next(&it)) != 0) {
+		if (strcmp(p,at) == 0) break;
+	}
+	/* what: -X deletes X, +X adds X */
+	name[1] = 0;
+	for(; what[0] && what[1]; what += 2) {
+		name[0] = what[1];
+		if (what[0] == '-') _del(l,name);
+		else list_add(l,name,2);
+	}
+	_rest(&it,buf);
+	list_destroy(l);
+	return buf;
+}
+
+int list_test(void) {
+	list_iter_t it,it2;
+	char buf[64],buf2[64],*p;
+	list l;
+
+	/* Plain walk and nesting */
+	l = _make("ABC");
+	CHECK(l != 0);
+	list_iter_init(&it,l);
+	*buf = 0;
+	while((p = list_iter_next(&it)) != 0) {
+		strcat(buf,p);
+		list_iter_init(&it2,l);
+		strcat(buf,_rest(&it2,buf2));
+	}
+	CHECK(strcmp(buf,"AABCBABCCABC") == 0);
+
+	/* Delete each one as it's returned */
+	list_iter_init(&it,l);
+	*buf = 0;
+	while((p = list_iter_next(&it)) != 0) {
+		strcat(buf,p);
+		list_delete(l,p);
+	}
+	CHECK(strcmp(buf,"ABC") == 0);
+	CHECK(list_count(l) == 0);
+
+	/* Empty, then added to */
+	list_iter_init(&it,l);
+	list_add(l,"X",2);
+	CHECK(strcmp(_rest(&it,buf),"X") == 0);
+	list_add(l,"Y",2);
+	CHECK(strcmp(_rest(&it,buf),"Y") == 0);
+	list_destroy(l);
+
+	/* Changes while at B */
+	CHECK(strcmp(_walk("ABCD","B","-B",buf),"CD") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-C",buf),"D") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-A",buf),"CD") == 0);
+	CHECK(strcmp(_walk("ABCD","B","+E",buf),"CDE") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-B-A",buf),"CD") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-A-B",buf),"CD") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-B-C",buf),"D") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-C-B",buf),"D") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-C-D",buf),"") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-C+E",buf),"DE") == 0);
+	CHECK(strcmp(_walk("ABCD","D","+E+F",buf),"EF") == 0);
+	CHECK(strcmp(_walk("ABCD","D","-D+E",buf),"E") == 0);
+
+	/* The deleted node's memory comes straight back for the add */
+	CHECK(strcmp(_walk("ABCD","B","-B+E",buf),"CDE") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-C+E",buf),"DE") == 0);
+	CHECK(strcmp(_walk("ABCD","B","-B+E-A+F",buf),"CDEF") == 0);
+	return 0;
+}
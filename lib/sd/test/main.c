@@ -0,0 +1,59 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "sdtest.h"
+
+struct sdtest {
+	char *name;
+	int (*func)(void);
+};
+
+static struct sdtest tests[] = {
+#if !defined(WINDOWS) && !defined(__APPLE__)
+	{ "canmux", canmux_test },
+#endif
+	{ "cansig", cansig_test },
+	{ "datafilter", datafilter_test },
+	{ "list", list_test },
+#ifdef MQTT
+	{ "inbox", inbox_test },
+	{ "mqtt", mqtt_test },
+	{ "router", router_test },
+#endif
+#ifdef INFLUX
+	{ "spool", spool_test },
+#endif
+	{ 0, 0 }
+};
+
+/* sdtest [name ...] - run the named tests (default all), exit status is the number that failed */
+int main(int argc, char **argv) {
+	struct sdtest *t;
+	int i,run,failed;
+
+	log_open("sdtest",0,LOG_ERROR|LOG_SYSERR|LOG_WARNING);
+	run = failed = 0;
+	for(t = tests; t->name; t++) {
+		if (argc > 1) {
+			for(i=1; i < argc; i++) {
+				if (strcmp(argv[i],t->name) == 0) break;
+			}
+			if (i >= argc) continue;
+		}
+		run++;
+		if (t->func()) {
+			printf("%s: FAILED\n", t->name);
+			failed++;
+		} else {
+			printf("%s: ok\n", t->name);
+		}
+	}
+	printf("%d tests, %d failed\n", run, failed);
+	return failed;
+}
@@ -0,0 +1,105 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifdef MQTT
+
+#include <pthread.h>
+#include "sdtest.h"
+
+#define MQTT_TEST_WINDOW 4
+#define MQTT_TEST_EARLY 32		/* Publishes outstanding when their acks come in */
+
+static int _claimed;
+
+static void *_claimer(void *arg) {
+	mqtt_session_t *s = arg;
+	struct mqtt_inflight *ip;
+
+	ip = mqtt_claim_slot(s);
+	if (ip) {
+		mqtt_release_slot(s,ip,100,1);
+		__atomic_store_n(&_claimed,1,__ATOMIC_SEQ_CST);
+	}
+	return 0;
+}
+
+int mqtt_test(void) {
+	struct mqtt_inflight *ip,*ips[MQTT_TEST_EARLY];
+	mqtt_stats_t stats;
+	mqtt_session_t *s;
+	pthread_t th;
+	int i;
+
+	s = mqtt_new(false,0,0);
+	CHECK(s != 0);
+	s->window = MQTT_TEST_WINDOW;
+
+	/* Ack after the publish call returned */
+	ip = mqtt_claim_slot(s);
+	CHECK(ip != 0);
+	mqtt_release_slot(s,ip,1,1);
+	mqtt_delivered(s,1);
+	mqtt_get_stats(s,&stats);
+	CHECK(stats.inflight == 0 && stats.acked == 1);
+
+	/* Ack before it returned */
+	ip = mqtt_claim_slot(s);
+	CHECK(ip != 0);
+	mqtt_delivered(s,2);
+	CHECK(s->early_count == 1);
+	mqtt_release_slot(s,ip,2,1);
+	mqtt_get_stats(s,&stats);
+	CHECK(stats.inflight == 0 && stats.acked == 2 && s->early_count == 0);
+
+	/* Failed publish gives the slot back */
+	ip = mqtt_claim_slot(s);
+	CHECK(ip != 0);
+	mqtt_release_slot(s,ip,0,0);
+	mqtt_get_stats(s,&stats);
+	CHECK(stats.inflight == 0 && stats.acked == 2);
+
+	/* Acks for nothing we're waiting on aren't kept */
+	mqtt_delivered(s,99);
+	CHECK(s->early_count == 0);
+
+	/* Full window: the next publish waits for an ack */
+	for(i=0; i < MQTT_TEST_WINDOW; i++) {
+		ip = mqtt_claim_slot(s);
+		CHECK(ip != 0);
+		mqtt_release_slot(s,ip,10+i,1);
+	}
+	_claimed = 0;
+	pthread_create(&th,0,_claimer,s);
+	usleep(100000);
+	CHECK(__atomic_load_n(&_claimed,__ATOMIC_SEQ_CST) == 0);
+	mqtt_delivered(s,10);
+	pthread_join(th,0);
+	CHECK(_claimed == 1);
+	for(i=1; i < MQTT_TEST_WINDOW; i++) mqtt_delivered(s,10+i);
+	mqtt_delivered(s,100);
+	mqtt_get_stats(s,&stats);
+	CHECK(stats.inflight == 0 && stats.inflight_max == MQTT_TEST_WINDOW);
+
+	/* Lots of acks beating their publish calls back - none may be lost */
+	s->window = MQTT_TEST_EARLY;
+	for(i=0; i < MQTT_TEST_EARLY; i++) {
+		ips[i] = mqtt_claim_slot(s);
+		CHECK(ips[i] != 0);
+	}
+	for(i=0; i < MQTT_TEST_EARLY; i++) mqtt_delivered(s,200+i);
+	CHECK(s->early_count == MQTT_TEST_EARLY);
+	for(i=0; i < MQTT_TEST_EARLY; i++) mqtt_release_slot(s,ips[i],200+i,1);
+	mqtt_get_stats(s,&stats);
+	CHECK(stats.inflight == 0 && s->early_count == 0);
+	CHECK(stats.acked == 2 + MQTT_TEST_WINDOW + 1 + MQTT_TEST_EARLY);
+
+	mqtt_destroy_session(s);
+	return 0;
+}
+#endif
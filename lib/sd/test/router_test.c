@@ -0,0 +1,91 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifdef MQTT
+
+#include "sdtest.h"
+#include "router.h"
+
+static int _hits;
+
+/* ctx is the bit to set */
+static int _handler(void *ctx, solard_message_t *msg) {
+	_hits |= (long)ctx;
+	return 0;
+}
+
+/* Dispatch topic and return the bits of the handlers it reached */
+static int _route(router_t *r, char *topic) {
+	solard_message_t *msg;
+
+	_hits = 0;
+	msg = solard_message_new(topic,"{}",2,0);
+	if (!msg) return -1;
+	router_dispatch(r,msg);
+	solard_message_unref(msg);
+	return _hits;
+}
+
+int router_test(void) {
+	solard_message_t *msg;
+	router_t *r;
+
+	/* String matching */
+	CHECK(topic_match("SolarD/Agents/+/Data","SolarD/Agents/si/Data"));
+	CHECK(!topic_match("SolarD/Agents/+/Data","SolarD/Agents/si/Config"));
+	CHECK(!topic_match("SolarD/Agents/+","SolarD/Agents/si/Data"));
+	CHECK(topic_match("SolarD/Agents/#","SolarD/Agents"));
+	CHECK(topic_match("SolarD/Agents/#","SolarD/Agents/si/Data"));
+	CHECK(!topic_match("SolarD/Agents/#","SolarD/AgentsX"));
+	CHECK(!topic_match("SolarD/Agent","SolarD/Agents"));
+	CHECK(topic_match("#","SolarD"));
+
+	r = router_create();
+	CHECK(r != 0);
+	CHECK(router_add(r,"SolarD/Agents/si",_handler,(void *)0x01,0) == 0);
+	CHECK(router_add(r,"SolarD/Agents/+/Data",_handler,(void *)0x02,0) == 0);
+	CHECK(router_add(r,"SolarD/Agents/#",_handler,(void *)0x04,0) == 0);
+	CHECK(router_add(r,"SolarD/#",_handler,(void *)0x08,0) == 0);
+	CHECK(router_add(r,"SolarD/Agents/+",_handler,(void *)0x10,0) == 0);
+	CHECK(router_add(r,"SolarD/Clients/+/+",_handler,(void *)0x20,0) == 0);
+	CHECK(router_add(r,"SolarD/#/x",_handler,(void *)0x40,0) != 0);
+	CHECK(router_count(r) == 6);
+
+	CHECK(_route(r,"SolarD/Agents/si") == (0x01|0x04|0x08|0x10));
+	CHECK(_route(r,"SolarD/Agents/pack_01/Data") == (0x02|0x04|0x08));
+	CHECK(_route(r,"SolarD/Agents/pack_01/Info") == (0x04|0x08));
+	CHECK(_route(r,"SolarD/Agents") == (0x04|0x08));
+	CHECK(_route(r,"SolarD/Clients/1234/si") == (0x08|0x20));
+	CHECK(_route(r,"SolarD/Clients/1234") == 0x08);
+
+	/* Received before the route that names its level was added */
+	msg = solard_message_new("SolarD/Agents/late_agent/Status","{}",2,0);
+	CHECK(msg != 0);
+	CHECK(router_add(r,"SolarD/Agents/late_agent/Status",_handler,(void *)0x40,0) == 0);
+	_hits = 0;
+	router_dispatch(r,msg);
+	solard_message_unref(msg);
+	CHECK(_hits == (0x04|0x08|0x40));
+
+	/* Deeper than the trie: topic and pattern both by string */
+	CHECK(_route(r,"SolarD/Agents/a/b/c/d/e/f/g/h") == (0x04|0x08));
+	CHECK(router_add(r,"SolarD/Agents/a/b/c/d/e/f/+/h",_handler,(void *)0x80,0) == 0);
+	CHECK(_route(r,"SolarD/Agents/a/b/c/d/e/f/g/h") == (0x04|0x08|0x80));
+	CHECK(_route(r,"SolarD/Agents/a/b/c/d/e/f/g/i") == (0x04|0x08));
+	CHECK(router_remove(r,"SolarD/Agents/a/b/c/d/e/f/+/h",_handler,(void *)0x80) == 0);
+	CHECK(_route(r,"SolarD/Agents/a/b/c/d/e/f/g/h") == (0x04|0x08));
+
+	CHECK(router_remove(r,"SolarD/#",_handler,(void *)0x08) == 0);
+	CHECK(router_remove(r,"SolarD/#",_handler,(void *)0x08) != 0);
+	CHECK(_route(r,"SolarD/Agents/si") == (0x01|0x04|0x10));
+	CHECK(router_count(r) == 6);
+	router_destroy(r);
+	return 0;
+}
+#endif
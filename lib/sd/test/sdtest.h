@@ -0,0 +1,39 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifndef __SD_TEST_H
+#define __SD_TEST_H
+
+#include <stdio.h>
+#include "common.h"
+
+/* Fail the current test (return 1) if expr isn't true */
+#define CHECK(expr) do { \
+	if (!(expr)) { \
+		printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+		return 1; \
+	} \
+} while(0)
+
+#if !defined(WINDOWS) && !defined(__APPLE__)
+int canmux_test(void);
+#endif
+int cansig_test(void);
+int datafilter_test(void);
+int list_test(void);
+#ifdef MQTT
+int inbox_test(void);
+int mqtt_test(void);
+int router_test(void);
+#endif
+#ifdef INFLUX
+int spool_test(void);
+#endif
+
+#endif /* __SD_TEST_H */
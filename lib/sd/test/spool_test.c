@@ -0,0 +1,181 @@
+
+/*
+Copyright (c) 2026, Stephen P. Shoecraft
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#ifdef INFLUX
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include "sdtest.h"
+#include "influx_internal.h"
+
+#define SPOOL_TEST_LINE 1000		/* Bytes per line */
+#define SPOOL_TEST_BATCH 50		/* Lines per put */
+
+struct spool_check {
+	int first;			/* First seq seen (-1 = none yet) */
+	int next;			/* Next seq expected */
+	int bad;
+};
+
+static char _pad[SPOOL_TEST_LINE];
+
+static int _put_lines(influx_spool_t *sp, int start, int count) {
+	char *buf,*p;
+	int i;
+
+	buf = malloc(count * SPOOL_TEST_LINE);
+	if (!buf) return 1;
+	p = buf;
+	for(i=0; i < count; i++) p += sprintf(p,"spool,seq=%08d x=\"%s\"\n", start + i, _pad);
+	i = influx_spool_put(sp, buf, p - buf);
+	free(buf);
+	return i;
+}
+
+/* Every line replayed must be the one after the last */
+static int _replay_func(void *ctx, char *data, int len) {
+	struct spool_check *c = ctx;
+	char *p,*e;
+	int seq;
+
+	for(p = data; p < data + len; p = e + 1) {
+		e = memchr(p,'\n',(data + len) - p);
+		if (!e || sscanf(p,"spool,seq=%d",&seq) != 1) {
+			c->bad++;
+			return 0;
+		}
+		if (c->first < 0) c->first = c->next = seq;
+		if (seq != c->next) c->bad++;
+		c->next = seq + 1;
+	}
+	return 0;
+}
+
+static int _replay(influx_spool_t *sp, struct spool_check *c) {
+	c->first = -1;
+	c->next = c->bad = 0;
+	return influx_spool_replay(sp, 1048576, _replay_func, c);
+}
+
+static int _count_segments(char *dir, char *name) {
+	char prefix[64];
+	struct dirent *ent;
+	int count,len;
+	DIR *dp;
+
+	len = sprintf(prefix,"influx-%s.",name);
+	count = 0;
+	dp = opendir(dir);
+	if (!dp) return -1;
+	while((ent = readdir(dp)) != 0) {
+		if (strncmp(ent->d_name,prefix,len) == 0 && strstr(ent->d_name,".spool")) count++;
+	}
+	closedir(dp);
+	return count;
+}
+
+/* Overwrite a byte just after the first occurrence of what (0 = the segment header) */
+static int _corrupt(char *dir, char *name, uint32_t seq, char *what) {
+	char path[300],*buf,*p;
+	struct stat sb;
+	FILE *fp;
+
+	sprintf(path,"%s/influx-%s.%08u.spool",dir,name,seq);
+	if (stat(path,&sb) < 0) return 1;
+	buf = malloc(sb.st_size);
+	fp = fopen(path,"r+");
+	if (!buf || !fp || fread(buf,1,sb.st_size,fp) != sb.st_size) return 1;
+	if (what) {
+		p = memmem(buf,sb.st_size,what,strlen(what));
+		if (!p) return 1;
+		fseek(fp,(p - buf) + strlen(what) + 5,SEEK_SET);
+	} else {
+		fseek(fp,0,SEEK_SET);
+	}
+	fputc('#',fp);
+	fclose(fp);
+	free(buf);
+	return 0;
+}
+
+int spool_test(void) {
+	char dir[] = "/tmp/sdtest_spoolXXXXXX";
+	char cmd[64];
+	struct spool_check c;
+	influx_spool_t *sp,*sp2;
+	int i,n;
+
+	memset(_pad,'x',sizeof(_pad)-32);
+	CHECK(mkdtemp(dir) != 0);
+
+	/* Rotation: 3 segments' worth comes back in order, leaving just the write segment */
+	sp = influx_spool_open(dir,"rotate",64);
+	CHECK(sp != 0);
+	n = (INFLUX_SPOOL_SEGSIZE * 5 / 2) / SPOOL_TEST_LINE;
+	for(i=0; i < n; i += SPOOL_TEST_BATCH) CHECK(_put_lines(sp,i,SPOOL_TEST_BATCH) == 0);
+	CHECK(_count_segments(dir,"rotate") == 3);
+	CHECK(!influx_spool_empty(sp));
+	CHECK(_replay(sp,&c) == 0);
+	CHECK(c.bad == 0 && c.first == 0 && c.next == i);
+	CHECK(influx_spool_empty(sp));
+	CHECK(_count_segments(dir,"rotate") == 1);
+	CHECK(influx_spool_dropped(sp) == 0);
+
+	/* Only one process at a time */
+	sp2 = influx_spool_open(dir,"rotate",64);
+	CHECK(sp2 == 0);
+	influx_spool_close(sp);
+
+	/* Full: the oldest segments go, what's left is the newest and contiguous */
+	sp = influx_spool_open(dir,"full",8);
+	CHECK(sp != 0);
+	n = (INFLUX_SPOOL_SEGSIZE * 4) / SPOOL_TEST_LINE;
+	for(i=0; i < n; i += SPOOL_TEST_BATCH) CHECK(_put_lines(sp,i,SPOOL_TEST_BATCH) == 0);
+	CHECK(_count_segments(dir,"full") == 2);
+	CHECK(influx_spool_dropped(sp) > 0);
+	CHECK(_replay(sp,&c) == 0);
+	CHECK(c.bad == 0 && c.first > 0 && c.next == i);
+	influx_spool_close(sp);
+
+	/* Corruption: a bad record loses the rest of its segment, not the spool */
+	sp = influx_spool_open(dir,"corrupt",64);
+	CHECK(sp != 0);
+	for(i=0; i < 10; i++) CHECK(_put_lines(sp,i,1) == 0);
+	influx_spool_close(sp);
+	CHECK(_corrupt(dir,"corrupt",1,"seq=00000005") == 0);
+	sp = influx_spool_open(dir,"corrupt",64);
+	CHECK(sp != 0);
+	CHECK(_replay(sp,&c) == 0);
+	CHECK(c.bad == 0 && c.first == 0 && c.next == 5);
+	CHECK(influx_spool_dropped(sp) > 0);
+	CHECK(influx_spool_empty(sp));
+	/* And carries on afterwards */
+	CHECK(_put_lines(sp,100,1) == 0);
+	CHECK(_replay(sp,&c) == 0);
+	CHECK(c.bad == 0 && c.first == 100 && c.next == 101);
+	influx_spool_close(sp);
+
+	/* A bad header discards the segment */
+	sp = influx_spool_open(dir,"header",64);
+	CHECK(sp != 0);
+	CHECK(_put_lines(sp,0,1) == 0);
+	influx_spool_close(sp);
+	CHECK(_corrupt(dir,"header",1,0) == 0);
+	sp = influx_spool_open(dir,"header",64);
+	CHECK(sp != 0);
+	CHECK(influx_spool_empty(sp));
+	influx_spool_close(sp);
+
+	sprintf(cmd,"rm -rf %s",dir);
+	CHECK(system(cmd) == 0);
+	return 0;
+}
+#endif
@@ -11,6 +11,7 @@ extern solard_driver_t bt_driver;
 #endif
 #if !defined(__WIN32) && !defined(__WIN64)
 extern solard_driver_t can_driver;
+extern solard_driver_t canlog_driver;
 #endif
 extern solard_driver_t ip_driver;
 extern solard_driver_t rdev_driver;
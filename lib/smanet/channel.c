@@ -21,9 +21,24 @@ LICENSE file in the root directory of this source tree.
 #define CHANFILE_SIG2 		0xaa
 #define CHANFILE_VERSION 	2
 
+static void _free_index(smanet_session_t *s) {
+	register int i;
+
+	for(i=0; i < s->groupcount; i++) free(s->groups[i].chans);
+	free(s->groups);
+	s->groups = 0;
+	s->groupcount = 0;
+	free(s->changroup);
+	s->changroup = 0;
+	free(s->chanhash);
+	s->chanhash = 0;
+	s->chanhash_mask = 0;
+}
+
 int smanet_destroy_channels(smanet_session_t *s) {
 	register int i;
 
+	_free_index(s);
 	if (!s->chans) return 0;
 
 	for(i=0; i < s->chancount; i++) {
@@ -32,6 +47,89 @@ int smanet_destroy_channels(smanet_session_t *s) {
 	}
 	free(s->chans);
 	s->chans = 0;
+	s->chancount = 0;
+	return 0;
+}
+
+static unsigned int _hash(char *name) {
+	register unsigned int h;
+
+	/* FNV-1a */
+	for(h = 2166136261U; *name; name++) h = (h ^ (unsigned char)*name) * 16777619U;
+	return h;
+}
+
+static int _dsize(int type) {
+	switch(type) {
+	case DATA_TYPE_BYTE:
+		return 1;
+	case DATA_TYPE_SHORT:
+		return 2;
+	case DATA_TYPE_LONG:
+	case DATA_TYPE_FLOAT:
+		return 4;
+	case DATA_TYPE_DOUBLE:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+/* Build the name index and work out which channels come back from the same request */
+int smanet_index_channels(smanet_session_t *s) {
+	smanet_group_t *g;
+	smanet_channel_t *c;
+	unsigned int size,h;
+	uint16_t mask;
+	int i,j,n;
+
+	_free_index(s);
+	s->changen++;
+	if (!s->chancount) return 0;
+
+	for(size = 16; size < (unsigned int)s->chancount * 2; size <<= 1);
+	s->chanhash = calloc(size,sizeof(*s->chanhash));
+	s->changroup = calloc(s->chancount,sizeof(*s->changroup));
+	s->groups = calloc(s->chancount,sizeof(*s->groups));
+	if (!s->chanhash || !s->changroup || !s->groups) {
+		log_syserror("smanet_index_channels: calloc");
+		_free_index(s);
+		return 1;
+	}
+	s->chanhash_mask = size - 1;
+
+	for(i=0; i < s->chancount; i++) {
+		c = &s->chans[i];
+
+		/* First one wins, same as the old linear search */
+		for(h = _hash(c->name) & s->chanhash_mask; s->chanhash[h]; h = (h + 1) & s->chanhash_mask) {
+			if (strcmp(s->chans[s->chanhash[h]-1].name,c->name) == 0) break;
+		}
+		if (!s->chanhash[h]) s->chanhash[h] = i + 1;
+
+		mask = (c->mask | 0x0f);
+		for(j=0; j < s->groupcount; j++) {
+			if (s->groups[j].mask == mask) break;
+		}
+		g = &s->groups[j];
+		if (j == s->groupcount) {
+			g->mask = mask;
+			g->dsize = (mask & CH_SPOT) ? 13 : 5;
+			g->chans = malloc(s->chancount * sizeof(*g->chans));
+			if (!g->chans) {
+				log_syserror("smanet_index_channels: malloc");
+				_free_index(s);
+				return 1;
+			}
+			s->groupcount++;
+		}
+		n = _dsize(c->type);
+		if (!n) dprintf(dlevel,"%s: unhandled type: %d(%s)\n", c->name, c->type, typestr(c->type));
+		g->dsize += n;
+		g->chans[g->count++] = i;
+		s->changroup[i] = j;
+	}
+	dprintf(dlevel,"chancount: %d, groupcount: %d\n", s->chancount, s->groupcount);
 	return 0;
 }
 
@@ -159,9 +257,11 @@ static int parse_channels(smanet_session_t *s, uint8_t *data, int data_len) {
 
 	/* Now that we know how many channels we have, alloc the mem and copy the list */
 	dprintf(dlevel,"count: %d\n", list_count(channels));
+	smanet_destroy_channels(s);
 	s->chans = malloc(sizeof(smanet_channel_t)*list_count(channels));
 	if (!s->chans) {
 		log_syserror("smanet_parse_channels: malloc");
+		list_destroy(channels);
 		return 1;
 	}
 	i = 0;
@@ -169,7 +269,7 @@ static int parse_channels(smanet_session_t *s, uint8_t *data, int data_len) {
 	while((c = list_get_next(channels)) != 0) s->chans[i++] = *c;
 	s->chancount = i;
 	list_destroy(channels);
-	return 0;
+	return smanet_index_channels(s);
 }
 
 extern char SOLARD_LIBDIR[256];
@@ -291,7 +391,7 @@ int smanet_load_channels(smanet_session_t *s, char *filename) {
 	char *n;
 
 	dprintf(dlevel,"filename: %s\n", filename);
-	s->chancount = 0;
+	smanet_destroy_channels(s);
 	rv = json_parse_file(filename);
 	dprintf(dlevel,"rv: %p\n", rv);
 	if (!rv) {
@@ -355,10 +455,11 @@ int smanet_load_channels(smanet_session_t *s, char *filename) {
 	dprintf(dlevel,"new chancount: %d\n", s->chancount);
 	dprintf(dlevel,"destroying rv\n");
 	json_destroy_value(rv);
-	return 0;
+	return smanet_index_channels(s);
 }
 
 smanet_channel_t *smanet_get_channel(smanet_session_t *s, char *name) {
+	register unsigned int h;
 	register int i;
 
 	dprintf(dlevel,"name: %s\n", name);
@@ -369,10 +470,19 @@ smanet_channel_t *smanet_get_channel(smanet_session_t *s, char *name) {
 		return 0;
 	}
 
-	for(i=0; i < s->chancount; i++) {
-		if (strcmp(s->chans[i].name,name) == 0) {
-			dprintf(dlevel,"found!\n");
-			return &s->chans[i];
+	if (s->chanhash) {
+		for(h = _hash(name) & s->chanhash_mask; (i = s->chanhash[h]) != 0; h = (h + 1) & s->chanhash_mask) {
+			if (strcmp(s->chans[i-1].name,name) == 0) {
+				dprintf(dlevel,"found!\n");
+				return &s->chans[i-1];
+			}
+		}
+	} else {
+		for(i=0; i < s->chancount; i++) {
+			if (strcmp(s->chans[i].name,name) == 0) {
+				dprintf(dlevel,"found!\n");
+				return &s->chans[i];
+			}
 		}
 	}
 	dprintf(dlevel,"NOT found!\n");
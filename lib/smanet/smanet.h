@@ -95,6 +95,10 @@ struct smanet_multreq {
 };
 typedef struct smanet_multreq smanet_multreq_t;
 
+/* Names resolved once into the minimum set of group reads */
+struct smanet_plan;
+typedef struct smanet_plan smanet_plan_t;
+
 //smanet_session_t *smanet_init(char *, char *, char *);
 smanet_session_t *smanet_init(bool readonly);
 void smanet_destroy(smanet_session_t *s);
@@ -115,6 +119,9 @@ smanet_channel_t *smanet_get_channel(smanet_session_t *s, char *);
 int smanet_destroy_channels(smanet_session_t *s);
 
 int smanet_get_multvalues(smanet_session_t *, smanet_multreq_t *, int);
+smanet_plan_t *smanet_plan_create(smanet_session_t *, char **, int);
+smanet_multreq_t *smanet_plan_read(smanet_session_t *, smanet_plan_t *);
+void smanet_plan_destroy(smanet_plan_t *);
 int smanet_get_value(smanet_session_t *, char *, double *, char **);
 int smanet_get_chanvalue(smanet_session_t *, smanet_channel_t *, double *, char **);
 int smanet_set_value(smanet_session_t *, char *, double, char *);
@@ -89,6 +89,25 @@ typedef struct smanet_packet smanet_packet_t;
 #define SMANET_RECV_THREAD 0
 #endif
 
+/* Channels that come back together in a single CMD_GET_DATA */
+struct smanet_group {
+	uint16_t mask;			/* Request mask (channel mask | 0x0f) */
+	int dsize;			/* Expected response size */
+	int count;
+	uint16_t *chans;		/* Index into chans, in response order */
+};
+typedef struct smanet_group smanet_group_t;
+
+struct smanet_plan {
+	int count;
+	char **names;
+	int *chans;			/* Index into chans for each name */
+	int *groups;			/* Groups to read */
+	int groupcount;
+	unsigned int gen;		/* Channel generation the names were resolved against */
+	smanet_multreq_t *mr;		/* Results */
+};
+
 #if SMANET_RECV_THREAD
 #error 1
 struct smanet_frame {
@@ -110,6 +129,12 @@ struct smanet_session {
 //	list channels;
 	smanet_channel_t *chans;
 	int chancount;
+	int *chanhash;			/* Name hash -> index into chans + 1 */
+	unsigned int chanhash_mask;
+	uint16_t *changroup;		/* Group of each channel */
+	smanet_group_t *groups;
+	int groupcount;
+	unsigned int changen;		/* Bumped each time the channels are (re)loaded */
 //	smanet_value_t *values;
 	smanet_value_t values[1024];
 	solard_driver_t *tp;
@@ -177,6 +202,8 @@ int smanet_get_net_start(smanet_session_t *s, uint32_t *sn, char *type, int len)
 int smanet_cfg_net_adr(smanet_session_t *s, int);
 int smanet_syn_online(smanet_session_t *s);
 
+int smanet_index_channels(smanet_session_t *s);
+
 #define smanet_set_state(s,v)     (s->state |= (v))
 #define smanet_clear_state(s,v)   (s->state &= (~v))
 #define smanet_check_state(s,v)   ((s->state & v) != 0)
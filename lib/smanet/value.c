@@ -37,18 +37,19 @@ Params
 #define CH_DOUBLE	0x05
 #define CH_ARRAY	0x08
 
-static int _read_values(smanet_session_t *s, smanet_channel_t *cx) {
+/* Read all the channels in a group with a single request */
+static int _read_group(smanet_session_t *s, smanet_group_t *g) {
 	smanet_packet_t *p;
 	register uint8_t *sptr,*eptr;
 	uint8_t req[3], index;
-	uint16_t mask,count,m1,m2;
+	uint16_t mask,count;
 	time_t timestamp;
 	long time_base;
-	int i,r,rcount,dsize,retries;
-//	smanet_channel_t *vc;
+	int i,r,retries;
 	smanet_value_t *v;
+	smanet_channel_t *c;
 
-	dprintf(dlevel,"id: %d, c->id, c->mask: %04x, index: %02x\n", cx->id, cx->mask, cx->index);
+	dprintf(dlevel,"mask: %04x, dsize: %d, count: %d\n", g->mask, g->dsize, g->count);
 
 	p = smanet_alloc_packet(2048);
 	if (!p) {
@@ -56,74 +57,27 @@ static int _read_values(smanet_session_t *s, smanet_channel_t *cx) {
 		return 1;
 	}
 
-#if 0
-	/* if no values allocated yet, do so now */
-	if (!s->values) {
-		size_t vsize = list_count(s->channels)*sizeof(smanet_value_t);
-		printf("===> vsize: %ld\n", vsize);
-		s->values = malloc(vsize);
-		if (!s->values) {
-			log_write(LOG_SYSERR,"_smanet_getvals: malloc(%d)\n",vsize);
-			smanet_free_packet(p);
-			return 1;
-		}
-		memset(s->values,0,vsize);
-	}
-#endif
-
 //	smanet_syn_online(s);
 
-	/* Go through each channel and determine how many results we should get (and how large) */
-	dsize = 5;
-	for(rcount=i=0; i < s->chancount; i++) {
-		m1 = (s->chans[i].mask | 0x0f);
-		m2 = (cx->mask | 0x0f);
-//		dprintf(dlevel,"chan mask: %04x, req mask: %04x\n", m1, m2);
-		if (m1 == m2) {
-			smanet_channel_t *c = &s->chans[i];
-//			dprintf(dlevel,"adding: chan: id: %d, name: %s, index: %02x, mask: %04x, format: %04x, level: %d, type: %d(%s), count: %d\n", c->id, c->name, c->index, c->mask, c->format, c->level, c->type, typestr(c->type), c->count);
-			switch(c->type) {
-			case DATA_TYPE_BYTE:
-				dsize += 1;
-				break;
-			case DATA_TYPE_SHORT:
-				dsize += 2;
-				break;
-			case DATA_TYPE_LONG:
-				dsize += 4;
-				break;
-			case DATA_TYPE_FLOAT:
-				dsize += 4;
-				break;
-			case DATA_TYPE_DOUBLE:
-				dsize += 8;
-				break;
-			default:
-				log_error("_read_values: unhandled type: %d(%s)\n", cx->type, typestr(cx->type));
-				continue;
-			}
-			rcount++;
-		}
-	}
-	if (cx->mask & CH_SPOT) dsize += 8;
-	dprintf(dlevel,"dsize: %d\n", dsize);
-	dprintf(dlevel,"rcount: %d\n", rcount);
-
-	_putu16(&req[0],(cx->mask | 0x0f));
+	_putu16(&req[0],g->mask);
 	/* My SI6048 wont return a single value - only for a group (index 0) wtf  */
 	req[2] = 0;
 	for(retries=3; retries >= 0; retries--) {
 		r = smanet_command(s,CMD_GET_DATA,p,req,3);
 		dprintf(dlevel,"smanet_command r: %d\n", r);
-		if (r) return r;
+		if (r) {
+			smanet_free_packet(p);
+			return r;
+		}
 		if (debug >= dlevel+1) bindump("values",p->data,p->dataidx);
-		if (p->dataidx == dsize) break;
-		else dprintf(dlevel,"dataidx: %d, dsize: %d\n", p->dataidx, dsize);
+		if (p->dataidx == g->dsize) break;
+		else dprintf(dlevel,"dataidx: %d, dsize: %d\n", p->dataidx, g->dsize);
 		p->dataidx = 0;
 	}
 	dprintf(dlevel,"retries: %d\n", retries);
 	if (retries < 0) {
 		sprintf(s->errmsg,"_read_values: retries exhausted");
+		smanet_free_packet(p);
 		return 1;
 	}
 
@@ -142,14 +96,8 @@ static int _read_values(smanet_session_t *s, smanet_channel_t *cx) {
 		sptr += 4;
 		dprintf(dlevel,"ts: %ld, time_base: %ld\n", timestamp, time_base);
 	}
-	for(rcount=i=0; i < s->chancount; i++) {
-		smanet_channel_t *c = &s->chans[i];
-		m1 = (c->mask | 0x0f);
-		m2 = (cx->mask | 0x0f);
-//		dprintf(dlevel+1,"chan: %s, mask: %04x, req mask: %04x\n", m1, m2);
-		if (m1 != m2) continue;
-//		dprintf(dlevel,"offset: %04x\n", sptr - p->data);
-//		dprintf(dlevel,"sptr: %p, eptr: %p\n", sptr, eptr);
+	for(i=0; i < g->count; i++) {
+		c = &s->chans[g->chans[i]];
 		if (sptr >= eptr) {
 			log_info("internal error: _read_values: sptr >= eptr");
 			smanet_free_packet(p);
@@ -159,43 +107,33 @@ static int _read_values(smanet_session_t *s, smanet_channel_t *cx) {
 		switch(c->type) {
 		case DATA_TYPE_BYTE:
 			v->bval = _getu8(sptr);
-//			dprintf(dlevel,"bval: %d (%02X)\n", v->bval, v->bval);
 			dprintf(dlevel,"%s: %d\n", c->name, v->bval);
 			sptr += 1;
 			break;
 		case DATA_TYPE_SHORT:
 			v->wval = _getu16(sptr);
-//			dprintf(dlevel,"wval: %d (%04x)\n", v->wval, v->wval);
 			dprintf(dlevel,"%s: %d\n", c->name, v->wval);
-#if 0
-			if (strcmp(c->name,"TotExtCur") == 0) {
-				bindump("wval",&v->wval,2);
-				printf("%s: %d\n", c->name, v->wval);
-			}
-#endif
 			sptr += 2;
 			break;
 		case DATA_TYPE_LONG:
 			v->lval = _getu32(sptr);
-//			dprintf(dlevel,"lval: %ld (%08lx)\n", v->lval, v->lval);
 			dprintf(dlevel,"%s: %ld\n", c->name, v->lval);
 			sptr += 4;
 			break;
 		case DATA_TYPE_FLOAT:
 			v->fval = _getf32(sptr);
-//			dprintf(dlevel,"fval: %f\n", v->fval);
 			dprintf(dlevel,"%s: %f\n", c->name, v->fval);
 			sptr += 4;
 			break;
 		case DATA_TYPE_DOUBLE:
 			v->dval = _getf64(sptr);
-//			dprintf(dlevel,"dval: %lf\n", v->dval);
 			dprintf(dlevel,"%s: %f\n", c->name, v->dval);
 			sptr += 8;
 			break;
 		default:
 			log_error("SMANET: _read_values: unhandled type: %d(%s)\n", c->type, typestr(c->type));
 			sprintf(s->errmsg,"_read_values: unhandled type: %d(%s)", c->type, typestr(c->type));
+			smanet_free_packet(p);
 			return 1;
 			break;
 		}
@@ -206,6 +144,19 @@ static int _read_values(smanet_session_t *s, smanet_channel_t *cx) {
 	return 0;
 }
 
+static int _read_values(smanet_session_t *s, smanet_channel_t *c) {
+	int i;
+
+	dprintf(dlevel,"id: %d, mask: %04x, index: %02x\n", c->id, c->mask, c->index);
+
+	i = c - s->chans;
+	if (!s->groups || i < 0 || i >= s->chancount) {
+		sprintf(s->errmsg,"_read_values: channel %s not indexed", c->name);
+		return 1;
+	}
+	return _read_group(s,&s->groups[s->changroup[i]]);
+}
+
 static int _get_value(smanet_session_t *s, smanet_channel_t *c, smanet_value_t *v, int cache) {
 	bool doit;
 
@@ -310,30 +261,134 @@ int smanet_get_value(smanet_session_t *s, char *name, double *dest, char **text)
 	return smanet_get_chanvalue(s,c,dest,text);
 }
 
-int smanet_get_multvalues(smanet_session_t *s, smanet_multreq_t *mr, int count) {
+void smanet_plan_destroy(smanet_plan_t *pp) {
+	register int i;
+
+	if (!pp) return;
+	if (pp->names) {
+		for(i=0; i < pp->count; i++) free(pp->names[i]);
+		free(pp->names);
+	}
+	free(pp->chans);
+	free(pp->groups);
+	free(pp->mr);
+	free(pp);
+}
+
+/* Look up the channels and the groups they're in */
+static int _plan_resolve(smanet_session_t *s, smanet_plan_t *pp) {
 	smanet_channel_t *c;
-	smanet_value_t v;
-	int i;
+	int i,j,g;
 
-	/* Always refresh spot values */
-	for(i=0; i < count; i++) {
-		if ((c = smanet_get_channel(s, mr[i].name)) == 0) {
-			sprintf(s->errmsg,"channel not found: %s", mr[i].name);
+	pp->groupcount = 0;
+	for(i=0; i < pp->count; i++) {
+		if ((c = smanet_get_channel(s, pp->names[i])) == 0) {
+			sprintf(s->errmsg,"channel not found: %s", pp->names[i]);
 			return 1;
 		}
-//		if (c->mask & CH_SPOT)) 
-			s->values[c->id].timestamp = 0;
+		pp->chans[i] = c - s->chans;
+		g = s->changroup[pp->chans[i]];
+		for(j=0; j < pp->groupcount; j++) {
+			if (pp->groups[j] == g) break;
+		}
+		if (j == pp->groupcount) pp->groups[pp->groupcount++] = g;
+	}
+	pp->gen = s->changen;
+	dprintf(dlevel,"count: %d, groupcount: %d\n", pp->count, pp->groupcount);
+	return 0;
+}
+
+smanet_plan_t *smanet_plan_create(smanet_session_t *s, char **names, int count) {
+	smanet_plan_t *pp;
+	int i;
+
+	dprintf(dlevel,"count: %d\n", count);
+
+	if (!s->chans || !s->changroup) {
+		sprintf(s->errmsg, "SMANET channels not loaded");
+		return 0;
+	}
+	pp = calloc(1,sizeof(*pp));
+	if (!pp) {
+		log_syserror("smanet_plan_create: calloc");
+		return 0;
+	}
+	pp->count = count;
+	pp->names = calloc(count ? count : 1,sizeof(char *));
+	pp->chans = calloc(count ? count : 1,sizeof(int));
+	pp->groups = calloc(count ? count : 1,sizeof(int));
+	pp->mr = calloc(count ? count : 1,sizeof(smanet_multreq_t));
+	if (!pp->names || !pp->chans || !pp->groups || !pp->mr) {
+		log_syserror("smanet_plan_create: calloc");
+		goto smanet_plan_create_error;
 	}
 	for(i=0; i < count; i++) {
-		c = smanet_get_channel(s, mr[i].name);
-		dprintf(dlevel,"getting value for: %s\n", mr[i].name);
-		if (_get_value(s, c, &v, 1)) return 1;
-		_getval(s,c,&mr[i].value,&mr[i].text,&v);
+		pp->names[i] = strdup(names[i]);
+		if (!pp->names[i]) {
+			log_syserror("smanet_plan_create: strdup");
+			goto smanet_plan_create_error;
+		}
+		pp->mr[i].name = pp->names[i];
 	}
-	dprintf(dlevel,"done!\n");
+	if (_plan_resolve(s,pp)) goto smanet_plan_create_error;
+	return pp;
+
+smanet_plan_create_error:
+	smanet_plan_destroy(pp);
 	return 0;
 }
 
+/* Refresh every group in the plan and return the values in request order */
+smanet_multreq_t *smanet_plan_read(smanet_session_t *s, smanet_plan_t *pp) {
+	smanet_channel_t *c;
+	int i;
+
+	if (!pp) return 0;
+
+	/* Channels were reloaded */
+	if (pp->gen != s->changen) {
+		dprintf(dlevel,"gen: %u, changen: %u\n", pp->gen, s->changen);
+		if (!s->changroup || _plan_resolve(s,pp)) return 0;
+	}
+	for(i=0; i < pp->groupcount; i++) {
+		if (_read_group(s,&s->groups[pp->groups[i]])) return 0;
+	}
+	for(i=0; i < pp->count; i++) {
+		c = &s->chans[pp->chans[i]];
+		_getval(s,c,&pp->mr[i].value,&pp->mr[i].text,&s->values[c->id]);
+	}
+	return pp->mr;
+}
+
+int smanet_get_multvalues(smanet_session_t *s, smanet_multreq_t *mr, int count) {
+	smanet_plan_t *pp;
+	smanet_multreq_t *res;
+	char **names;
+	int i;
+
+	names = malloc((count ? count : 1) * sizeof(char *));
+	if (!names) {
+		log_syserror("smanet_get_multvalues: malloc");
+		return 1;
+	}
+	for(i=0; i < count; i++) names[i] = mr[i].name;
+	pp = smanet_plan_create(s,names,count);
+	free(names);
+	if (!pp) return 1;
+
+	/* Always refresh spot values */
+	res = smanet_plan_read(s,pp);
+	if (res) {
+		for(i=0; i < count; i++) {
+			mr[i].value = res[i].value;
+			mr[i].text = res[i].text;
+		}
+	}
+	smanet_plan_destroy(pp);
+	dprintf(dlevel,"done!\n");
+	return (res ? 0 : 1);
+}
+
 #if 0
 int smanet_get_valuebyname(smanet_session_t *s, char *name, double *dest) {
 	smanet_channel_t *c;
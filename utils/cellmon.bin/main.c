@@ -40,7 +40,7 @@ int process_messages(solard_client_t *c, list agents) {
 	int ldlevel = dlevel;
 
 	count = 0;
-	list_reset(c->mq);
+	list_reset(client_get_mq(c));
 	dprintf(ldlevel,"mq.length: %d\n", list_count(c->mq));
 	while((msg = list_get_next(c->mq)) != 0) {
 //		solard_message_dump(msg,-1);
@@ -392,7 +392,7 @@ int sc_process_mqtt_messages(sc_session_t *sc) {
 #ifdef MQTT
 	if (!sc->c->m) return 0;
 
-	list_reset(sc->c->mq);
+	list_reset(client_get_mq(sc->c));
 	while((msg = list_get_next(sc->c->mq)) != 0) {
 		sc_update_agent_status(sc, msg);
 		count++;